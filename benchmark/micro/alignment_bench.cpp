@@ -0,0 +1,159 @@
+/*************************************************************************\
+ * AdapterRemoval - cleaning next-generation sequencing reads            *
+ *                                                                       *
+ * Copyright (C) 2011 by Stinus Lindgreen - stinus@binf.ku.dk            *
+ * Copyright (C) 2014 by Mikkel Schubert - mikkelsch@gmail.com           *
+ *                                                                       *
+ * If you use the program, please cite the paper:                        *
+ * S. Lindgreen (2012): AdapterRemoval: Easy Cleaning of Next Generation *
+ * Sequencing Reads, BMC Research Notes, 5:337                           *
+ * http://www.biomedcentral.com/1756-0500/5/337/                         *
+ *                                                                       *
+ * This program is free software: you can redistribute it and/or modify  *
+ * it under the terms of the GNU General Public License as published by  *
+ * the Free Software Foundation, either version 3 of the License, or     *
+ * (at your option) any later version.                                   *
+ *                                                                       *
+ * This program is distributed in the hope that it will be useful,       *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ * GNU General Public License for more details.                          *
+ *                                                                       *
+ * You should have received a copy of the GNU General Public License     *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+\*************************************************************************/
+#include <random>
+#include <string>
+#include <vector>
+
+#include "alignment.hpp"
+#include "bench_utils.hpp"
+#include "counter_rng.hpp"
+#include "fastq.hpp"
+
+//! Length of mate 1 and mate 2 reads
+const size_t READ_LEN = 150;
+//! Maximum number of missing bases allowed at the 5' of reads
+const int MAX_SHIFT = 2;
+//! Mismatch threshold used by AdapterRemoval by default
+const double MISMATCH_THRESHOLD = 1.0 / 6.0;
+
+namespace ar
+{
+
+/** Returns random read pairs, with mate 2 reads reverse complemented. */
+fastq_pair_vec random_reads(std::mt19937& rng, size_t count)
+{
+    fastq_pair_vec reads;
+    for (size_t i = 0; i < count; ++i) {
+        reads.push_back(random_read_pair(rng, READ_LEN, 50, 250));
+        reads.back().second.reverse_complement();
+    }
+
+    return reads;
+}
+
+
+void benchmark_alignment(std::mt19937& rng)
+{
+    // The number of reads is scaled down as the number of adapters increases
+    const size_t n_reads = 20000;
+    const fastq_pair_vec reads = random_reads(rng, n_reads);
+
+    for (size_t n_adapters : {1, 10, 100}) {
+        const fastq_pair_vec adapters = random_adapters(rng, n_adapters);
+        const size_t count = n_reads / n_adapters;
+
+        const bench_timings se_timings = time_runs([&]() {
+            for (size_t i = 0; i < count; ++i) {
+                const alignment_info alignment =
+                    align_single_ended_sequence(reads.at(i).first, adapters,
+                                                MAX_SHIFT, MISMATCH_THRESHOLD);
+                consume(alignment.length);
+            }
+        });
+
+        report_benchmark("align_se/adapters_" + std::to_string(n_adapters),
+                         count, count * READ_LEN, se_timings);
+
+        const bench_timings pe_timings = time_runs([&]() {
+            for (size_t i = 0; i < count; ++i) {
+                const alignment_info alignment =
+                    align_paired_ended_sequences(reads.at(i).first, reads.at(i).second,
+                                                 adapters, MAX_SHIFT, -1,
+                                                 MISMATCH_THRESHOLD);
+                consume(alignment.length);
+            }
+        });
+
+        report_benchmark("align_pe/adapters_" + std::to_string(n_adapters),
+                         count, count * READ_LEN * 2, pe_timings);
+    }
+}
+
+
+void benchmark_collapse(std::mt19937& rng)
+{
+    const fastq_pair_vec adapters = random_adapters(rng, 1);
+
+    // Reads are aligned and truncated up front, so that only collapsing is timed
+    std::vector<alignment_info> alignments;
+    fastq_pair_vec reads;
+    size_t bytes = 0;
+    while (reads.size() < 50000) {
+        fastq_pair pair = random_read_pair(rng, READ_LEN, 50, 250);
+        pair.second.reverse_complement();
+        const alignment_info alignment =
+            align_paired_ended_sequences(pair.first, pair.second, adapters,
+                                         MAX_SHIFT, -1, MISMATCH_THRESHOLD);
+
+        if (alignment.length >= 11) {
+            truncate_paired_ended_sequences(alignment, pair.first, pair.second);
+            bytes += pair.first.length() + pair.second.length();
+
+            alignments.push_back(alignment);
+            reads.push_back(pair);
+        }
+    }
+
+    for (const bool deterministic : {false, true}) {
+        const bench_timings timings = time_runs([&]() {
+            for (size_t i = 0; i < reads.size(); ++i) {
+                counter_rng rng_i(BENCH_SEED, 0, i);
+                const fastq collapsed =
+                    collapse_paired_ended_sequences(alignments.at(i),
+                                                    reads.at(i).first,
+                                                    reads.at(i).second,
+                                                    deterministic ? nullptr : &rng_i);
+                consume(collapsed.length());
+            }
+        });
+
+        report_benchmark(deterministic ? "collapse/deterministic" : "collapse/random",
+                         reads.size(), bytes, timings);
+    }
+}
+
+
+int run_benchmarks()
+{
+    std::mt19937 rng(BENCH_SEED);
+
+    report_header();
+    benchmark_alignment(rng);
+    benchmark_collapse(rng);
+
+    return 0;
+}
+
+} // namespace ar
+
+
+int main(int argc, char** argv)
+{
+    if (!ar::parse_bench_args(argc, argv)) {
+        return 1;
+    }
+
+    return ar::finish_benchmarks(ar::run_benchmarks());
+}
@@ -0,0 +1,159 @@
+/*************************************************************************\
+ * AdapterRemoval - cleaning next-generation sequencing reads            *
+ *                                                                       *
+ * Copyright (C) 2011 by Stinus Lindgreen - stinus@binf.ku.dk            *
+ * Copyright (C) 2014 by Mikkel Schubert - mikkelsch@gmail.com           *
+ *                                                                       *
+ * If you use the program, please cite the paper:                        *
+ * S. Lindgreen (2012): AdapterRemoval: Easy Cleaning of Next Generation *
+ * Sequencing Reads, BMC Research Notes, 5:337                           *
+ * http://www.biomedcentral.com/1756-0500/5/337/                         *
+ *                                                                       *
+ * This program is free software: you can redistribute it and/or modify  *
+ * it under the terms of the GNU General Public License as published by  *
+ * the Free Software Foundation, either version 3 of the License, or     *
+ * (at your option) any later version.                                   *
+ *                                                                       *
+ * This program is distributed in the hope that it will be useful,       *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ * GNU General Public License for more details.                          *
+ *                                                                       *
+ * You should have received a copy of the GNU General Public License     *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+\*************************************************************************/
+#include <cstdlib>
+#include <random>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "barcode_table.hpp"
+#include "bench_utils.hpp"
+#include "fastq.hpp"
+
+//! Number of reads identified per panel / strategy / mismatch setting
+const size_t N_READS = 50000;
+
+namespace ar
+{
+
+/** Returns a set of unique barcode pairs; mate 2 barcodes are empty for SE. */
+fastq_pair_vec random_panel(std::mt19937& rng, size_t count, size_t length, bool paired)
+{
+    std::set<std::string> observed;
+    fastq_pair_vec barcodes;
+    while (barcodes.size() < count) {
+        const std::string barcode_1 = random_sequence(rng, length);
+        const std::string barcode_2 = paired ? random_sequence(rng, length) : "";
+
+        if (observed.insert(barcode_1 + barcode_2).second) {
+            barcodes.push_back(fastq_pair(fastq("1", barcode_1), fastq("2", barcode_2)));
+        }
+    }
+
+    return barcodes;
+}
+
+
+/** Reads starting with a barcode with a single mismatch in 1/4 of reads. */
+fastq_pair_vec random_reads(std::mt19937& rng, const fastq_pair_vec& barcodes)
+{
+    std::uniform_int_distribution<size_t> barcode_dist(0, barcodes.size() - 1);
+    std::uniform_int_distribution<size_t> pos_dist(0, barcodes.front().first.length() - 1);
+    std::uniform_int_distribution<size_t> mm_dist(0, 3);
+
+    fastq_pair_vec reads;
+    for (size_t i = 0; i < N_READS; ++i) {
+        const auto& barcode = barcodes.at(barcode_dist(rng));
+        std::string seq_1 = barcode.first.sequence() + random_sequence(rng, 20);
+        std::string seq_2 = barcode.second.sequence() + random_sequence(rng, 20);
+
+        if (!mm_dist(rng)) {
+            seq_1.at(pos_dist(rng)) = "ACGT"[mm_dist(rng)];
+        }
+
+        reads.push_back(fastq_pair(fastq("read", seq_1), fastq("read", seq_2)));
+    }
+
+    return reads;
+}
+
+
+/** Returns the time in seconds taken to identify barcodes for all reads, per run. */
+bench_timings benchmark(const barcode_table& table, const fastq_pair_vec& reads, bool paired)
+{
+    return time_runs([&]() {
+        size_t identified = 0;
+        for (const auto& read : reads) {
+            const int result = paired ? table.identify(read.first, read.second)
+                                      : table.identify(read.first);
+
+            identified += (result >= 0);
+        }
+
+        consume(identified);
+    });
+}
+
+
+int run_benchmarks()
+{
+    struct named_strategy {
+        const char* name;
+        barcode_strategy strategy;
+    };
+
+    const named_strategy strategies[] = {
+        { "trie", barcode_strategy::trie },
+        { "neighbourhood", barcode_strategy::neighbourhood },
+        { "hamming", barcode_strategy::hamming },
+        { "automatic", barcode_strategy::automatic },
+    };
+
+    report_header();
+
+    std::mt19937 rng(BENCH_SEED);
+    for (bool paired : {false, true}) {
+        for (size_t length : {8, 17}) {
+            for (size_t count : {96, 384, 1536}) {
+                const fastq_pair_vec barcodes = random_panel(rng, count, length, paired);
+                const fastq_pair_vec reads = random_reads(rng, barcodes);
+
+                size_t bytes = 0;
+                for (const auto& read : reads) {
+                    bytes += read.first.length() + read.second.length();
+                }
+
+                for (size_t max_mm : {0, 1, 2, 3}) {
+                    for (const auto& it : strategies) {
+                        const barcode_table table(barcodes, max_mm, max_mm, max_mm, it.strategy);
+
+                        const bench_timings timings = benchmark(table, reads, paired);
+                        report_benchmark(std::string("barcode_table/")
+                                         + (paired ? "PE" : "SE")
+                                         + "/length_" + std::to_string(length)
+                                         + "/barcodes_" + std::to_string(count)
+                                         + "/mm_" + std::to_string(max_mm)
+                                         + "/" + it.name,
+                                         reads.size(), bytes, timings);
+                    }
+                }
+            }
+        }
+    }
+
+    return 0;
+}
+
+} // namespace ar
+
+
+int main(int argc, char** argv)
+{
+    if (!ar::parse_bench_args(argc, argv)) {
+        return 1;
+    }
+
+    return ar::finish_benchmarks(ar::run_benchmarks());
+}
@@ -0,0 +1,321 @@
+/*************************************************************************\
+ * AdapterRemoval - cleaning next-generation sequencing reads            *
+ *                                                                       *
+ * Copyright (C) 2011 by Stinus Lindgreen - stinus@binf.ku.dk            *
+ * Copyright (C) 2014 by Mikkel Schubert - mikkelsch@gmail.com           *
+ *                                                                       *
+ * If you use the program, please cite the paper:                        *
+ * S. Lindgreen (2012): AdapterRemoval: Easy Cleaning of Next Generation *
+ * Sequencing Reads, BMC Research Notes, 5:337                           *
+ * http://www.biomedcentral.com/1756-0500/5/337/                         *
+ *                                                                       *
+ * This program is free software: you can redistribute it and/or modify  *
+ * it under the terms of the GNU General Public License as published by  *
+ * the Free Software Foundation, either version 3 of the License, or     *
+ * (at your option) any later version.                                   *
+ *                                                                       *
+ * This program is distributed in the hope that it will be useful,       *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ * GNU General Public License for more details.                          *
+ *                                                                       *
+ * You should have received a copy of the GNU General Public License     *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+\*************************************************************************/
+#ifndef BENCH_UTILS_H
+#define BENCH_UTILS_H
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "fastq.hpp"
+
+namespace ar
+{
+
+//! Seed used to generate benchmark data; fixed so that runs are comparable
+const unsigned BENCH_SEED = 12345;
+//! Default number of times each benchmark is repeated; see --repetitions
+const size_t BENCH_REPETITIONS = 3;
+
+//! Adapter sequences used by default by AdapterRemoval
+const std::string BENCH_ADAPTER_1 = "AGATCGGAAGAGCACACGTCTGAACTCCAGTCACNNNNNNATCTCGTATGCCGTCTTCTGCTTG";
+const std::string BENCH_ADAPTER_2 = "AGATCGGAAGAGCGTCGTGTAGGGAAAGAGTGTAGATCTCGGTGGTCGCCGTATCATT";
+
+//! Wall-clock time in seconds of each repetition of a benchmark
+typedef std::vector<double> bench_timings;
+
+
+/** Options shared by all benchmark programs. */
+struct bench_options
+{
+    //! Number of times each benchmark is repeated
+    size_t repetitions = BENCH_REPETITIONS;
+    //! If not empty, the timings of every repetition are written to this file
+    std::string json;
+};
+
+
+/** Result of a single benchmark, as reported using report_benchmark. */
+struct bench_result
+{
+    std::string name;
+    size_t reads;
+    size_t bytes;
+    bench_timings timings;
+};
+
+
+/** Returns the options for the current benchmark program. */
+inline bench_options& get_bench_options()
+{
+    static bench_options options;
+    return options;
+}
+
+
+/** Returns the results reported so far by the current benchmark program. */
+inline std::vector<bench_result>& get_bench_results()
+{
+    static std::vector<bench_result> results;
+    return results;
+}
+
+
+/**
+ * Parses the command-line options supported by all benchmarks, namely
+ * '--repetitions N' and '--json FILE'; returns false on invalid options.
+ */
+inline bool parse_bench_args(int argc, char** argv)
+{
+    bench_options& options = get_bench_options();
+    for (int i = 1; i < argc; ++i) {
+        const std::string key = argv[i];
+        if (i + 1 >= argc) {
+            std::cerr << "Error: No value for option " << key << std::endl;
+            return false;
+        } else if (key == "--repetitions") {
+            options.repetitions = std::strtoul(argv[++i], nullptr, 10);
+            if (options.repetitions < 1) {
+                std::cerr << "Error: --repetitions must be at least 1" << std::endl;
+                return false;
+            }
+        } else if (key == "--json") {
+            options.json = argv[++i];
+        } else {
+            std::cerr << "Error: Unknown option " << key << std::endl;
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
+/** Returns a random sequence of ACGTs. */
+inline std::string random_sequence(std::mt19937& rng, size_t length)
+{
+    std::uniform_int_distribution<size_t> dist(0, 3);
+
+    std::string sequence;
+    sequence.reserve(length);
+    for (size_t i = 0; i < length; ++i) {
+        sequence.push_back("ACGT"[dist(rng)]);
+    }
+
+    return sequence;
+}
+
+
+/**
+ * Returns random Phred+33 qualities declining towards the 3' end, with
+ * occasional low-quality bases, resembling Illumina reads.
+ */
+inline std::string random_qualities(std::mt19937& rng, size_t length)
+{
+    std::uniform_int_distribution<int> noise(-5, 2);
+    std::uniform_int_distribution<int> dropout(0, 49);
+
+    std::string qualities;
+    qualities.reserve(length);
+    for (size_t i = 0; i < length; ++i) {
+        int score = 40 - static_cast<int>((20 * i) / std::max<size_t>(1, length)) + noise(rng);
+        if (!dropout(rng)) {
+            score = 2;
+        }
+
+        qualities.push_back(static_cast<char>(33 + std::max(2, std::min(41, score))));
+    }
+
+    return qualities;
+}
+
+
+/** Returns the reverse complement of a sequence of ACGTNs. */
+inline std::string reverse_complement(const std::string& sequence)
+{
+    std::string result(sequence.rbegin(), sequence.rend());
+    for (auto& nt : result) {
+        switch (nt) {
+            case 'A': nt = 'T'; break;
+            case 'C': nt = 'G'; break;
+            case 'G': nt = 'C'; break;
+            case 'T': nt = 'A'; break;
+            default: break;
+        }
+    }
+
+    return result;
+}
+
+
+/**
+ * Generates a random pair of reads of the given length, sequenced from an
+ * insert of random length; inserts shorter than the reads result in adapter
+ * read-through, followed by random sequence.
+ */
+inline fastq_pair random_read_pair(std::mt19937& rng, size_t read_length,
+                                   size_t min_insert, size_t max_insert)
+{
+    std::uniform_int_distribution<size_t> insert_dist(min_insert, max_insert);
+    const std::string insert = random_sequence(rng, insert_dist(rng));
+    const std::string tail = random_sequence(rng, read_length);
+
+    std::string seq_1 = insert + BENCH_ADAPTER_1 + tail;
+    std::string seq_2 = reverse_complement(insert) + BENCH_ADAPTER_2 + tail;
+    seq_1.resize(read_length);
+    seq_2.resize(read_length);
+
+    return fastq_pair(fastq("read/1", seq_1, random_qualities(rng, read_length)),
+                      fastq("read/2", seq_2, random_qualities(rng, read_length)));
+}
+
+
+/**
+ * Returns the default adapter pair followed by 'count' - 1 random adapter
+ * pairs, oriented as expected by align_paired_ended_sequences.
+ */
+inline fastq_pair_vec random_adapters(std::mt19937& rng, size_t count)
+{
+    fastq_pair_vec adapters;
+    for (size_t i = 0; i < count; ++i) {
+        const std::string adapter_1 = i ? random_sequence(rng, 33) : BENCH_ADAPTER_1;
+        const std::string adapter_2 = i ? random_sequence(rng, 33) : BENCH_ADAPTER_2;
+
+        adapters.push_back(fastq_pair(fastq("adapter_1", adapter_1),
+                                      fastq("adapter_2", reverse_complement(adapter_2))));
+    }
+
+    return adapters;
+}
+
+
+/** Prevents the compiler from discarding otherwise unused results. */
+inline void consume(size_t value)
+{
+    static volatile size_t sink = 0;
+    sink = sink + value;
+}
+
+
+/**
+ * Runs 'func' the number of times specified using --repetitions and returns
+ * the wall-clock time in seconds of every run.
+ */
+template <typename F>
+bench_timings time_runs(F func)
+{
+    bench_timings timings;
+    for (size_t i = 0; i < get_bench_options().repetitions; ++i) {
+        const auto start = std::chrono::steady_clock::now();
+        func();
+        const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+        timings.push_back(elapsed.count());
+    }
+
+    return timings;
+}
+
+
+/** Writes the header of the table printed by report_benchmark. */
+inline void report_header()
+{
+    std::cout << "benchmark\treads\tns_per_read\tGB_per_second\n";
+}
+
+
+/**
+ * Reports the throughput of the fastest run of a benchmark in nanoseconds
+ * per read and in gigabytes (10^9 bytes) per second, where the number of
+ * bytes depends on the benchmark; typically the number of bases or the size
+ * of the FASTQ records processed. All timings are kept for --json.
+ */
+inline void report_benchmark(const std::string& name, size_t reads,
+                             size_t bytes, const bench_timings& timings)
+{
+    get_bench_results().push_back(bench_result{name, reads, bytes, timings});
+
+    const double seconds = *std::min_element(timings.begin(), timings.end());
+    std::cout << name << "\t"
+              << reads << "\t"
+              << std::fixed << std::setprecision(1) << (seconds * 1e9) / reads << "\t"
+              << std::setprecision(4) << (bytes / seconds) / 1e9 << std::endl;
+}
+
+
+/**
+ * Writes the results reported so far to the file specified using --json,
+ * if any, and returns the exit code of the benchmark program. The resulting
+ * files may be compared using 'scripts/bench_compare.py'.
+ */
+inline int finish_benchmarks(int returncode)
+{
+    const std::string& filename = get_bench_options().json;
+    if (returncode || filename.empty()) {
+        return returncode;
+    }
+
+    std::ofstream output(filename);
+    output << "{\n  \"benchmarks\": [";
+
+    const std::vector<bench_result>& results = get_bench_results();
+    for (size_t i = 0; i < results.size(); ++i) {
+        const bench_result& result = results.at(i);
+
+        output << (i ? ",\n" : "\n")
+               << "    {\n"
+               << "      \"name\": \"" << result.name << "\",\n"
+               << "      \"reads\": " << result.reads << ",\n"
+               << "      \"bytes\": " << result.bytes << ",\n"
+               << "      \"seconds\": [";
+
+        output << std::setprecision(9);
+        for (size_t j = 0; j < result.timings.size(); ++j) {
+            output << (j ? ", " : "") << result.timings.at(j);
+        }
+
+        output << "]\n    }";
+    }
+
+    output << "\n  ]\n}\n";
+    output.close();
+
+    if (!output) {
+        std::cerr << "Error writing benchmark results to " << filename << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
+
+} // namespace ar
+
+#endif
@@ -0,0 +1,123 @@
+/*************************************************************************\
+ * AdapterRemoval - cleaning next-generation sequencing reads            *
+ *                                                                       *
+ * Copyright (C) 2011 by Stinus Lindgreen - stinus@binf.ku.dk            *
+ * Copyright (C) 2014 by Mikkel Schubert - mikkelsch@gmail.com           *
+ *                                                                       *
+ * If you use the program, please cite the paper:                        *
+ * S. Lindgreen (2012): AdapterRemoval: Easy Cleaning of Next Generation *
+ * Sequencing Reads, BMC Research Notes, 5:337                           *
+ * http://www.biomedcentral.com/1756-0500/5/337/                         *
+ *                                                                       *
+ * This program is free software: you can redistribute it and/or modify  *
+ * it under the terms of the GNU General Public License as published by  *
+ * the Free Software Foundation, either version 3 of the License, or     *
+ * (at your option) any later version.                                   *
+ *                                                                       *
+ * This program is distributed in the hope that it will be useful,       *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ * GNU General Public License for more details.                          *
+ *                                                                       *
+ * You should have received a copy of the GNU General Public License     *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+\*************************************************************************/
+#include <chrono>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "bench_utils.hpp"
+#include "fastq.hpp"
+#include "fastq_enc.hpp"
+#include "fastq_io.hpp"
+#include "main.hpp"
+#include "userconfig.hpp"
+
+//! Number of reads compressed per benchmark
+const size_t N_READS = 20000;
+//! Length of reads
+const size_t READ_LEN = 150;
+
+namespace ar
+{
+
+/**
+ * Compresses the reads in chunks of FASTQ_CHUNK_SIZE reads, as done when
+ * trimming, and returns the time in seconds of every repetition. Only
+ * compression is timed, not the creation of the output chunks.
+ */
+bench_timings benchmark_compression(analytical_step& step, const fastq_vec& reads)
+{
+    bench_timings timings;
+    for (size_t rep = 0; rep < get_bench_options().repetitions; ++rep) {
+        std::vector<output_chunk_ptr> chunks;
+        for (size_t i = 0; i < reads.size(); ++i) {
+            if (i % FASTQ_CHUNK_SIZE == 0) {
+                chunks.push_back(output_chunk_ptr(new fastq_output_chunk()));
+            }
+
+            chunks.back()->add(FASTQ_ENCODING_33, reads.at(i));
+        }
+
+        const auto start = std::chrono::steady_clock::now();
+        for (auto& chunk : chunks) {
+            const chunk_vec result = step.process(chunk.release());
+            consume(result.size());
+        }
+        const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+        timings.push_back(elapsed.count());
+    }
+
+    return timings;
+}
+
+
+int run_benchmarks()
+{
+    std::mt19937 rng(BENCH_SEED);
+
+    fastq_vec reads;
+    size_t bytes = 0;
+    for (size_t i = 0; i < N_READS; ++i) {
+        reads.push_back(random_read_pair(rng, READ_LEN, 50, 250).first);
+        bytes += reads.back().to_str().size();
+    }
+
+    userconfig config(NAME, VERSION, HELPTEXT);
+
+    report_header();
+    for (unsigned level : {1, 6, 9}) {
+        config.gzip_level = level;
+        gzip_fastq step(config, 0);
+
+        const bench_timings timings = benchmark_compression(step, reads);
+        report_benchmark("gzip_fastq/level_" + std::to_string(level),
+                         reads.size(), bytes, timings);
+    }
+
+    for (unsigned level : {1, 9}) {
+        config.bzip2_level = level;
+        bzip2_fastq step(config, 0);
+
+        const bench_timings timings = benchmark_compression(step, reads);
+        report_benchmark("bzip2_fastq/level_" + std::to_string(level),
+                         reads.size(), bytes, timings);
+    }
+
+    return 0;
+}
+
+} // namespace ar
+
+
+int main(int argc, char** argv)
+{
+    if (!ar::parse_bench_args(argc, argv)) {
+        return 1;
+    }
+
+    return ar::finish_benchmarks(ar::run_benchmarks());
+}
@@ -0,0 +1,174 @@
+/*************************************************************************\
+ * AdapterRemoval - cleaning next-generation sequencing reads            *
+ *                                                                       *
+ * Copyright (C) 2011 by Stinus Lindgreen - stinus@binf.ku.dk            *
+ * Copyright (C) 2014 by Mikkel Schubert - mikkelsch@gmail.com           *
+ *                                                                       *
+ * If you use the program, please cite the paper:                        *
+ * S. Lindgreen (2012): AdapterRemoval: Easy Cleaning of Next Generation *
+ * Sequencing Reads, BMC Research Notes, 5:337                           *
+ * http://www.biomedcentral.com/1756-0500/5/337/                         *
+ *                                                                       *
+ * This program is free software: you can redistribute it and/or modify  *
+ * it under the terms of the GNU General Public License as published by  *
+ * the Free Software Foundation, either version 3 of the License, or     *
+ * (at your option) any later version.                                   *
+ *                                                                       *
+ * This program is distributed in the hope that it will be useful,       *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ * GNU General Public License for more details.                          *
+ *                                                                       *
+ * You should have received a copy of the GNU General Public License     *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+\*************************************************************************/
+#include <random>
+#include <string>
+#include <vector>
+
+#include "bench_utils.hpp"
+#include "commontypes.hpp"
+#include "fastq.hpp"
+#include "linereader.hpp"
+
+//! Number of reads parsed / serialized / trimmed per benchmark
+const size_t N_READS = 200000;
+//! Length of reads
+const size_t READ_LEN = 150;
+
+namespace ar
+{
+
+/** Line reader returning lines from a vector; avoids IO during benchmarks. */
+class vec_reader : public line_reader_base
+{
+public:
+    vec_reader(const string_vec& lines)
+        : m_lines(lines)
+        , m_it(m_lines.begin())
+    {
+    }
+
+    bool getline(std::string& dst) {
+        if (m_it == m_lines.end()) {
+            return false;
+        }
+
+        dst = *m_it++;
+        return true;
+    }
+
+private:
+    const string_vec& m_lines;
+    string_vec::const_iterator m_it;
+};
+
+
+void benchmark_read(const fastq_vec& reads)
+{
+    string_vec lines;
+    size_t bytes = 0;
+    for (const auto& read : reads) {
+        lines.push_back("@" + read.header());
+        lines.push_back(read.sequence());
+        lines.push_back("+");
+        lines.push_back(read.qualities());
+
+        bytes += read.to_str().size();
+    }
+
+    const bench_timings timings = time_runs([&]() {
+        vec_reader reader(lines);
+
+        fastq record;
+        while (record.read(reader)) {
+            consume(record.length());
+        }
+    });
+
+    report_benchmark("fastq::read", reads.size(), bytes, timings);
+}
+
+
+void benchmark_to_str(const fastq_vec& reads)
+{
+    size_t bytes = 0;
+    for (const auto& read : reads) {
+        bytes += read.to_str().size();
+    }
+
+    const bench_timings timings = time_runs([&]() {
+        for (const auto& read : reads) {
+            consume(read.to_str().size());
+        }
+    });
+
+    report_benchmark("fastq::to_str", reads.size(), bytes, timings);
+}
+
+
+void benchmark_trimming(const fastq_vec& reads)
+{
+    struct named_window {
+        const char* name;
+        double window_size;
+    };
+
+    const named_window windows[] = {
+        { "trim_windowed_bases/fraction_0.1", 0.1 },
+        { "trim_windowed_bases/fixed_4", 4 },
+    };
+
+    for (const auto& it : windows) {
+        // Each repetition trims a fresh copy; copying is included in timings
+        const bench_timings timings = time_runs([&]() {
+            for (const auto& read : reads) {
+                fastq record = read;
+                const fastq::ntrimmed trimmed = record.trim_windowed_bases(true, 2, it.window_size);
+                consume(trimmed.first + trimmed.second);
+            }
+        });
+
+        report_benchmark(it.name, reads.size(), reads.size() * READ_LEN, timings);
+    }
+
+    const bench_timings timings = time_runs([&]() {
+        for (const auto& read : reads) {
+            fastq record = read;
+            const fastq::ntrimmed trimmed = record.trim_trailing_bases(true, 2);
+            consume(trimmed.first + trimmed.second);
+        }
+    });
+
+    report_benchmark("trim_trailing_bases", reads.size(), reads.size() * READ_LEN, timings);
+}
+
+
+int run_benchmarks()
+{
+    std::mt19937 rng(BENCH_SEED);
+
+    fastq_vec reads;
+    for (size_t i = 0; i < N_READS; ++i) {
+        reads.push_back(random_read_pair(rng, READ_LEN, 50, 250).first);
+    }
+
+    report_header();
+    benchmark_read(reads);
+    benchmark_to_str(reads);
+    benchmark_trimming(reads);
+
+    return 0;
+}
+
+} // namespace ar
+
+
+int main(int argc, char** argv)
+{
+    if (!ar::parse_bench_args(argc, argv)) {
+        return 1;
+    }
+
+    return ar::finish_benchmarks(ar::run_benchmarks());
+}
@@ -0,0 +1,213 @@
+/*************************************************************************\
+ * AdapterRemoval - cleaning next-generation sequencing reads            *
+ *                                                                       *
+ * Copyright (C) 2011 by Stinus Lindgreen - stinus@binf.ku.dk            *
+ * Copyright (C) 2014 by Mikkel Schubert - mikkelsch@gmail.com           *
+ *                                                                       *
+ * If you use the program, please cite the paper:                        *
+ * S. Lindgreen (2012): AdapterRemoval: Easy Cleaning of Next Generation *
+ * Sequencing Reads, BMC Research Notes, 5:337                           *
+ * http://www.biomedcentral.com/1756-0500/5/337/                         *
+ *                                                                       *
+ * This program is free software: you can redistribute it and/or modify  *
+ * it under the terms of the GNU General Public License as published by  *
+ * the Free Software Foundation, either version 3 of the License, or     *
+ * (at your option) any later version.                                   *
+ *                                                                       *
+ * This program is distributed in the hope that it will be useful,       *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ * GNU General Public License for more details.                          *
+ *                                                                       *
+ * You should have received a copy of the GNU General Public License     *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+\*************************************************************************/
+#include <cstdlib>
+#include <dirent.h>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+#include "bench_utils.hpp"
+#include "commontypes.hpp"
+#include "fastq.hpp"
+#include "main.hpp"
+#include "userconfig.hpp"
+
+//! Number of reads (pairs) processed per run of the pipeline
+const size_t N_READS = 50000;
+//! Length of mate 1 and mate 2 reads
+const size_t READ_LEN = 150;
+
+namespace ar
+{
+
+// See main_adapter_rm.cpp
+int remove_adapter_sequences(userconfig& config);
+
+
+/**
+ * Creates a temporary directory for input / output files; a RAM-backed
+ * file-system is used if available, so that disk IO is not included in
+ * the timings.
+ */
+std::string create_temp_dir()
+{
+    const char* tmpdir = getenv("TMPDIR");
+    struct stat info;
+
+    std::string root = "/tmp";
+    if (!stat("/dev/shm", &info) && S_ISDIR(info.st_mode)) {
+        root = "/dev/shm";
+    } else if (tmpdir && *tmpdir) {
+        root = tmpdir;
+    }
+
+    std::string templ = root + "/adapterremoval_bench.XXXXXX";
+    std::vector<char> buffer(templ.begin(), templ.end());
+    buffer.push_back('\0');
+
+    if (!mkdtemp(buffer.data())) {
+        return std::string();
+    }
+
+    return std::string(buffer.data());
+}
+
+
+/** Removes a (flat) directory created by create_temp_dir. */
+void remove_temp_dir(const std::string& root)
+{
+    if (DIR* dir = opendir(root.c_str())) {
+        while (const dirent* entry = readdir(dir)) {
+            const std::string name = entry->d_name;
+            if (name != "." && name != "..") {
+                unlink((root + "/" + name).c_str());
+            }
+        }
+
+        closedir(dir);
+    }
+
+    rmdir(root.c_str());
+}
+
+
+/** Runs the trimming pipeline with the given arguments; stderr is hidden. */
+bool run_pipeline(const string_vec& args)
+{
+    std::vector<char*> argv;
+    for (const auto& arg : args) {
+        argv.push_back(const_cast<char*>(arg.c_str()));
+    }
+    argv.push_back(nullptr);
+
+    std::ostringstream log;
+    std::streambuf* cerr_buf = std::cerr.rdbuf(log.rdbuf());
+
+    userconfig config(NAME, VERSION, HELPTEXT);
+    bool success = false;
+    if (config.parse_args(argv.size() - 1, argv.data()) == argparse::parse_result::ok) {
+        success = !remove_adapter_sequences(config);
+    }
+
+    std::cerr.rdbuf(cerr_buf);
+    if (!success) {
+        std::cerr << "Error running pipeline:\n" << log.str() << std::endl;
+    }
+
+    return success;
+}
+
+
+int run_benchmarks(const std::string& root)
+{
+    const std::string input_1 = root + "/input_1.fastq";
+    const std::string input_2 = root + "/input_2.fastq";
+
+    std::mt19937 rng(BENCH_SEED);
+    size_t bytes_1 = 0;
+    size_t bytes_2 = 0;
+    {
+        std::ofstream output_1(input_1);
+        std::ofstream output_2(input_2);
+
+        for (size_t i = 0; i < N_READS; ++i) {
+            const fastq_pair pair = random_read_pair(rng, READ_LEN, 50, 250);
+            const std::string record_1 = pair.first.to_str();
+            const std::string record_2 = pair.second.to_str();
+
+            output_1 << record_1;
+            output_2 << record_2;
+            bytes_1 += record_1.size();
+            bytes_2 += record_2.size();
+        }
+
+        if (!output_1 || !output_2) {
+            std::cerr << "Error writing benchmark data to " << root << std::endl;
+            return 1;
+        }
+    }
+
+    struct named_args {
+        const char* name;
+        bool paired;
+        string_vec args;
+    };
+
+    const named_args runs[] = {
+        { "pipeline/se", false, {} },
+        { "pipeline/pe", true, {} },
+        { "pipeline/pe_collapse_trim", true, { "--collapse", "--trimns", "--trimqualities" } },
+        { "pipeline/pe_gzip", true, { "--gzip" } },
+    };
+
+    report_header();
+    for (const auto& it : runs) {
+        string_vec args = { NAME, "--file1", input_1, "--basename", root + "/output" };
+        if (it.paired) {
+            args.push_back("--file2");
+            args.push_back(input_2);
+        }
+        args.insert(args.end(), it.args.begin(), it.args.end());
+
+        bool success = true;
+        const bench_timings timings = time_runs([&]() {
+            success = run_pipeline(args) && success;
+        });
+
+        if (!success) {
+            return 1;
+        }
+
+        report_benchmark(it.name, N_READS, bytes_1 + (it.paired ? bytes_2 : 0), timings);
+    }
+
+    return 0;
+}
+
+} // namespace ar
+
+
+int main(int argc, char** argv)
+{
+    if (!ar::parse_bench_args(argc, argv)) {
+        return 1;
+    }
+
+    const std::string root = ar::create_temp_dir();
+    if (root.empty()) {
+        std::cerr << "Error creating temporary directory" << std::endl;
+        return 1;
+    }
+
+    const int returncode = ar::run_benchmarks(root);
+    ar::remove_temp_dir(root);
+
+    return ar::finish_benchmarks(returncode);
+}
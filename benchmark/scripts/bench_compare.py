@@ -0,0 +1,180 @@
+#!/usr/bin/env python3
+# -*- coding: utf-8 -*-
+# Copyright (c) 2026 AdapterRemoval contributors
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy
+# of this software and associated documentation files (the "Software"), to deal
+# in the Software without restriction, including without limitation the rights
+# to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+# copies of the Software, and to permit persons to whom the Software is
+# furnished to do so, subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in
+# all copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+# AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+# LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+# OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+# SOFTWARE.
+#
+# Merges the JSON files written by the microbenchmarks (using --json), or
+# compares them against a baseline written by the 'merge' command. For each
+# benchmark the change in mean time per read is reported with a 95%
+# confidence interval; the exit code is 1 if any benchmark is slower than the
+# baseline by more than --threshold percent, and the slowdown is significant.
+import os
+import sys
+import json
+import math
+import argparse
+
+
+# Two-sided 95% quantiles of Student's t-distribution for 1 - 30 d.f.
+T_QUANTILES = (12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306,
+               2.262, 2.228, 2.201, 2.179, 2.160, 2.145, 2.131, 2.120,
+               2.110, 2.101, 2.093, 2.086, 2.080, 2.074, 2.069, 2.064,
+               2.060, 2.056, 2.052, 2.048, 2.045, 2.042)
+
+
+def t_quantile(dof):
+    if dof >= len(T_QUANTILES):
+        return 1.960
+
+    return T_QUANTILES[max(1, int(dof)) - 1]
+
+
+def read_benchmarks(filenames):
+    benchmarks = {}
+    for filename in filenames:
+        with open(filename) as handle:
+            for benchmark in json.load(handle)["benchmarks"]:
+                if benchmark["name"] in benchmarks:
+                    raise ValueError("benchmark %r found more than once"
+                                     % (benchmark["name"],))
+
+                benchmarks[benchmark["name"]] = benchmark
+
+    return benchmarks
+
+
+def summarize(benchmark):
+    """Returns the mean and variance of the time in ns per read."""
+    values = [seconds * 1e9 / benchmark["reads"]
+              for seconds in benchmark["seconds"]]
+    mean = sum(values) / len(values)
+    if len(values) > 1:
+        variance = sum((value - mean) ** 2 for value in values) \
+            / (len(values) - 1)
+    else:
+        variance = 0.0
+
+    return mean, variance, len(values)
+
+
+def compare(baseline, current):
+    """Returns the relative change in mean time per read between the current
+    and the baseline results, with a 95% CI using Welch's t-test."""
+    mean_b, var_b, n_b = summarize(baseline)
+    mean_c, var_c, n_c = summarize(current)
+
+    se_b = var_b / n_b
+    se_c = var_c / n_c
+    std_err = math.sqrt(se_b + se_c)
+    if std_err > 0:
+        dof = (se_b + se_c) ** 2 \
+            / (se_b ** 2 / max(1, n_b - 1) + se_c ** 2 / max(1, n_c - 1))
+    else:
+        dof = n_b + n_c - 2
+
+    delta = mean_c - mean_b
+    margin = t_quantile(dof) * std_err
+
+    return (mean_b, mean_c, delta / mean_b,
+            (delta - margin) / mean_b, (delta + margin) / mean_b)
+
+
+def main_merge(args):
+    benchmarks = read_benchmarks(args.files)
+    with open(args.output, "w") as handle:
+        json.dump({"benchmarks": [benchmarks[key]
+                                  for key in sorted(benchmarks)]},
+                  handle, indent=2)
+        handle.write("\n")
+
+    return 0
+
+
+def main_compare(args):
+    if not os.path.exists(args.baseline):
+        sys.stderr.write("ERROR: Baseline %r not found; run `make bench_baseline` "
+                         "first.\n" % (args.baseline,))
+        return 1
+
+    baseline = read_benchmarks([args.baseline])
+    current = read_benchmarks(args.files)
+
+    regressions = []
+    print("benchmark\tbaseline_ns\tcurrent_ns\tdelta\tCI_low\tCI_high\tstatus")
+    for name in sorted(current):
+        if name not in baseline:
+            print("%s\tNA\tNA\tNA\tNA\tNA\tnew" % (name,))
+            continue
+
+        mean_b, mean_c, delta, low, high = compare(baseline[name], current[name])
+        if delta * 100 > args.threshold and low > 0:
+            status = "REGRESSION"
+            regressions.append(name)
+        elif high < 0:
+            status = "faster"
+        elif low > 0:
+            status = "slower"
+        else:
+            status = "ok"
+
+        print("%s\t%.1f\t%.1f\t%+.1f%%\t%+.1f%%\t%+.1f%%\t%s"
+              % (name, mean_b, mean_c, delta * 100, low * 100, high * 100,
+                 status))
+
+    for name in sorted(set(baseline) - set(current)):
+        print("%s\tNA\tNA\tNA\tNA\tNA\tmissing" % (name,))
+
+    if regressions:
+        sys.stderr.write("%i benchmark(s) regressed by more than %.1f%%: %s\n"
+                         % (len(regressions), args.threshold,
+                            ", ".join(regressions)))
+        return 1
+
+    return 0
+
+
+def parse_args(argv):
+    parser = argparse.ArgumentParser()
+    subparsers = parser.add_subparsers(dest="command")
+    subparsers.required = True
+
+    merge = subparsers.add_parser("merge")
+    merge.add_argument("output")
+    merge.add_argument("files", nargs="+")
+    merge.set_defaults(main=main_merge)
+
+    compare = subparsers.add_parser("compare")
+    compare.add_argument("baseline")
+    compare.add_argument("files", nargs="+")
+    compare.add_argument("--threshold", type=float, default=5.0,
+                         help="Maximum slowdown in percent [%(default)s]")
+    compare.set_defaults(main=main_compare)
+
+    return parser.parse_args(argv)
+
+
+def main(argv):
+    args = parse_args(argv)
+
+    return args.main(args)
+
+
+if __name__ == '__main__':
+    sys.exit(main(sys.argv[1:]))
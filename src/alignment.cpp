@@ -67,23 +67,98 @@ inline size_t COUNT_BITS_128(__m128i value)
 #endif
 
 
+//! Possible outcomes when comparing an alignment to the best alignment
+enum class comparison
+{
+    //! The alignment is not better than the best alignment
+    not_better,
+    //! The alignment is better than the best alignment
+    better,
+    //! The alignment has too many mismatches to be acceptable; comparison of
+    //! this alignment was abandoned before all bases were compared.
+    abandoned,
+};
+
+
+/** Partially evaluated alignment that was abandoned due to mismatches. */
+struct partial_alignment
+{
+    partial_alignment(const alignment_info& alignment_, size_t n_compared_)
+      : alignment(alignment_)
+      , n_compared(n_compared_)
+    {
+    }
+
+    //! The alignment, including counts for the bases compared so far, and
+    //! an upper bound on the final score.
+    alignment_info alignment;
+    //! The number of bases compared so far
+    size_t n_compared;
+};
+
+typedef std::vector<partial_alignment> partial_alignment_vec;
+
+
+/** State shared between pairwise alignments against multiple adapters. */
+struct alignment_state
+{
+    alignment_state(double mismatch_threshold_)
+      : mismatch_threshold(mismatch_threshold_)
+      , adapter_id(0)
+      , abandoned()
+      , counters()
+    {
+    }
+
+    //! Mismatch rate used to abandon unacceptable alignments; disabled if < 0.
+    const double mismatch_threshold;
+    //! The adapter currently being aligned
+    int adapter_id;
+    //! Abandoned alignments that may need to be evaluated fully
+    partial_alignment_vec abandoned;
+    //! Counters for the current alignment
+    alignment_counters counters;
+};
+
+
+/** Returns true if an alignment has too many mismatches given the threshold. */
+inline bool too_many_mismatches(const alignment_info& alignment,
+                                double mismatch_threshold)
+{
+    const size_t n_aligned = alignment.length - alignment.n_ambiguous;
+
+    return alignment.n_mismatches > max_alignment_mismatches(n_aligned, mismatch_threshold);
+}
+
+
 /**
  * Compares two subsequences in an alignment to a previous (best) alignment.
  *
  * @param best The currently best alignment, used for evaluating this alignment
- * @param current The current alignment to be evaluated (counts are assumed to be zero'd!)
+ * @param current The current alignment to be evaluated; counts must reflect
+ *                the first n_compared bases (typically zero).
  * @param seq_1_ptr Pointer to the first base in the first sequence in the alignment.
  * @param seq_2_ptr Pointer to the first base in the second sequence in the alignment.
- * @return True if the current alignment is at least as good as the best alignment, false otherwise.
+ * @param n_compared Number of bases already compared; updated on return.
+ * @param mismatch_threshold If not negative, comparisons are abandoned once
+ *                           the alignment has too many mismatches to be
+ *                           acceptable (see max_alignment_mismatches).
+ * @return Whether the current alignment is better than the best alignment.
  *
- * If the function returns false, the current alignment cannot be assumed to
- * have been completely evaluated (due to early termination), and hence counts
- * and scores are not reliable. The function assumes uppercase nucleotides.
+ * If the function does not return comparison::better, the current alignment
+ * cannot be assumed to have been completely evaluated (due to early
+ * termination), and hence counts and scores are not reliable. However, the
+ * score of abandoned alignments is an upper bound on the final score. The
+ * function assumes uppercase nucleotides.
  */
-bool compare_subsequences(const alignment_info& best, alignment_info& current,
-                          const char* seq_1_ptr, const char* seq_2_ptr)
+comparison compare_subsequences(const alignment_info& best, alignment_info& current,
+                                const char* seq_1_ptr, const char* seq_2_ptr,
+                                size_t& n_compared, double mismatch_threshold)
 {
-    int remaining_bases = current.score = current.length;
+    int remaining_bases = current.length - n_compared;
+    current.score = current.length - current.n_ambiguous - (current.n_mismatches * 2);
+    seq_1_ptr += n_compared;
+    seq_2_ptr += n_compared;
 
 #if defined(__SSE__) && defined(__SSE2__)
     while (remaining_bases >= 16 && current.score >= best.score) {
@@ -110,6 +185,11 @@ bool compare_subsequences(const alignment_info& best, alignment_info& current,
         seq_1_ptr += 16;
         seq_2_ptr += 16;
         remaining_bases -= 16;
+
+        if (mismatch_threshold >= 0 && too_many_mismatches(current, mismatch_threshold)) {
+            n_compared = current.length - remaining_bases;
+            return comparison::abandoned;
+        }
     }
 #endif
 
@@ -123,39 +203,138 @@ bool compare_subsequences(const alignment_info& best, alignment_info& current,
         } else if (nt_1 != nt_2) {
             current.n_mismatches++;
             current.score -= 2;
+
+            if (mismatch_threshold >= 0 && too_many_mismatches(current, mismatch_threshold)) {
+                n_compared = current.length - remaining_bases + 1;
+                return comparison::abandoned;
+            }
         }
     }
 
-    return current.is_better_than(best);
+    n_compared = current.length - remaining_bases;
+
+    return current.is_better_than(best) ? comparison::better : comparison::not_better;
 }
 
 
+/**
+ * Compares two subsequences in an alignment to a previous (best) alignment,
+ * without abandoning alignments with too many mismatches.
+ *
+ * @return True if the current alignment is better than the best alignment.
+ */
+bool compare_subsequences(const alignment_info& best, alignment_info& current,
+                          const char* seq_1_ptr, const char* seq_2_ptr)
+{
+    size_t n_compared = 0;
+
+    return compare_subsequences(best, current, seq_1_ptr, seq_2_ptr, n_compared, -1) == comparison::better;
+}
+
+
+/**
+ * Evaluates a single offset in a pairwise alignment, updating the best
+ * alignment if the current alignment is better. Equally good alignments
+ * replace the best alignment if they were found during the current search
+ * and have a lower offset, so that the result does not depend on the order
+ * in which offsets are evaluated. Abandoned alignments are saved in state.
+ *
+ * @return False if the offset could not possibly match the best alignment.
+ */
+inline bool align_at_offset(alignment_info& best,
+                            bool& best_is_current,
+                            const std::string& seq1,
+                            const std::string& seq2,
+                            int offset,
+                            alignment_state& state)
+{
+    const size_t initial_seq1_offset = std::max<int>(0,  offset);
+    const size_t initial_seq2_offset = std::max<int>(0, -offset);
+    const size_t length = std::min(seq1.length() - initial_seq1_offset,
+                                   seq2.length() - initial_seq2_offset);
+
+    if (static_cast<int>(length) < best.score) {
+        return false;
+    }
+
+    alignment_info current;
+    current.offset = offset;
+    current.length = length;
+    current.adapter_id = state.adapter_id;
+
+    const char* seq_1_ptr = seq1.data() + initial_seq1_offset;
+    const char* seq_2_ptr = seq2.data() + initial_seq2_offset;
+
+    size_t n_compared = 0;
+    switch (compare_subsequences(best, current, seq_1_ptr, seq_2_ptr, n_compared, state.mismatch_threshold)) {
+        case comparison::better:
+            best = current;
+            best_is_current = true;
+            break;
+
+        case comparison::not_better:
+            if (best_is_current && offset < best.offset && !best.is_better_than(current)) {
+                // Early termination only happens for alignments worse than best
+                best = current;
+            }
+            break;
+
+        case comparison::abandoned:
+            state.abandoned.push_back(partial_alignment(current, n_compared));
+            state.counters.offsets_abandoned++;
+            break;
+
+        default:
+            AR_DEBUG_FAIL("unexpected comparison result");
+    }
+
+    state.counters.offsets_evaluated++;
+    state.counters.bases_compared += n_compared;
+
+    return true;
+}
+
+
+/**
+ * Aligns two sequences, returning the best alignment, or best_alignment if no
+ * better alignment was found. Offsets are evaluated starting at first_offset,
+ * alternating between higher and lower offsets, but the result is the same as
+ * if all offsets were evaluated in ascending order; a good choice of initial
+ * offset merely allows more offsets to be skipped.
+ */
 alignment_info pairwise_align_sequences(const alignment_info& best_alignment,
                                         const std::string& seq1,
                                         const std::string& seq2,
-                                        int min_offset = std::numeric_limits<int>::min(),
-                                        int max_offset = std::numeric_limits<int>::max())
+                                        int min_offset,
+                                        int max_offset,
+                                        int first_offset,
+                                        alignment_state& state)
 {
     const int start_offset = std::max<int>(min_offset, -static_cast<int>(seq2.length()) + 1);
     const int end_offset = std::min<int>(max_offset, static_cast<int>(seq1.length()) - 1);
 
     alignment_info best = best_alignment;
-    for (int offset = start_offset; offset <= end_offset; ++offset) {
-        const size_t initial_seq1_offset = std::max<int>(0,  offset);
-        const size_t initial_seq2_offset = std::max<int>(0, -offset);
-        const size_t length = std::min(seq1.length() - initial_seq1_offset,
-                                       seq2.length() - initial_seq2_offset);
-
-        if (static_cast<int>(length) >= best.score) {
-            alignment_info current;
-            current.offset = offset;
-            current.length = length;
-
-            const char* seq_1_ptr = seq1.data() + initial_seq1_offset;
-            const char* seq_2_ptr = seq2.data() + initial_seq2_offset;
+    bool best_is_current = false;
+
+    // The length of the alignment decreases monotonically for offsets moving
+    // away from 0, so a search in that direction may stop once the length
+    // is less than the best score.
+    int upper_offset = std::max(start_offset, std::min(end_offset, first_offset));
+    int lower_offset = upper_offset - 1;
+    while (upper_offset <= end_offset || lower_offset >= start_offset) {
+        if (upper_offset <= end_offset) {
+            if (align_at_offset(best, best_is_current, seq1, seq2, upper_offset, state) || upper_offset < 0) {
+                ++upper_offset;
+            } else {
+                upper_offset = end_offset + 1;
+            }
+        }
 
-            if (compare_subsequences(best, current, seq_1_ptr, seq_2_ptr)) {
-                best = current;
+        if (lower_offset >= start_offset) {
+            if (align_at_offset(best, best_is_current, seq1, seq2, lower_offset, state) || lower_offset > 0) {
+                --lower_offset;
+            } else {
+                lower_offset = start_offset - 1;
             }
         }
     }
@@ -164,6 +343,75 @@ alignment_info pairwise_align_sequences(const alignment_info& best_alignment,
 }
 
 
+/**
+ * Returns true if alignment a is preferred over alignment b; ties are resolved
+ * in favor of the first adapter, and then the lowest offset, matching the order
+ * in which alignments are (nominally) evaluated.
+ */
+bool is_preferred_alignment(const alignment_info& a, const alignment_info& b)
+{
+    if (a.is_better_than(b)) {
+        return true;
+    } else if (b.is_better_than(a)) {
+        return false;
+    } else if (a.adapter_id != b.adapter_id) {
+        return a.adapter_id < b.adapter_id;
+    }
+
+    return a.offset < b.offset;
+}
+
+
+/**
+ * Returns true if any abandoned alignments need to be evaluated in full; this
+ * is only the case if the best alignment may be acceptable, since otherwise
+ * the read is unaligned regardless of which unacceptable alignment is best.
+ */
+bool must_resume_alignments(const alignment_info& best,
+                            const alignment_state& state)
+{
+    return !state.abandoned.empty()
+        && best.length
+        && best.score > 0
+        && !too_many_mismatches(best, state.mismatch_threshold);
+}
+
+
+/**
+ * Resumes an abandoned alignment, updating best if the final alignment is
+ * preferred over the current best alignment; offset_adjustment is subtracted
+ * from the offset of the completed alignment prior to comparisons.
+ */
+void resume_alignment(alignment_info& best,
+                      partial_alignment& partial,
+                      const std::string& seq1,
+                      const std::string& seq2,
+                      int offset_adjustment,
+                      alignment_state& state)
+{
+    alignment_info& current = partial.alignment;
+    if (current.score < best.score) {
+        // The score is an upper bound, so this cannot be the best alignment
+        return;
+    }
+
+    const char* seq_1_ptr = seq1.data() + std::max<int>(0,  current.offset);
+    const char* seq_2_ptr = seq2.data() + std::max<int>(0, -current.offset);
+
+    const size_t n_compared = partial.n_compared;
+    compare_subsequences(best, current, seq_1_ptr, seq_2_ptr, partial.n_compared, -1);
+
+    state.counters.offsets_resumed++;
+    state.counters.bases_compared += partial.n_compared - n_compared;
+
+    // Alignments terminated early are never preferred, since score < best.score
+    current.offset -= offset_adjustment;
+    if (is_preferred_alignment(current, best)) {
+        best = current;
+    }
+}
+
+
 struct phred_scores
 {
     explicit phred_scores(size_t index)
@@ -197,7 +445,7 @@ string_pair collapse_sequence(const std::string& sequence1,
                               const std::string& sequence2,
                               const std::string& qualities1,
                               const std::string& qualities2,
-                              std::mt19937* rng)
+                              counter_rng* rng)
 {
     AR_DEBUG_ASSERT(sequence1.length() == sequence2.length() &&
                      sequence1.length() == qualities1.length() &&
@@ -285,11 +533,49 @@ bool alignment_info::is_better_than(const alignment_info& other) const
 }
 
 
+alignment_counters::alignment_counters()
+    : offsets_evaluated(0)
+    , offsets_abandoned(0)
+    , offsets_resumed(0)
+    , bases_compared(0)
+{
+}
+
+
+alignment_counters& alignment_counters::operator+=(const alignment_counters& other)
+{
+    offsets_evaluated += other.offsets_evaluated;
+    offsets_abandoned += other.offsets_abandoned;
+    offsets_resumed += other.offsets_resumed;
+    bases_compared += other.bases_compared;
+
+    return *this;
+}
+
+
+size_t max_alignment_mismatches(size_t n_aligned, double mismatch_threshold)
+{
+    if (n_aligned < 6) {
+        return 0;
+    }
+
+    const size_t mm_threshold = static_cast<size_t>(mismatch_threshold * n_aligned);
+    if (n_aligned < 10) {
+        // --mm may imply fewer allowed mismatches than 1, so always compare
+        return std::min<size_t>(1, mm_threshold);
+    }
+
+    return mm_threshold;
+}
+
+
 alignment_info align_single_ended_sequence(const fastq& read,
                                            const fastq_pair_vec& adapters,
-                                           int max_shift)
+                                           int max_shift,
+                                           double mismatch_threshold,
+                                           alignment_counters* counters)
 {
-    size_t adapter_id = 0;
+    alignment_state state(mismatch_threshold);
     alignment_info best_alignment;
     for (const auto& adapter_pair : adapters) {
         const fastq& adapter = adapter_pair.first;
@@ -297,14 +583,27 @@ alignment_info align_single_ended_sequence(const fastq& read,
                                                                   read.sequence(),
                                                                   adapter.sequence(),
                                                                   -max_shift,
-                                                                  std::numeric_limits<int>::max());
+                                                                  std::numeric_limits<int>::max(),
+                                                                  std::numeric_limits<int>::min(),
+                                                                  state);
 
         if (alignment.is_better_than(best_alignment)) {
             best_alignment = alignment;
-            best_alignment.adapter_id = adapter_id;
         }
 
-        ++adapter_id;
+        ++state.adapter_id;
+    }
+
+    if (must_resume_alignments(best_alignment, state)) {
+        for (auto& partial : state.abandoned) {
+            const fastq& adapter = adapters.at(partial.alignment.adapter_id).first;
+
+            resume_alignment(best_alignment, partial, read.sequence(), adapter.sequence(), 0, state);
+        }
+    }
+
+    if (counters) {
+        *counters += state.counters;
     }
 
     return best_alignment;
@@ -314,9 +613,12 @@ alignment_info align_single_ended_sequence(const fastq& read,
 alignment_info align_paired_ended_sequences(const fastq& read1,
                                             const fastq& read2,
                                             const fastq_pair_vec& adapters,
-                                            int max_shift)
+                                            int max_shift,
+                                            int insert_size,
+                                            double mismatch_threshold,
+                                            alignment_counters* counters)
 {
-    size_t adapter_id = 0;
+    alignment_state state(mismatch_threshold);
     alignment_info best_alignment;
     for (const auto& adapter_pair : adapters) {
         const fastq& adapter1 = adapter_pair.first;
@@ -329,20 +631,44 @@ alignment_info align_paired_ended_sequences(const fastq& read1,
         // is aligned against the other, included shifted alignments to account
         // for missing bases at the 5' ends of the reads.
         const int min_offset = adapter2.length() - read2.length() - max_shift;
+        // The offset corresponding to the expected insert size is tried first
+        int first_offset = std::numeric_limits<int>::min();
+        if (insert_size >= 0) {
+            first_offset = insert_size - read2.length() + adapter2.length();
+        }
+
         alignment_info alignment = pairwise_align_sequences(best_alignment,
                                                             sequence1,
                                                             sequence2,
                                                             min_offset,
-                                                            std::numeric_limits<int>::max());
+                                                            std::numeric_limits<int>::max(),
+                                                            first_offset,
+                                                            state);
 
         if (alignment.is_better_than(best_alignment)) {
             best_alignment = alignment;
-            best_alignment.adapter_id = adapter_id;
             // Convert the alignment into an alignment between read 1 & 2 only
             best_alignment.offset -= adapter2.length();
         }
 
-        ++adapter_id;
+        ++state.adapter_id;
+    }
+
+    if (must_resume_alignments(best_alignment, state)) {
+        for (auto& partial : state.abandoned) {
+            const fastq_pair& adapter_pair = adapters.at(partial.alignment.adapter_id);
+            const fastq& adapter1 = adapter_pair.first;
+            const fastq& adapter2 = adapter_pair.second;
+
+            const std::string sequence1 = adapter2.sequence() + read1.sequence();
+            const std::string sequence2 = read2.sequence() + adapter1.sequence();
+
+            resume_alignment(best_alignment, partial, sequence1, sequence2, adapter2.length(), state);
+        }
+    }
+
+    if (counters) {
+        *counters += state.counters;
     }
 
     return best_alignment;
@@ -410,7 +736,7 @@ std::string strip_mate_info(const std::string& header, const char mate_sep)
 fastq collapse_paired_ended_sequences(const alignment_info& alignment,
                                       const fastq& read1,
                                       const fastq& read2,
-                                      std::mt19937* rng,
+                                      counter_rng* rng,
                                       const char mate_sep)
 {
     if (alignment.offset > static_cast<int>(read1.length())) {
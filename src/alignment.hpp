@@ -25,8 +25,8 @@
 #define ALIGNMENT_H
 
 #include <string>
-#include <random>
 
+#include "counter_rng.hpp"
 #include "fastq.hpp"
 
 namespace ar
@@ -114,6 +114,37 @@ struct alignment_info
 };
 
 
+/** Counters summarizing the work done when aligning reads. */
+struct alignment_counters
+{
+    /** Initializes all counters to zero. */
+    alignment_counters();
+
+    /** Combine counters, e.g. those used by different threads. */
+    alignment_counters& operator+=(const alignment_counters& other);
+
+    //! Number of offsets for which bases were compared
+    size_t offsets_evaluated;
+    //! Number of offsets abandoned due to the number of mismatches
+    size_t offsets_abandoned;
+    //! Number of abandoned offsets that had to be evaluated in full
+    size_t offsets_resumed;
+    //! Total number of pairs of bases compared
+    size_t bases_compared;
+};
+
+
+/**
+ * Returns the maximum number of mismatches allowed in an acceptable alignment.
+ *
+ * @param n_aligned Number of aligned bases, not counting ambiguous bases.
+ * @param mismatch_threshold The maximum rate of mismatches (--mm).
+ *
+ * Fewer mismatches are allowed for alignments shorter than 10 bp.
+ */
+size_t max_alignment_mismatches(size_t n_aligned, double mismatch_threshold);
+
+
 /**
  * Attempts to align adapters sequences against a SE read.
  *
@@ -121,13 +152,21 @@ struct alignment_info
  * @param adapters A set of adapter pairs; only the first adapters are used.
  * @param max_shift Allow up to this number of missing bases at the 5' end of
  *                  the read, when aligning the adapter.
+ * @param mismatch_threshold If not negative, the evaluation of alignments
+ *                           with too many mismatches to be acceptable (see
+ *                           max_alignment_mismatches) is abandoned early.
+ * @param counters If not null, counts of work done are added to this object.
  * @return The best alignment, or a length 0 alignment if not aligned.
  *
- * The best alignment is selected using alignment_info::is_better_than.
+ * The best alignment is selected using alignment_info::is_better_than. If a
+ * mismatch_threshold is set and no acceptable alignment exists, then another
+ * unacceptable alignment may be returned in place of the best alignment.
  */
 alignment_info align_single_ended_sequence(const fastq& read,
                                            const fastq_pair_vec& adapters,
-                                           int max_shift);
+                                           int max_shift,
+                                           double mismatch_threshold = -1,
+                                           alignment_counters* counters = nullptr);
 
 
 /**
@@ -138,6 +177,12 @@ alignment_info align_single_ended_sequence(const fastq& read,
  * @param adapters A set of adapter pairs; both in each pair adapters are used.
  * @param max_shift Allow up to this number of missing bases at the 5' end of
  *                  both mate reads.
+ * @param insert_size The expected insert size, if known; alignments matching
+ *                    this insert size are evaluated first, which allows other
+ *                    alignments to be skipped sooner. The result is the same
+ *                    regardless of this value.
+ * @param mismatch_threshold See align_single_ended_sequence.
+ * @param counters If not null, counts of work done are added to this object.
  * @return The best alignment, or a length 0 alignment if not aligned.
  *
  * The alignment is carried out following the concatenation of pcr2 and read1,
@@ -152,7 +197,10 @@ alignment_info align_single_ended_sequence(const fastq& read,
 alignment_info align_paired_ended_sequences(const fastq& read1,
                                             const fastq& read2,
                                             const fastq_pair_vec& adapters,
-                                            int max_shift);
+                                            int max_shift,
+                                            int insert_size = -1,
+                                            double mismatch_threshold = -1,
+                                            alignment_counters* counters = nullptr);
 
 
 /**
@@ -194,7 +242,7 @@ size_t truncate_paired_ended_sequences(const alignment_info& alignment,
 fastq collapse_paired_ended_sequences(const alignment_info& alignment,
                                       const fastq& read1,
                                       const fastq& read2,
-                                      std::mt19937* rng,
+                                      counter_rng* rng,
                                       const char mate_sep=MATE_SEPARATOR);
 
 
@@ -0,0 +1,113 @@
+/*************************************************************************\
+ * AdapterRemoval - cleaning next-generation sequencing reads            *
+ *                                                                       *
+ * Copyright (C) 2011 by Stinus Lindgreen - stinus@binf.ku.dk            *
+ * Copyright (C) 2014 by Mikkel Schubert - mikkelsch@gmail.com           *
+ *                                                                       *
+ * If you use the program, please cite the paper:                        *
+ * S. Lindgreen (2012): AdapterRemoval: Easy Cleaning of Next Generation *
+ * Sequencing Reads, BMC Research Notes, 5:337                           *
+ * http://www.biomedcentral.com/1756-0500/5/337/                         *
+ *                                                                       *
+ * This program is free software: you can redistribute it and/or modify  *
+ * it under the terms of the GNU General Public License as published by  *
+ * the Free Software Foundation, either version 3 of the License, or     *
+ * (at your option) any later version.                                   *
+ *                                                                       *
+ * This program is distributed in the hope that it will be useful,       *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ * GNU General Public License for more details.                          *
+ *                                                                       *
+ * You should have received a copy of the GNU General Public License     *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+\*************************************************************************/
+#include <functional>
+
+#include "alignment_cache.hpp"
+
+namespace ar
+{
+
+//! Expected number of bytes used to store the sequences of a single entry;
+//! used to determine the number of slots available for a given memory limit.
+const size_t EXPECTED_SEQUENCE_BYTES = 256;
+
+
+alignment_cache::entry::entry()
+  : hash(0)
+  , seq_1()
+  , seq_2()
+  , alignment()
+{
+}
+
+
+alignment_cache::alignment_cache(size_t max_bytes)
+  : m_entries()
+  , m_bytes_used(0)
+  , m_bytes_max(0)
+{
+    size_t n_slots = 1;
+    while (n_slots * 2 * (sizeof(entry) + EXPECTED_SEQUENCE_BYTES) <= max_bytes) {
+        n_slots *= 2;
+    }
+
+    m_entries.resize(n_slots);
+    if (max_bytes > n_slots * sizeof(entry)) {
+        m_bytes_max = max_bytes - n_slots * sizeof(entry);
+    }
+}
+
+
+bool alignment_cache::lookup(const std::string& seq_1,
+                             const std::string& seq_2,
+                             alignment_info& alignment)
+{
+    const size_t key = hash(seq_1, seq_2);
+    const entry& slot = m_entries.at(key & (m_entries.size() - 1));
+
+    if (slot.hash == key && slot.seq_1 == seq_1 && slot.seq_2 == seq_2
+        && (slot.seq_1.length() || slot.seq_2.length())) {
+        alignment = slot.alignment;
+
+        return true;
+    }
+
+    return false;
+}
+
+
+void alignment_cache::insert(const std::string& seq_1,
+                             const std::string& seq_2,
+                             const alignment_info& alignment)
+{
+    const size_t key = hash(seq_1, seq_2);
+    entry& slot = m_entries.at(key & (m_entries.size() - 1));
+
+    const size_t old_bytes = slot.seq_1.length() + slot.seq_2.length();
+    const size_t new_bytes = seq_1.length() + seq_2.length();
+    if (m_bytes_used - old_bytes + new_bytes > m_bytes_max) {
+        return;
+    }
+
+    m_bytes_used = m_bytes_used - old_bytes + new_bytes;
+
+    slot.hash = key;
+    slot.seq_1.assign(seq_1);
+    slot.seq_2.assign(seq_2);
+    slot.alignment = alignment;
+}
+
+
+size_t alignment_cache::hash(const std::string& seq_1,
+                             const std::string& seq_2) const
+{
+    const std::hash<std::string> hasher;
+    const size_t hash_1 = hasher(seq_1);
+
+    // Combine hashes as in boost::hash_combine
+    return hash_1 ^ (hasher(seq_2) + 0x9e3779b9 + (hash_1 << 6) + (hash_1 >> 2));
+}
+
+} // namespace ar
@@ -0,0 +1,105 @@
+/*************************************************************************\
+ * AdapterRemoval - cleaning next-generation sequencing reads            *
+ *                                                                       *
+ * Copyright (C) 2011 by Stinus Lindgreen - stinus@binf.ku.dk            *
+ * Copyright (C) 2014 by Mikkel Schubert - mikkelsch@gmail.com           *
+ *                                                                       *
+ * If you use the program, please cite the paper:                        *
+ * S. Lindgreen (2012): AdapterRemoval: Easy Cleaning of Next Generation *
+ * Sequencing Reads, BMC Research Notes, 5:337                           *
+ * http://www.biomedcentral.com/1756-0500/5/337/                         *
+ *                                                                       *
+ * This program is free software: you can redistribute it and/or modify  *
+ * it under the terms of the GNU General Public License as published by  *
+ * the Free Software Foundation, either version 3 of the License, or     *
+ * (at your option) any later version.                                   *
+ *                                                                       *
+ * This program is distributed in the hope that it will be useful,       *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ * GNU General Public License for more details.                          *
+ *                                                                       *
+ * You should have received a copy of the GNU General Public License     *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+\*************************************************************************/
+#ifndef ALIGNMENT_CACHE_H
+#define ALIGNMENT_CACHE_H
+
+#include <string>
+#include <vector>
+
+#include "alignment.hpp"
+
+namespace ar
+{
+
+/**
+ * Bounded cache of alignments, keyed by the sequence(s) that were aligned.
+ *
+ * The cache is direct-mapped: Each pair of sequences is hashed to a single
+ * slot, and a new entry simply replaces any previous entry in that slot. The
+ * full sequences are stored along with the alignment, so that hash collisions
+ * can never result in an incorrect alignment being returned.
+ *
+ * The cache is not thread-safe; one cache should be used per thread.
+ */
+class alignment_cache
+{
+public:
+    /**
+     * @param max_bytes Approximate upper bound on the memory used by the cache,
+     *                  including the table itself and the cached sequences.
+     */
+    explicit alignment_cache(size_t max_bytes);
+
+    /**
+     * Looks up the alignment of a (pair of) sequence(s).
+     *
+     * @param seq_1 The first (or only) sequence that was aligned.
+     * @param seq_2 The second sequence that was aligned; empty for SE reads.
+     * @param alignment Set to the cached alignment if found.
+     * @return True if the alignment was cached, false otherwise.
+     */
+    bool lookup(const std::string& seq_1,
+                const std::string& seq_2,
+                alignment_info& alignment);
+
+    /**
+     * Stores the alignment of a (pair of) sequence(s); this may replace a
+     * previously cached alignment. Entries are not cached if doing so would
+     * exceed the memory limit.
+     */
+    void insert(const std::string& seq_1,
+                const std::string& seq_2,
+                const alignment_info& alignment);
+
+    //! Copy construction not supported
+    alignment_cache(const alignment_cache&) = delete;
+    //! Assignment not supported
+    alignment_cache& operator=(const alignment_cache&) = delete;
+
+private:
+    struct entry {
+        entry();
+
+        //! Hash of seq_1 and seq_2, used to quickly reject mismatches.
+        size_t hash;
+        std::string seq_1;
+        std::string seq_2;
+        alignment_info alignment;
+    };
+
+    /** Returns a hash of the pair of sequences. */
+    size_t hash(const std::string& seq_1, const std::string& seq_2) const;
+
+    //! Slots in the direct-mapped cache; the size is a power of two.
+    std::vector<entry> m_entries;
+    //! Bytes used by sequences currently stored in the cache.
+    size_t m_bytes_used;
+    //! Maximum number of bytes available for sequences.
+    size_t m_bytes_max;
+};
+
+} // namespace ar
+
+#endif
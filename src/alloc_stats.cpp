@@ -0,0 +1,215 @@
+/*************************************************************************\
+ * AdapterRemoval - cleaning next-generation sequencing reads            *
+ *                                                                       *
+ * Copyright (C) 2011 by Stinus Lindgreen - stinus@binf.ku.dk            *
+ * Copyright (C) 2014 by Mikkel Schubert - mikkelsch@gmail.com           *
+ *                                                                       *
+ * If you use the program, please cite the paper:                        *
+ * S. Lindgreen (2012): AdapterRemoval: Easy Cleaning of Next Generation *
+ * Sequencing Reads, BMC Research Notes, 5:337                           *
+ * http://www.biomedcentral.com/1756-0500/5/337/                         *
+ *                                                                       *
+ * This program is free software: you can redistribute it and/or modify  *
+ * it under the terms of the GNU General Public License as published by  *
+ * the Free Software Foundation, either version 3 of the License, or     *
+ * (at your option) any later version.                                   *
+ *                                                                       *
+ * This program is distributed in the hope that it will be useful,       *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ * GNU General Public License for more details.                          *
+ *                                                                       *
+ * You should have received a copy of the GNU General Public License     *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+\*************************************************************************/
+#include "alloc_stats.hpp"
+
+#ifdef AR_ALLOC_STATS
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+namespace ar
+{
+
+/**
+ * Header prepended to every allocation, recording the size and the slot to
+ * which the allocation was attributed; padded to preserve the alignment
+ * guaranteed by malloc.
+ */
+struct alignas(16) alloc_header
+{
+    size_t size;
+    size_t slot;
+};
+
+
+/** Counters for a single slot; zero-initialized as they have static storage. */
+struct alloc_slot
+{
+    std::atomic<uint64_t> allocations;
+    std::atomic<uint64_t> bytes;
+    std::atomic<int64_t> live_bytes;
+    std::atomic<int64_t> peak_live_bytes;
+};
+
+
+static alloc_slot g_slots[ALLOC_SLOTS];
+//! Slot of the step currently executed by this thread; 0 if none
+static thread_local size_t g_current_slot = 0;
+
+
+size_t alloc_stats_set_slot(size_t slot)
+{
+    const size_t previous = g_current_slot;
+    g_current_slot = slot < ALLOC_SLOTS ? slot : ALLOC_SLOTS - 1;
+
+    return previous;
+}
+
+
+void alloc_stats_reset()
+{
+    for (auto& slot : g_slots) {
+        slot.allocations = 0;
+        slot.bytes = 0;
+        slot.peak_live_bytes = slot.live_bytes.load();
+    }
+}
+
+
+alloc_values alloc_stats_get(size_t slot)
+{
+    const alloc_slot& counters = g_slots[slot < ALLOC_SLOTS ? slot : ALLOC_SLOTS - 1];
+
+    alloc_values values;
+    values.allocations = counters.allocations;
+    values.bytes = counters.bytes;
+    values.peak_live_bytes = counters.peak_live_bytes;
+
+    return values;
+}
+
+
+void* counted_malloc(size_t size)
+{
+    alloc_header* header = static_cast<alloc_header*>(std::malloc(sizeof(alloc_header) + size));
+    if (!header) {
+        return nullptr;
+    }
+
+    header->size = size;
+    header->slot = g_current_slot;
+
+    alloc_slot& slot = g_slots[header->slot];
+    slot.allocations.fetch_add(1, std::memory_order_relaxed);
+    slot.bytes.fetch_add(size, std::memory_order_relaxed);
+
+    const int64_t live = slot.live_bytes.fetch_add(size, std::memory_order_relaxed) + size;
+    int64_t peak = slot.peak_live_bytes.load(std::memory_order_relaxed);
+    while (live > peak && !slot.peak_live_bytes.compare_exchange_weak(peak, live, std::memory_order_relaxed)) {
+    }
+
+    return header + 1;
+}
+
+
+void counted_free(void* ptr)
+{
+    if (ptr) {
+        alloc_header* header = static_cast<alloc_header*>(ptr) - 1;
+        g_slots[header->slot].live_bytes.fetch_sub(header->size, std::memory_order_relaxed);
+
+        std::free(header);
+    }
+}
+
+
+void* counted_new(size_t size)
+{
+    while (true) {
+        if (void* ptr = counted_malloc(size ? size : 1)) {
+            return ptr;
+        }
+
+        std::new_handler handler = std::get_new_handler();
+        if (!handler) {
+            throw std::bad_alloc();
+        }
+
+        handler();
+    }
+}
+
+} // namespace ar
+
+
+void* operator new(size_t size)
+{
+    return ar::counted_new(size);
+}
+
+
+void* operator new[](size_t size)
+{
+    return ar::counted_new(size);
+}
+
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept
+{
+    try {
+        return ar::counted_new(size);
+    } catch (const std::bad_alloc&) {
+        return nullptr;
+    }
+}
+
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept
+{
+    try {
+        return ar::counted_new(size);
+    } catch (const std::bad_alloc&) {
+        return nullptr;
+    }
+}
+
+
+void operator delete(void* ptr) noexcept
+{
+    ar::counted_free(ptr);
+}
+
+
+void operator delete[](void* ptr) noexcept
+{
+    ar::counted_free(ptr);
+}
+
+
+void operator delete(void* ptr, const std::nothrow_t&) noexcept
+{
+    ar::counted_free(ptr);
+}
+
+
+void operator delete[](void* ptr, const std::nothrow_t&) noexcept
+{
+    ar::counted_free(ptr);
+}
+
+
+void operator delete(void* ptr, size_t) noexcept
+{
+    ar::counted_free(ptr);
+}
+
+
+void operator delete[](void* ptr, size_t) noexcept
+{
+    ar::counted_free(ptr);
+}
+
+#endif
@@ -0,0 +1,83 @@
+/*************************************************************************\
+ * AdapterRemoval - cleaning next-generation sequencing reads            *
+ *                                                                       *
+ * Copyright (C) 2011 by Stinus Lindgreen - stinus@binf.ku.dk            *
+ * Copyright (C) 2014 by Mikkel Schubert - mikkelsch@gmail.com           *
+ *                                                                       *
+ * If you use the program, please cite the paper:                        *
+ * S. Lindgreen (2012): AdapterRemoval: Easy Cleaning of Next Generation *
+ * Sequencing Reads, BMC Research Notes, 5:337                           *
+ * http://www.biomedcentral.com/1756-0500/5/337/                         *
+ *                                                                       *
+ * This program is free software: you can redistribute it and/or modify  *
+ * it under the terms of the GNU General Public License as published by  *
+ * the Free Software Foundation, either version 3 of the License, or     *
+ * (at your option) any later version.                                   *
+ *                                                                       *
+ * This program is distributed in the hope that it will be useful,       *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ * GNU General Public License for more details.                          *
+ *                                                                       *
+ * You should have received a copy of the GNU General Public License     *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+\*************************************************************************/
+#ifndef ALLOC_STATS_H
+#define ALLOC_STATS_H
+
+#include <cstddef>
+#include <cstdint>
+
+namespace ar
+{
+
+//! Number of slots to which allocations may be attributed; slot 0 is used
+//! for allocations made outside of analytical steps, and slots greater than
+//! or equal to ALLOC_SLOTS - 1 share the last slot.
+const size_t ALLOC_SLOTS = 4096;
+
+
+/** Allocations attributed to a single slot; see 'alloc_stats_get'. */
+struct alloc_values
+{
+    //! Number of calls to operator new
+    uint64_t allocations;
+    //! Number of bytes requested from operator new
+    uint64_t bytes;
+    //! Maximum number of bytes allocated, and not yet freed, at any one time
+    int64_t peak_live_bytes;
+};
+
+
+#ifdef AR_ALLOC_STATS
+
+//! Allocation accounting is enabled in this build (ALLOC_STATS=yes)
+const bool ALLOC_STATS_ENABLED = true;
+
+/**
+ * Attributes allocations made by the calling thread to the given slot, until
+ * the slot is changed; returns the previous slot. Memory freed by any thread
+ * is attributed to the slot in which it was allocated.
+ */
+size_t alloc_stats_set_slot(size_t slot);
+
+/** Resets the number of allocations / bytes, and peak live bytes, for all slots. */
+void alloc_stats_reset();
+
+/** Returns the allocations attributed to a slot since the last reset. */
+alloc_values alloc_stats_get(size_t slot);
+
+#else
+
+//! Allocation accounting is enabled in this build (ALLOC_STATS=yes)
+const bool ALLOC_STATS_ENABLED = false;
+
+inline size_t alloc_stats_set_slot(size_t) { return 0; }
+inline void alloc_stats_reset() { }
+inline alloc_values alloc_stats_get(size_t) { return alloc_values(); }
+
+#endif
+
+} // namespace ar
+
+#endif
@@ -0,0 +1,257 @@
+/*************************************************************************\
+ * AdapterRemoval - cleaning next-generation sequencing reads            *
+ *                                                                       *
+ * Copyright (C) 2011 by Stinus Lindgreen - stinus@binf.ku.dk            *
+ * Copyright (C) 2014 by Mikkel Schubert - mikkelsch@gmail.com           *
+ *                                                                       *
+ * If you use the program, please cite the paper:                        *
+ * S. Lindgreen (2012): AdapterRemoval: Easy Cleaning of Next Generation *
+ * Sequencing Reads, BMC Research Notes, 5:337                           *
+ * http://www.biomedcentral.com/1756-0500/5/337/                         *
+ *                                                                       *
+ * This program is free software: you can redistribute it and/or modify  *
+ * it under the terms of the GNU General Public License as published by  *
+ * the Free Software Foundation, either version 3 of the License, or     *
+ * (at your option) any later version.                                   *
+ *                                                                       *
+ * This program is distributed in the hope that it will be useful,       *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ * GNU General Public License for more details.                          *
+ *                                                                       *
+ * You should have received a copy of the GNU General Public License     *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+\*************************************************************************/
+#include <limits>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define AR_HAMMING_AVX2
+#include <immintrin.h>
+#endif
+
+#include "barcode_hamming.hpp"
+#include "barcode_table.hpp"
+#include "debug.hpp"
+
+namespace ar
+{
+
+//! Mask selecting the lower bit of each packed nucleotide
+const uint64_t EVEN_BITS = 0x5555555555555555ull;
+
+
+/**
+ * Packs a nucleotide sequence into 64 bit words (32 nucleotides per word),
+ * setting the lower bit of each nucleotide in 'n_mask' for Ns. Words are
+ * expected to be zero-initialized.
+ */
+void pack_words(const char* seq, size_t length, uint64_t* words, uint64_t* n_mask)
+{
+    for (size_t i = 0; i < length; ++i) {
+        const size_t shift = 2 * (i % 32);
+
+        words[i / 32] |= static_cast<uint64_t>(ACGT_TO_IDX(seq[i])) << shift;
+        if (seq[i] == 'N') {
+            n_mask[i / 32] |= uint64_t(1) << shift;
+        }
+    }
+}
+
+
+#if defined(AR_HAMMING_AVX2)
+/**
+ * Sums distances for words [first, last) of 4 barcodes using AVX2; 'words'
+ * points to the first of the barcodes in word 0, and words are 'stride' apart.
+ * Only called if barcode_hamming::supports_avx2() returns true.
+ */
+__attribute__((target("avx2")))
+void count_mismatches_avx2(const uint64_t* words, size_t stride,
+                           const uint64_t* read, const uint64_t* n_mask,
+                           size_t first, size_t last, uint64_t* distances)
+{
+    const __m256i even_bits = _mm256_set1_epi64x(EVEN_BITS);
+    const __m256i low_nibbles = _mm256_set1_epi8(0x0f);
+    // Number of bits set in each possible nibble
+    const __m256i nibble_counts = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3,
+                                                   1, 2, 2, 3, 2, 3, 3, 4,
+                                                   0, 1, 1, 2, 1, 2, 2, 3,
+                                                   1, 2, 2, 3, 2, 3, 3, 4);
+
+    __m256i sums = _mm256_setzero_si256();
+    for (size_t word = first; word < last; ++word) {
+        const __m256i* ptr = reinterpret_cast<const __m256i*>(words + word * stride);
+
+        __m256i diff = _mm256_xor_si256(_mm256_loadu_si256(ptr), _mm256_set1_epi64x(read[word]));
+        diff = _mm256_and_si256(_mm256_or_si256(diff, _mm256_srli_epi64(diff, 1)), even_bits);
+        diff = _mm256_or_si256(diff, _mm256_set1_epi64x(n_mask[word]));
+
+        const __m256i lo = _mm256_and_si256(diff, low_nibbles);
+        const __m256i hi = _mm256_and_si256(_mm256_srli_epi16(diff, 4), low_nibbles);
+        const __m256i counts = _mm256_add_epi8(_mm256_shuffle_epi8(nibble_counts, lo),
+                                               _mm256_shuffle_epi8(nibble_counts, hi));
+
+        // Horizontal sum of the byte-counts in each 64 bit lane
+        sums = _mm256_add_epi64(sums, _mm256_sad_epu8(counts, _mm256_setzero_si256()));
+    }
+
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(distances), sums);
+}
+#endif
+
+
+///////////////////////////////////////////////////////////////////////////////
+
+const size_t barcode_hamming::MAX_LENGTH;
+const size_t barcode_hamming::LANES;
+
+
+barcode_hamming::barcode_hamming()
+    : m_words()
+    , m_barcodes()
+    , m_stride()
+    , m_max_mismatches()
+    , m_max_mismatches_r1()
+    , m_max_mismatches_r2()
+    , m_barcode_1_len()
+    , m_barcode_2_len()
+    , m_words_1()
+    , m_words_2()
+    , m_avx2()
+{
+}
+
+
+barcode_hamming::barcode_hamming(const fastq_pair_vec& barcodes,
+                                 size_t max_mm,
+                                 size_t max_mm_r1,
+                                 size_t max_mm_r2,
+                                 bool allow_avx2)
+    : barcode_hamming()
+{
+    if (barcodes.empty()) {
+        return;
+    }
+
+    m_avx2 = allow_avx2 && supports_avx2();
+
+    m_barcodes = barcodes.size();
+    m_stride = (m_barcodes + LANES - 1) / LANES * LANES;
+    m_max_mismatches = max_mm;
+    m_max_mismatches_r1 = max_mm_r1;
+    m_max_mismatches_r2 = max_mm_r2;
+    m_barcode_1_len = barcodes.front().first.length();
+    m_barcode_2_len = barcodes.front().second.length();
+    m_words_1 = (m_barcode_1_len + 31) / 32;
+    m_words_2 = (m_barcode_2_len + 31) / 32;
+
+    AR_DEBUG_ASSERT(m_barcode_1_len <= MAX_LENGTH);
+    AR_DEBUG_ASSERT(m_barcode_2_len <= MAX_LENGTH);
+
+    m_words.resize((m_words_1 + m_words_2) * m_stride);
+    for (size_t barcode = 0; barcode < m_barcodes; ++barcode) {
+        const fastq_pair& pair = barcodes.at(barcode);
+
+        word_array words = word_array();
+        word_array n_mask = word_array();
+        pack_words(pair.first.sequence().c_str(), m_barcode_1_len,
+                   words.data(), n_mask.data());
+        pack_words(pair.second.sequence().c_str(), m_barcode_2_len,
+                   words.data() + m_words_1, n_mask.data() + m_words_1);
+
+        for (size_t word = 0; word < m_words_1 + m_words_2; ++word) {
+            m_words.at(word * m_stride + barcode) = words.at(word);
+        }
+    }
+}
+
+
+bool barcode_hamming::lookup(const char* seq_1, const char* seq_2, int& barcode) const
+{
+    if (!m_barcodes) {
+        return false;
+    }
+
+    word_array read = word_array();
+    word_array n_mask = word_array();
+    pack_words(seq_1, m_barcode_1_len, read.data(), n_mask.data());
+    if (seq_2) {
+        pack_words(seq_2, m_barcode_2_len, read.data() + m_words_1, n_mask.data() + m_words_1);
+    }
+
+    int best_barcode = barcode_table::no_match;
+    size_t best_mismatches = std::numeric_limits<size_t>::max();
+
+    lane_array mismatches_1;
+    lane_array mismatches_2;
+    mismatches_2.fill(0);
+
+    for (size_t offset = 0; offset < m_barcodes; offset += LANES) {
+        count_mismatches(read, n_mask, 0, m_words_1, offset, mismatches_1);
+        if (seq_2) {
+            count_mismatches(read, n_mask, m_words_1, m_words_1 + m_words_2, offset, mismatches_2);
+        }
+
+        for (size_t lane = 0; lane < LANES && offset + lane < m_barcodes; ++lane) {
+            const size_t mismatches = mismatches_1[lane] + mismatches_2[lane];
+
+            if (mismatches_1[lane] <= m_max_mismatches_r1 &&
+                mismatches_2[lane] <= m_max_mismatches_r2 &&
+                mismatches <= m_max_mismatches) {
+                if (mismatches < best_mismatches) {
+                    best_barcode = offset + lane;
+                    best_mismatches = mismatches;
+                } else if (mismatches == best_mismatches) {
+                    best_barcode = barcode_table::ambigious;
+                }
+            }
+        }
+    }
+
+    barcode = best_barcode;
+
+    return true;
+}
+
+
+bool barcode_hamming::supports_avx2()
+{
+#if defined(AR_HAMMING_AVX2)
+    static const bool supported = __builtin_cpu_supports("avx2");
+
+    return supported;
+#else
+    return false;
+#endif
+}
+
+
+void barcode_hamming::count_mismatches(const word_array& read,
+                                       const word_array& n_mask,
+                                       size_t first,
+                                       size_t last,
+                                       size_t offset,
+                                       lane_array& distances) const
+{
+#if defined(AR_HAMMING_AVX2)
+    static_assert(LANES * 64 == 256, "LANES must match AVX2 register size");
+
+    if (m_avx2) {
+        count_mismatches_avx2(m_words.data() + offset, m_stride, read.data(),
+                              n_mask.data(), first, last, distances.data());
+        return;
+    }
+#endif
+
+    distances.fill(0);
+    for (size_t word = first; word < last; ++word) {
+        const uint64_t* words = m_words.data() + word * m_stride + offset;
+
+        for (size_t lane = 0; lane < LANES; ++lane) {
+            const uint64_t diff = words[lane] ^ read[word];
+
+            distances[lane] += __builtin_popcountll(((diff | (diff >> 1)) & EVEN_BITS) | n_mask[word]);
+        }
+    }
+}
+
+} // namespace ar
@@ -0,0 +1,121 @@
+/*************************************************************************\
+ * AdapterRemoval - cleaning next-generation sequencing reads            *
+ *                                                                       *
+ * Copyright (C) 2011 by Stinus Lindgreen - stinus@binf.ku.dk            *
+ * Copyright (C) 2014 by Mikkel Schubert - mikkelsch@gmail.com           *
+ *                                                                       *
+ * If you use the program, please cite the paper:                        *
+ * S. Lindgreen (2012): AdapterRemoval: Easy Cleaning of Next Generation *
+ * Sequencing Reads, BMC Research Notes, 5:337                           *
+ * http://www.biomedcentral.com/1756-0500/5/337/                         *
+ *                                                                       *
+ * This program is free software: you can redistribute it and/or modify  *
+ * it under the terms of the GNU General Public License as published by  *
+ * the Free Software Foundation, either version 3 of the License, or     *
+ * (at your option) any later version.                                   *
+ *                                                                       *
+ * This program is distributed in the hope that it will be useful,       *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ * GNU General Public License for more details.                          *
+ *                                                                       *
+ * You should have received a copy of the GNU General Public License     *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+\*************************************************************************/
+#ifndef BARCODE_HAMMING_H
+#define BARCODE_HAMMING_H
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+#include "fastq.hpp"
+
+namespace ar
+{
+
+/**
+ * Identifies barcodes (pairs) by computing the Hamming distance from a read to
+ * every barcode; used for panels where a barcode_neighbourhood table would be
+ * too large.
+ *
+ * Barcodes are packed using 2 bits per nucleotide and stored in a
+ * structure-of-arrays layout, such that the distances to several barcodes can
+ * be calculated at once using XOR / popcount. AVX2 instructions are used if
+ * supported by the CPU, as determined at runtime. Ns in reads count as
+ * mismatches, and ties between the best barcodes result in ambigious,
+ * matching the results obtained by searching the quad-tree in barcode_table.
+ */
+class barcode_hamming
+{
+public:
+    /** Creates empty engine; lookups always fail. */
+    barcode_hamming();
+
+    /**
+     * Builds engine for barcodes that have been validated by barcode_table;
+     * barcodes must be no longer than MAX_LENGTH. If 'allow_avx2' is false,
+     * AVX2 instructions are not used even if supported by the CPU.
+     */
+    barcode_hamming(const fastq_pair_vec& barcodes,
+                    size_t max_mm,
+                    size_t max_mm_r1,
+                    size_t max_mm_r2,
+                    bool allow_avx2 = true);
+
+    /**
+     * Identifies the barcode (pair) matching the start of the given
+     * sequences, which must be at least as long as the barcodes. If 'seq_2'
+     * is nullptr, only mate 1 barcodes are considered. Returns false if the
+     * engine is empty, in which case 'barcode' is not modified.
+     */
+    bool lookup(const char* seq_1, const char* seq_2, int& barcode) const;
+
+    /** Returns true if the CPU (and the compiler) supports AVX2. */
+    static bool supports_avx2();
+
+    //! Maximum length of mate 1 and of mate 2 barcodes.
+    static const size_t MAX_LENGTH = 256;
+
+    //! Number of barcodes processed together.
+    static const size_t LANES = 4;
+
+private:
+    //! Maximum number of 64 bit words per barcode
+    static const size_t MAX_WORDS = 2 * MAX_LENGTH / 32;
+
+    typedef std::array<uint64_t, MAX_WORDS> word_array;
+    typedef std::array<uint64_t, LANES> lane_array;
+
+    /** Sums distances for words [first, last) of barcodes [offset, offset + LANES). */
+    void count_mismatches(const word_array& read, const word_array& n_mask,
+                          size_t first, size_t last, size_t offset,
+                          lane_array& distances) const;
+
+    //! Packed barcodes; word w of barcode b is found at w * m_stride + b
+    std::vector<uint64_t> m_words;
+    //! Number of barcodes
+    size_t m_barcodes;
+    //! Number of barcodes, rounded up to a multiple of LANES
+    size_t m_stride;
+    //! Maximum number of mismatches (considering both barcodes)
+    size_t m_max_mismatches;
+    //! Maximum number of mismatches in mate 1 barcodes
+    size_t m_max_mismatches_r1;
+    //! Maximum number of mismatches in mate 2 barcodes
+    size_t m_max_mismatches_r2;
+    //! Length of mate 1 barcodes
+    size_t m_barcode_1_len;
+    //! Length of mate 2 barcodes
+    size_t m_barcode_2_len;
+    //! Number of words used for mate 1 barcodes
+    size_t m_words_1;
+    //! Number of words used for mate 2 barcodes
+    size_t m_words_2;
+    //! Distances are calculated using AVX2 instructions
+    bool m_avx2;
+};
+
+} // namespace ar
+
+#endif
@@ -0,0 +1,266 @@
+/*************************************************************************\
+ * AdapterRemoval - cleaning next-generation sequencing reads            *
+ *                                                                       *
+ * Copyright (C) 2011 by Stinus Lindgreen - stinus@binf.ku.dk            *
+ * Copyright (C) 2014 by Mikkel Schubert - mikkelsch@gmail.com           *
+ *                                                                       *
+ * If you use the program, please cite the paper:                        *
+ * S. Lindgreen (2012): AdapterRemoval: Easy Cleaning of Next Generation *
+ * Sequencing Reads, BMC Research Notes, 5:337                           *
+ * http://www.biomedcentral.com/1756-0500/5/337/                         *
+ *                                                                       *
+ * This program is free software: you can redistribute it and/or modify  *
+ * it under the terms of the GNU General Public License as published by  *
+ * the Free Software Foundation, either version 3 of the License, or     *
+ * (at your option) any later version.                                   *
+ *                                                                       *
+ * This program is distributed in the hope that it will be useful,       *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ * GNU General Public License for more details.                          *
+ *                                                                       *
+ * You should have received a copy of the GNU General Public License     *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+\*************************************************************************/
+#include <cmath>
+#include <limits>
+
+#include "barcode_neighbourhood.hpp"
+#include "barcode_table.hpp"
+#include "debug.hpp"
+
+namespace ar
+{
+
+//! Multiplier used for multiply-shift hashing of packed sequences
+const uint64_t HASH_MULTIPLIER = 0x9E3779B97F4A7C15ull;
+//! Minimum number of bits used to index the hash table
+const size_t MIN_TABLE_BITS = 4;
+//! Maximum number of bits used to index the hash table
+const size_t MAX_TABLE_BITS = 40;
+
+
+/** Packs a nucleotide sequence into 'key'; returns false if it contains Ns. */
+bool pack_sequence(const char* seq, size_t length, uint64_t& key)
+{
+    for (size_t i = 0; i < length; ++i) {
+        const char nt = seq[i];
+        if (nt == 'N') {
+            return false;
+        }
+
+        key = (key << 2) | ACGT_TO_IDX(nt);
+    }
+
+    return true;
+}
+
+
+/** Returns the number of sequences with exactly n mismatches to a sequence. */
+double count_variants(size_t length, size_t mismatches)
+{
+    double count = 1;
+    for (size_t i = 0; i < mismatches; ++i) {
+        count = count * 3 * (length - i) / (i + 1);
+    }
+
+    return count;
+}
+
+
+/** Returns the number of sequences in the neighbourhood of a barcode pair. */
+double count_neighbourhood(size_t len_1, size_t len_2, size_t max_mm,
+                           size_t max_mm_r1, size_t max_mm_r2)
+{
+    double count = 0;
+    for (size_t mm_1 = 0; mm_1 <= std::min(len_1, max_mm_r1); ++mm_1) {
+        for (size_t mm_2 = 0; mm_2 <= std::min(len_2, max_mm_r2); ++mm_2) {
+            if (mm_1 + mm_2 <= max_mm) {
+                count += count_variants(len_1, mm_1) * count_variants(len_2, mm_2);
+            }
+        }
+    }
+
+    return count;
+}
+
+
+/**
+ * Returns the number of bits needed to index a table with a load-factor of at
+ * most 0.5, or a value greater than MAX_TABLE_BITS if the table is too large.
+ */
+size_t count_table_bits(double n_entries)
+{
+    size_t bits = MIN_TABLE_BITS;
+    while (bits <= MAX_TABLE_BITS && std::ldexp(1.0, bits) < 2 * n_entries) {
+        ++bits;
+    }
+
+    return bits;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+
+barcode_neighbourhood::barcode_neighbourhood()
+    : m_keys()
+    , m_values()
+    , m_bits()
+    , m_max_mismatches()
+    , m_max_mismatches_r1()
+    , m_max_mismatches_r2()
+    , m_barcode_1_len()
+    , m_barcode_2_len()
+{
+}
+
+
+barcode_neighbourhood::barcode_neighbourhood(const fastq_pair_vec& barcodes,
+                                             size_t max_mm,
+                                             size_t max_mm_r1,
+                                             size_t max_mm_r2)
+    : barcode_neighbourhood()
+{
+    if (barcodes.empty()) {
+        return;
+    }
+
+    m_max_mismatches = max_mm;
+    m_max_mismatches_r1 = max_mm_r1;
+    m_max_mismatches_r2 = max_mm_r2;
+    m_barcode_1_len = barcodes.front().first.length();
+    m_barcode_2_len = barcodes.front().second.length();
+    AR_DEBUG_ASSERT(m_barcode_1_len + m_barcode_2_len <= MAX_LENGTH);
+
+    const double n_entries = barcodes.size() * count_neighbourhood(
+        m_barcode_1_len, m_barcode_2_len, max_mm, max_mm_r1, max_mm_r2);
+    m_bits = count_table_bits(n_entries);
+    AR_DEBUG_ASSERT(m_bits <= MAX_TABLE_BITS);
+
+    m_keys.resize(size_t(1) << m_bits);
+    m_values.resize(size_t(1) << m_bits, barcode_table::no_match);
+    // Number of mismatches for each entry; only needed during construction
+    std::vector<uint8_t> mismatches(m_values.size());
+
+    for (size_t barcode = 0; barcode < barcodes.size(); ++barcode) {
+        const fastq_pair& pair = barcodes.at(barcode);
+
+        uint64_t key = 0;
+        if (!pack_sequence(pair.first.sequence().c_str(), m_barcode_1_len, key) ||
+            !pack_sequence(pair.second.sequence().c_str(), m_barcode_2_len, key)) {
+            // Barcodes containing Ns are left to the quad-tree
+            *this = barcode_neighbourhood();
+            return;
+        }
+
+        insert(key, barcode, 0, mismatches);
+        add_neighbours(key, 0, 0, 0, barcode, mismatches);
+    }
+}
+
+
+bool barcode_neighbourhood::lookup(const char* seq_1, const char* seq_2, int& barcode) const
+{
+    if (m_values.empty()) {
+        return false;
+    }
+
+    uint64_t key = 0;
+    if (!pack_sequence(seq_1, m_barcode_1_len, key) ||
+        !pack_sequence(seq_2, m_barcode_2_len, key)) {
+        return false;
+    }
+
+    const size_t mask = m_values.size() - 1;
+    for (size_t idx = slot(key); ; idx = (idx + 1) & mask) {
+        const int value = m_values[idx];
+        if (value == barcode_table::no_match || m_keys[idx] == key) {
+            barcode = value;
+            return true;
+        }
+    }
+}
+
+
+size_t barcode_neighbourhood::estimate_size(const fastq_pair_vec& barcodes,
+                                            size_t max_mm,
+                                            size_t max_mm_r1,
+                                            size_t max_mm_r2)
+{
+    if (barcodes.empty()) {
+        return 0;
+    }
+
+    const size_t len_1 = barcodes.front().first.length();
+    const size_t len_2 = barcodes.front().second.length();
+    if (len_1 + len_2 > MAX_LENGTH) {
+        return std::numeric_limits<size_t>::max();
+    }
+
+    const double n_entries = barcodes.size() * count_neighbourhood(
+        len_1, len_2, max_mm, max_mm_r1, max_mm_r2);
+    const size_t bits = count_table_bits(n_entries);
+    if (bits > MAX_TABLE_BITS) {
+        return std::numeric_limits<size_t>::max();
+    }
+
+    return (size_t(1) << bits) * (sizeof(uint64_t) + sizeof(int) + sizeof(uint8_t));
+}
+
+
+void barcode_neighbourhood::add_neighbours(uint64_t key, size_t pos,
+                                           size_t mm_r1, size_t mm_r2,
+                                           int barcode,
+                                           std::vector<uint8_t>& mismatches)
+{
+    const size_t length = m_barcode_1_len + m_barcode_2_len;
+    for (; pos < length; ++pos) {
+        const bool is_mate_1 = pos < m_barcode_1_len;
+        const size_t next_mm_r1 = mm_r1 + is_mate_1;
+        const size_t next_mm_r2 = mm_r2 + !is_mate_1;
+
+        if (next_mm_r1 > m_max_mismatches_r1 ||
+            next_mm_r2 > m_max_mismatches_r2 ||
+            next_mm_r1 + next_mm_r2 > m_max_mismatches) {
+            continue;
+        }
+
+        // Each of the 3 other nucleotides at this position
+        const size_t shift = 2 * (length - pos - 1);
+        for (uint64_t nt = 1; nt < 4; ++nt) {
+            const uint64_t neighbour = key ^ (nt << shift);
+
+            insert(neighbour, barcode, next_mm_r1 + next_mm_r2, mismatches);
+            add_neighbours(neighbour, pos + 1, next_mm_r1, next_mm_r2, barcode, mismatches);
+        }
+    }
+}
+
+
+void barcode_neighbourhood::insert(uint64_t key, int barcode, size_t n_mismatches,
+                                   std::vector<uint8_t>& mismatches)
+{
+    const size_t mask = m_values.size() - 1;
+
+    size_t idx = slot(key);
+    while (m_values[idx] != barcode_table::no_match && m_keys[idx] != key) {
+        idx = (idx + 1) & mask;
+    }
+
+    if (m_values[idx] == barcode_table::no_match || n_mismatches < mismatches[idx]) {
+        m_keys[idx] = key;
+        m_values[idx] = barcode;
+        mismatches[idx] = n_mismatches;
+    } else if (n_mismatches == mismatches[idx]) {
+        // Equally good hits for two or more barcodes
+        m_values[idx] = barcode_table::ambigious;
+    }
+}
+
+
+size_t barcode_neighbourhood::slot(uint64_t key) const
+{
+    return (key * HASH_MULTIPLIER) >> (64 - m_bits);
+}
+
+} // namespace ar
@@ -0,0 +1,114 @@
+/*************************************************************************\
+ * AdapterRemoval - cleaning next-generation sequencing reads            *
+ *                                                                       *
+ * Copyright (C) 2011 by Stinus Lindgreen - stinus@binf.ku.dk            *
+ * Copyright (C) 2014 by Mikkel Schubert - mikkelsch@gmail.com           *
+ *                                                                       *
+ * If you use the program, please cite the paper:                        *
+ * S. Lindgreen (2012): AdapterRemoval: Easy Cleaning of Next Generation *
+ * Sequencing Reads, BMC Research Notes, 5:337                           *
+ * http://www.biomedcentral.com/1756-0500/5/337/                         *
+ *                                                                       *
+ * This program is free software: you can redistribute it and/or modify  *
+ * it under the terms of the GNU General Public License as published by  *
+ * the Free Software Foundation, either version 3 of the License, or     *
+ * (at your option) any later version.                                   *
+ *                                                                       *
+ * This program is distributed in the hope that it will be useful,       *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ * GNU General Public License for more details.                          *
+ *                                                                       *
+ * You should have received a copy of the GNU General Public License     *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+\*************************************************************************/
+#ifndef BARCODE_NEIGHBOURHOOD_H
+#define BARCODE_NEIGHBOURHOOD_H
+
+#include <cstdint>
+#include <vector>
+
+#include "fastq.hpp"
+
+namespace ar
+{
+
+/**
+ * Precomputed table of all sequences within a given number of mismatches of
+ * a set of barcodes (pairs), used to identify barcodes with a single lookup.
+ *
+ * Barcodes are packed into 64 bit integers using 2 bits per nucleotide, and
+ * stored in an open-addressing hash table using linear probing. Each entry
+ * maps to the barcode with the fewest mismatches, or to ambigious if two or
+ * more barcodes are equally close, matching the results obtained by searching
+ * the quad-tree in barcode_table. Reads containing Ns cannot be packed, and
+ * must be identified using other means.
+ */
+class barcode_neighbourhood
+{
+public:
+    /** Creates empty table; lookups always fail. */
+    barcode_neighbourhood();
+
+    /**
+     * Builds table for barcodes that have been validated by barcode_table;
+     * the combined length of barcode pairs must not exceed MAX_LENGTH.
+     */
+    barcode_neighbourhood(const fastq_pair_vec& barcodes,
+                          size_t max_mm,
+                          size_t max_mm_r1,
+                          size_t max_mm_r2);
+
+    /**
+     * Looks up the barcode (pair) matching the start of the given sequences,
+     * which must be at least as long as the barcodes. The second sequence is
+     * ignored for single-indexed barcodes. Returns false if the sequences
+     * could not be looked up, in which case 'barcode' is not modified.
+     */
+    bool lookup(const char* seq_1, const char* seq_2, int& barcode) const;
+
+    /** Returns the (estimated) number of bytes used by a table. */
+    static size_t estimate_size(const fastq_pair_vec& barcodes,
+                                size_t max_mm,
+                                size_t max_mm_r1,
+                                size_t max_mm_r2);
+
+    //! Maximum combined length of barcode (pairs) that can be packed.
+    static const size_t MAX_LENGTH = 32;
+
+private:
+    /**
+     * Adds all sequences with additional mismatches after position 'pos' to
+     * the table, given 'mm_r1' and 'mm_r2' mismatches in the current key.
+     */
+    void add_neighbours(uint64_t key, size_t pos, size_t mm_r1, size_t mm_r2,
+                        int barcode, std::vector<uint8_t>& mismatches);
+
+    /** Adds key to table, if better than any existing entry. */
+    void insert(uint64_t key, int barcode, size_t n_mismatches,
+                std::vector<uint8_t>& mismatches);
+
+    /** Returns the initial slot for a given key. */
+    size_t slot(uint64_t key) const;
+
+    //! Packed sequences; slots are empty if the value is no_match
+    std::vector<uint64_t> m_keys;
+    //! Barcode ID or ambigious for each slot
+    std::vector<int> m_values;
+    //! Number of bits used to index the table
+    size_t m_bits;
+    //! Maximum number of mismatches (considering both barcodes)
+    size_t m_max_mismatches;
+    //! Maximum number of mismatches in mate 1 barcodes
+    size_t m_max_mismatches_r1;
+    //! Maximum number of mismatches in mate 2 barcodes
+    size_t m_max_mismatches_r2;
+    //! Length of mate 1 barcodes
+    size_t m_barcode_1_len;
+    //! Length of mate 2 barcodes
+    size_t m_barcode_2_len;
+};
+
+} // namespace ar
+
+#endif
@@ -23,7 +23,9 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>. *
 \*************************************************************************/
 #include <algorithm>
+#include <deque>
 #include <iostream>
+#include <limits>
 
 #include "barcode_table.hpp"
 #include "commontypes.hpp"
@@ -38,6 +40,48 @@ namespace ar
 typedef std::pair<std::string, size_t> barcode_pair;
 typedef std::vector<barcode_pair> barcode_vec;
 
+//! Maximum size of neighbourhood tables built automatically (in bytes)
+const size_t MAX_NEIGHBOURHOOD_SIZE = 128 * 1024 * 1024;
+//! Cost of comparing a 64 bit word of a read with one barcode, relative to
+//! the (estimated) quad-tree nodes visited per read; based on
+//! barcode_table_bench, in which most reads match a barcode exactly
+const double HAMMING_WORD_COST_AVX2 = 12.0;
+const double HAMMING_WORD_COST_SCALAR = 32.0;
+
+
+/**
+ * Estimates the number of quad-tree nodes visited per lookup. Mismatches
+ * only cause branching in the first levels of the tree, which are (nearly)
+ * saturated, after which the remainder of each branch is walked.
+ */
+double estimate_trie_cost(size_t n_barcodes, size_t length, size_t max_mm)
+{
+    size_t saturated_depth = 0;
+    for (double nodes = 1; nodes < n_barcodes && saturated_depth < length; nodes *= 4) {
+        ++saturated_depth;
+    }
+
+    double branches = 0;
+    double combinations = 1;
+    for (size_t mm = 0; mm <= std::min(max_mm, saturated_depth); ++mm) {
+        branches += combinations;
+        combinations *= 3.0 * (saturated_depth - mm) / (mm + 1);
+    }
+
+    return branches * length;
+}
+
+
+/** Estimates the cost per lookup using barcode_hamming; see above. */
+double estimate_hamming_cost(size_t n_barcodes, size_t len_1, size_t len_2)
+{
+    const size_t words = (len_1 + 31) / 32 + (len_2 + 31) / 32;
+    const double word_cost = barcode_hamming::supports_avx2()
+        ? HAMMING_WORD_COST_AVX2 : HAMMING_WORD_COST_SCALAR;
+
+    return n_barcodes * words * word_cost;
+}
+
 
 struct next_subsequence {
     explicit next_subsequence(const char* seq_,
@@ -90,6 +134,61 @@ demultiplexer_node::demultiplexer_node()
 }
 
 
+///////////////////////////////////////////////////////////////////////////////
+
+demux_tree::demux_tree()
+    : m_children_16(4, 0)
+    , m_children_32()
+    , m_values(1, barcode_table::no_match)
+{
+}
+
+
+demux_tree::demux_tree(const demux_node_vec& nodes)
+    : m_children_16()
+    , m_children_32()
+    , m_values()
+{
+    AR_DEBUG_ASSERT(!nodes.empty());
+    const bool wide = nodes.size() > std::numeric_limits<uint16_t>::max();
+
+    // Breadth-first traversal; since children are queued in the order that
+    // indices are assigned, the new index of a node equals its queue order
+    std::deque<size_t> queue(1, 0);
+    uint32_t next_index = 1;
+
+    while (!queue.empty()) {
+        const auto& node = nodes.at(queue.front());
+        queue.pop_front();
+
+        m_values.push_back(node.value);
+        for (const auto child : node.children) {
+            uint32_t new_index = 0;
+            if (child != barcode_table::no_match) {
+                new_index = next_index++;
+                queue.push_back(child);
+            }
+
+            if (wide) {
+                m_children_32.push_back(new_index);
+            } else {
+                m_children_16.push_back(new_index);
+            }
+        }
+    }
+
+    AR_DEBUG_ASSERT(m_values.size() == nodes.size());
+}
+
+
+size_t demux_tree::size() const
+{
+    return m_values.size();
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+
 barcode_table::candidate::candidate(int barcode_, size_t mismatches_)
     : barcode(barcode_)
     , mismatches(mismatches_)
@@ -150,10 +249,8 @@ void add_sequence_to_tree(demux_node_vec& tree, const std::string& sequence,
 
         added_last_node = (child == barcode_table::no_match);
         if (added_last_node) {
-            // New nodes are added to the end of the list; as barcodes are
-            // added in lexicographic order, this helps ensure that a set of
-            // similar barcodes will be placed in mostly contiguous runs
-            // of the vector representation.
+            // New nodes are added to the end of the list; nodes are later
+            // re-ordered breadth-first when converted to a demux_tree.
             child = node.children[nuc_idx] = tree.size();
             tree.push_back(demultiplexer_node());
         }
@@ -171,11 +268,11 @@ void add_sequence_to_tree(demux_node_vec& tree, const std::string& sequence,
 
 
 /**
- * Builds a sparse quad tree using the first sequence in a set of unique
+ * Builds a compact quad tree using the first sequence in a set of unique
  * barcodes pairs; duplicate pairs will negatively impact the identification of
  * these, since all hits will be considered ambiguous.
  */
-demux_node_vec build_demux_tree(const fastq_pair_vec& barcodes)
+demux_tree build_demux_tree(const fastq_pair_vec& barcodes)
 {
     // Step 1: Construct list of merged, sorted barcodes barcodes;
     //         this allows construction of the sparse tree in one pass.
@@ -191,7 +288,8 @@ demux_node_vec build_demux_tree(const fastq_pair_vec& barcodes)
         add_sequence_to_tree(tree, pair.first, pair.second);
     }
 
-    return tree;
+    // Step 4: Convert to a compact tree in breadth-first order
+    return demux_tree(tree);
 }
 
 
@@ -202,13 +300,17 @@ const int barcode_table::ambigious;
 
 
 barcode_table::barcode_table(const fastq_pair_vec& barcodes, size_t mismatches,
-                             size_t mm_r1, size_t mm_r2)
+                             size_t mm_r1, size_t mm_r2,
+                             barcode_strategy strategy)
     : m_nodes()
+    , m_neighbourhood()
+    , m_hamming()
     , m_max_mismatches()
     , m_max_mismatches_r1()
     , m_max_mismatches_r2()
     , m_barcode_1_len()
     , m_barcode_2_len()
+    , m_strategy(barcode_strategy::trie)
 {
     m_max_mismatches = std::min<size_t>(mismatches, mm_r1 + mm_r2);
     m_max_mismatches_r1 = std::min<size_t>(m_max_mismatches, mm_r1);
@@ -218,16 +320,59 @@ barcode_table::barcode_table(const fastq_pair_vec& barcodes, size_t mismatches,
         m_nodes = build_demux_tree(barcodes);
         m_barcode_1_len = barcodes.front().first.length();
         m_barcode_2_len = barcodes.front().second.length();
+
+        const size_t size = barcode_neighbourhood::estimate_size(
+            barcodes, m_max_mismatches, m_max_mismatches_r1, m_max_mismatches_r2);
+
+        const bool fits_neighbourhood = m_barcode_1_len + m_barcode_2_len <= barcode_neighbourhood::MAX_LENGTH;
+        const bool fits_hamming = m_barcode_1_len <= barcode_hamming::MAX_LENGTH &&
+                                  m_barcode_2_len <= barcode_hamming::MAX_LENGTH;
+
+        // Linear scans are only worthwhile for small panels or large numbers
+        // of mismatches, compared to the cost of searching the quad-tree
+        const bool hamming_is_cheaper =
+            estimate_hamming_cost(barcodes.size(), m_barcode_1_len, m_barcode_2_len) <
+            estimate_trie_cost(barcodes.size(), m_barcode_1_len + m_barcode_2_len, m_max_mismatches);
+
+        if (fits_neighbourhood &&
+            (strategy == barcode_strategy::neighbourhood ||
+             (strategy == barcode_strategy::automatic && size <= MAX_NEIGHBOURHOOD_SIZE))) {
+            m_neighbourhood = barcode_neighbourhood(barcodes, m_max_mismatches,
+                                                    m_max_mismatches_r1,
+                                                    m_max_mismatches_r2);
+            m_strategy = barcode_strategy::neighbourhood;
+        } else if (fits_hamming &&
+                   (strategy == barcode_strategy::hamming ||
+                    (strategy == barcode_strategy::automatic && hamming_is_cheaper))) {
+            m_hamming = barcode_hamming(barcodes, m_max_mismatches,
+                                        m_max_mismatches_r1,
+                                        m_max_mismatches_r2);
+            m_strategy = barcode_strategy::hamming;
+        }
     }
 }
 
 
+barcode_strategy barcode_table::strategy() const
+{
+    return m_strategy;
+}
+
+
 int barcode_table::identify(const fastq& read_r1) const
 {
     if (read_r1.length() < m_barcode_1_len) {
         return barcode_table::no_match;
     }
 
+    // The neighbourhood table only includes complete barcode pairs
+    int match_id = no_match;
+    if (!m_barcode_2_len && m_neighbourhood.lookup(read_r1.sequence().c_str(), nullptr, match_id)) {
+        return match_id;
+    } else if (m_hamming.lookup(read_r1.sequence().c_str(), nullptr, match_id)) {
+        return match_id;
+    }
+
     const std::string barcode = read_r1.sequence().substr(0, m_barcode_1_len);
     auto match = lookup(barcode.c_str(), 0, 0, nullptr);
     if (match.barcode == no_match && m_max_mismatches) {
@@ -246,6 +391,13 @@ int barcode_table::identify(const fastq& read_r1, const fastq& read_r2) const
         return no_match;
     }
 
+    int match_id = no_match;
+    if (m_neighbourhood.lookup(read_r1.sequence().c_str(), read_r2.sequence().c_str(), match_id)) {
+        return match_id;
+    } else if (m_hamming.lookup(read_r1.sequence().c_str(), read_r2.sequence().c_str(), match_id)) {
+        return match_id;
+    }
+
     const auto barcode_1 = read_r1.sequence().substr(0, m_barcode_1_len);
     const auto barcode_2 = read_r2.sequence().substr(0, m_barcode_2_len);
     const auto combined_barcode = barcode_1 + barcode_2;
@@ -277,10 +429,7 @@ barcode_table::lookup(const char* seq, int parent,
             return candidate(no_match);
         }
 
-        const auto encoded_nuc = ACGT_TO_IDX(*seq);
-        const auto& node = m_nodes.at(parent);
-
-        parent = node.children.at(encoded_nuc);
+        parent = m_nodes.child(parent, ACGT_TO_IDX(*seq));
     }
 
     if (parent == no_match) {
@@ -296,8 +445,8 @@ barcode_table::lookup(const char* seq, int parent,
             return lookup(next->seq, parent, max_global_mismatches, nullptr);
         }
     } else {
-        const auto& node = m_nodes.at(parent);
-        return candidate(node.value, m_max_mismatches - max_global_mismatches);
+        return candidate(m_nodes.value(parent),
+                         m_max_mismatches - max_global_mismatches);
     }
 }
 
@@ -306,14 +455,13 @@ barcode_table::candidate barcode_table::lookup_with_mm(
     const size_t max_local_mismatches, const next_subsequence* next) const
 
 {
-    const demultiplexer_node& node = m_nodes.at(parent);
     const auto nucleotide = *seq;
 
     if (nucleotide) {
         candidate best_candidate;
 
         for (size_t encoded_i = 0; encoded_i < 4; ++encoded_i) {
-            const auto child = node.children.at(encoded_i);
+            const auto child = m_nodes.child(parent, encoded_i);
 
             if (child != -1) {
                 candidate current_candidate;
@@ -354,7 +502,8 @@ barcode_table::candidate barcode_table::lookup_with_mm(
             return lookup(next->seq, parent, max_global_mismatches, nullptr);
         }
     } else {
-        return candidate(node.value, m_max_mismatches - max_global_mismatches);
+        return candidate(m_nodes.value(parent),
+                         m_max_mismatches - max_global_mismatches);
     }
 }
 
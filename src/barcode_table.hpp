@@ -26,7 +26,11 @@
 #define BARCODE_TABLE_H
 
 #include <array>
+#include <cstdint>
+#include <vector>
 
+#include "barcode_hamming.hpp"
+#include "barcode_neighbourhood.hpp"
 #include "fastq.hpp"
 #include "fastq_io.hpp"
 #include "scheduler.hpp"
@@ -60,7 +64,7 @@ private:
 /**
  * Struct representing node in quad-tree; children are referenced using the
  * corresponding indice in the vector representing the tree; -1 is used to
- * represent unassigned children.
+ * represent unassigned children. Only used while building a demux_tree.
  */
 struct demultiplexer_node {
     demultiplexer_node();
@@ -73,17 +77,89 @@ typedef std::vector<demultiplexer_node> demux_node_vec;
 
 
 /**
+ * Compact, read-only representation of a quad-tree of barcodes.
  *
+ * Nodes are stored in breadth-first order, so that the top levels of the tree,
+ * which are visited by every lookup, share a small number of cache lines.
+ * Child indices are stored using 16 bits when the tree is small enough and
+ * node values are kept in a separate array, since these are only needed once
+ * a lookup terminates. As the root cannot be the child of any node, index 0 is
+ * used to represent unassigned children.
+ */
+class demux_tree
+{
+public:
+    /** Creates tree containing only an empty root node. */
+    demux_tree();
+
+    /** Creates tree from nodes built by add_sequence_to_tree. */
+    explicit demux_tree(const demux_node_vec& nodes);
+
+    /** Returns the child of a node for an encoded nucleotide, or -1. */
+    inline int child(int node, size_t nuc_idx) const
+    {
+        const size_t offset = static_cast<size_t>(node) * 4 + nuc_idx;
+        const uint32_t idx = m_children_32.empty() ? m_children_16[offset]
+                                                   : m_children_32[offset];
+
+        return idx ? static_cast<int>(idx) : -1;
+    }
+
+    /** Returns the value (barcode, no_match, or ambigious) of a node. */
+    inline int value(int node) const
+    {
+        return m_values[node];
+    }
+
+    /** Returns the number of nodes in the tree. */
+    size_t size() const;
+
+private:
+    //! Child indices if the tree contains at most 2^16 nodes
+    std::vector<uint16_t> m_children_16;
+    //! Child indices if the tree contains more than 2^16 nodes
+    std::vector<uint32_t> m_children_32;
+    //! Value of each node
+    std::vector<int> m_values;
+};
+
+
+//! Strategies for identifying barcodes in reads
+enum class barcode_strategy
+{
+    //! Use a neighbourhood table if it is reasonably small, and otherwise
+    //! either search the quad-tree or compare reads with all barcodes,
+    //! depending on the estimated cost of either for the panel
+    automatic,
+    //! Search the quad-tree for each read
+    trie,
+    //! Use a precomputed table of barcodes with mismatches, if possible
+    neighbourhood,
+    //! Compare reads with all barcodes, if possible
+    hamming,
+};
+
+
+/**
+ * Table of barcodes (pairs) used to identify reads when demultiplexing.
+ *
+ * Barcodes are identified using a demux_tree, optionally supplemented by a
+ * precomputed barcode_neighbourhood table or by a barcode_hamming engine;
+ * results are identical regardless of the strategy used.
  */
 class barcode_table
 {
 public:
     barcode_table(const fastq_pair_vec& barcodes, size_t max_mm,
-                  size_t max_mm_r1, size_t max_mm_r2);
+                  size_t max_mm_r1, size_t max_mm_r2,
+                  barcode_strategy strategy = barcode_strategy::automatic);
 
     int identify(const fastq& read_r1) const;
     int identify(const fastq& read_r1, const fastq& read_r2) const;
 
+    /** Returns the strategy used to identify barcodes; never 'automatic'. */
+    barcode_strategy strategy() const;
+
     static const int no_match = -1;
     static const int ambigious = -2;
 
@@ -105,12 +181,15 @@ protected:
                              const size_t max_local_mismatches,
                              const next_subsequence* next) const;
 
-    demux_node_vec m_nodes;
+    demux_tree m_nodes;
+    barcode_neighbourhood m_neighbourhood;
+    barcode_hamming m_hamming;
     size_t m_max_mismatches;
     size_t m_max_mismatches_r1;
     size_t m_max_mismatches_r2;
     size_t m_barcode_1_len;
     size_t m_barcode_2_len;
+    barcode_strategy m_strategy;
 };
 
 
@@ -76,6 +76,9 @@ enum analyses_id
     //! Step for writing mate 2 reads which were not identified
     ai_write_unidentified_2,
 
+    //! Step for identifying barcodes in SE or PE reads prior to demultiplexing
+    ai_identify_barcodes,
+
     //! Offset for post-demultiplexing analytical steps
     //! If enabled, the demultiplexing step will forward reads to the
     //! nth * ai_analyses_offset analytical step, corresponding to the
@@ -88,6 +91,8 @@ enum analyses_id
     ai_trim_pe = 20,
     //! Step for trimming of SE reads
     ai_trim_se = 20,
+    //! Step for generating simulated SE or PE reads
+    ai_simulate_reads = 20,
 
     //! Offset added to write steps when zipping
     ai_zip_offset = 10,
@@ -0,0 +1,86 @@
+/*************************************************************************\
+ * AdapterRemoval - cleaning next-generation sequencing reads            *
+ *                                                                       *
+ * Copyright (C) 2011 by Stinus Lindgreen - stinus@binf.ku.dk            *
+ * Copyright (C) 2014 by Mikkel Schubert - mikkelsch@gmail.com           *
+ *                                                                       *
+ * If you use the program, please cite the paper:                        *
+ * S. Lindgreen (2012): AdapterRemoval: Easy Cleaning of Next Generation *
+ * Sequencing Reads, BMC Research Notes, 5:337                           *
+ * http://www.biomedcentral.com/1756-0500/5/337/                         *
+ *                                                                       *
+ * This program is free software: you can redistribute it and/or modify  *
+ * it under the terms of the GNU General Public License as published by  *
+ * the Free Software Foundation, either version 3 of the License, or     *
+ * (at your option) any later version.                                   *
+ *                                                                       *
+ * This program is distributed in the hope that it will be useful,       *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ * GNU General Public License for more details.                          *
+ *                                                                       *
+ * You should have received a copy of the GNU General Public License     *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+\*************************************************************************/
+#include "counter_rng.hpp"
+
+namespace ar
+{
+
+//! Multipliers used in Philox4x32 rounds
+const uint64_t PHILOX_M0 = 0xD2511F53;
+const uint64_t PHILOX_M1 = 0xCD9E8D57;
+//! Weyl sequence constants used to bump the key between rounds
+const uint32_t PHILOX_W0 = 0x9E3779B9;
+const uint32_t PHILOX_W1 = 0xBB67AE85;
+//! Number of rounds recommended for Philox4x32
+const size_t PHILOX_ROUNDS = 10;
+
+
+counter_rng::counter_rng(uint32_t seed, uint32_t stream, uint64_t index)
+  : m_key({{seed, stream}})
+  , m_counter({{static_cast<uint32_t>(index), static_cast<uint32_t>(index >> 32), 0, 0}})
+  , m_block()
+  , m_used(m_block.size())
+{
+}
+
+
+counter_rng::result_type counter_rng::operator()()
+{
+    if (m_used == m_block.size()) {
+        generate_block();
+        m_used = 0;
+    }
+
+    return m_block.at(m_used++);
+}
+
+
+void counter_rng::generate_block()
+{
+    std::array<uint32_t, 4> ctr = m_counter;
+    std::array<uint32_t, 2> key = m_key;
+
+    for (size_t round = 0; round < PHILOX_ROUNDS; ++round) {
+        if (round) {
+            key[0] += PHILOX_W0;
+            key[1] += PHILOX_W1;
+        }
+
+        const uint64_t product_0 = PHILOX_M0 * ctr[0];
+        const uint64_t product_1 = PHILOX_M1 * ctr[2];
+
+        ctr = {{static_cast<uint32_t>(product_1 >> 32) ^ ctr[1] ^ key[0],
+                static_cast<uint32_t>(product_1),
+                static_cast<uint32_t>(product_0 >> 32) ^ ctr[3] ^ key[1],
+                static_cast<uint32_t>(product_0)}};
+    }
+
+    m_block = ctr;
+
+    // The third word of the counter enumerates blocks for the current read
+    ++m_counter[2];
+}
+
+} // namespace ar
@@ -0,0 +1,80 @@
+/*************************************************************************\
+ * AdapterRemoval - cleaning next-generation sequencing reads            *
+ *                                                                       *
+ * Copyright (C) 2011 by Stinus Lindgreen - stinus@binf.ku.dk            *
+ * Copyright (C) 2014 by Mikkel Schubert - mikkelsch@gmail.com           *
+ *                                                                       *
+ * If you use the program, please cite the paper:                        *
+ * S. Lindgreen (2012): AdapterRemoval: Easy Cleaning of Next Generation *
+ * Sequencing Reads, BMC Research Notes, 5:337                           *
+ * http://www.biomedcentral.com/1756-0500/5/337/                         *
+ *                                                                       *
+ * This program is free software: you can redistribute it and/or modify  *
+ * it under the terms of the GNU General Public License as published by  *
+ * the Free Software Foundation, either version 3 of the License, or     *
+ * (at your option) any later version.                                   *
+ *                                                                       *
+ * This program is distributed in the hope that it will be useful,       *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ * GNU General Public License for more details.                          *
+ *                                                                       *
+ * You should have received a copy of the GNU General Public License     *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+\*************************************************************************/
+#ifndef COUNTER_RNG_H
+#define COUNTER_RNG_H
+
+#include <array>
+#include <cstdint>
+#include <cstdlib>
+
+namespace ar
+{
+
+/**
+ * Counter-based random number generator (Philox4x32-10).
+ *
+ * Random numbers are a pure function of a key (the seed and a stream number)
+ * and a counter (the index of the read being processed), so that the values
+ * generated for a given read do not depend on the order in which reads are
+ * processed, nor on the number of threads used. The class satisfies the
+ * requirements of UniformRandomBitGenerator.
+ *
+ * See Salmon et al. 2011, "Parallel random numbers: As easy as 1, 2, 3".
+ */
+class counter_rng
+{
+public:
+    typedef uint32_t result_type;
+
+    /**
+     * @param seed User supplied seed.
+     * @param stream Stream of random numbers, e.g. the sample number.
+     * @param index Index of the read (pair) in the stream.
+     */
+    counter_rng(uint32_t seed, uint32_t stream, uint64_t index);
+
+    /** Returns the next random number for the current read. */
+    result_type operator()();
+
+    static constexpr result_type min() { return 0; }
+    static constexpr result_type max() { return UINT32_MAX; }
+
+private:
+    /** Generates the next block of 4 values, incrementing the counter. */
+    void generate_block();
+
+    //! Key for the current stream
+    std::array<uint32_t, 2> m_key;
+    //! Counter for the current read and block of values
+    std::array<uint32_t, 4> m_counter;
+    //! Values generated from the last block
+    std::array<uint32_t, 4> m_block;
+    //! Number of values in the current block that have been returned
+    size_t m_used;
+};
+
+} // namespace ar
+
+#endif
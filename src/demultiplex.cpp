@@ -37,12 +37,94 @@ namespace ar
 
 ///////////////////////////////////////////////////////////////////////////////
 
-demultiplex_reads::demultiplex_reads(const userconfig* config)
-    : analytical_step(analytical_step::ordering::ordered)
+identify_barcodes::identify_barcodes(const userconfig* config, size_t next_step)
+    : analytical_step(analytical_step::ordering::unordered)
     , m_barcodes(config->adapters.get_barcodes())
     , m_barcode_table(m_barcodes, config->barcode_mm, config->barcode_mm_r1, config->barcode_mm_r2)
+    , m_next_step(next_step)
+{
+    AR_DEBUG_ASSERT(!m_barcodes.empty());
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+
+identify_se_barcodes::identify_se_barcodes(const userconfig* config, size_t next_step)
+    : identify_barcodes(config, next_step)
+{
+}
+
+
+chunk_vec identify_se_barcodes::process(analytical_chunk* chunk)
+{
+    read_chunk_ptr read_chunk(dynamic_cast<fastq_read_chunk*>(chunk));
+
+    read_chunk->barcodes.reserve(read_chunk->reads_1.size());
+    for (auto& read : read_chunk->reads_1) {
+        const int best_barcode = m_barcode_table.identify(read);
+        if (best_barcode >= 0) {
+            read.truncate(m_barcodes.at(best_barcode).first.length());
+        }
+
+        read_chunk->barcodes.push_back(best_barcode);
+    }
+
+    chunk_vec chunks;
+    chunks.push_back(chunk_pair(m_next_step, std::move(read_chunk)));
+
+    return chunks;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+
+identify_pe_barcodes::identify_pe_barcodes(const userconfig* config, size_t next_step)
+    : identify_barcodes(config, next_step)
+{
+}
+
+
+chunk_vec identify_pe_barcodes::process(analytical_chunk* chunk)
+{
+    read_chunk_ptr read_chunk(dynamic_cast<fastq_read_chunk*>(chunk));
+    AR_DEBUG_ASSERT(read_chunk->reads_1.size() == read_chunk->reads_2.size());
+
+    read_chunk->barcodes.reserve(read_chunk->reads_1.size());
+
+    fastq_vec::iterator it_1 = read_chunk->reads_1.begin();
+    fastq_vec::iterator it_2 = read_chunk->reads_2.begin();
+    for (; it_1 != read_chunk->reads_1.end(); ++it_1, ++it_2) {
+        const int best_barcode = m_barcode_table.identify(*it_1, *it_2);
+        if (best_barcode >= 0) {
+            it_1->truncate(m_barcodes.at(best_barcode).first.length());
+            it_2->truncate(m_barcodes.at(best_barcode).second.length());
+        }
+
+        read_chunk->barcodes.push_back(best_barcode);
+    }
+
+    chunk_vec chunks;
+    chunks.push_back(chunk_pair(m_next_step, std::move(read_chunk)));
+
+    return chunks;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+
+demultiplex_reads::demultiplex_reads(const userconfig* config,
+                                     size_t max_cache_age,
+                                     size_t max_cache_size)
+    : analytical_step(analytical_step::ordering::ordered)
+    , m_barcodes(config->adapters.get_barcodes())
     , m_config(config)
+    , m_max_cache_age(max_cache_age)
+    , m_max_cache_size(max_cache_size)
     , m_cache()
+    , m_cache_sizes(m_barcodes.size())
+    , m_cache_created(m_barcodes.size())
+    , m_cache_size()
+    , m_chunks_processed()
     , m_unidentified_1(new fastq_output_chunk())
     , m_unidentified_2()
     , m_statistics(m_barcodes.size())
@@ -81,21 +163,51 @@ chunk_vec demultiplex_reads::flush_cache(bool eof)
         m_unidentified_2 = output_chunk_ptr(new fastq_output_chunk());
     }
 
-    for (size_t nth = 0; nth < m_cache.size(); ++nth) {
+    auto flush_sample = [&](size_t nth) {
         read_chunk_ptr& chunk = m_cache.at(nth);
-        if (eof || chunk->reads_1.size() >= FASTQ_CHUNK_SIZE) {
-            chunk->eof = eof;
+        chunk->eof = eof;
+
+        const size_t step_id = (nth + 1) * ai_analyses_offset;
+        output.push_back(chunk_pair(step_id, std::move(chunk)));
+        chunk = read_chunk_ptr(new fastq_read_chunk(false, m_statistics.barcodes.at(nth)));
+
+        m_cache_size -= m_cache_sizes.at(nth);
+        m_cache_sizes.at(nth) = 0;
+    };
+
+    for (size_t nth = 0; nth < m_cache.size(); ++nth) {
+        const read_chunk_ptr& chunk = m_cache.at(nth);
+        const bool is_expired = !chunk->reads_1.empty() &&
+            m_chunks_processed - m_cache_created.at(nth) >= m_max_cache_age;
 
-            const size_t step_id = (nth + 1) * ai_analyses_offset;
-            output.push_back(chunk_pair(step_id, std::move(chunk)));
-            chunk = read_chunk_ptr(new fastq_read_chunk());
+        if (eof || is_expired || chunk->reads_1.size() >= FASTQ_CHUNK_SIZE) {
+            flush_sample(nth);
         }
     }
 
+    while (m_cache_size > m_max_cache_size) {
+        const auto largest = std::max_element(m_cache_sizes.begin(), m_cache_sizes.end());
+
+        flush_sample(largest - m_cache_sizes.begin());
+    }
+
+    ++m_chunks_processed;
+
     return output;
 }
 
 
+void demultiplex_reads::add_to_cache(size_t nth, size_t size)
+{
+    if (m_cache.at(nth)->reads_1.empty()) {
+        m_cache_created.at(nth) = m_chunks_processed;
+    }
+
+    m_cache_sizes.at(nth) += size;
+    m_cache_size += size;
+}
+
+
 demux_statistics demultiplex_reads::statistics() const
 {
     return m_statistics;
@@ -104,8 +216,10 @@ demux_statistics demultiplex_reads::statistics() const
 
 ///////////////////////////////////////////////////////////////////////////////
 
-demultiplex_se_reads::demultiplex_se_reads(const userconfig* config)
-    : demultiplex_reads(config)
+demultiplex_se_reads::demultiplex_se_reads(const userconfig* config,
+                                           size_t max_cache_age,
+                                           size_t max_cache_size)
+    : demultiplex_reads(config, max_cache_age, max_cache_size)
 {
 }
 
@@ -114,9 +228,11 @@ chunk_vec demultiplex_se_reads::process(analytical_chunk* chunk)
 {
     AR_DEBUG_LOCK(m_lock);
     read_chunk_ptr read_chunk(dynamic_cast<fastq_read_chunk*>(chunk));
+    AR_DEBUG_ASSERT(read_chunk->reads_1.size() == read_chunk->barcodes.size());
 
-    for (const auto& read : read_chunk->reads_1) {
-        const int best_barcode = m_barcode_table.identify(read);
+    auto it_barcode = read_chunk->barcodes.cbegin();
+    for (auto& read : read_chunk->reads_1) {
+        const int best_barcode = *it_barcode++;
 
         if (best_barcode < 0) {
             m_unidentified_1->add(*m_config->quality_output_fmt, read);
@@ -127,11 +243,9 @@ chunk_vec demultiplex_se_reads::process(analytical_chunk* chunk)
                 m_statistics.ambiguous += 1;
             }
         } else {
-            read_chunk_ptr& dst = m_cache.at(best_barcode);
-            dst->reads_1.push_back(read);
-            dst->reads_1.back().truncate(m_barcodes.at(best_barcode).first.length());
-
-           m_statistics.barcodes.at(best_barcode) += 1;
+            add_to_cache(best_barcode, read.header().size() + read.length() * 2);
+            m_cache.at(best_barcode)->reads_1.push_back(std::move(read));
+            m_statistics.barcodes.at(best_barcode) += 1;
         }
     }
 
@@ -141,8 +255,10 @@ chunk_vec demultiplex_se_reads::process(analytical_chunk* chunk)
 
 ///////////////////////////////////////////////////////////////////////////////
 
-demultiplex_pe_reads::demultiplex_pe_reads(const userconfig* config)
-    : demultiplex_reads(config)
+demultiplex_pe_reads::demultiplex_pe_reads(const userconfig* config,
+                                           size_t max_cache_age,
+                                           size_t max_cache_size)
+    : demultiplex_reads(config, max_cache_age, max_cache_size)
 {
 }
 
@@ -152,11 +268,13 @@ chunk_vec demultiplex_pe_reads::process(analytical_chunk* chunk)
     AR_DEBUG_LOCK(m_lock);
     read_chunk_ptr read_chunk(dynamic_cast<fastq_read_chunk*>(chunk));
     AR_DEBUG_ASSERT(read_chunk->reads_1.size() == read_chunk->reads_2.size());
+    AR_DEBUG_ASSERT(read_chunk->reads_1.size() == read_chunk->barcodes.size());
 
+    auto it_barcode = read_chunk->barcodes.cbegin();
     fastq_vec::iterator it_1 = read_chunk->reads_1.begin();
     fastq_vec::iterator it_2 = read_chunk->reads_2.begin();
     for (; it_1 != read_chunk->reads_1.end(); ++it_1, ++it_2) {
-        const int best_barcode = m_barcode_table.identify(*it_1, *it_2);
+        const int best_barcode = *it_barcode++;
 
         if (best_barcode < 0) {
             m_unidentified_1->add(*m_config->quality_output_fmt, *it_1);
@@ -172,12 +290,12 @@ chunk_vec demultiplex_pe_reads::process(analytical_chunk* chunk)
                 m_statistics.ambiguous += 1;
             }
         } else {
-            read_chunk_ptr& dst = m_cache.at(best_barcode);
+            add_to_cache(best_barcode, it_1->header().size() + it_1->length() * 2 +
+                                       it_2->header().size() + it_2->length() * 2);
 
-            it_1->truncate(m_barcodes.at(best_barcode).first.length());
-            dst->reads_1.push_back(*it_1);
-            it_2->truncate(m_barcodes.at(best_barcode).second.length());
-            dst->reads_2.push_back(*it_2);
+            read_chunk_ptr& dst = m_cache.at(best_barcode);
+            dst->reads_1.push_back(std::move(*it_1));
+            dst->reads_2.push_back(std::move(*it_2));
 
             m_statistics.barcodes.at(best_barcode) += 1;
         }
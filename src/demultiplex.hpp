@@ -36,16 +36,88 @@ namespace ar
 
 class userconfig;
 
+//! Maximum number of input chunks for which reads are cached per sample
+const size_t DEMUX_CACHE_MAX_AGE = 64;
+//! Maximum combined size (approximate, in bytes) of cached reads
+const size_t DEMUX_CACHE_MAX_SIZE = 128 * 1024 * 1024;
+
 /**
- * Baseclass for demultiplexing of reads; responsible for building the quad-tree
- * representing the set of adapter sequences, and for maintaining the cache of
- * demultiplexed reads.
+ * Baseclass for identification of barcodes; responsible for building the
+ * quad-tree representing the set of barcode sequences. Reads are processed
+ * independently of each other, allowing identification to run in parallel;
+ * the results are recorded in fastq_read_chunk::barcodes and barcodes are
+ * removed from identified reads, before the chunk is forwarded to the
+ * (ordered) demultiplex_reads step.
+ */
+class identify_barcodes : public analytical_step
+{
+public:
+    /** Setup barcode table; keeps pointer to config object. */
+    identify_barcodes(const userconfig* config, size_t next_step);
+
+    //! Copy construction not supported
+    identify_barcodes(const identify_barcodes&) = delete;
+    //! Assignment not supported
+    identify_barcodes& operator=(const identify_barcodes&) = delete;
+
+protected:
+    //! List of barcode (pairs) supplied by caller
+    const fastq_pair_vec& m_barcodes;
+    //! Quad-tree representing all mate 1 adapters; for search with n mismatches
+    const barcode_table m_barcode_table;
+    //! The step to which tagged chunks are forwarded
+    const size_t m_next_step;
+};
+
+
+/** Barcode identification for single-end reads. */
+class identify_se_barcodes : public identify_barcodes
+{
+public:
+    /** See identify_barcodes::identify_barcodes. */
+    identify_se_barcodes(const userconfig* config, size_t next_step);
+
+    /** Identifies the barcode of each read and trims identified reads. */
+    chunk_vec process(analytical_chunk* chunk);
+};
+
+
+/** Barcode identification for paired-end reads. */
+class identify_pe_barcodes : public identify_barcodes
+{
+public:
+    /** See identify_barcodes::identify_barcodes. */
+    identify_pe_barcodes(const userconfig* config, size_t next_step);
+
+    /** Identifies the barcodes of each pair and trims identified pairs. */
+    chunk_vec process(analytical_chunk* chunk);
+};
+
+
+/**
+ * Baseclass for demultiplexing of reads; responsible for maintaining the cache
+ * of demultiplexed reads. Reads are expected to have been processed by the
+ * identify_barcodes step, and are assigned to samples in input order.
+ *
+ * Caches are forwarded once they contain FASTQ_CHUNK_SIZE reads, once they
+ * have held reads for DEMUX_CACHE_MAX_AGE input chunks, or (largest first)
+ * when the combined size of all caches exceeds DEMUX_CACHE_MAX_SIZE; both
+ * limits may be changed in the constructor. This
+ * ensures that samples with few reads are processed throughout the run.
  */
 class demultiplex_reads : public analytical_step
 {
 public:
-    /** Setup demultiplexer; keeps pointer to config object. */
-    demultiplex_reads(const userconfig* config);
+    /**
+     * Setup demultiplexer; keeps pointer to config object.
+     *
+     * @param config User settings, including the list of barcodes.
+     * @param max_cache_age Max number of input chunks for which reads are cached.
+     * @param max_cache_size Max combined size (approximate) of cached reads.
+     */
+    demultiplex_reads(const userconfig* config,
+                      size_t max_cache_age = DEMUX_CACHE_MAX_AGE,
+                      size_t max_cache_size = DEMUX_CACHE_MAX_SIZE);
 
     /** Frees any unflushed caches. */
     virtual ~demultiplex_reads();
@@ -61,22 +133,37 @@ public:
 protected:
     //! List of barcode (pairs) supplied by caller
     const fastq_pair_vec& m_barcodes;
-    //! Quad-tree representing all mate 1 adapters; for search with n mismatches
-    const barcode_table m_barcode_table;
     //! Pointer to user settings used for output format for unidentified reads
     const userconfig* m_config;
-
-    //! Returns a chunk-list with any set of reads exceeding the max cache size
+    //! Max number of input chunks for which reads are cached per sample
+    const size_t m_max_cache_age;
+    //! Max combined size (approximate, in bytes) of cached reads
+    const size_t m_max_cache_size;
+
+    //! Returns a chunk-list with any set of reads exceeding the max cache size,
+    //! any set of reads older than the max cache age, and (if the combined
+    //! size of all caches exceeds the limit) the largest sets of reads.
     //! If 'eof' is true, all chunks are returned, and the 'eof' values in the
     //! chunks are set to true.
     chunk_vec flush_cache(bool eof = false);
 
+    //! Records the addition of a read (pair) to the cache for a sample
+    void add_to_cache(size_t nth, size_t size);
+
     typedef std::vector<read_chunk_ptr> demultiplexed_cache;
 
     //! Cache of demultiplex reads; used to reduce the number of output chunks
     //! generated from each processed chunk, which would otherwise increase
     //! linearly with the number of barcodes.
     demultiplexed_cache m_cache;
+    //! Approximate size in bytes of the reads in each cache
+    std::vector<size_t> m_cache_sizes;
+    //! Index of the input chunk in which the oldest read in each cache was seen
+    std::vector<size_t> m_cache_created;
+    //! Approximate size in bytes of the reads in all caches
+    size_t m_cache_size;
+    //! Number of input chunks processed
+    size_t m_chunks_processed;
     //! Cache of unidentified mate 1 reads
     output_chunk_ptr m_unidentified_1;
     //! Cache of unidentified mate 2 reads
@@ -95,10 +182,13 @@ class demultiplex_se_reads : public demultiplex_reads
 {
 public:
     /** See demultiplex_reads::demultiplex_reads. */
-    demultiplex_se_reads(const userconfig* config);
+    demultiplex_se_reads(const userconfig* config,
+                         size_t max_cache_age = DEMUX_CACHE_MAX_AGE,
+                         size_t max_cache_size = DEMUX_CACHE_MAX_SIZE);
 
     /**
-     * Processes a read chunk, and forwards chunks to downstream steps, with
+     * Processes a chunk of reads tagged by identify_barcodes, and forwards
+     * chunks to downstream steps, with
      * the IDs corresponding to ai_analyses_offset * (nth + 1) for the nth
      * barcode (pair). Unidentified reads are sent to ai_write_unidentified_1.
      */
@@ -111,10 +201,13 @@ class demultiplex_pe_reads : public demultiplex_reads
 {
 public:
     /** See demultiplex_reads::demultiplex_reads. */
-    demultiplex_pe_reads(const userconfig* config);
+    demultiplex_pe_reads(const userconfig* config,
+                         size_t max_cache_age = DEMUX_CACHE_MAX_AGE,
+                         size_t max_cache_size = DEMUX_CACHE_MAX_SIZE);
 
     /**
-     * Processes a read chunk, and forwards chunks to downstream steps, with
+     * Processes a chunk of reads tagged by identify_barcodes, and forwards
+     * chunks to downstream steps, with
      * the IDs corresponding to ai_analyses_offset * (nth + 1) for the nth
      * barcode (pair). Unidentified reads are sent to ai_write_unidentified_1
      * and ai_write_unidentified_2.
@@ -247,8 +247,14 @@ void fastq::truncate(size_t pos, size_t len)
     AR_DEBUG_ASSERT(pos == 0 || pos <= length());
 
     if (pos || len < length()) {
-        m_sequence = m_sequence.substr(pos, len);
-        m_qualities = m_qualities.substr(pos, len);
+        // Truncate in place, avoiding the allocation of new strings
+        m_sequence.erase(0, pos);
+        m_qualities.erase(0, pos);
+
+        if (len < m_sequence.length()) {
+            m_sequence.resize(len);
+            m_qualities.resize(len);
+        }
     }
 }
 
@@ -325,4 +325,38 @@ const char* fastq_encoding_solexa::name() const
     return "Solexa";
 }
 
+
+
+fastq_encoding_passthrough::fastq_encoding_passthrough(char max_score)
+  : fastq_encoding(PHRED_OFFSET_33, max_score)
+{
+}
+
+
+void fastq_encoding_passthrough::encode(const std::string& qualities,
+                                        std::string& dst) const
+{
+    dst.append(qualities);
+}
+
+
+void fastq_encoding_passthrough::decode(std::string& qualities) const
+{
+    // Branch-free min/max, allowing the loop to be vectorized by the compiler
+    char min_quality = std::numeric_limits<char>::max();
+    char max_quality = std::numeric_limits<char>::min();
+    for (const auto quality : qualities) {
+        min_quality = std::min(min_quality, quality);
+        max_quality = std::max(max_quality, quality);
+    }
+
+    if (min_quality < m_offset || max_quality > m_offset + m_max_score) {
+        if (!qualities.empty()) {
+            // Report the first invalid score
+            std::string copy = qualities;
+            fastq_encoding::decode(copy);
+        }
+    }
+}
+
 } // namespace ar
@@ -141,6 +141,27 @@ public:
 };
 
 
+/**
+ * Phred+33 encoding that passes quality scores through unchanged.
+ *
+ * Scores are validated as for fastq_encoding, but are not re-encoded, since
+ * the input encoding matches the internal (Phred+33) encoding. This allows
+ * reads to be read and written without translating the quality scores. Other
+ * encodings must be converted to Phred+33 using fastq_encoding.
+ */
+class fastq_encoding_passthrough : public fastq_encoding
+{
+public:
+    /** See fastq_encoding::fastq_encoding; the offset is always Phred+33. */
+    fastq_encoding_passthrough(char max_score = MAX_PHRED_SCORE_DEFAULT);
+
+    /** Appends quality-scores to dst. */
+    virtual void encode(const std::string& qualities, std::string& dst) const override;
+    /** Validates a string of ASCII values, without modifying them. */
+    virtual void decode(std::string& qualities) const override;
+};
+
+
 static const fastq_encoding FASTQ_ENCODING_33(PHRED_OFFSET_33);
 static const fastq_encoding FASTQ_ENCODING_64(PHRED_OFFSET_64);
 static const fastq_encoding FASTQ_ENCODING_SAM(PHRED_OFFSET_33, MAX_PHRED_SCORE);
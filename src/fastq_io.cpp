@@ -21,10 +21,13 @@
  * You should have received a copy of the GNU General Public License     *
  * along with this program.  If not, see <http://www.gnu.org/licenses/>. *
 \*************************************************************************/
+#include <algorithm>
+#include <iterator>
 #include <stdexcept>
 #include <iostream>
 #include <cerrno>
 #include <cstring>
+#include <mutex>
 
 #include "debug.hpp"
 #include "fastq_io.hpp"
@@ -43,7 +46,7 @@ size_t read_fastq_reads(fastq_vec& dst, joined_line_readers& reader,
         fastq record;
         for (size_t i = 0; i < FASTQ_CHUNK_SIZE; ++i) {
             if (record.read(reader, encoding)) {
-                dst.push_back(record);
+                dst.push_back(std::move(record));
             } else {
                 break;
             }
@@ -66,24 +69,51 @@ size_t read_fastq_reads(fastq_vec& dst, joined_line_readers& reader,
 ///////////////////////////////////////////////////////////////////////////////
 // Implementations for 'fastq_read_chunk'
 
-fastq_read_chunk::fastq_read_chunk(bool eof_)
+fastq_read_chunk::fastq_read_chunk(bool eof_, size_t first_read_)
   : eof(eof_)
+  , first_read(first_read_)
   , reads_1()
   , reads_2()
+  , barcodes()
 {
 }
 
 
+size_t fastq_read_chunk::read_count() const
+{
+    return reads_1.size();
+}
+
+
+size_t fastq_read_chunk::memory_usage() const
+{
+    size_t size = 0;
+    for (const fastq_vec* reads : { &reads_1, &reads_2 }) {
+        for (const auto& read : *reads) {
+            size += read.header().size() + read.sequence().size() + read.qualities().size();
+        }
+    }
+
+    return size + barcodes.size() * sizeof(int);
+}
+
+
 ///////////////////////////////////////////////////////////////////////////////
 // Implementations for 'fastq_output_chunk'
 
-fastq_output_chunk::fastq_output_chunk(bool eof_)
+fastq_output_chunk::fastq_output_chunk(bool eof_, bool keep_records)
   : eof(eof_)
   , count(0)
+  , records()
+  , m_keep_records(keep_records)
   , reads()
   , buffers()
 {
-    reads.reserve(FASTQ_CHUNK_SIZE);
+    if (keep_records) {
+        records.reserve(FASTQ_CHUNK_SIZE);
+    } else {
+        reads.reserve(FASTQ_CHUNK_SIZE);
+    }
 }
 
 
@@ -99,7 +129,36 @@ void fastq_output_chunk::add(const fastq_encoding& encoding,
                              const fastq& read, size_t count_)
 {
     count += count_;
-    reads.push_back(read.to_str(encoding));
+    if (m_keep_records) {
+        records.push_back(read);
+    } else {
+        reads.push_back(read.to_str(encoding));
+    }
+}
+
+
+size_t fastq_output_chunk::read_count() const
+{
+    return count;
+}
+
+
+size_t fastq_output_chunk::memory_usage() const
+{
+    size_t size = 0;
+    for (const auto& read : reads) {
+        size += read.size();
+    }
+
+    for (const auto& buffer : buffers) {
+        size += buffer.first;
+    }
+
+    for (const auto& read : records) {
+        size += read.header().size() + read.sequence().size() + read.qualities().size();
+    }
+
+    return size;
 }
 
 
@@ -130,7 +189,7 @@ chunk_vec read_single_fastq::process(analytical_chunk* chunk)
         return chunk_vec();
     }
 
-    read_chunk_ptr file_chunk(new fastq_read_chunk());
+    read_chunk_ptr file_chunk(new fastq_read_chunk(false, (m_line_offset - 1) / 4));
 
     const size_t n_read = read_fastq_reads(file_chunk->reads_1, m_io_input,
                                            m_line_offset, *m_encoding);
@@ -188,7 +247,7 @@ chunk_vec read_paired_fastq::process(analytical_chunk* chunk)
         return chunk_vec();
     }
 
-    read_chunk_ptr file_chunk(new fastq_read_chunk());
+    read_chunk_ptr file_chunk(new fastq_read_chunk(false, (m_line_offset - 1) / 4));
 
     const size_t n_read_1 = read_fastq_reads(file_chunk->reads_1, m_io_input_1,
                                              m_line_offset, *m_encoding);
@@ -255,7 +314,7 @@ chunk_vec read_interleaved_fastq::process(analytical_chunk* chunk)
         return chunk_vec();
     }
 
-    read_chunk_ptr file_chunk(new fastq_read_chunk());
+    read_chunk_ptr file_chunk(new fastq_read_chunk(false, (m_line_offset - 1) / 8));
 
     file_chunk->reads_1.reserve(FASTQ_CHUNK_SIZE);
     file_chunk->reads_2.reserve(FASTQ_CHUNK_SIZE);
@@ -265,14 +324,14 @@ chunk_vec read_interleaved_fastq::process(analytical_chunk* chunk)
         for (size_t i = 0; i < FASTQ_CHUNK_SIZE; ++i) {
             // Mate 1 reads
             if (record.read(m_io_input, *m_encoding)) {
-                file_chunk->reads_1.push_back(record);
+                file_chunk->reads_1.push_back(std::move(record));
             } else {
                 break;
             }
 
             // Mate 2 reads
             if (record.read(m_io_input, *m_encoding)) {
-                file_chunk->reads_2.push_back(record);
+                file_chunk->reads_2.push_back(std::move(record));
             } else {
                 break;
             }
@@ -348,294 +407,289 @@ std::pair<size_t, unsigned char*> build_input_buffer(const string_vec& lines)
 }
 
 
-///////////////////////////////////////////////////////////////////////////////
-// Implementations for 'gzip_fastq'
+/** Returns the combined size of a set of lines. */
+size_t get_total_size(const string_vec& lines)
+{
+    size_t size = 0;
+    for (const auto& line : lines) {
+        size += line.size();
+    }
 
+    return size;
+}
 
-bzip2_fastq::bzip2_fastq(const userconfig& config, size_t next_step)
-  : analytical_step(analytical_step::ordering::ordered, false)
-  , m_buffered_reads(0)
+
+///////////////////////////////////////////////////////////////////////////////
+// Implementations for 'compress_fastq'
+
+compress_fastq::compress_fastq(size_t next_step)
+  : analytical_step(analytical_step::ordering::unordered, false)
   , m_next_step(next_step)
-  , m_stream()
   , m_eof(false)
-  , m_lock()
 {
-    m_stream.bzalloc = nullptr;
-    m_stream.bzfree = nullptr;
-    m_stream.opaque = nullptr;
+}
 
-    const int errorcode = BZ2_bzCompressInit(/* strm          = */ &m_stream,
-                                             /* blockSize100k = */ config.bzip2_level,
-                                             /* verbosity     = */ 0,
-                                             /* workFactor    = */ 0);
 
-    switch (errorcode) {
-        case BZ_OK:
-            break;
+void compress_fastq::finalize()
+{
+    if (!m_eof) {
+        throw thread_error("compress_fastq::finalize: terminated before EOF");
+    }
+}
 
-        case BZ_MEM_ERROR:
-            throw thread_error("bzip2_fastq: not enough memory");
 
-        case BZ_CONFIG_ERROR:
-            throw thread_error("bzip2_fastq: miscompiled bzip2 library");
+chunk_vec compress_fastq::process(analytical_chunk* chunk)
+{
+    output_chunk_ptr file_chunk(dynamic_cast<fastq_output_chunk*>(chunk));
 
-        case BZ_PARAM_ERROR:
-            throw thread_error("bzip2_fastq: invalid parameters");
+    if (file_chunk->eof) {
+        m_eof = true;
+    }
 
-        default:
-            throw thread_error("bzip2_fastq: unknown error");
+    // Concatenated gzip members / bzip2 streams are valid, so chunks can be
+    // compressed in parallel. Small chunks (and the EOF chunk, which may be
+    // empty) are combined and compressed by the write step.
+    if (!file_chunk->eof && get_total_size(file_chunk->reads) >= FASTQ_COMPRESSED_MIN_SIZE) {
+        compress(file_chunk->reads, file_chunk->buffers);
+        file_chunk->reads.clear();
     }
+
+    chunk_vec chunks;
+    chunks.push_back(chunk_pair(m_next_step, std::move(file_chunk)));
+
+    return chunks;
 }
 
 
-void bzip2_fastq::finalize()
-{
-    AR_DEBUG_LOCK(m_lock);
-    if (!m_eof) {
-        throw thread_error("bzip2_fastq::finalize: terminated before EOF");
-    }
+///////////////////////////////////////////////////////////////////////////////
+// Implementations for 'bzip2_fastq'
 
-    const int errorcode = BZ2_bzCompressEnd(&m_stream);
-    if (errorcode != BZ_OK) {
-        print_locker lock;
-        switch (errorcode) {
-            case BZ_PARAM_ERROR:
-                throw thread_error("bzip2_fastq::finalize: parameter error");
 
-            default:
-                throw thread_error("Unknown error in bzip2_fastq::finalize");
-        }
-    }
+bzip2_fastq::bzip2_fastq(const userconfig& config, size_t next_step)
+  : compress_fastq(next_step)
+  , m_level(config.bzip2_level)
+{
 }
 
 
-chunk_vec bzip2_fastq::process(analytical_chunk* chunk)
+void bzip2_fastq::compress(const string_vec& lines, buffer_vec& buffers)
 {
-    AR_DEBUG_LOCK(m_lock);
-    output_chunk_ptr file_chunk(dynamic_cast<fastq_output_chunk*>(chunk));
-    buffer_vec& buffers = file_chunk->buffers;
+    bz_stream stream;
+    stream.bzalloc = nullptr;
+    stream.bzfree = nullptr;
+    stream.opaque = nullptr;
 
-    if (m_eof) {
-        throw thread_error("bzip2_fastq::process: received data after EOF");
-    }
+    switch (BZ2_bzCompressInit(&stream, m_level, 0, 0)) {
+        case BZ_OK:
+            break;
 
-    m_eof = file_chunk->eof;
-    if (file_chunk->reads.empty() && !m_eof) {
-        return chunk_vec();
+        case BZ_MEM_ERROR:
+            throw thread_error("bzip2_fastq: not enough memory");
+
+        case BZ_CONFIG_ERROR:
+            throw thread_error("bzip2_fastq: miscompiled bzip2 library");
+
+        case BZ_PARAM_ERROR:
+            throw thread_error("bzip2_fastq: invalid parameters");
+
+        default:
+            throw thread_error("bzip2_fastq: unknown error");
     }
 
     std::pair<size_t, unsigned char*> input_buffer;
     std::pair<size_t, unsigned char*> output_buffer;
     try {
-        input_buffer = build_input_buffer(file_chunk->reads);
-        file_chunk->reads.clear();
-
-        m_stream.avail_in = input_buffer.first;
-        m_stream.next_in = reinterpret_cast<char*>(input_buffer.second);
-
-        if (m_stream.avail_in || m_eof) {
-            int errorcode = -1;
+        input_buffer = build_input_buffer(lines);
 
-            do {
-                output_buffer.first = FASTQ_COMPRESSED_CHUNK;
-                output_buffer.second = new unsigned char[FASTQ_COMPRESSED_CHUNK];
+        stream.avail_in = input_buffer.first;
+        stream.next_in = reinterpret_cast<char*>(input_buffer.second);
 
-                m_stream.avail_out = output_buffer.first;
-                m_stream.next_out = reinterpret_cast<char*>(output_buffer.second);
+        int errorcode = -1;
+        do {
+            output_buffer.first = FASTQ_COMPRESSED_CHUNK;
+            output_buffer.second = new unsigned char[FASTQ_COMPRESSED_CHUNK];
 
-                errorcode = BZ2_bzCompress(&m_stream, m_eof ? BZ_FINISH : BZ_RUN);
-                switch (errorcode) {
-                    case BZ_RUN_OK:
-                    case BZ_FINISH_OK:
-                    case BZ_STREAM_END:
-                        break;
+            stream.avail_out = output_buffer.first;
+            stream.next_out = reinterpret_cast<char*>(output_buffer.second);
 
-                    case BZ_FLUSH_OK:
-                        throw thread_error("bzip2_fastq::process: BZ_FLUSH_OK");
+            errorcode = BZ2_bzCompress(&stream, BZ_FINISH);
+            switch (errorcode) {
+                case BZ_FINISH_OK:
+                case BZ_STREAM_END:
+                    break;
 
-                    case BZ_PARAM_ERROR:
-                        throw thread_error("bzip2_fastq::process: BZ_PARAM_ERROR");
+                case BZ_PARAM_ERROR:
+                    throw thread_error("bzip2_fastq::compress: BZ_PARAM_ERROR");
 
-                    case BZ_SEQUENCE_ERROR:
-                        throw thread_error("bzip2_fastq::process: sequence error");
+                case BZ_SEQUENCE_ERROR:
+                    throw thread_error("bzip2_fastq::compress: sequence error");
 
-                    default:
-                        throw thread_error("bzip2_fastq::process: unknown error");
-                }
+                default:
+                    throw thread_error("bzip2_fastq::compress: unknown error");
+            }
 
-                output_buffer.first = FASTQ_COMPRESSED_CHUNK - m_stream.avail_out;
-                if (output_buffer.first) {
-                    buffers.push_back(output_buffer);
-                } else {
-                    delete[] output_buffer.second;
-                }
+            output_buffer.first = FASTQ_COMPRESSED_CHUNK - stream.avail_out;
+            if (output_buffer.first) {
+                buffers.push_back(output_buffer);
+            } else {
+                delete[] output_buffer.second;
+            }
 
-                output_buffer.second = nullptr;
-            } while (m_stream.avail_in || errorcode == BZ_FINISH_OK);
-        }
+            output_buffer.second = nullptr;
+        } while (errorcode != BZ_STREAM_END);
 
         delete[] input_buffer.second;
     } catch (...) {
+        BZ2_bzCompressEnd(&stream);
         delete[] input_buffer.second;
         delete[] output_buffer.second;
         throw;
     }
 
-    chunk_vec chunks;
-    if (!file_chunk->buffers.empty() || m_eof) {
-        file_chunk->count += m_buffered_reads;
-        chunks.push_back(chunk_pair(m_next_step, std::move(file_chunk)));
-        m_buffered_reads = 0;
-    } else {
-        m_buffered_reads += file_chunk->count;
+    if (BZ2_bzCompressEnd(&stream) != BZ_OK) {
+        throw thread_error("bzip2_fastq::compress: parameter error");
     }
-
-    return chunks;
 }
 
 
 ///////////////////////////////////////////////////////////////////////////////
 // Implementations for 'gzip_fastq'
 
+
 gzip_fastq::gzip_fastq(const userconfig& config, size_t next_step)
-  : analytical_step(analytical_step::ordering::ordered, false)
-  , m_buffered_reads(0)
-  , m_next_step(next_step)
-  , m_stream()
-  , m_eof(false)
+  : compress_fastq(next_step)
+  , m_level(config.gzip_level)
   , m_lock()
+  , m_streams()
 {
-    m_stream.zalloc = nullptr;
-    m_stream.zfree = nullptr;
-    m_stream.opaque = nullptr;
-
-    const int errorcode = deflateInit2(/* strm       = */ &m_stream,
-                                       /* level      = */ config.gzip_level,
-                                       /* method     = */ Z_DEFLATED,
-                                       /* windowBits = */ 15 + 16,
-                                       /* memLevel   = */ 8,
-                                       /* strategy   = */ Z_DEFAULT_STRATEGY);
-
-    switch (errorcode) {
-        case Z_OK:
-            break;
-
-        case Z_MEM_ERROR:
-            throw thread_error("gzip_fastq: not enough memory");
-
-        case Z_STREAM_ERROR:
-            throw thread_error("gzip_fastq: invalid parameters");
-
-        case Z_VERSION_ERROR:
-            throw thread_error("gzip_fastq: incompatible zlib version");
-
-        default:
-            throw thread_error("gzip_fastq: unknown error");
-    }
 }
 
 
-void gzip_fastq::finalize()
+gzip_fastq::~gzip_fastq()
 {
-    AR_DEBUG_LOCK(m_lock);
-    if (!m_eof) {
-        throw thread_error("gzip_fastq::finalize: terminated before EOF");
-    }
-
-    const int errorcode = deflateEnd(&m_stream);
-    if (errorcode != Z_OK) {
-        print_locker lock;
-        switch (errorcode) {
-            case Z_STREAM_ERROR:
-                throw thread_error("gzip_fastq::finalize: stream error");
-
-            case Z_DATA_ERROR:
-                throw thread_error("gzip_fastq::finalize: data error");
-
-            default:
-                throw thread_error("Unknown error in gzip_fastq::finalize");
-        }
+    for (auto stream : m_streams) {
+        deflateEnd(stream);
+        delete stream;
     }
 }
 
 
-chunk_vec gzip_fastq::process(analytical_chunk* chunk)
+void gzip_fastq::compress(const string_vec& lines, buffer_vec& buffers)
 {
-    AR_DEBUG_LOCK(m_lock);
-    output_chunk_ptr file_chunk(dynamic_cast<fastq_output_chunk*>(chunk));
-    buffer_vec& buffers = file_chunk->buffers;
-
-    if (m_eof) {
-        throw thread_error("bzip2_fastq::process: received data after EOF");
-    }
-
-    m_eof = file_chunk->eof;
-    if (file_chunk->reads.empty() && !m_eof) {
-        return chunk_vec();
-    }
+    z_stream* stream = acquire_stream();
 
     std::pair<size_t, unsigned char*> input_buffer;
     std::pair<size_t, unsigned char*> output_buffer;
     try {
-        input_buffer = build_input_buffer(file_chunk->reads);
-        file_chunk->reads.clear();
+        input_buffer = build_input_buffer(lines);
 
-        if (input_buffer.first || m_eof) {
-            m_stream.avail_in = input_buffer.first;
-            m_stream.next_in = input_buffer.second;
-            int returncode = -1;
+        stream->avail_in = input_buffer.first;
+        stream->next_in = input_buffer.second;
 
-            do {
-                output_buffer.first = FASTQ_COMPRESSED_CHUNK;
-                output_buffer.second = new unsigned char[FASTQ_COMPRESSED_CHUNK];
+        int returncode = -1;
+        do {
+            output_buffer.first = FASTQ_COMPRESSED_CHUNK;
+            output_buffer.second = new unsigned char[FASTQ_COMPRESSED_CHUNK];
 
-                m_stream.avail_out = output_buffer.first;
-                m_stream.next_out = output_buffer.second;
+            stream->avail_out = output_buffer.first;
+            stream->next_out = output_buffer.second;
 
-                returncode = deflate(&m_stream, m_eof ? Z_FINISH : Z_NO_FLUSH);
-                switch (returncode) {
-                    case Z_OK:
-                    case Z_STREAM_END:
-                        break;
+            returncode = deflate(stream, Z_FINISH);
+            switch (returncode) {
+                case Z_OK:
+                case Z_STREAM_END:
+                    break;
 
-                    case Z_BUF_ERROR:
-                        throw thread_error("gzip_fastq::process: buf error");
+                case Z_BUF_ERROR:
+                    throw thread_error("gzip_fastq::compress: buf error");
 
-                    case Z_STREAM_ERROR:
-                        throw thread_error("gzip_fastq::process: stream error");
+                case Z_STREAM_ERROR:
+                    throw thread_error("gzip_fastq::compress: stream error");
 
-                    default:
-                        throw thread_error("gzip_fastq::process: unknown error");
-                }
+                default:
+                    throw thread_error("gzip_fastq::compress: unknown error");
+            }
 
-                output_buffer.first = FASTQ_COMPRESSED_CHUNK - m_stream.avail_out;
-                if (output_buffer.first) {
-                    buffers.push_back(output_buffer);
-                } else {
-                    delete[] output_buffer.second;
-                }
+            output_buffer.first = FASTQ_COMPRESSED_CHUNK - stream->avail_out;
+            if (output_buffer.first) {
+                buffers.push_back(output_buffer);
+            } else {
+                delete[] output_buffer.second;
+            }
 
-                output_buffer.second = nullptr;
-            } while (m_stream.avail_out == 0 || (m_eof && returncode != Z_STREAM_END));
-        }
+            output_buffer.second = nullptr;
+        } while (returncode != Z_STREAM_END);
 
         delete[] input_buffer.second;
     } catch (...) {
+        release_stream(stream);
         delete[] input_buffer.second;
         delete[] output_buffer.second;
         throw;
     }
 
-    chunk_vec chunks;
-    if (!file_chunk->buffers.empty() || m_eof) {
-        file_chunk->count += m_buffered_reads;
-        chunks.push_back(chunk_pair(m_next_step, std::move(file_chunk)));
-        m_buffered_reads = 0;
-    } else {
-        m_buffered_reads += file_chunk->count;
+    release_stream(stream);
+}
+
+
+z_stream* gzip_fastq::acquire_stream()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        if (!m_streams.empty()) {
+            z_stream* stream = m_streams.back();
+            m_streams.pop_back();
+
+            return stream;
+        }
     }
 
-    return chunks;
+    z_stream* stream = new z_stream();
+    stream->zalloc = nullptr;
+    stream->zfree = nullptr;
+    stream->opaque = nullptr;
+
+    const int errorcode = deflateInit2(/* strm       = */ stream,
+                                       /* level      = */ m_level,
+                                       /* method     = */ Z_DEFLATED,
+                                       /* windowBits = */ 15 + 16,
+                                       /* memLevel   = */ 8,
+                                       /* strategy   = */ Z_DEFAULT_STRATEGY);
+
+    switch (errorcode) {
+        case Z_OK:
+            return stream;
+
+        case Z_MEM_ERROR:
+            delete stream;
+            throw thread_error("gzip_fastq: not enough memory");
+
+        case Z_STREAM_ERROR:
+            delete stream;
+            throw thread_error("gzip_fastq: invalid parameters");
+
+        case Z_VERSION_ERROR:
+            delete stream;
+            throw thread_error("gzip_fastq: incompatible zlib version");
+
+        default:
+            delete stream;
+            throw thread_error("gzip_fastq: unknown error");
+    }
+}
+
+
+void gzip_fastq::release_stream(z_stream* stream)
+{
+    if (deflateReset(stream) != Z_OK) {
+        deflateEnd(stream);
+        delete stream;
+
+        throw thread_error("gzip_fastq: stream error");
+    }
+
+    std::lock_guard<std::mutex> lock(m_lock);
+    m_streams.push_back(stream);
 }
 
 
@@ -650,9 +704,12 @@ static timer s_timer = timer("reads");
 static bool s_finalized = false;
 
 
-write_fastq::write_fastq(const std::string& filename)
+write_fastq::write_fastq(const std::string& filename, compress_fastq* compressor)
   : analytical_step(analytical_step::ordering::ordered, true)
   , m_output(filename)
+  , m_compressor(compressor)
+  , m_pending()
+  , m_pending_size(0)
   , m_eof(false)
   , m_lock()
 {
@@ -669,7 +726,35 @@ chunk_vec write_fastq::process(analytical_chunk* chunk)
     }
 
     m_eof = file_chunk->eof;
-    if (file_chunk->buffers.empty()) {
+    if (m_compressor) {
+        buffer_vec& buffers = file_chunk->buffers;
+        const bool compressed = !buffers.empty();
+
+        if (!compressed) {
+            m_pending_size += get_total_size(file_chunk->reads);
+            std::move(file_chunk->reads.begin(), file_chunk->reads.end(),
+                      std::back_inserter(m_pending));
+            file_chunk->reads.clear();
+        }
+
+        // Buffered lines must be written before the compressed chunk
+        bool flush = !m_pending.empty()
+                     && (compressed || m_pending_size >= FASTQ_COMPRESSED_MIN_SIZE);
+        // An (empty) block is written at EOF, so that output is valid even if
+        // no reads were written.
+        flush = flush || (m_eof && !compressed);
+
+        if (flush) {
+            const size_t n_buffers = buffers.size();
+            m_compressor->compress(m_pending, buffers);
+            std::rotate(buffers.begin(), buffers.begin() + n_buffers, buffers.end());
+
+            m_pending.clear();
+            m_pending_size = 0;
+        }
+
+        m_output.write_buffers(buffers, m_eof);
+    } else if (file_chunk->buffers.empty()) {
         m_output.write_strings(file_chunk->reads, m_eof);
     } else {
         AR_DEBUG_ASSERT(file_chunk->reads.empty());
@@ -24,6 +24,9 @@
 #ifndef FASTQ_IO_H
 #define FASTQ_IO_H
 
+#include <atomic>
+#include <mutex>
+#include <vector>
 #include <zlib.h>
 
 #include <bzlib.h>
@@ -53,6 +56,9 @@ typedef std::unique_ptr<fastq_read_chunk> read_chunk_ptr;
 const size_t FASTQ_CHUNK_SIZE = 2 * 1024;
 //! Size of compressed chunks used to transport compressed data
 const size_t FASTQ_COMPRESSED_CHUNK = 40 * 1024;
+//! Minimum number of bytes compressed into each gzip member / bzip2 stream,
+//! except for the last block in a file
+const size_t FASTQ_COMPRESSED_MIN_SIZE = 64 * 1024;
 
 
 /**
@@ -61,16 +67,28 @@ const size_t FASTQ_COMPRESSED_CHUNK = 40 * 1024;
 class fastq_read_chunk : public analytical_chunk
 {
 public:
-    /** Create chunk representing lines starting at line offset (1-based). */
-    fastq_read_chunk(bool eof_ = false);
+    /** Create chunk representing reads starting at the given (0-based) read. */
+    fastq_read_chunk(bool eof_ = false, size_t first_read_ = 0);
+
+    /** Returns the number of reads (pairs) in the chunk. */
+    virtual size_t read_count() const;
+
+    /** Returns the combined size of headers, sequences and qualities. */
+    virtual size_t memory_usage() const;
 
     //! Indicates that EOF has been reached.
     bool eof;
+    //! Index of the first read (pair) in this chunk, counting from the start
+    //! of the input (or of the sample, for demultiplexed reads).
+    size_t first_read;
 
     //! Lines read from the mate 1 files
     fastq_vec reads_1;
     //! Lines read from the mate 2 files
     fastq_vec reads_2;
+    //! Barcode (pair) identified for each read (pair) when demultiplexing;
+    //! either the index of the barcode or one of the barcode_table constants.
+    std::vector<int> barcodes;
 };
 
 
@@ -80,8 +98,14 @@ public:
 class fastq_output_chunk : public analytical_chunk
 {
 public:
-    /** Constructor; does nothing. */
-    fastq_output_chunk(bool eof_ = false);
+    /**
+     * Constructor.
+     *
+     * @param eof_ Indicates that EOF has been reached.
+     * @param keep_records If true, reads are kept in 'records' rather than
+     *                     being encoded as FASTQ text for writing.
+     */
+    fastq_output_chunk(bool eof_ = false, bool keep_records = false);
 
     /** Destructor; frees buffers. */
     ~fastq_output_chunk();
@@ -89,18 +113,27 @@ public:
     /** Add FASTQ read, accounting for one or more input reads. */
     void add(const fastq_encoding& encoding, const fastq& read, size_t count = 1);
 
+    /** Returns the number of input reads used to generate this chunk. */
+    virtual size_t read_count() const;
+
+    /** Returns the size of (compressed) reads held by the chunk. */
+    virtual size_t memory_usage() const;
+
     //! Indicates that EOF has been reached.
     bool eof;
 
     //! The number of reads used to generate this chunk; may differ from the
     //! the number of reads, in the case of collapsed reads.
     size_t count;
+    //! Reads added to the chunk, if 'keep_records' was set; empty otherwise
+    fastq_vec records;
 
 private:
-    friend class gzip_fastq;
-    friend class bzip2_fastq;
+    friend class compress_fastq;
     friend class write_fastq;
 
+    //! Indicates if reads are kept in 'records' rather than in 'reads'
+    bool m_keep_records;
     //! Lines read from the mate 1 and mate 2 files
     string_vec reads;
 
@@ -252,70 +285,93 @@ private:
 
 
 /**
- * BZip2 compression step; takes any lines in the input chunk, compresses them,
- * and adds them to the buffer list of the chunk, before forwarding it. */
-class bzip2_fastq : public analytical_step
+ * Base class for compression steps; takes any lines in the input chunk,
+ * compresses them, and adds them to the buffer list of the chunk, before
+ * forwarding it.
+ *
+ * Each chunk is compressed into an independent block (a gzip member or a
+ * bzip2 stream), allowing chunks to be compressed in parallel; the downstream
+ * (ordered) write step restores the order of the chunks. Chunks smaller than
+ * FASTQ_COMPRESSED_MIN_SIZE are forwarded uncompressed, and are combined and
+ * compressed by the write step (see 'write_fastq'), since small blocks both
+ * compress poorly and are expensive to set up.
+ */
+class compress_fastq : public analytical_step
 {
 public:
     /** Constructor; 'next_step' sets the destination of compressed chunks. */
-    bzip2_fastq(const userconfig& config, size_t next_step);
+    compress_fastq(size_t next_step);
 
     /** Compresses input lines, saving compressed chunks to chunk->buffers. */
     virtual chunk_vec process(analytical_chunk* chunk);
 
-    /** Checks that all input has been processed and frees stream. */
+    /** Checks that all input has been processed. */
     virtual void finalize();
 
+    /**
+     * Compresses a set of lines into a single block, appending the output to
+     * 'buffers'; may be called by multiple threads at the same time.
+     */
+    virtual void compress(const string_vec& lines, buffer_vec& buffers) = 0;
+
     //! Copy construction not supported
-    bzip2_fastq(const bzip2_fastq&) = delete;
+    compress_fastq(const compress_fastq&) = delete;
     //! Assignment not supported
-    bzip2_fastq& operator=(const bzip2_fastq&) = delete;
+    compress_fastq& operator=(const compress_fastq&) = delete;
 
 private:
-    //! N reads which did not result in an output chunk
-    size_t m_buffered_reads;
     //! The analytical step following this step
     const size_t m_next_step;
-    //! BZip2 stream object
-    bz_stream m_stream;
     //! Used to track whether an EOF block has been received.
-    bool m_eof;
-    //! Lock used to verify that the analytical_step is only run sequentially.
-    std::mutex m_lock;
+    std::atomic<bool> m_eof;
+};
+
+
+/** BZip2 compression step; see 'compress_fastq'. */
+class bzip2_fastq : public compress_fastq
+{
+public:
+    /** Constructor; 'next_step' sets the destination of compressed chunks. */
+    bzip2_fastq(const userconfig& config, size_t next_step);
+
+    /** Compresses lines into a single bzip2 stream. */
+    virtual void compress(const string_vec& lines, buffer_vec& buffers);
+
+private:
+    //! BZip2 compression level (block size)
+    const int m_level;
 };
 
 
 /**
- * GZip compression step; takes any lines in the input chunk, compresses them,
- * and adds them to the buffer list of the chunk, before forwarding it. */
-class gzip_fastq : public analytical_step
+ * GZip compression step; see 'compress_fastq'. Deflate streams are reset and
+ * re-used, so that the number of streams (and the memory used) depends on the
+ * number of threads compressing data at the same time.
+ */
+class gzip_fastq : public compress_fastq
 {
 public:
     /** Constructor; 'next_step' sets the destination of compressed chunks. */
     gzip_fastq(const userconfig& config, size_t next_step);
 
-    /** Compresses input lines, saving compressed chunks to chunk->buffers. */
-    virtual chunk_vec process(analytical_chunk* chunk);
+    /** Frees any remaining deflate streams. */
+    ~gzip_fastq();
 
-    /** Checks that all input has been processed and frees stream. */
-    virtual void finalize();
-
-    //! Copy construction not supported
-    gzip_fastq(const gzip_fastq&) = delete;
-    //! Assignment not supported
-    gzip_fastq& operator=(const gzip_fastq&) = delete;
+    /** Compresses lines into a single gzip member. */
+    virtual void compress(const string_vec& lines, buffer_vec& buffers);
 
 private:
-    //! N reads which did not result in an output chunk
-    size_t m_buffered_reads;
-    //! The analytical step following this step
-    const size_t m_next_step;
-    //! GZip stream object
-    z_stream m_stream;
-    //! Used to track whether an EOF block has been received.
-    bool m_eof;
-    //! Lock used to verify that the analytical_step is only run sequentially.
+    /** Returns an unused deflate stream, creating one if needed. */
+    z_stream* acquire_stream();
+    /** Resets a stream and returns it to the list of unused streams. */
+    void release_stream(z_stream* stream);
+
+    //! GZip compression level
+    const int m_level;
+    //! Lock used to control access to the list of streams
     std::mutex m_lock;
+    //! Unused deflate streams
+    std::vector<z_stream*> m_streams;
 };
 
 
@@ -325,6 +381,11 @@ private:
  * The 'process' function takes a fastq_file_chunk object and writes the lines
  * at the offset corresponding to the 'type' argument to the corresponding
  * output file. The list of lines is cleared upon writing.
+ *
+ * If a compression step is specified, then uncompressed chunks (see
+ * 'compress_fastq') are buffered until at least FASTQ_COMPRESSED_MIN_SIZE
+ * bytes have been collected, or until a compressed chunk or EOF is received,
+ * after which the buffered lines are compressed and written.
  */
 class write_fastq : public analytical_step
 {
@@ -333,11 +394,13 @@ public:
      * Constructor.
      *
      * @param filename Filename to which FASTQ reads are written.
+     * @param compressor Step used to compress chunks before they are written;
+     *                   used to compress buffered lines, if not null.
      *
      * Based on the read-type specified, and SE / PE mode, the corresponding
      * output file is opened
      */
-    write_fastq(const std::string& filename);
+    write_fastq(const std::string& filename, compress_fastq* compressor = nullptr);
 
     /** Writes the reads of the type specified in the constructor. */
     virtual chunk_vec process(analytical_chunk* chunk);
@@ -345,9 +408,20 @@ public:
     /** Flushes the output file and prints progress report (if enabled). */
     virtual void finalize();
 
+    //! Copy construction not supported
+    write_fastq(const write_fastq&) = delete;
+    //! Assignment not supported
+    write_fastq& operator=(const write_fastq&) = delete;
+
 private:
     //! Lazily opened / automatically closed handle
     managed_writer m_output;
+    //! Compression step preceding this step; may be null
+    compress_fastq* const m_compressor;
+    //! Uncompressed lines waiting to be compressed and written
+    string_vec m_pending;
+    //! Total size of the lines in 'm_pending'
+    size_t m_pending_size;
 
     //! Used to track whether an EOF block has been received.
     bool m_eof;
@@ -22,6 +22,7 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>. *
 \*************************************************************************/
 #include <cerrno>
+#include <atomic>
 #include <cstdio>
 #include <cstring>
 #include <cstdlib>
@@ -39,6 +40,9 @@ namespace ar
 //! Size of compressed and uncompressed buffers.
 const int BUF_SIZE = 10 * BUFSIZ;
 
+//! Total number of bytes read from files; used to report progress
+static std::atomic<uint64_t> g_bytes_read(0);
+
 
 ///////////////////////////////////////////////////////////////////////////////
 // Implementations for 'io_error'
@@ -166,6 +170,12 @@ bool line_reader::getline(std::string& dst)
 }
 
 
+uint64_t line_reader::bytes_read()
+{
+    return g_bytes_read;
+}
+
+
 void line_reader::refill_buffers()
 {
     if (m_buffer) {
@@ -202,6 +212,7 @@ void line_reader::refill_buffers_uncompressed()
 void line_reader::refill_raw_buffer()
 {
     const int nread = fread(m_raw_buffer, 1, BUF_SIZE, m_file);
+    g_bytes_read += nread;
 
     if (nread == BUF_SIZE) {
         m_raw_buffer_end = m_raw_buffer + BUF_SIZE;
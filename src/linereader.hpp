@@ -24,6 +24,7 @@
 #ifndef GZFILE_H
 #define GZFILE_H
 
+#include <cstdint>
 #include <cstdio>
 #include <ios>
 #include <string>
@@ -96,6 +97,9 @@ public:
     /** Reads a lien into dst, returning false on EOF. */
     bool getline(std::string& dst);
 
+    /** Returns the number of (compressed) bytes read by all line_readers. */
+    static uint64_t bytes_read();
+
     //! Copy construction not supported
     line_reader(const line_reader&) = delete;
     //! Assignment not supported
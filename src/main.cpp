@@ -32,11 +32,13 @@ namespace ar
 {
 
 // See main_adapter_rm.cpp
-int remove_adapter_sequences(const userconfig& config);
+int remove_adapter_sequences(userconfig& config);
 // See main_adapter_id.cpp
 int identify_adapter_sequences(const userconfig& config);
 // See main_demultiplex.cpp
 int demultiplex_sequences(const userconfig& config);
+// See main_simulate.cpp
+int simulate_sequences(const userconfig& config);
 
 } // namespace ar
 
@@ -78,6 +80,10 @@ int main(int argc, char *argv[])
             return identify_adapter_sequences(config);
         }
 
+        case ar_command::simulate_reads: {
+            return simulate_sequences(config);
+        }
+
         default: {
             std::cerr << "ERROR: Unknown run-type: "
                       << static_cast<size_t>(config.run_type)
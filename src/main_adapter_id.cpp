@@ -22,10 +22,13 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>. *
 \*************************************************************************/
 #include <algorithm>
+#include <atomic>
+#include <cstdlib>
 #include <fstream>
 #include <iomanip>
 #include <iostream>
 #include <list>
+#include <mutex>
 #include <queue>
 #include <stdexcept>
 #include <vector>
@@ -33,6 +36,7 @@
 #include "alignment.hpp"
 #include "debug.hpp"
 #include "fastq_io.hpp"
+#include "main_adapter_id.hpp"
 #include "scheduler.hpp"
 #include "strutils.hpp"
 #include "timer.hpp"
@@ -42,6 +46,10 @@
 namespace ar
 {
 
+//! Implemented in main_adapter_rm.cpp
+void enable_status_feed(const userconfig& config, scheduler& sch);
+
+
 ///////////////////////////////////////////////////////////////////////////////
 // KMer related functions and constants
 
@@ -52,6 +60,18 @@ const size_t N_KMERS = 2 << (2 * KMER_LENGTH);
 //! The N most common kmers to print
 const size_t TOP_N_KMERS = 5;
 
+//! Mismatch threshold used when detecting adapters during trimming; this
+//! corresponds to the default threshold used by --identify-adapters
+const double IDENTIFICATION_MISMATCH_THRESHOLD = 1.0 / 10.0;
+
+//! Number of pairs examined between checks for convergence (--converge)
+const size_t CONVERGENCE_INTERVAL = 100000;
+//! Number of consecutive unchanged checks before reading is stopped
+const size_t CONVERGENCE_CHECKS = 3;
+//! Consensus bases with lower Phred scores are ignored when checking for
+//! convergence, as are all following bases (typically random sequence)
+const char CONVERGENCE_MIN_PHRED = 10;
+
 
 /**
  * Hashing function for string consisting of the chars "ACGT" (uppercase only).
@@ -232,6 +252,69 @@ std::pair<char, char> get_consensus_nt(const nt_counts& nts)
 }
 
 
+/**
+ * Returns the consensus adapter sequence and (Phred+33 encoded) qualities
+ * derived from the observed nucleotide frequencies.
+ */
+string_pair get_consensus_adapter(const nt_count_vec& counts)
+{
+    std::string sequence;
+    std::string qualities;
+
+    for(nt_count_vec::const_iterator it = counts.begin(); it != counts.end(); ++it) {
+        const std::pair<char, char> consensus = get_consensus_nt(*it);
+
+        sequence.push_back(consensus.first);
+        qualities.push_back(consensus.second);
+    }
+
+    return string_pair(sequence, qualities);
+}
+
+
+/**
+ * Returns true if two consensus sequences are considered identical, meaning
+ * that all bases up to the first base with a Phred score less than
+ * CONVERGENCE_MIN_PHRED are identical and that the Phred scores of these
+ * bases differ by at most one.
+ */
+bool is_same_consensus(const string_pair& a, const string_pair& b)
+{
+    for (size_t i = 0; i < std::max(a.first.size(), b.first.size()); ++i) {
+        const bool a_confident = i < a.first.size()
+            && a.second.at(i) - PHRED_OFFSET_33 >= CONVERGENCE_MIN_PHRED;
+        const bool b_confident = i < b.first.size()
+            && b.second.at(i) - PHRED_OFFSET_33 >= CONVERGENCE_MIN_PHRED;
+
+        if (!a_confident || !b_confident) {
+            return a_confident == b_confident;
+        } else if (a.first.at(i) != b.first.at(i)
+                   || std::abs(a.second.at(i) - b.second.at(i)) > 1) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
+/**
+ * Truncates a consensus sequence before the first base with a Phred score
+ * less than CONVERGENCE_MIN_PHRED; see also is_same_consensus.
+ */
+string_pair trim_consensus(const string_pair& consensus)
+{
+    size_t length = 0;
+    while (length < consensus.second.size()
+           && consensus.second.at(length) - PHRED_OFFSET_33 >= CONVERGENCE_MIN_PHRED) {
+        ++length;
+    }
+
+    return string_pair(consensus.first.substr(0, length),
+                       consensus.second.substr(0, length));
+}
+
+
 /**
  * Prints description of consensus adapter sequence.
  *
@@ -245,23 +328,13 @@ void print_consensus_adapter(const nt_count_vec& counts,
                              const std::string& name,
                              const std::string& ref)
 {
-    std::stringstream sequence;
-    std::stringstream qualities;
-
-    for(nt_count_vec::const_iterator it = counts.begin(); it != counts.end(); ++it) {
-        const std::pair<char, char> consensus = get_consensus_nt(*it);
-
-        sequence << consensus.first;
-        qualities << consensus.second;
-    }
-
-    const std::string consensus = sequence.str();
-    const std::string identity = compare_consensus_with_ref(ref, consensus);
+    const string_pair consensus = get_consensus_adapter(counts);
+    const std::string identity = compare_consensus_with_ref(ref, consensus.first);
 
     std::cout << "  " << name << ":  " << ref << "\n"
               << "               " << identity << "\n"
-              << "   Consensus:  " << consensus << "\n"
-              << "     Quality:  " << qualities.str() << "\n\n";
+              << "   Consensus:  " << consensus.first << "\n"
+              << "     Quality:  " << consensus.second << "\n\n";
 
     print_most_common_kmers(kmers);
 }
@@ -346,14 +419,133 @@ private:
 ///////////////////////////////////////////////////////////////////////////////
 // Threaded adapter identification step
 
+/**
+ * Wrapper around a FASTQ reader, allowing reading to be stopped before EOF
+ * once a fixed number of pairs (--max-reads) have been read, or once the
+ * 'stop' flag has been set by a downstream step (--converge). Optionally,
+ * chunks read may be kept, in which case copies are passed downstream.
+ */
+class sampled_fastq_reader : public analytical_step
+{
+public:
+    /**
+     * @param reader Reader producing fastq_read_chunks of paired reads.
+     * @param next_step The analytical step following this step.
+     * @param max_reads Maximum number of pairs to return; 0 for no limit.
+     * @param stop Flag set by downstream steps to terminate reading.
+     * @param buffer If not null, (untruncated) chunks read are stored here.
+     */
+    sampled_fastq_reader(analytical_step& reader,
+                         size_t next_step,
+                         size_t max_reads,
+                         const std::atomic<bool>& stop,
+                         chunk_vec* buffer = nullptr)
+      : analytical_step(analytical_step::ordering::ordered, true)
+      , m_reader(reader)
+      , m_next_step(next_step)
+      , m_max_reads(max_reads)
+      , m_stop(stop)
+      , m_buffer(buffer)
+      , m_reads(0)
+      , m_stopped(false)
+    {
+    }
+
+    chunk_vec process(analytical_chunk* chunk)
+    {
+        if (m_stopped || m_stop) {
+            m_stopped = true;
+            return chunk_vec();
+        }
+
+        chunk_vec chunks;
+        for (auto& it : m_reader.process(chunk)) {
+            read_chunk_ptr file_chunk(dynamic_cast<fastq_read_chunk*>(it.second.release()));
+            AR_DEBUG_ASSERT(file_chunk->reads_1.size() == file_chunk->reads_2.size());
+
+            size_t n_reads = file_chunk->reads_1.size();
+            if (m_max_reads && m_reads + n_reads >= m_max_reads) {
+                n_reads = m_max_reads - m_reads;
+                m_stopped = true;
+            }
+
+            if (m_buffer) {
+                read_chunk_ptr copy(new fastq_read_chunk(file_chunk->eof, file_chunk->first_read));
+                copy->reads_1.assign(file_chunk->reads_1.begin(), file_chunk->reads_1.begin() + n_reads);
+                copy->reads_2.assign(file_chunk->reads_2.begin(), file_chunk->reads_2.begin() + n_reads);
+
+                m_buffer->push_back(chunk_pair(it.first, std::move(file_chunk)));
+                file_chunk = std::move(copy);
+            } else {
+                file_chunk->reads_1.resize(n_reads);
+                file_chunk->reads_2.resize(n_reads);
+            }
+
+            m_reads += n_reads;
+            chunks.push_back(chunk_pair(m_next_step, std::move(file_chunk)));
+        }
+
+        return chunks;
+    }
+
+    /**
+     * Finalizes the wrapped reader, unless reading was stopped early or
+     * chunks were buffered for further processing.
+     */
+    void finalize()
+    {
+        if (!m_stopped && !m_buffer) {
+            m_reader.finalize();
+        }
+    }
+
+    //! Copy construction not supported
+    sampled_fastq_reader(const sampled_fastq_reader&) = delete;
+    //! Assignment not supported
+    sampled_fastq_reader& operator=(const sampled_fastq_reader&) = delete;
+
+private:
+    //! The wrapped FASTQ reader
+    analytical_step& m_reader;
+    //! The analytical step following this step
+    const size_t m_next_step;
+    //! Maximum number of pairs to read; 0 if unlimited
+    const size_t m_max_reads;
+    //! Flag set by downstream steps to terminate reading
+    const std::atomic<bool>& m_stop;
+    //! Optional buffer in which to store chunks read
+    chunk_vec* m_buffer;
+    //! Number of pairs returned so far
+    size_t m_reads;
+    //! Set once reading has been terminated before EOF
+    bool m_stopped;
+};
+
+
 class adapter_identification : public analytical_step
 {
 public:
-    adapter_identification(const userconfig& config)
+    /**
+     * @param config User settings.
+     * @param mismatch_threshold Mismatch threshold for overlapping pairs.
+     * @param stop Flag set once the consensus sequences have converged.
+     */
+    adapter_identification(const userconfig& config,
+                           double mismatch_threshold,
+                           std::atomic<bool>& stop)
       : analytical_step(analytical_step::ordering::unordered)
       , m_config(config)
+      , m_mismatch_threshold(mismatch_threshold)
       , m_timer("reads")
       , m_sinks(config)
+      , m_totals()
+      , m_stop(stop)
+      , m_checkpoint_lock()
+      , m_checkpoint_pcr1()
+      , m_checkpoint_pcr2()
+      , m_checkpoint_reads(0)
+      , m_checkpoint_consensus()
+      , m_unchanged_checks(0)
     {
     }
 
@@ -376,24 +568,62 @@ public:
         fastq_vec::iterator read_1 = file_chunk->reads_1.begin();
         fastq_vec::iterator read_2 = file_chunk->reads_2.begin();
 
+        // Counts are collected per chunk, so that they may be used for checks
+        nt_count_vec pcr1_counts;
+        nt_count_vec pcr2_counts;
         while (read_1 != file_chunk->reads_1.end()) {
-            process_reads(adapters, stats, *sink, *read_1++, *read_2++);
+            process_reads(adapters, stats, pcr1_counts, pcr2_counts, *sink,
+                          *read_1++, *read_2++);
         }
 
+        stats.records += file_chunk->reads_1.size();
+        merge_vectors(sink->pcr1_counts, pcr1_counts);
+        merge_vectors(sink->pcr2_counts, pcr2_counts);
+
         m_sinks.return_sink(std::move(sink));
         m_timer.increment(file_chunk->reads_1.size() * 2);
 
+        if (m_config.converge) {
+            check_convergence(file_chunk->reads_1.size(), pcr1_counts, pcr2_counts);
+        }
+
         return chunk_vec();
     }
 
-    /** Prints summary of inferred consensus sequences. */
+    /** Merges statistics and consensus sequences collected by all threads. */
     void finalize()
     {
         m_timer.finalize();
+        m_totals = m_sinks.finalize();
+    }
+
+    /** Returns the inferred adapters; must be called after finalize. */
+    inferred_adapters get_inferred_adapters() const
+    {
+        inferred_adapters result;
+        result.pairs_examined = m_totals->stats->records;
+        result.overlapping_pairs = m_totals->stats->well_aligned_reads;
+        result.pairs_with_adapters = m_totals->stats->number_of_reads_with_adapter.at(0);
+        result.adapter1 = trim_consensus(get_consensus_adapter(m_totals->pcr1_counts));
+        result.adapter2 = trim_consensus(get_consensus_adapter(m_totals->pcr2_counts));
+
+        return result;
+    }
+
+    /** Prints summary of inferred consensus sequences; see finalize. */
+    void print_summary() const
+    {
+        const std::unique_ptr<adapter_stats>& sink = m_totals;
 
-        std::unique_ptr<adapter_stats> sink(m_sinks.finalize());
+        std::cout << "   Examined " << sink->stats->records << " pairs";
+        if (m_stop) {
+            std::cout << "; stopped after consensus converged";
+        } else if (m_config.max_reads && sink->stats->records >= m_config.max_reads) {
+            std::cout << "; stopped at --max-reads";
+        }
 
-        std::cout << "   Found " << sink->stats->well_aligned_reads << " overlapping pairs ...\n"
+        std::cout << " ...\n"
+                  << "   Found " << sink->stats->well_aligned_reads << " overlapping pairs ...\n"
                   << "   Of which " << sink->stats->number_of_reads_with_adapter.at(0) << " contained adapter sequence(s) ...\n\n"
                   << "Printing adapter sequences, including poly-A tails:"
                   << std::endl;
@@ -408,8 +638,52 @@ public:
     }
 
 private:
+    /**
+     * Adds counts from a chunk to the running totals, and checks if the
+     * consensus sequences and qualities (see is_same_consensus) have changed
+     * every CONVERGENCE_INTERVAL pairs; if the consensus sequences are
+     * unchanged for CONVERGENCE_CHECKS consecutive checks, the stop flag is
+     * set.
+     */
+    void check_convergence(size_t n_reads,
+                           const nt_count_vec& pcr1_counts,
+                           const nt_count_vec& pcr2_counts)
+    {
+        std::lock_guard<std::mutex> lock(m_checkpoint_lock);
+
+        merge_vectors(m_checkpoint_pcr1, pcr1_counts);
+        merge_vectors(m_checkpoint_pcr2, pcr2_counts);
+        m_checkpoint_reads += n_reads;
+
+        if (m_checkpoint_reads < CONVERGENCE_INTERVAL) {
+            return;
+        }
+
+        m_checkpoint_reads -= CONVERGENCE_INTERVAL;
+
+        const string_pair pcr1 = get_consensus_adapter(m_checkpoint_pcr1);
+        const string_pair pcr2 = get_consensus_adapter(m_checkpoint_pcr2);
+
+        // Checks are only counted once adapter sequences have been observed
+        if (!pcr1.first.empty()
+            && is_same_consensus(pcr1, m_checkpoint_consensus.first)
+            && is_same_consensus(pcr2, m_checkpoint_consensus.second)) {
+            if (++m_unchanged_checks >= CONVERGENCE_CHECKS) {
+                m_stop = true;
+            }
+        } else {
+            m_unchanged_checks = 0;
+        }
+
+        m_checkpoint_consensus.first = pcr1;
+        m_checkpoint_consensus.second = pcr2;
+    }
+
+
     void process_reads(const fastq_pair_vec& adapters,
                        statistics& stats,
+                       nt_count_vec& pcr1_counts,
+                       nt_count_vec& pcr2_counts,
                        adapter_stats& sink,
                        fastq& read1,
                        fastq& read2)
@@ -420,18 +694,20 @@ private:
         // Reverse complement to match the orientation of read1
         read2.reverse_complement();
 
-        const alignment_info alignment = align_paired_ended_sequences(read1, read2, adapters, m_config.shift);
+        const alignment_info alignment = align_paired_ended_sequences(read1, read2, adapters, m_config.shift, -1,
+                                                                      m_mismatch_threshold);
 
-        if (m_config.is_good_alignment(alignment)) {
+        if (m_config.is_good_alignment(alignment, m_mismatch_threshold)) {
             stats.well_aligned_reads++;
-            if (m_config.is_alignment_collapsible(alignment)) {
+            // Pairs are required to overlap as if collapsing, regardless of --collapse
+            if (alignment.length - alignment.n_ambiguous >= m_config.min_alignment_length) {
                 if (extract_adapter_sequences(alignment, read1, read2)) {
                     stats.number_of_reads_with_adapter.at(0)++;
 
-                    process_adapter(read1.sequence(), sink.pcr1_counts, sink.pcr1_kmers);
+                    process_adapter(read1.sequence(), pcr1_counts, sink.pcr1_kmers);
 
                     read2.reverse_complement();
-                    process_adapter(read2.sequence(), sink.pcr2_counts, sink.pcr2_kmers);
+                    process_adapter(read2.sequence(), pcr2_counts, sink.pcr2_kmers);
                 }
             }
         } else {
@@ -459,30 +735,93 @@ private:
     }
 
     const userconfig& m_config;
+    //! Mismatch threshold used when aligning pairs
+    const double m_mismatch_threshold;
 
     timer m_timer;
     adapter_sink m_sinks;
+    //! Totals collected by all threads; set by finalize
+    std::unique_ptr<adapter_stats> m_totals;
+
+    //! Set once the consensus sequences have converged (--converge)
+    std::atomic<bool>& m_stop;
+    //! Lock protecting the following members
+    std::mutex m_checkpoint_lock;
+    //! Running totals of nucleotide frequencies for adapter 1 fragments
+    nt_count_vec m_checkpoint_pcr1;
+    //! Running totals of nucleotide frequencies for adapter 2 fragments
+    nt_count_vec m_checkpoint_pcr2;
+    //! Number of pairs processed since the last check
+    size_t m_checkpoint_reads;
+    //! Consensus sequences and qualities found at the last check
+    std::pair<string_pair, string_pair> m_checkpoint_consensus;
+    //! Number of consecutive checks without changes to the consensus
+    size_t m_unchanged_checks;
 };
 
 
+inferred_adapters::inferred_adapters()
+  : pairs_examined(0)
+  , overlapping_pairs(0)
+  , pairs_with_adapters(0)
+  , adapter1()
+  , adapter2()
+{
+}
+
+
+bool infer_adapter_sequences(const userconfig& config,
+                             analytical_step& reader,
+                             chunk_vec& buffer,
+                             inferred_adapters& result)
+{
+    std::atomic<bool> stop(false);
+    adapter_identification* identification = nullptr;
+
+    scheduler sch;
+    sch.add_step(ai_read_fastq, "read_fastq_sample",
+                 new sampled_fastq_reader(reader, ai_identify_adapters,
+                                          config.max_reads, stop, &buffer));
+    sch.add_step(ai_identify_adapters, "detect_adapters",
+                 identification = new adapter_identification(config, IDENTIFICATION_MISMATCH_THRESHOLD, stop));
+
+    if (!sch.run(config.max_threads)) {
+        return false;
+    }
+
+    result = identification->get_inferred_adapters();
+
+    return true;
+}
+
+
 int identify_adapter_sequences(const userconfig& config)
 {
     std::cout << "Attempting to identify adapter sequences ..." << std::endl;
 
-    scheduler sch;
+    std::atomic<bool> stop(false);
+    std::unique_ptr<analytical_step> reader;
+    adapter_identification* identification = nullptr;
+
+    scheduler sch(config.profile, !config.trace_file.empty(), config.perf_counters);
+    enable_status_feed(config, sch);
     try {
         if (config.interleaved_input) {
-            sch.add_step(ai_read_fastq, "read_interleaved_fastq",
-                         new read_interleaved_fastq(config.quality_input_fmt.get(),
+            reader.reset(new read_interleaved_fastq(config.quality_input_fmt.get(),
                                                     config.input_files_1,
                                                     ai_identify_adapters));
         } else {
-            sch.add_step(ai_read_fastq, "read_paired_fastq",
-                         new read_paired_fastq(config.quality_input_fmt.get(),
+            reader.reset(new read_paired_fastq(config.quality_input_fmt.get(),
                                                config.input_files_1,
                                                config.input_files_2,
                                                ai_identify_adapters));
         }
+
+        sch.add_step(ai_read_fastq,
+                     config.interleaved_input ? "read_interleaved_fastq"
+                                              : "read_paired_fastq",
+                     new sampled_fastq_reader(*reader, ai_identify_adapters,
+                                              config.max_reads, stop));
     } catch (const std::ios_base::failure& error) {
         std::cerr << "IO error opening file; aborting:\n"
                   << cli_formatter::fmt(error.what()) << std::endl;
@@ -490,12 +829,18 @@ int identify_adapter_sequences(const userconfig& config)
     }
 
     sch.add_step(ai_identify_adapters, "identify_adapters",
-                 new adapter_identification(config));
+                 identification = new adapter_identification(config, config.mismatch_threshold, stop));
 
     if (!sch.run(config.max_threads)) {
         return 1;
+    } else if (config.profile && !sch.write_profile(config.get_output_filename("--profile"))) {
+        return 1;
+    } else if (!config.trace_file.empty() && !sch.write_trace(config.trace_file)) {
+        return 1;
     }
 
+    identification->print_summary();
+
     return 0;
 }
 
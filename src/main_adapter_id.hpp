@@ -0,0 +1,79 @@
+/*************************************************************************\
+ * AdapterRemoval - cleaning next-generation sequencing reads            *
+ *                                                                       *
+ * Copyright (C) 2011 by Stinus Lindgreen - stinus@binf.ku.dk            *
+ * Copyright (C) 2014 by Mikkel Schubert - mikkelsch@gmail.com           *
+ *                                                                       *
+ * If you use the program, please cite the paper:                        *
+ * S. Lindgreen (2012): AdapterRemoval: Easy Cleaning of Next Generation *
+ * Sequencing Reads, BMC Research Notes, 5:337                           *
+ * http://www.biomedcentral.com/1756-0500/5/337/                         *
+ *                                                                       *
+ * This program is free software: you can redistribute it and/or modify  *
+ * it under the terms of the GNU General Public License as published by  *
+ * the Free Software Foundation, either version 3 of the License, or     *
+ * (at your option) any later version.                                   *
+ *                                                                       *
+ * This program is distributed in the hope that it will be useful,       *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ * GNU General Public License for more details.                          *
+ *                                                                       *
+ * You should have received a copy of the GNU General Public License     *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+\*************************************************************************/
+#ifndef MAIN_ADAPTER_ID_H
+#define MAIN_ADAPTER_ID_H
+
+#include <string>
+
+#include "commontypes.hpp"
+#include "scheduler.hpp"
+
+namespace ar
+{
+
+class userconfig;
+
+
+/** Summary of adapter sequences inferred from overlapping pairs of reads. */
+struct inferred_adapters
+{
+    /** Constructor; no pairs examined and no adapters inferred. */
+    inferred_adapters();
+
+    //! Number of pairs of reads examined
+    size_t pairs_examined;
+    //! Number of pairs of reads found to overlap
+    size_t overlapping_pairs;
+    //! Number of overlapping pairs containing adapter sequence(s)
+    size_t pairs_with_adapters;
+    //! Consensus adapter 1 sequence and (Phred+33) quality scores
+    string_pair adapter1;
+    //! Consensus adapter 2 sequence and (Phred+33) quality scores, in the
+    //! orientation found in mate 2 reads (e.g. as expected by --adapter2)
+    string_pair adapter2;
+};
+
+
+/**
+ * Infers adapter sequences from (up to) the first --max-reads pairs of reads
+ * produced by a paired FASTQ reader, using the same approach as when running
+ * with --identify-adapters. Consensus sequences are truncated before the first
+ * base with a low consensus quality score (e.g. at the poly-A tail or at the
+ * first random base).
+ *
+ * @param config User settings; --converge is respected.
+ * @param reader A read_paired_fastq or read_interleaved_fastq step.
+ * @param buffer Receives every chunk read from 'reader', in order.
+ * @param result Summary of inferred adapter sequences.
+ * @return True on success, false if an error occured.
+ */
+bool infer_adapter_sequences(const userconfig& config,
+                             analytical_step& reader,
+                             chunk_vec& buffer,
+                             inferred_adapters& result);
+
+} // namespace ar
+
+#endif
@@ -30,13 +30,17 @@
 #include <stdexcept>
 #include <string>
 #include <vector>
+#include <sys/stat.h>
 
 #include "alignment.hpp"
+#include "alignment_cache.hpp"
 #include "debug.hpp"
 #include "demultiplex.hpp"
 #include "fastq.hpp"
 #include "fastq_io.hpp"
 #include "main.hpp"
+#include "main_adapter_id.hpp"
+#include "reads_processor.hpp"
 #include "strutils.hpp"
 #include "trimmed_reads.hpp"
 #include "userconfig.hpp"
@@ -45,7 +49,9 @@
 namespace ar
 {
 
-typedef std::unique_ptr<std::mt19937> mt19937_ptr;
+//! Number of well aligned pairs sampled (per thread) in order to estimate the
+//! most common insert size, which is used to speed up alignments.
+const size_t INSERT_SIZE_SAMPLES = 10000;
 
 
 std::ostream& operator<<(std::ostream& stream, const fastq::ntrimmed& ntrim)
@@ -59,7 +65,8 @@ std::ostream& operator<<(std::ostream& stream, const fastq::ntrimmed& ntrim)
 }
 
 
-void write_settings(const userconfig& config, std::ostream& output, int nth)
+void write_settings(const userconfig& config, std::ostream& output, int nth,
+                    const inferred_adapters* detected = nullptr)
 {
     output << NAME << " " << VERSION
              << "\nTrimming of ";
@@ -133,8 +140,21 @@ void write_settings(const userconfig& config, std::ostream& output, int nth)
         }
     }
 
+    if (detected) {
+        output << "\n\n[Adapter detection]"
+               << "\nNumber of read pairs examined: " << detected->pairs_examined
+               << "\nNumber of overlapping read pairs: " << detected->overlapping_pairs
+               << "\nNumber of read pairs with adapters: " << detected->pairs_with_adapters
+               << "\nConsensus adapter1: " << detected->adapter1.first
+               << "\nConsensus quality1: " << detected->adapter1.second
+               << "\nConsensus adapter2: " << detected->adapter2.first
+               << "\nConsensus quality2: " << detected->adapter2.second
+               << "\nUsing detected adapters: "
+               << (detected->adapter1.first.empty() || detected->adapter2.first.empty() ? "No" : "Yes");
+    }
+
     output << "\n\n[Adapter trimming]";
-    if (config.max_threads > 1 || config.deterministic) {
+    if (config.deterministic) {
         output << "\nRNG seed: NA";
     } else {
         output << "\nRNG seed: " << config.seed;
@@ -176,9 +196,10 @@ void write_settings(const userconfig& config, std::ostream& output, int nth)
 void write_trimming_settings(const userconfig& config,
                              const statistics& stats,
                              size_t nth,
+                             const inferred_adapters* detected,
                              std::ostream& settings)
 {
-    write_settings(config, settings, nth);
+    write_settings(config, settings, nth, detected);
 
     const std::string reads_type = (config.paired_ended_mode ? "read pairs: " : "reads: ");
     settings << "\n\n\n[Trimming statistics]"
@@ -211,6 +232,18 @@ void write_trimming_settings(const userconfig& config,
              << "\nAverage length of retained reads: "
              << (stats.total_number_of_good_reads ? ( static_cast<double>(stats.total_number_of_nucleotides) / stats.total_number_of_good_reads) : 0);
 
+    if (config.alignment_cache_size) {
+        settings << "\nNumber of alignment cache hits: " << stats.alignment_cache_hits
+                 << "\nNumber of alignment cache misses: " << stats.alignment_cache_misses;
+    }
+
+    if (config.report_alignment_stats) {
+        settings << "\nNumber of alignment offsets evaluated: " << stats.alignments.offsets_evaluated
+                 << "\nNumber of alignment offsets abandoned: " << stats.alignments.offsets_abandoned
+                 << "\nNumber of alignment offsets resumed: " << stats.alignments.offsets_resumed
+                 << "\nNumber of bases compared during alignment: " << stats.alignments.bases_compared;
+    }
+
     settings << "\n\n\n[Length distribution]"
              << "\nLength\tMate1\t";
     if (config.paired_ended_mode) {
@@ -285,9 +318,94 @@ bool write_demux_settings(const userconfig& config,
 }
 
 
+//! Features of the read-processing loops that are selected at compile time
+enum processing_feature : unsigned
+{
+    //! Overlapping reads are collapsed (--collapse)
+    feature_collapse = 1 << 0,
+    //! All reads are written to the same file(s) (--combined-output)
+    feature_combined_output = 1 << 1,
+    //! Reads are trimmed using sliding windows (--trimwindows)
+    feature_trim_windows = 1 << 2,
+    //! Low quality or ambiguous bases are trimmed (--trimns / --trimqualities)
+    feature_trim_trailing = 1 << 3,
+    //! Fixed numbers of bases are trimmed (--trim5p / --trim3p)
+    feature_trim_fixed = 1 << 4,
+    //! Conflicts are not resolved randomly when collapsing (--deterministic)
+    feature_deterministic = 1 << 5,
+    //! Features are determined at runtime; used for uncommon combinations
+    feature_generic = 1u << 31,
+};
+
+
+/** Returns the set of processing features enabled by the user. */
+unsigned select_processing_features(const userconfig& config)
+{
+    unsigned features = 0;
+    if (config.collapse) {
+        features |= feature_collapse;
+
+        if (config.deterministic) {
+            features |= feature_deterministic;
+        }
+    }
+
+    if (config.combined_output) {
+        features |= feature_combined_output;
+    }
+
+    if (config.trim_window_length >= 0) {
+        features |= feature_trim_windows;
+    } else if (config.trim_ambiguous_bases || config.trim_by_quality) {
+        features |= feature_trim_trailing;
+    }
+
+    if (config.trim_fixed_5p.first || config.trim_fixed_5p.second ||
+        config.trim_fixed_3p.first || config.trim_fixed_3p.second) {
+        features |= feature_trim_fixed;
+    }
+
+    return features;
+}
+
+
+/**
+ * Set of processing features; for any value of FEATURES other than
+ * feature_generic, checks are resolved at compile time, allowing the compiler
+ * to remove code for disabled features from the per-read loops.
+ */
+template <unsigned FEATURES>
+class processing_features
+{
+public:
+    processing_features(const userconfig& config)
+      : m_features(FEATURES == feature_generic ? select_processing_features(config) : FEATURES)
+    {
+    }
+
+    /** Returns true if the feature is enabled. */
+    bool operator()(processing_feature feature) const
+    {
+        return (FEATURES == feature_generic) ? (m_features & feature) : (FEATURES & feature);
+    }
+
+private:
+    //! Features enabled at runtime; only used by the generic instantiation
+    const unsigned m_features;
+};
+
+
 /** Trims fixed numbers of bases from the 5' and/or 3' termini of reads. **/
-void trim_read_termini_if_enabled(const userconfig& config, fastq& read, read_type type)
+template <typename FEATURES>
+void trim_read_termini_if_enabled(const userconfig& config,
+                                  const FEATURES& enabled,
+                                  fastq& read,
+                                  read_type type)
 {
+    if (!enabled(feature_trim_fixed)) {
+        return;
+    }
+
     size_t trim_5p = 0;
     size_t trim_3p = 0;
 
@@ -327,13 +445,16 @@ void trim_read_termini_if_enabled(const userconfig& config, fastq& read, read_ty
 
 
 /** Trims a read if enabled, returning the #bases removed from each end. */
-fastq::ntrimmed trim_sequence_by_quality_if_enabled(const userconfig& config, fastq& read)
+template <typename FEATURES>
+fastq::ntrimmed trim_sequence_by_quality_if_enabled(const userconfig& config,
+                                                    const FEATURES& enabled,
+                                                    fastq& read)
 {
-    if (config.trim_window_length >= 0) {
+    if (enabled(feature_trim_windows)) {
         return read.trim_windowed_bases(config.trim_ambiguous_bases,
                                         config.low_quality_score,
                                         config.trim_window_length);
-    } else if (config.trim_ambiguous_bases || config.trim_by_quality) {
+    } else if (enabled(feature_trim_trailing)) {
         const char quality_score = config.trim_by_quality ? config.low_quality_score : -1;
 
         return read.trim_trailing_bases(config.trim_ambiguous_bases,
@@ -344,14 +465,16 @@ fastq::ntrimmed trim_sequence_by_quality_if_enabled(const userconfig& config, fa
 }
 
 
+template <typename FEATURES>
 void process_collapsed_read(const userconfig& config,
+                            const FEATURES& enabled,
                             statistics& stats,
                             fastq& collapsed_read,
                             fastq* mate_read,
                             trimmed_reads& chunks)
 {
-    trim_read_termini_if_enabled(config, collapsed_read, read_type::collapsed);
-    const fastq::ntrimmed trimmed = trim_sequence_by_quality_if_enabled(config, collapsed_read);
+    trim_read_termini_if_enabled(config, enabled, collapsed_read, read_type::collapsed);
+    const fastq::ntrimmed trimmed = trim_sequence_by_quality_if_enabled(config, enabled, collapsed_read);
 
     // If trimmed, the external coordinates are no longer reliable
     // for determining the size of the original template.
@@ -389,56 +512,13 @@ void process_collapsed_read(const userconfig& config,
 }
 
 
-class reads_processor : public analytical_step
-{
-public:
-    reads_processor(const userconfig& config, size_t nth)
-      : analytical_step(analytical_step::ordering::unordered)
-      , m_config(config)
-      , m_adapters(config.adapters.get_adapter_set(nth))
-      , m_stats(config)
-      , m_nth(nth)
-    {
-
-    }
-
-    statistics_ptr get_final_statistics() {
-        return m_stats.finalize();
-    }
-
-protected:
-    class stats_sink : public statistics_sink<statistics>
-    {
-    public:
-        stats_sink(const userconfig& config)
-          : m_config(config)
-        {
-        }
-
-    protected:
-        virtual pointer new_sink() const {
-            return m_config.create_stats();
-        }
-
-        virtual void reduce(pointer& dst, const pointer& src) const {
-            (*dst) += (*src);
-        }
-
-        const userconfig& m_config;
-    };
-
-    const userconfig& m_config;
-    const fastq_pair_vec m_adapters;
-    stats_sink m_stats;
-    const size_t m_nth;
-};
-
-
+template <unsigned FEATURES>
 class se_reads_processor : public reads_processor
 {
 public:
-    se_reads_processor(const userconfig& config, size_t nth = 0)
-      : reads_processor(config, nth)
+    se_reads_processor(const userconfig& config, size_t nth = 0, bool keep_records = false)
+      : reads_processor(config, nth, keep_records)
+      , m_enabled(config)
     {
     }
 
@@ -447,27 +527,41 @@ public:
         const size_t offset = m_nth * ai_analyses_offset;
 
         read_chunk_ptr read_chunk(dynamic_cast<fastq_read_chunk*>(chunk));
-        trimmed_reads chunks(m_config, offset, read_chunk->eof);
+        trimmed_reads chunks(m_config, offset, read_chunk->eof, m_keep_records);
         stats_sink::pointer stats = m_stats.get_sink();
+        alignment_cache_ptr cache = get_alignment_cache();
 
         for (auto& read : read_chunk->reads_1) {
-            const alignment_info alignment = align_single_ended_sequence(read, m_adapters, m_config.shift);
+            alignment_info alignment;
+            if (!cache) {
+                alignment = align_single_ended_sequence(read, m_adapters, m_config.shift,
+                                                        m_config.mismatch_threshold,
+                                                        &stats->alignments);
+            } else if (cache->lookup(read.sequence(), std::string(), alignment)) {
+                stats->alignment_cache_hits++;
+            } else {
+                alignment = align_single_ended_sequence(read, m_adapters, m_config.shift,
+                                                        m_config.mismatch_threshold,
+                                                        &stats->alignments);
+                cache->insert(read.sequence(), std::string(), alignment);
+                stats->alignment_cache_misses++;
+            }
 
             if (m_config.is_good_alignment(alignment)) {
                 truncate_single_ended_sequence(alignment, read);
                 stats->number_of_reads_with_adapter.at(alignment.adapter_id)++;
                 stats->well_aligned_reads++;
 
-                if (m_config.is_alignment_collapsible(alignment)) {
-                    process_collapsed_read(m_config, *stats, read, nullptr, chunks);
+                if (m_enabled(feature_collapse) && m_config.is_alignment_collapsible(alignment)) {
+                    process_collapsed_read(m_config, m_enabled, *stats, read, nullptr, chunks);
                     continue;
                 }
             } else {
                 stats->unaligned_reads++;
             }
 
-            trim_read_termini_if_enabled(m_config, read, read_type::mate_1);
-            trim_sequence_by_quality_if_enabled(m_config, read);
+            trim_read_termini_if_enabled(m_config, m_enabled, read, read_type::mate_1);
+            trim_sequence_by_quality_if_enabled(m_config, m_enabled, read);
             if (m_config.is_acceptable_read(read)) {
                 stats->keep1++;
                 stats->total_number_of_good_reads++;
@@ -485,70 +579,53 @@ public:
 
         stats->records += read_chunk->reads_1.size();
         m_stats.return_sink(std::move(stats));
+        if (cache) {
+            m_caches.return_sink(std::move(cache));
+        }
 
         return chunks.finalize();
     }
-};
-
-
-/** Class for building RNGs on demand. */
-class rng_sink : public statistics_sink<std::mt19937>
-{
-public:
-    rng_sink(unsigned seed)
-      : m_seed(seed)
-    {
-    }
-
-protected:
-    virtual pointer new_sink() const {
-        return pointer(new std::mt19937(m_seed()));
-    }
-
-    virtual void reduce(pointer&, const pointer&) const {
-        // Intentionally left empty
-    }
-
-    //! Copy construction not supported
-    rng_sink(const rng_sink&) = delete;
-    //! Assignment not supported
-    rng_sink& operator=(const rng_sink&) = delete;
 
 private:
-    mutable std::mt19937 m_seed;
+    const processing_features<FEATURES> m_enabled;
 };
 
 
+template <unsigned FEATURES>
 class pe_reads_processor : public reads_processor
 {
 public:
-    pe_reads_processor(const userconfig& config, size_t nth)
-      : reads_processor(config, nth)
-      , m_rngs(config.seed)
+    pe_reads_processor(const userconfig& config, size_t nth, bool keep_records = false)
+      : reads_processor(config, nth, keep_records)
+      , m_enabled(config)
     {
     }
 
     chunk_vec process(analytical_chunk* chunk)
     {
         const size_t offset = m_nth * ai_analyses_offset;
-        const char mate_separator = m_config.combined_output ? '\0' : m_config.mate_separator;
-
-        mt19937_ptr rng;
-        if (!m_config.deterministic) {
-            rng = m_rngs.get_sink();
-        }
+        const char mate_separator = m_enabled(feature_combined_output) ? '\0' : m_config.mate_separator;
 
         read_chunk_ptr read_chunk(dynamic_cast<fastq_read_chunk*>(chunk));
-        trimmed_reads chunks(m_config, offset, read_chunk->eof);
+        trimmed_reads chunks(m_config, offset, read_chunk->eof, m_keep_records);
         statistics_ptr stats = m_stats.get_sink();
+        alignment_cache_ptr cache = get_alignment_cache();
 
         AR_DEBUG_ASSERT(read_chunk->reads_1.size() == read_chunk->reads_2.size());
 
+        // Alignments are most likely to match the most common insert size
+        const int insert_size = stats->insert_size_mode();
+
+        // Index of the current pair; used to select random numbers for the
+        // pair independently of the order in which chunks are processed.
+        size_t read_index = read_chunk->first_read;
+
         auto it_1 = read_chunk->reads_1.begin();
         auto it_2 = read_chunk->reads_2.begin();
-        while (it_1 != read_chunk->reads_1.end()) {
-            fastq read_1 = *it_1++;
-            fastq read_2 = *it_2++;
+        for (; it_1 != read_chunk->reads_1.end(); ++read_index) {
+            // Reads are not used after processing, and can be modified in place
+            fastq& read_1 = *it_1++;
+            fastq& read_2 = *it_2++;
 
             // Throws if read-names or mate numbering does not match
             fastq::validate_paired_reads(read_1, read_2, m_config.mate_separator);
@@ -556,24 +633,44 @@ public:
             // Reverse complement to match the orientation of read_1
             read_2.reverse_complement();
 
-            const alignment_info alignment = align_paired_ended_sequences(read_1, read_2, m_adapters, m_config.shift);
+            alignment_info alignment;
+            if (!cache) {
+                alignment = align_paired_ended_sequences(read_1, read_2, m_adapters, m_config.shift,
+                                                         insert_size, m_config.mismatch_threshold,
+                                                         &stats->alignments);
+            } else if (cache->lookup(read_1.sequence(), read_2.sequence(), alignment)) {
+                stats->alignment_cache_hits++;
+            } else {
+                alignment = align_paired_ended_sequences(read_1, read_2, m_adapters, m_config.shift,
+                                                         insert_size, m_config.mismatch_threshold,
+                                                         &stats->alignments);
+                cache->insert(read_1.sequence(), read_2.sequence(), alignment);
+                stats->alignment_cache_misses++;
+            }
 
             if (m_config.is_good_alignment(alignment)) {
                 stats->well_aligned_reads++;
+                if (stats->insert_size_samples < INSERT_SIZE_SAMPLES) {
+                    stats->inc_insert_size_count(std::max<int>(0, read_2.length() + alignment.offset));
+                }
+
                 const size_t n_adapters = truncate_paired_ended_sequences(alignment, read_1, read_2);
                 stats->number_of_reads_with_adapter.at(alignment.adapter_id) += n_adapters;
 
-                if (m_config.is_alignment_collapsible(alignment)) {
-                    fastq collapsed_read = collapse_paired_ended_sequences(alignment, read_1, read_2, rng.get(),
+                if (m_enabled(feature_collapse) && m_config.is_alignment_collapsible(alignment)) {
+                    counter_rng rng(m_config.seed, m_nth, read_index);
+                    fastq collapsed_read = collapse_paired_ended_sequences(alignment, read_1, read_2,
+                                                                           m_enabled(feature_deterministic) ? nullptr : &rng,
                                                                            mate_separator);
                     process_collapsed_read(m_config,
+                                           m_enabled,
                                            *stats,
                                            collapsed_read,
                                            // Make sure read_2 header is updated, if needed
-                                           m_config.combined_output ? &read_2 : nullptr,
+                                           m_enabled(feature_combined_output) ? &read_2 : nullptr,
                                            chunks);
 
-                    if (m_config.combined_output) {
+                    if (m_enabled(feature_combined_output)) {
                         // Dummy read with read-count of zero; both mates have
                         // already been accounted for in process_collapsed_read
                         chunks.add_mate_2_read(read_2, read_status::failed, 0);
@@ -589,11 +686,11 @@ public:
             read_2.reverse_complement();
 
             // Trim fixed number of bases from 5' and/or 3' termini
-            trim_read_termini_if_enabled(m_config, read_1, read_type::mate_1);
-            trim_read_termini_if_enabled(m_config, read_2, read_type::mate_2);
+            trim_read_termini_if_enabled(m_config, m_enabled, read_1, read_type::mate_1);
+            trim_read_termini_if_enabled(m_config, m_enabled, read_2, read_type::mate_2);
             // Sliding window trimming or single-base trimming
-            trim_sequence_by_quality_if_enabled(m_config, read_1);
-            trim_sequence_by_quality_if_enabled(m_config, read_2);
+            trim_sequence_by_quality_if_enabled(m_config, m_enabled, read_1);
+            trim_sequence_by_quality_if_enabled(m_config, m_enabled, read_2);
 
             // Are the reads good enough? Not too many Ns?
             const bool read_1_acceptable = m_config.is_acceptable_read(read_1);
@@ -628,17 +725,59 @@ public:
 
         stats->records += read_chunk->reads_1.size();
         m_stats.return_sink(std::move(stats));
-        m_rngs.return_sink(std::move(rng));
+        if (cache) {
+            m_caches.return_sink(std::move(cache));
+        }
 
         return chunks.finalize();
     }
 
 private:
-    rng_sink m_rngs;
+    const processing_features<FEATURES> m_enabled;
 };
 
 
-bool write_settings(const userconfig& config, const std::vector<reads_processor*>& processors)
+/**
+ * Creates a reads processor specialized for the features enabled by the user;
+ * uncommon combinations of features are handled by a generic implementation.
+ */
+template <template <unsigned> class PROCESSOR>
+reads_processor* new_reads_processor(const userconfig& config, size_t nth,
+                                     bool keep_records = false)
+{
+    switch (select_processing_features(config)) {
+        case 0:
+            return new PROCESSOR<0>(config, nth, keep_records);
+        case feature_trim_trailing:
+            return new PROCESSOR<feature_trim_trailing>(config, nth, keep_records);
+        case feature_trim_windows:
+            return new PROCESSOR<feature_trim_windows>(config, nth, keep_records);
+        case feature_collapse:
+            return new PROCESSOR<feature_collapse>(config, nth, keep_records);
+        case feature_collapse | feature_trim_trailing:
+            return new PROCESSOR<feature_collapse | feature_trim_trailing>(config, nth, keep_records);
+        case feature_collapse | feature_trim_windows:
+            return new PROCESSOR<feature_collapse | feature_trim_windows>(config, nth, keep_records);
+        default:
+            return new PROCESSOR<feature_generic>(config, nth, keep_records);
+    }
+}
+
+
+reads_processor* create_reads_processor(const userconfig& config, size_t nth,
+                                        bool keep_records)
+{
+    if (config.paired_ended_mode) {
+        return new_reads_processor<pe_reads_processor>(config, nth, keep_records);
+    }
+
+    return new_reads_processor<se_reads_processor>(config, nth, keep_records);
+}
+
+
+bool write_settings(const userconfig& config,
+                    const std::vector<reads_processor*>& processors,
+                    const inferred_adapters* detected = nullptr)
 {
     for (size_t nth = 0; nth < processors.size(); ++nth) {
         const std::string filename = config.get_output_filename("--settings", nth);
@@ -654,7 +793,7 @@ bool write_settings(const userconfig& config, const std::vector<reads_processor*
             }
 
             output.exceptions(std::ofstream::failbit | std::ofstream::badbit);
-            write_trimming_settings(config, *stats, nth, output);
+            write_trimming_settings(config, *stats, nth, detected, output);
         } catch (const std::ios_base::failure& error) {
             std::cerr << "IO error writing settings file; aborting:\n"
                       << cli_formatter::fmt(error.what()) << std::endl;
@@ -666,19 +805,131 @@ bool write_settings(const userconfig& config, const std::vector<reads_processor*
 }
 
 
+/**
+ * Reader returning previously buffered chunks, before returning chunks read
+ * by a wrapped FASTQ reader; used to process reads that were buffered while
+ * detecting adapter sequences (--detect-adapters).
+ */
+class buffered_fastq_reader : public analytical_step
+{
+public:
+    /**
+     * @param reader Reader from which the buffered chunks were read.
+     * @param buffer Chunks to return before reading further chunks.
+     */
+    buffered_fastq_reader(analytical_step* reader, chunk_vec buffer)
+      : analytical_step(analytical_step::ordering::ordered, true)
+      , m_reader(reader)
+      , m_buffer(std::move(buffer))
+      , m_next(0)
+    {
+    }
+
+    chunk_vec process(analytical_chunk* chunk)
+    {
+        if (m_next < m_buffer.size()) {
+            chunk_vec chunks;
+            chunks.push_back(std::move(m_buffer.at(m_next++)));
+
+            return chunks;
+        }
+
+        return m_reader->process(chunk);
+    }
+
+    void finalize()
+    {
+        m_reader->finalize();
+    }
+
+    //! Copy construction not supported
+    buffered_fastq_reader(const buffered_fastq_reader&) = delete;
+    //! Assignment not supported
+    buffered_fastq_reader& operator=(const buffered_fastq_reader&) = delete;
+
+private:
+    //! The wrapped FASTQ reader
+    std::unique_ptr<analytical_step> m_reader;
+    //! Chunks read prior to running the pipeline
+    chunk_vec m_buffer;
+    //! Index of the next buffered chunk to return
+    size_t m_next;
+};
+
+
+/**
+ * Infers adapter sequences from the first reads returned by 'reader', and
+ * replaces the adapters in 'config' with these, if adapters were found.
+ *
+ * @return True on success, false if an error occured.
+ */
+bool detect_adapter_sequences(userconfig& config,
+                              analytical_step& reader,
+                              chunk_vec& buffer,
+                              inferred_adapters& detected)
+{
+    std::cerr << "Detecting adapter sequences ..." << std::endl;
+    if (!infer_adapter_sequences(config, reader, buffer, detected)) {
+        return false;
+    }
+
+    std::cerr << "   Examined " << detected.pairs_examined << " pairs; found "
+              << detected.pairs_with_adapters << " containing adapter sequence(s) ..."
+              << std::endl;
+
+    if (detected.adapter1.first.empty() || detected.adapter2.first.empty()) {
+        std::cerr << "WARNING: No adapter sequences could be detected; using "
+                  << "--adapter1 and --adapter2 instead!" << std::endl;
+    } else {
+        std::cerr << "   Using --adapter1 " << detected.adapter1.first << "\n"
+                  << "   Using --adapter2 " << detected.adapter2.first << std::endl;
+
+        config.adapters = adapter_set();
+        config.adapters.add_adapters(detected.adapter1.first,
+                                     detected.adapter2.first);
+    }
+
+    return true;
+}
+
+
+void enable_status_feed(const userconfig& config, scheduler& sch)
+{
+    if (config.status_file.empty() && config.status_socket.empty()) {
+        return;
+    }
+
+    // Sizes of input files are used to estimate the time remaining
+    uint64_t input_bytes = 0;
+    for (const auto files : { &config.input_files_1, &config.input_files_2 }) {
+        for (const auto& filename : *files) {
+            struct stat info;
+            if (!stat(filename.c_str(), &info) && S_ISREG(info.st_mode)) {
+                input_bytes += info.st_size;
+            }
+        }
+    }
+
+    sch.enable_status(config.status_file, config.status_socket,
+                      config.status_interval, input_bytes);
+}
+
+
 void add_write_step(const userconfig& config, scheduler& sch, size_t offset,
-                    const std::string& name, analytical_step* step)
+                    const std::string& name, const std::string& filename)
 {
     if (config.gzip) {
-        sch.add_step(offset + ai_zip_offset, "write_gzip_" + name, step);
-        sch.add_step(offset, "gzip_" + name,
-                     new gzip_fastq(config, offset + ai_zip_offset));
+        gzip_fastq* compressor = new gzip_fastq(config, offset + ai_zip_offset);
+        sch.add_step(offset, "gzip_" + name, compressor);
+        sch.add_step(offset + ai_zip_offset, "write_gzip_" + name,
+                     new write_fastq(filename, compressor));
     } else if (config.bzip2) {
-        sch.add_step(offset + ai_zip_offset, "write_bzip2_" + name, step);
-        sch.add_step(offset, "bzip2_" + name,
-                     new bzip2_fastq(config, offset + ai_zip_offset));
+        bzip2_fastq* compressor = new bzip2_fastq(config, offset + ai_zip_offset);
+        sch.add_step(offset, "bzip2_" + name, compressor);
+        sch.add_step(offset + ai_zip_offset, "write_bzip2_" + name,
+                     new write_fastq(filename, compressor));
     } else {
-        sch.add_step(offset, "write_" + name, step);
+        sch.add_step(offset, "write_" + name, new write_fastq(filename));
     }
 }
 
@@ -687,7 +938,8 @@ int remove_adapter_sequences_se(const userconfig& config)
 {
     std::cerr << "Trimming single ended reads ..." << std::endl;
 
-    scheduler sch;
+    scheduler sch(config.profile, !config.trace_file.empty(), config.perf_counters);
+    enable_status_feed(config, sch);
     std::vector<reads_processor*> processors;
     demultiplex_reads* demultiplexer = nullptr;
 
@@ -697,14 +949,16 @@ int remove_adapter_sequences_se(const userconfig& config)
             sch.add_step(ai_read_fastq, "read_fastq",
                          new read_single_fastq(config.quality_input_fmt.get(),
                                                config.input_files_1,
-                                               ai_demultiplex));
+                                               ai_identify_barcodes));
 
-            // Step 2: Parse and demultiplex reads based on single or double indices
+            // Step 2: Identify barcodes (in parallel) and demultiplex reads
+            sch.add_step(ai_identify_barcodes, "identify_barcodes_se",
+                         new identify_se_barcodes(&config, ai_demultiplex));
             sch.add_step(ai_demultiplex, "demultiplex_se",
                          demultiplexer = new demultiplex_se_reads(&config));
 
             add_write_step(config, sch, ai_write_unidentified_1, "unidentified",
-                           new write_fastq(config.get_output_filename("demux_unknown")));
+                           config.get_output_filename("demux_unknown"));
         } else {
             sch.add_step(ai_read_fastq, "read_fastq",
                          new read_single_fastq(config.quality_input_fmt.get(),
@@ -717,23 +971,23 @@ int remove_adapter_sequences_se(const userconfig& config)
             const size_t offset = nth * ai_analyses_offset;
             const std::string& sample = config.adapters.get_sample_name(nth);
 
-            processors.push_back(new se_reads_processor(config, nth));
+            processors.push_back(new_reads_processor<se_reads_processor>(config, nth));
             sch.add_step(offset + ai_trim_se, "trim_se_" + sample,
                          processors.back());
 
             add_write_step(config, sch, offset + ai_write_mate_1, sample + "_fastq",
-                           new write_fastq(config.get_output_filename("--output1", nth)));
+                           config.get_output_filename("--output1", nth));
 
             if (!config.combined_output) {
                 add_write_step(config, sch, offset + ai_write_discarded, sample + "_discarded",
-                             new write_fastq(config.get_output_filename("--discarded", nth)));
+                             config.get_output_filename("--discarded", nth));
 
                 if (config.collapse) {
                     add_write_step(config, sch, offset + ai_write_collapsed, sample + "_collapsed",
-                                   new write_fastq(config.get_output_filename("--outputcollapsed", nth)));
+                                   config.get_output_filename("--outputcollapsed", nth));
                     add_write_step(config, sch, offset + ai_write_collapsed_truncated,
                                    sample + "_collapsed_truncated",
-                                   new write_fastq(config.get_output_filename("--outputcollapsedtruncated", nth)));
+                                   config.get_output_filename("--outputcollapsedtruncated", nth));
                 }
             }
         }
@@ -745,6 +999,10 @@ int remove_adapter_sequences_se(const userconfig& config)
 
     if (!sch.run(config.max_threads)) {
         return 1;
+    } else if (config.profile && !sch.write_profile(config.get_output_filename("--profile"))) {
+        return 1;
+    } else if (!config.trace_file.empty() && !sch.write_trace(config.trace_file)) {
+        return 1;
     } else if (!write_settings(config, processors)) {
         return 1;
     } else if (!write_demux_settings(config, demultiplexer)) {
@@ -755,41 +1013,59 @@ int remove_adapter_sequences_se(const userconfig& config)
 }
 
 
-int remove_adapter_sequences_pe(const userconfig& config)
+int remove_adapter_sequences_pe(userconfig& config)
 {
     std::cerr << "Trimming paired end reads ..." << std::endl;
 
-    scheduler sch;
+    scheduler sch(config.profile, !config.trace_file.empty(), config.perf_counters);
+    enable_status_feed(config, sch);
     std::vector<reads_processor*> processors;
     demultiplex_reads* demultiplexer = nullptr;
+    std::unique_ptr<inferred_adapters> detected;
 
     try {
         // Step 1: Read input file
-        const size_t next_step = config.adapters.barcode_count() ? ai_demultiplex : ai_analyses_offset;
+        const size_t next_step = config.adapters.barcode_count() ? ai_identify_barcodes : ai_analyses_offset;
+        std::unique_ptr<analytical_step> reader;
         if (config.interleaved_input) {
-            sch.add_step(ai_read_fastq, "read_interleaved_fastq",
-                         new read_interleaved_fastq(config.quality_input_fmt.get(),
+            reader.reset(new read_interleaved_fastq(config.quality_input_fmt.get(),
                                                     config.input_files_1,
                                                     next_step));
         } else {
-            sch.add_step(ai_read_fastq, "read_paired_fastq",
-                         new read_paired_fastq(config.quality_input_fmt.get(),
+            reader.reset(new read_paired_fastq(config.quality_input_fmt.get(),
                                                config.input_files_1,
                                                config.input_files_2,
                                                next_step));
         }
 
+        const std::string reader_name = config.interleaved_input ? "read_interleaved_fastq" : "read_paired_fastq";
+        if (config.detect_adapters) {
+            // Adapters must be known before reads processors are created
+            chunk_vec buffer;
+            detected.reset(new inferred_adapters());
+            if (!detect_adapter_sequences(config, *reader, buffer, *detected)) {
+                return 1;
+            }
+
+            sch.add_step(ai_read_fastq, reader_name,
+                         new buffered_fastq_reader(reader.release(), std::move(buffer)));
+        } else {
+            sch.add_step(ai_read_fastq, reader_name, reader.release());
+        }
+
         if (config.adapters.barcode_count()) {
-            // Step 2: Parse and demultiplex reads based on single or double indices
+            // Step 2: Identify barcodes (in parallel) and demultiplex reads
+            sch.add_step(ai_identify_barcodes, "identify_barcodes_pe",
+                         new identify_pe_barcodes(&config, ai_demultiplex));
             sch.add_step(ai_demultiplex, "demultiplex_pe",
                          demultiplexer = new demultiplex_pe_reads(&config));
 
             add_write_step(config, sch, ai_write_unidentified_1, "unidentified_mate_1",
-                           new write_fastq(config.get_output_filename("demux_unknown", 1)));
+                           config.get_output_filename("demux_unknown", 1));
 
             if (!config.interleaved_output) {
                 add_write_step(config, sch, ai_write_unidentified_2, "unidentified_mate_2",
-                               new write_fastq(config.get_output_filename("demux_unknown", 2)));
+                               config.get_output_filename("demux_unknown", 2));
             }
         }
 
@@ -798,30 +1074,30 @@ int remove_adapter_sequences_pe(const userconfig& config)
             const size_t offset = nth * ai_analyses_offset;
             const std::string& sample = config.adapters.get_sample_name(nth);
 
-            processors.push_back(new pe_reads_processor(config, nth));
+            processors.push_back(new_reads_processor<pe_reads_processor>(config, nth));
             sch.add_step(offset + ai_trim_pe, "trim_pe_" + sample,
                          processors.back());
 
             add_write_step(config, sch, offset + ai_write_mate_1, sample + "_mate_1",
-                           new write_fastq(config.get_output_filename("--output1", nth)));
+                           config.get_output_filename("--output1", nth));
 
             if (!config.interleaved_output) {
                 add_write_step(config, sch, offset + ai_write_mate_2, sample + "_mate_2",
-                               new write_fastq(config.get_output_filename("--output2", nth)));
+                               config.get_output_filename("--output2", nth));
             }
 
             if (!config.combined_output) {
                 add_write_step(config, sch, offset + ai_write_discarded, sample + "_discarded",
-                               new write_fastq(config.get_output_filename("--discarded", nth)));
+                               config.get_output_filename("--discarded", nth));
                 add_write_step(config, sch, offset + ai_write_singleton, sample + "_singleton",
-                               new write_fastq(config.get_output_filename("--singleton", nth)));
+                               config.get_output_filename("--singleton", nth));
 
                 if (config.collapse) {
                     add_write_step(config, sch, offset + ai_write_collapsed, sample + "_collapsed",
-                                   new write_fastq(config.get_output_filename("--outputcollapsed", nth)));
+                                   config.get_output_filename("--outputcollapsed", nth));
                     add_write_step(config, sch, offset + ai_write_collapsed_truncated,
                                    sample + "_collapsed_truncated",
-                                   new write_fastq(config.get_output_filename("--outputcollapsedtruncated", nth)));
+                                   config.get_output_filename("--outputcollapsedtruncated", nth));
                 }
             }
         }
@@ -833,7 +1109,11 @@ int remove_adapter_sequences_pe(const userconfig& config)
 
     if (!sch.run(config.max_threads)) {
         return 1;
-    } else if (!write_settings(config, processors)) {
+    } else if (config.profile && !sch.write_profile(config.get_output_filename("--profile"))) {
+        return 1;
+    } else if (!config.trace_file.empty() && !sch.write_trace(config.trace_file)) {
+        return 1;
+    } else if (!write_settings(config, processors, detected.get())) {
         return 1;
     } else if (!write_demux_settings(config, demultiplexer)) {
         return 1;
@@ -843,7 +1123,7 @@ int remove_adapter_sequences_pe(const userconfig& config)
 }
 
 
-int remove_adapter_sequences(const userconfig& config)
+int remove_adapter_sequences(userconfig& config)
 {
     if (config.paired_ended_mode) {
         return remove_adapter_sequences_pe(config);
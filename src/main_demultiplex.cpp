@@ -42,7 +42,9 @@ namespace ar
 
 //! Implemented in main_adapter_rm.cpp
 void add_write_step(const userconfig& config, scheduler& sch, size_t offset,
-                    const std::string& name, analytical_step* step);
+                    const std::string& name, const std::string& filename);
+//! Implemented in main_adapter_rm.cpp
+void enable_status_feed(const userconfig& config, scheduler& sch);
 
 
 void write_demultiplex_statistics(std::ofstream& output,
@@ -234,11 +236,11 @@ public:
             encoded_reads_2.reset(new fastq_output_chunk(read_chunk->eof));
         }
 
-        fastq_vec::iterator it_1 = read_chunk->reads_1.begin();
-        fastq_vec::iterator it_2 = read_chunk->reads_2.begin();
+        fastq_vec::const_iterator it_1 = read_chunk->reads_1.begin();
+        fastq_vec::const_iterator it_2 = read_chunk->reads_2.begin();
         while (it_1 != read_chunk->reads_1.end()) {
-            fastq read_1 = *it_1++;
-            fastq read_2 = *it_2++;
+            const fastq& read_1 = *it_1++;
+            const fastq& read_2 = *it_2++;
 
             encoded_reads_1->add(*m_config.quality_output_fmt, read_1);
 
@@ -268,7 +270,8 @@ int demultiplex_sequences_se(const userconfig& config)
 {
     std::cerr << "Demultiplexing single ended reads ..." << std::endl;
 
-    scheduler sch;
+    scheduler sch(config.profile, !config.trace_file.empty(), config.perf_counters);
+    enable_status_feed(config, sch);
     demultiplex_reads* demultiplexer = nullptr;
 
     try {
@@ -276,14 +279,16 @@ int demultiplex_sequences_se(const userconfig& config)
         sch.add_step(ai_read_fastq, "read_fastq",
                      new read_single_fastq(config.quality_input_fmt.get(),
                                            config.input_files_1,
-                                           ai_demultiplex));
+                                           ai_identify_barcodes));
 
-        // Step 2: Parse and demultiplex reads based on single or double indices
+        // Step 2: Identify barcodes (in parallel) and demultiplex reads
+        sch.add_step(ai_identify_barcodes, "identify_barcodes_se",
+                     new identify_se_barcodes(&config, ai_demultiplex));
         sch.add_step(ai_demultiplex, "demultiplex_se",
                      demultiplexer = new demultiplex_se_reads(&config));
 
         add_write_step(config, sch, ai_write_unidentified_1, "unidentified",
-                       new write_fastq(config.get_output_filename("demux_unknown")));
+                       config.get_output_filename("demux_unknown"));
 
         // Step 3 - N: Trim and write demultiplexed reads
         for (size_t nth = 0; nth < config.adapters.adapter_set_count(); ++nth) {
@@ -294,7 +299,7 @@ int demultiplex_sequences_se(const userconfig& config)
                          new se_demultiplexed_reads_processor(config, nth));
 
             add_write_step(config, sch, offset + ai_write_mate_1, sample + "_fastq",
-                           new write_fastq(config.get_output_filename("--output1", nth)));
+                           config.get_output_filename("--output1", nth));
         }
     } catch (const std::ios_base::failure& error) {
         std::cerr << "IO error opening file; aborting:\n"
@@ -304,6 +309,10 @@ int demultiplex_sequences_se(const userconfig& config)
 
     if (!sch.run(config.max_threads)) {
         return 1;
+    } else if (config.profile && !sch.write_profile(config.get_output_filename("--profile"))) {
+        return 1;
+    } else if (!config.trace_file.empty() && !sch.write_trace(config.trace_file)) {
+        return 1;
     } else if (!write_demultiplex_settings(config, demultiplexer)) {
         return 1;
     }
@@ -322,7 +331,8 @@ int demultiplex_sequences_pe(const userconfig& config)
 {
     std::cerr << "Demultiplexing paired end reads ..." << std::endl;
 
-    scheduler sch;
+    scheduler sch(config.profile, !config.trace_file.empty(), config.perf_counters);
+    enable_status_feed(config, sch);
     demultiplex_reads* demultiplexer = nullptr;
 
     try {
@@ -331,25 +341,27 @@ int demultiplex_sequences_pe(const userconfig& config)
             sch.add_step(ai_read_fastq, "read_interleaved_fastq",
                          new read_interleaved_fastq(config.quality_input_fmt.get(),
                                                     config.input_files_1,
-                                                    ai_demultiplex));
+                                                    ai_identify_barcodes));
         } else {
             sch.add_step(ai_read_fastq, "read_paired_fastq",
                          new read_paired_fastq(config.quality_input_fmt.get(),
                                                config.input_files_1,
                                                config.input_files_2,
-                                               ai_demultiplex));
+                                               ai_identify_barcodes));
         }
 
-        // Step 2: Parse and demultiplex reads based on single or double indices
+        // Step 2: Identify barcodes (in parallel) and demultiplex reads
+        sch.add_step(ai_identify_barcodes, "identify_barcodes_pe",
+                     new identify_pe_barcodes(&config, ai_demultiplex));
         sch.add_step(ai_demultiplex, "demultiplex_pe",
                      demultiplexer = new demultiplex_pe_reads(&config));
 
         add_write_step(config, sch, ai_write_unidentified_1, "unidentified_mate_1",
-                       new write_fastq(config.get_output_filename("demux_unknown", 1)));
+                       config.get_output_filename("demux_unknown", 1));
 
         if (!config.interleaved_output) {
             add_write_step(config, sch, ai_write_unidentified_2, "unidentified_mate_2",
-                           new write_fastq(config.get_output_filename("demux_unknown", 2)));
+                           config.get_output_filename("demux_unknown", 2));
         }
 
         // Step 3 - N: Write demultiplexed reads
@@ -361,11 +373,11 @@ int demultiplex_sequences_pe(const userconfig& config)
                          new pe_demultiplexed_reads_processor(config, nth));
 
             add_write_step(config, sch, offset + ai_write_mate_1, sample + "_mate_1",
-                           new write_fastq(config.get_output_filename("--output1", nth)));
+                           config.get_output_filename("--output1", nth));
 
             if (!config.interleaved_output) {
                 add_write_step(config, sch, offset + ai_write_mate_2, sample + "_mate_2",
-                               new write_fastq(config.get_output_filename("--output2", nth)));
+                               config.get_output_filename("--output2", nth));
             }
         }
     } catch (const std::ios_base::failure& error) {
@@ -376,6 +388,10 @@ int demultiplex_sequences_pe(const userconfig& config)
 
     if (!sch.run(config.max_threads)) {
         return 1;
+    } else if (config.profile && !sch.write_profile(config.get_output_filename("--profile"))) {
+        return 1;
+    } else if (!config.trace_file.empty() && !sch.write_trace(config.trace_file)) {
+        return 1;
     } else if (!write_demultiplex_settings(config, demultiplexer)) {
         return 1;
     }
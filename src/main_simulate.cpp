@@ -0,0 +1,394 @@
+/*************************************************************************\
+ * AdapterRemoval - cleaning next-generation sequencing reads            *
+ *                                                                       *
+ * Copyright (C) 2011 by Stinus Lindgreen - stinus@binf.ku.dk            *
+ * Copyright (C) 2014 by Mikkel Schubert - mikkelsch@gmail.com           *
+ *                                                                       *
+ * If you use the program, please cite the paper:                        *
+ * S. Lindgreen (2012): AdapterRemoval: Easy Cleaning of Next Generation *
+ * Sequencing Reads, BMC Research Notes, 5:337                           *
+ * http://www.biomedcentral.com/1756-0500/5/337/                         *
+ *                                                                       *
+ * This program is free software: you can redistribute it and/or modify  *
+ * it under the terms of the GNU General Public License as published by  *
+ * the Free Software Foundation, either version 3 of the License, or     *
+ * (at your option) any later version.                                   *
+ *                                                                       *
+ * This program is distributed in the hope that it will be useful,       *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ * GNU General Public License for more details.                          *
+ *                                                                       *
+ * You should have received a copy of the GNU General Public License     *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+\*************************************************************************/
+#include <algorithm>
+#include <iostream>
+#include <mutex>
+#include <random>
+#include <string>
+
+#include "counter_rng.hpp"
+#include "debug.hpp"
+#include "fastq.hpp"
+#include "fastq_io.hpp"
+#include "scheduler.hpp"
+#include "userconfig.hpp"
+
+
+namespace ar
+{
+
+//! Implemented in main_adapter_rm.cpp
+void add_write_step(const userconfig& config, scheduler& sch, size_t offset,
+                    const std::string& name, const std::string& filename);
+//! Implemented in main_adapter_rm.cpp
+void enable_status_feed(const userconfig& config, scheduler& sch);
+
+
+//! Streams of random numbers used for each read (pair)
+enum simulation_stream
+{
+    //! Whether a read is a duplicate, and of which template
+    ss_duplicates = 0,
+    //! Sample, adapter pair, insert size, and insert sequence of templates
+    ss_templates,
+    //! Sequencing errors, Ns, and quality scores of individual reads
+    ss_reads
+};
+
+//! Maximum distance (in reads) between a duplicate and its template
+const size_t SIMULATION_DUPLICATE_WINDOW = 100000;
+//! Phred score assigned to bases at the 5' and 3' of reads, respectively
+const int SIMULATION_MAX_QUALITY = 40;
+const int SIMULATION_MIN_QUALITY = 25;
+//! Phred score assigned to bases containing sequencing errors
+const int SIMULATION_ERROR_QUALITY = 10;
+
+
+/** Returns a uniformly random sequence of ACGT of the given length. */
+void random_sequence(counter_rng& rng, std::string& dst, size_t length)
+{
+    dst.reserve(dst.size() + length);
+    while (length) {
+        // Each random number provides 16 bases
+        uint32_t value = rng();
+        for (size_t i = 0; i < 16 && length; ++i, --length) {
+            dst.push_back(IDX_TO_ACGT(value & 0x3));
+            value >>= 2;
+        }
+    }
+}
+
+
+/**
+ * Source of simulated reads; forwards empty chunks, each specifying a range
+ * of reads (pairs) to be generated by the downstream step, until the number
+ * of reads specified using --simulate-reads have been generated.
+ */
+class simulate_chunks : public analytical_step
+{
+public:
+    simulate_chunks(size_t nreads, size_t next_step)
+      : analytical_step(analytical_step::ordering::ordered)
+      , m_nreads(nreads)
+      , m_offset(0)
+      , m_next_step(next_step)
+      , m_eof(false)
+      , m_lock()
+    {
+    }
+
+    chunk_vec process(analytical_chunk* chunk)
+    {
+        AR_DEBUG_LOCK(m_lock);
+        AR_DEBUG_ASSERT(chunk == nullptr);
+        if (m_eof) {
+            return chunk_vec();
+        }
+
+        read_chunk_ptr sim_chunk(new fastq_read_chunk(false, m_offset));
+        if (m_offset >= m_nreads) {
+            sim_chunk->eof = true;
+            m_eof = true;
+        }
+
+        m_offset = std::min(m_nreads, m_offset + FASTQ_CHUNK_SIZE);
+
+        chunk_vec chunks;
+        chunks.push_back(chunk_pair(m_next_step, std::move(sim_chunk)));
+
+        return chunks;
+    }
+
+    //! Copy construction not supported
+    simulate_chunks(const simulate_chunks&) = delete;
+    //! Assignment not supported
+    simulate_chunks& operator=(const simulate_chunks&) = delete;
+
+private:
+    //! Total number of reads (pairs) to simulate
+    const size_t m_nreads;
+    //! Index of the first read (pair) in the next chunk
+    size_t m_offset;
+    //! The analytical step following this step
+    const size_t m_next_step;
+    //! Used to track whether an EOF block has been sent.
+    bool m_eof;
+    //! Lock used to verify that the analytical_step is only run sequentially.
+    std::mutex m_lock;
+};
+
+
+/**
+ * Generates SE or PE reads for the range of reads specified by chunks from
+ * 'simulate_chunks'. Each read (pair) is a pure function of the seed and of
+ * the index of the read, so that the output does not depend on the number
+ * of threads used.
+ *
+ * Reads consist of the (optional) barcode, followed by the insert, the
+ * adapter sequence, and random bases, in that order. The insert sequence is
+ * shared between a read and any duplicates of that read, while sequencing
+ * errors and Ns are simulated independently for every read.
+ */
+class simulate_reads : public analytical_step
+{
+public:
+    simulate_reads(const userconfig& config)
+      : analytical_step(analytical_step::ordering::unordered)
+      , m_config(config)
+      , m_adapters()
+      , m_barcodes(config.adapters.get_barcodes())
+      , m_qualities()
+    {
+        for (size_t nth = 0; nth < config.adapters.adapter_set_count(); ++nth) {
+            m_adapters.push_back(config.adapters.get_adapter_set(nth));
+        }
+
+        const size_t read_length = config.sim_read_length;
+        for (size_t i = 0; i < read_length; ++i) {
+            const int delta = SIMULATION_MAX_QUALITY - SIMULATION_MIN_QUALITY;
+            const int score = SIMULATION_MAX_QUALITY - (i * delta) / read_length;
+            m_qualities.push_back(PHRED_OFFSET_33 + score);
+        }
+    }
+
+    chunk_vec process(analytical_chunk* chunk)
+    {
+        read_chunk_ptr sim_chunk(dynamic_cast<fastq_read_chunk*>(chunk));
+        const size_t first_read = sim_chunk->first_read;
+        const size_t last_read = std::min<size_t>(m_config.sim_reads,
+                                                  first_read + FASTQ_CHUNK_SIZE);
+
+        output_chunk_ptr output_1(new fastq_output_chunk(sim_chunk->eof));
+        output_chunk_ptr output_2;
+        if (m_config.paired_ended_mode && !m_config.interleaved_output) {
+            output_2.reset(new fastq_output_chunk(sim_chunk->eof));
+        }
+
+        const fastq_encoding& encoding = *m_config.quality_output_fmt;
+        for (size_t nth = first_read; !sim_chunk->eof && nth < last_read; ++nth) {
+            if (m_config.paired_ended_mode) {
+                fastq read_1;
+                fastq read_2;
+                simulate_pair(nth, read_1, read_2);
+
+                output_1->add(encoding, read_1);
+                if (m_config.interleaved_output) {
+                    output_1->add(encoding, read_2);
+                } else {
+                    output_2->add(encoding, read_2);
+                }
+            } else {
+                fastq read;
+                simulate_pair(nth, read, read);
+
+                output_1->add(encoding, read);
+            }
+        }
+
+        chunk_vec chunks;
+        chunks.push_back(chunk_pair(ai_write_mate_1, std::move(output_1)));
+        if (output_2) {
+            chunks.push_back(chunk_pair(ai_write_mate_2, std::move(output_2)));
+        }
+
+        return chunks;
+    }
+
+    //! Copy construction not supported
+    simulate_reads(const simulate_reads&) = delete;
+    //! Assignment not supported
+    simulate_reads& operator=(const simulate_reads&) = delete;
+
+private:
+    /** Returns the index of the template from which the nth read is drawn. */
+    size_t get_template(size_t nth) const
+    {
+        while (nth && m_config.sim_duplication_rate > 0) {
+            counter_rng rng(m_config.seed, ss_duplicates, nth);
+            std::uniform_real_distribution<double> is_duplicate;
+            if (is_duplicate(rng) >= m_config.sim_duplication_rate) {
+                break;
+            }
+
+            nth -= 1 + rng() % std::min(nth, SIMULATION_DUPLICATE_WINDOW);
+        }
+
+        return nth;
+    }
+
+    /**
+     * Simulates the nth SE read or PE read pair; for SE reads, only read_1
+     * is used, and read_1 and read_2 may refer to the same object.
+     */
+    void simulate_pair(size_t nth, fastq& read_1, fastq& read_2) const
+    {
+        const size_t tmpl = get_template(nth);
+        counter_rng tmpl_rng(m_config.seed, ss_templates, tmpl);
+
+        const size_t sample = m_barcodes.empty() ? 0 : tmpl_rng() % m_barcodes.size();
+        const fastq_pair_vec& adapters = m_adapters.at(sample);
+        const fastq_pair& adapter_pair = adapters.at(tmpl_rng() % adapters.size());
+
+        std::normal_distribution<double> insert_size(m_config.sim_insert_mean,
+                                                     m_config.sim_insert_sd);
+        const double length = std::round(insert_size(tmpl_rng));
+        std::string insert;
+        random_sequence(tmpl_rng, insert, length > 0 ? static_cast<size_t>(length) : 0);
+
+        std::string barcode_1;
+        std::string barcode_2;
+        if (!m_barcodes.empty()) {
+            barcode_1 = m_barcodes.at(sample).first.sequence();
+            barcode_2 = m_barcodes.at(sample).second.sequence();
+        }
+
+        counter_rng read_rng(m_config.seed, ss_reads, nth);
+        const std::string name = "sim_" + std::to_string(nth);
+        if (!m_config.paired_ended_mode) {
+            read_1 = simulate_read(read_rng, name, barcode_1, insert,
+                                   adapter_pair.first.sequence());
+            return;
+        }
+
+        const char mate_sep = m_config.mate_separator;
+        read_1 = simulate_read(read_rng, name + mate_sep + "1", barcode_1,
+                               insert, adapter_pair.first.sequence());
+
+        // Adapter 2 is stored in the orientation of mate 1 reads
+        fastq adapter_2 = adapter_pair.second;
+        adapter_2.reverse_complement();
+        fastq insert_2("insert", insert);
+        insert_2.reverse_complement();
+
+        read_2 = simulate_read(read_rng, name + mate_sep + "2", barcode_2,
+                               insert_2.sequence(), adapter_2.sequence());
+    }
+
+    /** Builds a single read of --sim-read-length bases. */
+    fastq simulate_read(counter_rng& rng,
+                        const std::string& name,
+                        const std::string& barcode,
+                        const std::string& insert,
+                        const std::string& adapter) const
+    {
+        const size_t read_length = m_config.sim_read_length;
+
+        std::string sequence;
+        sequence.reserve(read_length + 16);
+        sequence.append(barcode);
+        sequence.append(insert);
+        sequence.append(adapter);
+        if (sequence.size() < read_length) {
+            random_sequence(rng, sequence, read_length - sequence.size());
+        }
+        sequence.resize(read_length);
+
+        std::string qualities = m_qualities;
+        add_errors(rng, sequence, qualities, m_config.sim_error_rate, false);
+        add_errors(rng, sequence, qualities, m_config.sim_n_rate, true);
+
+        return fastq(name, sequence, qualities);
+    }
+
+    /**
+     * Introduces substitutions (or Ns) at the given per-base rate; positions
+     * are drawn using a geometric distribution, so that the cost is
+     * proportional to the number of errors rather than to the read length.
+     */
+    static void add_errors(counter_rng& rng,
+                           std::string& sequence,
+                           std::string& qualities,
+                           double rate,
+                           bool ambiguous)
+    {
+        if (rate <= 0) {
+            return;
+        }
+
+        std::geometric_distribution<size_t> skip(std::min(1.0, rate));
+        for (size_t i = skip(rng); i < sequence.size(); i += 1 + skip(rng)) {
+            if (ambiguous) {
+                sequence.at(i) = 'N';
+                qualities.at(i) = PHRED_OFFSET_33;
+            } else {
+                const size_t offset = 1 + rng() % 3;
+                const size_t idx = ACGT_TO_IDX(sequence.at(i));
+                sequence.at(i) = IDX_TO_ACGT((idx + offset) % 4);
+                qualities.at(i) = PHRED_OFFSET_33 + SIMULATION_ERROR_QUALITY;
+            }
+        }
+    }
+
+    const userconfig& m_config;
+    //! Adapter pairs for each sample, including barcodes
+    std::vector<fastq_pair_vec> m_adapters;
+    //! Barcodes (pairs) for each sample; may be empty
+    fastq_pair_vec m_barcodes;
+    //! Phred+33 encoded quality scores for error free reads
+    std::string m_qualities;
+};
+
+
+int simulate_sequences(const userconfig& config)
+{
+    std::cerr << "Simulating " << config.sim_reads
+              << (config.paired_ended_mode ? " paired end reads ..."
+                                           : " single ended reads ...")
+              << std::endl;
+
+    scheduler sch(config.profile, !config.trace_file.empty(), config.perf_counters);
+    enable_status_feed(config, sch);
+
+    try {
+        sch.add_step(ai_read_fastq, "simulate_chunks",
+                     new simulate_chunks(config.sim_reads, ai_simulate_reads));
+        sch.add_step(ai_simulate_reads, "simulate_reads",
+                     new simulate_reads(config));
+
+        add_write_step(config, sch, ai_write_mate_1, "mate_1",
+                       config.get_output_filename("--output1"));
+
+        if (config.paired_ended_mode && !config.interleaved_output) {
+            add_write_step(config, sch, ai_write_mate_2, "mate_2",
+                           config.get_output_filename("--output2"));
+        }
+    } catch (const std::ios_base::failure& error) {
+        std::cerr << "IO error opening file; aborting:\n"
+                  << cli_formatter::fmt(error.what()) << std::endl;
+        return 1;
+    }
+
+    if (!sch.run(config.max_threads)) {
+        return 1;
+    } else if (config.profile && !sch.write_profile(config.get_output_filename("--profile"))) {
+        return 1;
+    } else if (!config.trace_file.empty() && !sch.write_trace(config.trace_file)) {
+        return 1;
+    }
+
+    return 0;
+}
+
+} // namespace ar
@@ -22,6 +22,8 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>. *
 \*************************************************************************/
 #include <cerrno>
+#include <algorithm>
+#include <atomic>
 #include <iostream>
 #include <mutex>
 #include <vector>
@@ -37,15 +39,20 @@ namespace ar
 {
 
 static std::mutex g_writer_lock;
+//! Total number of bytes passed to writers; may be read without the lock
+static std::atomic<uint64_t> g_bytes_written(0);
 managed_writer* managed_writer::s_head = nullptr;
 managed_writer* managed_writer::s_tail = nullptr;
 bool managed_writer::s_warning_printed = false;
+std::vector<managed_writer*> managed_writer::s_buffered;
+size_t managed_writer::s_buffered_size = 0;
 
 
 managed_writer::managed_writer(const std::string& filename)
     : m_filename(filename)
     , m_stream()
     , m_created(false)
+    , m_buffer()
     , m_prev(nullptr)
     , m_next(nullptr)
 {
@@ -55,6 +62,16 @@ managed_writer::managed_writer(const std::string& filename)
 
 managed_writer::~managed_writer()
 {
+    {
+        // Unflushed data is only left behind if the run was aborted
+        std::lock_guard<std::mutex> lock(g_writer_lock);
+        if (!m_buffer.empty()) {
+            s_buffered_size -= m_buffer.size();
+            s_buffered.erase(std::find(s_buffered.begin(), s_buffered.end(), this));
+            m_buffer.clear();
+        }
+    }
+
     close();
 }
 
@@ -81,36 +98,28 @@ FILE* managed_writer::fopen(const std::string& filename, const char* mode)
 void managed_writer::write_buffers(const buffer_vec& buffers, bool flush)
 {
     std::lock_guard<std::mutex> lock(g_writer_lock);
-    if (buffers.size() || flush) {
-        managed_writer::open_writer(this);
-
-        for (auto& buf : buffers) {
-            if (buf.first) {
-                m_stream.write(reinterpret_cast<char*>(buf.second), buf.first);
-            }
-        }
-
-        if (flush) {
-            m_stream.flush();
-        }
+    for (auto& buf : buffers) {
+        append(reinterpret_cast<const char*>(buf.second), buf.first);
     }
+
+    commit(flush);
 }
 
 
 void managed_writer::write_strings(const string_vec& strings, bool flush)
 {
     std::lock_guard<std::mutex> lock(g_writer_lock);
-    if (strings.size() || flush) {
-        managed_writer::open_writer(this);
+    for (const auto& str : strings) {
+        append(str.data(), str.length());
+    }
 
-        for (const auto& str : strings) {
-            m_stream.write(str.data(), str.length());
-        }
+    commit(flush);
+}
 
-        if (flush) {
-            m_stream.flush();
-        }
-    }
+
+uint64_t managed_writer::bytes_written()
+{
+    return g_bytes_written;
 }
 
 
@@ -118,6 +127,10 @@ void managed_writer::close()
 {
     std::lock_guard<std::mutex> lock(g_writer_lock);
 
+    if (!m_buffer.empty()) {
+        managed_writer::write_buffer(this, false);
+    }
+
     managed_writer::remove_writer(this);
     if (m_stream.is_open()) {
         m_stream.close();
@@ -125,6 +138,76 @@ void managed_writer::close()
 }
 
 
+void managed_writer::append(const char* data, size_t size)
+{
+    if (!size) {
+        return;
+    }
+
+    g_bytes_written += size;
+
+    // Files closed to free up handles are not re-opened until required
+    const bool is_writable = m_stream.is_open() || !m_created;
+    if (is_writable && m_buffer.size() + size >= WRITER_BLOCK_SIZE) {
+        // Large writes bypass the buffer, after writing any buffered data
+        managed_writer::write_buffer(this, false);
+        m_stream.write(data, size);
+    } else {
+        if (m_buffer.empty()) {
+            s_buffered.push_back(this);
+        }
+
+        m_buffer.append(data, size);
+        s_buffered_size += size;
+    }
+}
+
+
+void managed_writer::commit(bool flush)
+{
+    if (flush) {
+        managed_writer::write_buffer(this, flush);
+    }
+
+    // Write the largest buffers first, to minimize the number of writes and
+    // (if handles are limited) the number of files that need to be re-opened
+    while (s_buffered_size > WRITER_MEMORY_BUDGET) {
+        auto largest = s_buffered.front();
+        for (auto ptr : s_buffered) {
+            if (ptr->m_buffer.size() > largest->m_buffer.size()) {
+                largest = ptr;
+            }
+        }
+
+        managed_writer::write_buffer(largest, false);
+    }
+}
+
+
+void managed_writer::write_buffer(managed_writer* ptr, bool flush)
+{
+    managed_writer::open_writer(ptr);
+
+    if (!ptr->m_buffer.empty()) {
+        ptr->m_stream.write(ptr->m_buffer.data(), ptr->m_buffer.size());
+
+        s_buffered_size -= ptr->m_buffer.size();
+        s_buffered.erase(std::find(s_buffered.begin(), s_buffered.end(), ptr));
+
+        if (ptr->m_buffer.capacity() > WRITER_BLOCK_SIZE) {
+            // Large buffers would otherwise take up space outside the budget
+            std::string().swap(ptr->m_buffer);
+        } else {
+            ptr->m_buffer.clear();
+        }
+    }
+
+    if (flush) {
+        ptr->m_stream.flush();
+    }
+}
+
+
 void managed_writer::open_writer(managed_writer* ptr)
 {
     const std::ios_base::openmode mode =
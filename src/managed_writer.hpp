@@ -24,7 +24,9 @@
 #ifndef WRITER_HPP
 #define WRITER_HPP
 
+#include <cstdint>
 #include <fstream>
+#include <string>
 #include <vector>
 
 #include "commontypes.hpp"
@@ -38,6 +40,13 @@ typedef std::pair<size_t, unsigned char*> buffer_pair;
 typedef std::vector<buffer_pair> buffer_vec;
 
 
+//! Size of buffered data at which a writer with an open file writes to disk
+const size_t WRITER_BLOCK_SIZE = 64 * 1024;
+//! Maximum size of data buffered by all writers; once this is exceeded, the
+//! writers with the most buffered data write their buffers to disk.
+const size_t WRITER_MEMORY_BUDGET = 64 * 1024 * 1024;
+
+
 /**
  * Writer that manages open handles if open files exceeds ulimits.
  *
@@ -45,6 +54,14 @@ typedef std::vector<buffer_pair> buffer_vec;
  * if the file cannot be opened due to the number of already open
  * files, the writer will close the least recently used handle and
  * retry.
+ *
+ * Small writes are buffered in memory until WRITER_BLOCK_SIZE bytes have been
+ * accumulated, while larger writes are passed directly to the file. Writers
+ * whose files have been closed to free up handles instead continue to buffer
+ * data until the total amount of buffered data exceeds the
+ * WRITER_MEMORY_BUDGET, at which point the writers with the most buffered data
+ * re-open their files. This limits the number of times files have to be
+ * re-opened when the number of outputs exceeds the number of handles.
  */
 class managed_writer
 {
@@ -63,19 +80,35 @@ public:
     void write_buffers(const buffer_vec& buffers, bool flush);
     void write_strings(const string_vec& strings, bool flush);
 
+    /** Returns the number of bytes written (or buffered) by all writers. */
+    static uint64_t bytes_written();
+
+    /** Writes any buffered data and closes the file. */
     void close();
 
     managed_writer(const managed_writer&) = delete;
     managed_writer& operator=(const managed_writer&) = delete;
 
 private:
+    /** Buffers or writes data; must be called while holding the lock. */
+    void append(const char* data, size_t size);
+    /** Flushes and enforces the memory budget; called after appending data. */
+    void commit(bool flush);
+
+    /* Writes the buffer of a writer to disk, opening the file if nessesary. */
+    static void write_buffer(managed_writer* ptr, bool flush);
     /* Ensure that the writer is open, closing existing files if nessesary. */
     static void open_writer(managed_writer* ptr);
     /* Removes the writer from the list of open writers. */
     static void remove_writer(managed_writer* ptr);
     /* Sets the writer as the most recently used writer. */
     static void add_head_writer(managed_writer* ptr);
-    /* Close the least recently used writer. */
+    /*
+     * Close the least recently used writer. Open writers hold less than
+     * WRITER_BLOCK_SIZE pending bytes, and writers that have just written a
+     * large block hold none, so recency rather than pending bytes is used to
+     * find writers that are unlikely to be written to again soon.
+     */
     static void close_tail_writer();
 
     //! Destination filename; is created lazily.
@@ -84,6 +117,8 @@ private:
     std::ofstream m_stream;
     //! Indicates if the file has been created
     bool m_created;
+    //! Data not yet written to the file
+    std::string m_buffer;
 
     //! Previous managed_writer; used more recently than this.
     managed_writer* m_prev;
@@ -96,6 +131,10 @@ private:
     static managed_writer* s_tail;
     //! Indicates if a performance warning has been printed
     static bool s_warning_printed;
+    //! Writers with non-empty buffers
+    static std::vector<managed_writer*> s_buffered;
+    //! Total size of data buffered by all writers
+    static size_t s_buffered_size;
 };
 
 
@@ -0,0 +1,235 @@
+/*************************************************************************\
+ * AdapterRemoval - cleaning next-generation sequencing reads            *
+ *                                                                       *
+ * Copyright (C) 2011 by Stinus Lindgreen - stinus@binf.ku.dk            *
+ * Copyright (C) 2014 by Mikkel Schubert - mikkelsch@gmail.com           *
+ *                                                                       *
+ * If you use the program, please cite the paper:                        *
+ * S. Lindgreen (2012): AdapterRemoval: Easy Cleaning of Next Generation *
+ * Sequencing Reads, BMC Research Notes, 5:337                           *
+ * http://www.biomedcentral.com/1756-0500/5/337/                         *
+ *                                                                       *
+ * This program is free software: you can redistribute it and/or modify  *
+ * it under the terms of the GNU General Public License as published by  *
+ * the Free Software Foundation, either version 3 of the License, or     *
+ * (at your option) any later version.                                   *
+ *                                                                       *
+ * This program is distributed in the hope that it will be useful,       *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ * GNU General Public License for more details.                          *
+ *                                                                       *
+ * You should have received a copy of the GNU General Public License     *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+\*************************************************************************/
+#include <cerrno>
+#include <cstring>
+#include <vector>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "perf_counters.hpp"
+
+namespace ar
+{
+
+///////////////////////////////////////////////////////////////////////////////
+// perf_values
+
+perf_values::perf_values()
+  : counts()
+{
+}
+
+
+uint64_t perf_values::at(perf_event event) const
+{
+    return counts[static_cast<size_t>(event)];
+}
+
+
+perf_values& perf_values::operator+=(const perf_values& other)
+{
+    for (size_t i = 0; i < static_cast<size_t>(perf_event::max); ++i) {
+        counts[i] += other.counts[i];
+    }
+
+    return *this;
+}
+
+
+perf_values perf_values::operator-(const perf_values& other) const
+{
+    perf_values result;
+    for (size_t i = 0; i < static_cast<size_t>(perf_event::max); ++i) {
+        // Scaled (multiplexed) counts are estimates and may decrease
+        result.counts[i] = counts[i] > other.counts[i] ? counts[i] - other.counts[i] : 0;
+    }
+
+    return result;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// perf_counters
+
+#ifdef __linux__
+
+namespace
+{
+
+/** Opens a single user-space hardware counter for the calling thread. */
+int open_counter(uint64_t config, int group_fd)
+{
+    perf_event_attr attr;
+    std::memset(&attr, 0, sizeof(attr));
+
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = config;
+    attr.disabled = (group_fd == -1);
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP
+                     | PERF_FORMAT_TOTAL_TIME_ENABLED
+                     | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+    return static_cast<int>(syscall(__NR_perf_event_open, &attr, 0, -1, group_fd, 0));
+}
+
+} // namespace
+
+
+perf_counters::perf_counters()
+  : m_fds()
+  , m_indices()
+  , m_events(0)
+  , m_error()
+{
+    const uint64_t configs[] = {
+        PERF_COUNT_HW_CPU_CYCLES,
+        PERF_COUNT_HW_INSTRUCTIONS,
+        PERF_COUNT_HW_CACHE_MISSES,
+        PERF_COUNT_HW_BRANCH_MISSES,
+    };
+
+    for (size_t i = 0; i < static_cast<size_t>(perf_event::max); ++i) {
+        const int group_fd = m_fds[static_cast<size_t>(perf_event::cycles)];
+
+        m_fds[i] = open_counter(configs[i], i ? group_fd : -1);
+        m_indices[i] = -1;
+
+        if (m_fds[i] != -1) {
+            m_indices[i] = static_cast<int>(m_events++);
+        } else if (!i) {
+            m_error = std::string("perf_event_open failed: ") + std::strerror(errno);
+            return;
+        }
+    }
+
+    const int leader = m_fds[static_cast<size_t>(perf_event::cycles)];
+    if (ioctl(leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP) == -1
+        || ioctl(leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP) == -1) {
+        m_error = std::string("failed to enable counters: ") + std::strerror(errno);
+    }
+}
+
+
+perf_counters::~perf_counters()
+{
+    for (size_t i = 0; i < static_cast<size_t>(perf_event::max); ++i) {
+        if (is_counted(static_cast<perf_event>(i))) {
+            close(m_fds[i]);
+        }
+    }
+}
+
+
+bool perf_counters::is_open() const
+{
+    return m_error.empty();
+}
+
+
+bool perf_counters::is_counted(perf_event event) const
+{
+    return m_events && m_indices[static_cast<size_t>(event)] != -1;
+}
+
+
+bool perf_counters::read(perf_values& values) const
+{
+    if (!is_open()) {
+        return false;
+    }
+
+    // Layout: nr, time_enabled, time_running, values[nr]
+    std::vector<uint64_t> buffer(3 + m_events);
+    const size_t nbytes = buffer.size() * sizeof(uint64_t);
+    const int leader = m_fds[static_cast<size_t>(perf_event::cycles)];
+    if (::read(leader, buffer.data(), nbytes) != static_cast<ssize_t>(nbytes)) {
+        return false;
+    }
+
+    const uint64_t enabled = buffer.at(1);
+    const uint64_t running = buffer.at(2);
+    const double scale = (running && running < enabled) ? static_cast<double>(enabled) / running : 1.0;
+
+    for (size_t i = 0; i < static_cast<size_t>(perf_event::max); ++i) {
+        if (m_indices[i] == -1) {
+            values.counts[i] = 0;
+        } else {
+            values.counts[i] = static_cast<uint64_t>(buffer.at(3 + m_indices[i]) * scale);
+        }
+    }
+
+    return true;
+}
+
+#else
+
+perf_counters::perf_counters()
+  : m_fds()
+  , m_indices()
+  , m_events(0)
+  , m_error("hardware performance counters require Linux")
+{
+}
+
+
+perf_counters::~perf_counters()
+{
+}
+
+
+bool perf_counters::is_open() const
+{
+    return false;
+}
+
+
+bool perf_counters::is_counted(perf_event) const
+{
+    return false;
+}
+
+
+bool perf_counters::read(perf_values&) const
+{
+    return false;
+}
+
+#endif
+
+
+const std::string& perf_counters::error() const
+{
+    return m_error;
+}
+
+} // namespace ar
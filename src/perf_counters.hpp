@@ -0,0 +1,116 @@
+/*************************************************************************\
+ * AdapterRemoval - cleaning next-generation sequencing reads            *
+ *                                                                       *
+ * Copyright (C) 2011 by Stinus Lindgreen - stinus@binf.ku.dk            *
+ * Copyright (C) 2014 by Mikkel Schubert - mikkelsch@gmail.com           *
+ *                                                                       *
+ * If you use the program, please cite the paper:                        *
+ * S. Lindgreen (2012): AdapterRemoval: Easy Cleaning of Next Generation *
+ * Sequencing Reads, BMC Research Notes, 5:337                           *
+ * http://www.biomedcentral.com/1756-0500/5/337/                         *
+ *                                                                       *
+ * This program is free software: you can redistribute it and/or modify  *
+ * it under the terms of the GNU General Public License as published by  *
+ * the Free Software Foundation, either version 3 of the License, or     *
+ * (at your option) any later version.                                   *
+ *                                                                       *
+ * This program is distributed in the hope that it will be useful,       *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ * GNU General Public License for more details.                          *
+ *                                                                       *
+ * You should have received a copy of the GNU General Public License     *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+\*************************************************************************/
+#ifndef PERF_COUNTERS_H
+#define PERF_COUNTERS_H
+
+#include <cstdint>
+#include <string>
+
+namespace ar
+{
+
+/** Hardware events counted by 'perf_counters'. */
+enum class perf_event
+{
+    cycles = 0,
+    instructions,
+    cache_misses,
+    branch_misses,
+    max
+};
+
+
+/** Counter values for each 'perf_event'; see perf_counters. */
+struct perf_values
+{
+    /** Creates zero-initialized counts. */
+    perf_values();
+
+    /** Returns the count for an event. */
+    uint64_t at(perf_event event) const;
+
+    /** Adds the counts from another set of values. */
+    perf_values& operator+=(const perf_values& other);
+    /** Returns the difference between this and a previous set of counts. */
+    perf_values operator-(const perf_values& other) const;
+
+    //! Counts indexed by 'perf_event'
+    uint64_t counts[static_cast<size_t>(perf_event::max)];
+};
+
+
+/**
+ * Hardware performance counters for the calling thread, opened using the
+ * Linux perf_event_open system call; only user-space events are counted.
+ *
+ * Counters may be unavailable, for example if access is blocked by the value
+ * of /proc/sys/kernel/perf_event_paranoid, if the system call is blocked in a
+ * container, or on systems other than Linux. Individual events (other than
+ * cycles) may also be unsupported, for example in virtual machines.
+ */
+class perf_counters
+{
+public:
+    /** Opens and starts counters for the calling thread. */
+    perf_counters();
+
+    /** Closes any open counters. */
+    ~perf_counters();
+
+    /** Returns true if counters could be opened. */
+    bool is_open() const;
+
+    /** Returns true if the specific event is being counted. */
+    bool is_counted(perf_event event) const;
+
+    /** Returns error message describing why counters could not be opened. */
+    const std::string& error() const;
+
+    /**
+     * Reads the current (cumulative) counts, scaled if the counters were
+     * multiplexed; unavailable events are reported as zero. Returns false if
+     * the counters are not open or could not be read.
+     */
+    bool read(perf_values& values) const;
+
+    //! Copy construction not supported
+    perf_counters(const perf_counters&) = delete;
+    //! Assignment not supported
+    perf_counters& operator=(const perf_counters&) = delete;
+
+private:
+    //! File descriptor per event; -1 if not counted. Cycles lead the group.
+    int m_fds[static_cast<size_t>(perf_event::max)];
+    //! Position of each event in the group read-out; -1 if not counted.
+    int m_indices[static_cast<size_t>(perf_event::max)];
+    //! Number of events in the group
+    size_t m_events;
+    //! Error message set if counters could not be opened
+    std::string m_error;
+};
+
+} // namespace ar
+
+#endif
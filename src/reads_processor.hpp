@@ -0,0 +1,148 @@
+/*************************************************************************\
+ * AdapterRemoval - cleaning next-generation sequencing reads            *
+ *                                                                       *
+ * Copyright (C) 2015 by Mikkel Schubert - mikkelsch@gmail.com           *
+ *                                                                       *
+ * If you use the program, please cite the paper:                        *
+ * S. Lindgreen (2012): AdapterRemoval: Easy Cleaning of Next Generation *
+ * Sequencing Reads, BMC Research Notes, 5:337                           *
+ * http://www.biomedcentral.com/1756-0500/5/337/                         *
+ *                                                                       *
+ * This program is free software: you can redistribute it and/or modify  *
+ * it under the terms of the GNU General Public License as published by  *
+ * the Free Software Foundation, either version 3 of the License, or     *
+ * (at your option) any later version.                                   *
+ *                                                                       *
+ * This program is distributed in the hope that it will be useful,       *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ * GNU General Public License for more details.                          *
+ *                                                                       *
+ * You should have received a copy of the GNU General Public License     *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+\*************************************************************************/
+#ifndef READS_PROCESSOR_H
+#define READS_PROCESSOR_H
+
+#include <memory>
+
+#include "alignment_cache.hpp"
+#include "scheduler.hpp"
+#include "statistics.hpp"
+#include "userconfig.hpp"
+
+namespace ar
+{
+
+typedef std::unique_ptr<alignment_cache> alignment_cache_ptr;
+
+
+/**
+ * Base class for steps trimming (and collapsing) SE or PE reads for a single
+ * adapter set (sample); see 'create_reads_processor'. Each call to 'process'
+ * takes a 'fastq_read_chunk' and returns a 'fastq_output_chunk' for each of
+ * the outputs enabled by the user, as generated by 'trimmed_reads'.
+ */
+class reads_processor : public analytical_step
+{
+public:
+    /**
+     * Constructor.
+     *
+     * @param config User settings; must outlive the processor.
+     * @param nth Index of the adapter set (sample) used to trim reads.
+     * @param keep_records If true, trimmed reads are kept as 'fastq' records
+     *                     in output chunks, rather than being serialized.
+     */
+    reads_processor(const userconfig& config, size_t nth, bool keep_records = false)
+      : analytical_step(analytical_step::ordering::unordered)
+      , m_config(config)
+      , m_adapters(config.adapters.get_adapter_set(nth))
+      , m_stats(config)
+      , m_caches(config)
+      , m_nth(nth)
+      , m_keep_records(keep_records)
+    {
+
+    }
+
+    /** Returns the sum of statistics collected by all threads. */
+    statistics_ptr get_final_statistics() {
+        return m_stats.finalize();
+    }
+
+protected:
+    class stats_sink : public statistics_sink<statistics>
+    {
+    public:
+        stats_sink(const userconfig& config)
+          : m_config(config)
+        {
+        }
+
+    protected:
+        virtual pointer new_sink() const {
+            return m_config.create_stats();
+        }
+
+        virtual void reduce(pointer& dst, const pointer& src) const {
+            (*dst) += (*src);
+        }
+
+        const userconfig& m_config;
+    };
+
+    /** Class for building per-thread alignment caches on demand. */
+    class cache_sink : public statistics_sink<alignment_cache>
+    {
+    public:
+        cache_sink(const userconfig& config)
+          : m_config(config)
+        {
+        }
+
+    protected:
+        virtual pointer new_sink() const {
+            // The memory limit is shared between all threads and samples
+            const size_t max_bytes = static_cast<size_t>(m_config.alignment_cache_size) * 1024 * 1024;
+            const size_t n_caches = m_config.max_threads * m_config.adapters.adapter_set_count();
+
+            return pointer(new alignment_cache(max_bytes / n_caches));
+        }
+
+        virtual void reduce(pointer&, const pointer&) const {
+            // Intentionally left empty
+        }
+
+        const userconfig& m_config;
+    };
+
+    /** Returns a cache if alignment caching is enabled; nullptr otherwise. */
+    alignment_cache_ptr get_alignment_cache() {
+        if (m_config.alignment_cache_size) {
+            return m_caches.get_sink();
+        }
+
+        return alignment_cache_ptr();
+    }
+
+    const userconfig& m_config;
+    const fastq_pair_vec m_adapters;
+    stats_sink m_stats;
+    cache_sink m_caches;
+    const size_t m_nth;
+    const bool m_keep_records;
+};
+
+
+/**
+ * Creates a SE or PE reads processor for the nth adapter set, depending on
+ * the user settings, and specialized for the processing features enabled
+ * by the user. Implemented in main_adapter_rm.cpp.
+ */
+reads_processor* create_reads_processor(const userconfig& config, size_t nth,
+                                        bool keep_records = false);
+
+} // namespace ar
+
+#endif
@@ -24,13 +24,25 @@
 
 #include <algorithm>
 #include <cerrno>
+#include <chrono>
 #include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <functional>
+#include <iomanip>
 #include <iostream>
+#include <sstream>
 #include <stdexcept>
 #include <unistd.h>
 
 #include "debug.hpp"
+#include "alloc_stats.hpp"
+#include "linereader.hpp"
+#include "managed_writer.hpp"
+#include "perf_counters.hpp"
 #include "scheduler.hpp"
+#include "status_feed.hpp"
 #include "strutils.hpp"
 
 namespace ar
@@ -47,6 +59,16 @@ analytical_chunk::~analytical_chunk()
 {
 }
 
+size_t analytical_chunk::read_count() const
+{
+    return 0;
+}
+
+size_t analytical_chunk::memory_usage() const
+{
+    return 0;
+}
+
 
 ///////////////////////////////////////////////////////////////////////////////
 // analytical_step
@@ -65,12 +87,117 @@ analytical_step::~analytical_step()
 ///////////////////////////////////////////////////////////////////////////////
 // scheduler
 
+/** Returns a monotonic timestamp in nanoseconds. */
+inline uint64_t get_wall_time_ns()
+{
+    const auto now = std::chrono::steady_clock::now().time_since_epoch();
+
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(now).count();
+}
+
+
+/** Returns the CPU time used by the current thread in nanoseconds. */
+inline uint64_t get_thread_time_ns()
+{
+    timespec now;
+    if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now)) {
+        return 0;
+    }
+
+    return static_cast<uint64_t>(now.tv_sec) * 1000000000 + now.tv_nsec;
+}
+
+
+//! Maximum number of trace events kept per thread (--trace)
+const size_t TRACE_BUFFER_SIZE = 256 * 1024;
+//! Step ID used to mark time spent waiting for work in traces
+const size_t TRACE_IDLE = static_cast<size_t>(-1);
+
+
+/** Event recorded per call to 'process' (or while idle) when tracing. */
+struct trace_event
+{
+    //! Start of the event (ns)
+    uint64_t start_ns;
+    //! End of the event (ns)
+    uint64_t end_ns;
+    //! ID of the step being executed; TRACE_IDLE if waiting for work
+    size_t step_id;
+    //! ID of the chunk being processed
+    size_t chunk_id;
+    //! Number of reads in the input chunk, or the output chunks if no input
+    size_t reads;
+};
+
+
+/**
+ * Fixed size ring-buffer of trace events. Each buffer is only written by a
+ * single thread, and only read once all threads have been joined, so no
+ * locking is required. Once full, the oldest events are overwritten.
+ */
+class trace_buffer
+{
+public:
+    trace_buffer()
+      : m_events(TRACE_BUFFER_SIZE)
+      , m_added(0)
+    {
+    }
+
+    void add(const trace_event& event)
+    {
+        m_events[m_added++ % m_events.size()] = event;
+    }
+
+    /** Returns the number of events kept in the buffer. */
+    size_t size() const
+    {
+        return std::min(m_added, m_events.size());
+    }
+
+    /** Returns the nth (oldest first) event kept in the buffer. */
+    const trace_event& at(size_t nth) const
+    {
+        const size_t first = m_added > m_events.size() ? m_added : 0;
+
+        return m_events.at((first + nth) % m_events.size());
+    }
+
+private:
+    //! Ring-buffer of events
+    std::vector<trace_event> m_events;
+    //! Total number of events added
+    size_t m_added;
+};
+
+
+/** Per-thread instrumentation used while executing steps. */
+struct thread_state
+{
+    thread_state()
+      : trace(nullptr)
+      , counters()
+    {
+    }
+
+    //! Trace events for the current thread, if tracing is enabled
+    trace_buffer* trace;
+    //! Hardware counters for the current thread, if enabled and available
+    std::unique_ptr<perf_counters> counters;
+
+    //! Copy construction not supported
+    thread_state(const thread_state&) = delete;
+    //! Assignment not supported
+    thread_state& operator=(const thread_state&) = delete;
+};
+
 
 struct data_chunk
 {
     explicit data_chunk(size_t chunk_id_ = 0)
       : chunk_id(chunk_id_)
       , data()
+      , queued_ns(0)
       , counter(new bool())
     {
     }
@@ -78,6 +205,7 @@ struct data_chunk
     explicit data_chunk(const data_chunk& parent, chunk_ptr data_)
       : chunk_id(parent.chunk_id)
       , data(std::move(data_))
+      , queued_ns(0)
       , counter(parent.counter)
     {
     }
@@ -105,6 +233,8 @@ struct data_chunk
     size_t chunk_id;
     //! Use generated data; is normally not freed by this struct
     chunk_ptr data;
+    //! Time at which the chunk was queued; only set when profiling
+    uint64_t queued_ns;
 
 private:
     //! Reference counts
@@ -151,6 +281,19 @@ public:
         return m_chunks.size();
     }
 
+    /** Returns the combined size of data held by queued chunks. */
+    size_t memory_usage() const
+    {
+        size_t size = 0;
+        for (const auto& chunk : m_chunks) {
+            if (chunk.data) {
+                size += chunk.data->memory_usage();
+            }
+        }
+
+        return size;
+    }
+
 private:
     typedef std::vector<data_chunk> chunk_vec;
 
@@ -158,18 +301,86 @@ private:
 };
 
 
+/** Timings collected for a single step when profiling is enabled. */
+struct step_profile
+{
+    step_profile()
+      : chunks(0)
+      , reads(0)
+      , wall_ns(0)
+      , cpu_ns(0)
+      , queued_ns(0)
+      , stalled_ns(0)
+      , max_queue_depth(0)
+      , runnable_ns(0)
+      , counters()
+    {
+    }
+
+    //! Number of chunks processed; protected by the scheduler queue lock
+    size_t chunks;
+    //! Number of reads in chunks processed; protected by the queue lock
+    size_t reads;
+    //! Wall time spent in 'process'; protected by the scheduler queue lock
+    uint64_t wall_ns;
+    //! CPU time spent in 'process'; protected by the scheduler queue lock
+    uint64_t cpu_ns;
+    //! Time chunks spent queued; protected by the step lock
+    uint64_t queued_ns;
+    //! Time chunks spent waiting for preceding chunks (ordered steps only);
+    //! protected by the step lock
+    uint64_t stalled_ns;
+    //! Maximum number of queued chunks; protected by the step lock
+    size_t max_queue_depth;
+    //! Time at which the current chunk became runnable (ordered steps only)
+    uint64_t runnable_ns;
+    //! Hardware counters; protected by the scheduler queue lock
+    perf_values counters;
+};
+
+
 struct scheduler_step
 {
-    scheduler_step(analytical_step* value, const std::string& name_)
+    scheduler_step(analytical_step* value, size_t id_, const std::string& name_)
       : lock()
       , ptr(value)
       , current_chunk(0)
       , last_chunk(0)
       , queue()
+      , id(id_)
       , name(name_)
+      , profile()
     {
     }
 
+    /** Queues a chunk; must be called while holding 'lock'. */
+    void push(data_chunk chunk, bool profiling)
+    {
+        if (profiling) {
+            chunk.queued_ns = get_wall_time_ns();
+        }
+
+        queue.push(std::move(chunk));
+        profile.max_queue_depth = std::max(profile.max_queue_depth, queue.size());
+    }
+
+    /** Takes the next chunk; must be called while holding 'lock'. */
+    data_chunk pop(bool profiling)
+    {
+        data_chunk chunk = queue.pop();
+
+        if (profiling) {
+            const uint64_t now = get_wall_time_ns();
+            profile.queued_ns += now - chunk.queued_ns;
+
+            if (profile.runnable_ns > chunk.queued_ns) {
+                profile.stalled_ns += profile.runnable_ns - chunk.queued_ns;
+            }
+        }
+
+        return chunk;
+    }
+
     bool can_run(size_t next_chunk)
     {
         if (ptr->get_ordering() == analytical_step::ordering::ordered) {
@@ -190,8 +401,12 @@ struct scheduler_step
     size_t last_chunk;
     //! (Ordered) vector of chunks to be processed
     chunk_queue queue;
+    //! ID of the step; corresponds to the index in the pipeline
+    size_t id;
     //! Short name for step used for error reporting
     std::string name;
+    //! Timings collected when profiling is enabled
+    step_profile profile;
 
     //! Copy construction not supported
     scheduler_step(const scheduler_step&) = delete;
@@ -200,7 +415,7 @@ struct scheduler_step
 };
 
 
-scheduler::scheduler()
+scheduler::scheduler(bool profile, bool trace, bool perf)
   : m_steps()
   , m_condition()
   , m_chunk_counter(0)
@@ -210,6 +425,21 @@ scheduler::scheduler()
   , m_queue_io()
   , m_io_active(false)
   , m_errors(false)
+  , m_profile(profile)
+  , m_threads(0)
+  , m_runtime_ns(0)
+  , m_traces()
+  , m_trace(trace)
+  , m_start_ns(0)
+  , m_perf(perf)
+  , m_perf_events(0)
+  , m_status_file()
+  , m_status_socket()
+  , m_status_interval(0)
+  , m_input_bytes(0)
+  , m_status_ns(0)
+  , m_status_reads(0)
+  , m_status_rate(0.0)
 {
 }
 
@@ -229,7 +459,18 @@ void scheduler::add_step(size_t step_id, const std::string& name,
     AR_DEBUG_ASSERT(step);
     AR_DEBUG_ASSERT(!m_steps.at(step_id));
 
-    m_steps.at(step_id) = step_ptr(new scheduler_step(step, name));
+    m_steps.at(step_id) = step_ptr(new scheduler_step(step, step_id, name));
+}
+
+
+void scheduler::enable_status(const std::string& filename,
+                              const std::string& socket,
+                              unsigned interval, uint64_t input_bytes)
+{
+    m_status_file = filename;
+    m_status_socket = socket;
+    m_status_interval = interval;
+    m_input_bytes = input_bytes;
 }
 
 
@@ -240,17 +481,45 @@ bool scheduler::run(int nthreads)
     AR_DEBUG_ASSERT(nthreads >= 1);
     AR_DEBUG_ASSERT(!m_chunk_counter);
 
+    const uint64_t start_ns = m_start_ns = get_wall_time_ns();
+    m_threads = nthreads;
+    alloc_stats_reset();
+
+    m_traces.clear();
+    if (m_trace) {
+        for (int i = 0; i < nthreads; ++i) {
+            m_traces.emplace_back(new trace_buffer());
+        }
+    }
+
     for (size_t task = 3 * static_cast<size_t>(nthreads); task; --task) {
-        m_steps.front()->queue.push(data_chunk(m_chunk_counter++));
+        m_steps.front()->push(data_chunk(m_chunk_counter++), m_profile);
     }
 
     queue_analytical_step(m_steps.front(), 0);
 
+    std::unique_ptr<status_feed> status;
+    if (!m_status_file.empty() || !m_status_socket.empty()) {
+        m_status_ns = start_ns;
+        m_status_reads = 0;
+        m_status_rate = 0.0;
+
+        status.reset(new status_feed(m_status_file, m_status_socket, m_status_interval,
+                                     [this]() { update_status_rate(); },
+                                     [this](std::ostream& output, bool finished) {
+                                         write_status(output, finished);
+                                     }));
+
+        if (!status->start()) {
+            return false;
+        }
+    }
+
     std::vector<std::thread> threads;
 
     try {
-        for (int i = 0; i < nthreads - 1; ++i) {
-            threads.emplace_back(run_wrapper, this);
+        for (int i = 1; i < nthreads; ++i) {
+            threads.emplace_back(run_wrapper, this, i);
         }
     } catch (const std::system_error& error) {
         print_locker lock;
@@ -261,7 +530,7 @@ bool scheduler::run(int nthreads)
     }
 
     // Run the main thread (the only thread in case of non-threaded mode)
-    run_wrapper(this);
+    run_wrapper(this, 0);
 
     for (auto& thread: threads) {
         try {
@@ -272,6 +541,12 @@ bool scheduler::run(int nthreads)
         }
     }
 
+    m_runtime_ns = get_wall_time_ns() - start_ns;
+
+    if (status) {
+        status->stop();
+    }
+
     if (errors_occured()) {
         return false;
     }
@@ -301,14 +576,53 @@ bool scheduler::run(int nthreads)
         }
     }
 
+    if (m_perf && m_perf_events) {
+        write_perf_table(std::cerr);
+    }
+
+    if (ALLOC_STATS_ENABLED) {
+        write_alloc_table(std::cerr);
+    }
+
     return true;
 }
 
 
-void scheduler::run_wrapper(scheduler* sch)
+void scheduler::run_wrapper(scheduler* sch, size_t thread_id)
 {
     try {
-        return sch->do_run();
+        thread_state state;
+        if (sch->m_trace) {
+            state.trace = sch->m_traces.at(thread_id).get();
+        }
+
+        if (sch->m_perf) {
+            state.counters.reset(new perf_counters());
+
+            if (state.counters->is_open()) {
+                unsigned events = 0;
+                for (size_t i = 0; i < static_cast<size_t>(perf_event::max); ++i) {
+                    if (state.counters->is_counted(static_cast<perf_event>(i))) {
+                        events |= 1u << i;
+                    }
+                }
+
+                sch->m_perf_events |= events;
+            } else {
+                // Only warn once; counters are unavailable for all threads
+                if (!thread_id) {
+                    print_locker lock;
+                    std::cerr << "WARNING: Hardware performance counters are unavailable ("
+                              << state.counters->error() << "); this may be due to "
+                              << "the value of /proc/sys/kernel/perf_event_paranoid."
+                              << std::endl;
+                }
+
+                state.counters.reset();
+            }
+        }
+
+        return sch->do_run(state);
     } catch (const thread_abort&) {
         print_locker lock;
         std::cerr << "Aborting thread due to error." << std::endl;
@@ -326,7 +640,7 @@ void scheduler::run_wrapper(scheduler* sch)
 }
 
 
-void scheduler::do_run()
+void scheduler::do_run(thread_state& state)
 {
     std::unique_lock<std::mutex> lock(m_queue_lock);
 
@@ -349,8 +663,12 @@ void scheduler::do_run()
 
         if (current_step) {
             lock.unlock();
-            execute_analytical_step(current_step);
+            execute_analytical_step(current_step, state);
             lock.lock();
+        } else if (state.trace) {
+            const uint64_t start_ns = get_wall_time_ns();
+            m_condition.wait(lock);
+            state.trace->add(trace_event { start_ns, get_wall_time_ns(), TRACE_IDLE, 0, 0 });
         } else {
             m_condition.wait(lock);
         }
@@ -361,19 +679,64 @@ void scheduler::do_run()
 }
 
 
-void scheduler::execute_analytical_step(const step_ptr& step)
+void scheduler::execute_analytical_step(const step_ptr& step, thread_state& state)
 {
     data_chunk chunk;
 
     {
         std::lock_guard<std::mutex> lock(step->lock);
-        chunk = step->queue.pop();
+        chunk = step->pop(m_profile);
+    }
+
+    const bool instrumented = m_profile || state.trace || state.counters || ALLOC_STATS_ENABLED
+                              || !m_status_file.empty() || !m_status_socket.empty();
+    const uint64_t wall_start = instrumented ? get_wall_time_ns() : 0;
+    const uint64_t cpu_start = m_profile ? get_thread_time_ns() : 0;
+    size_t n_reads = (instrumented && chunk.data) ? chunk.data->read_count() : 0;
+
+    perf_values counters_start;
+    if (state.counters) {
+        state.counters->read(counters_start);
     }
 
+    // Allocations are attributed to the step until processing is done
+    const size_t alloc_slot = alloc_stats_set_slot(step->id + 1);
     chunk_vec chunks = step->ptr->process(chunk.data.release());
+    alloc_stats_set_slot(alloc_slot);
+
+    perf_values counters_end;
+    if (state.counters) {
+        state.counters->read(counters_end);
+    }
+
+    if (instrumented && !n_reads) {
+        // Reads are counted in the output of steps that receive no input
+        for (const auto& result: chunks) {
+            n_reads += result.second->read_count();
+        }
+    }
+
+    if (state.trace) {
+        state.trace->add(trace_event { wall_start, get_wall_time_ns(), step->id,
+                                       chunk.chunk_id, n_reads });
+    }
 
     std::lock_guard<std::mutex> lock(m_queue_lock);
 
+    if (instrumented) {
+        step->profile.chunks++;
+        step->profile.reads += n_reads;
+        step->profile.wall_ns += get_wall_time_ns() - wall_start;
+    }
+
+    if (m_profile) {
+        step->profile.cpu_ns += get_thread_time_ns() - cpu_start;
+    }
+
+    if (state.counters) {
+        step->profile.counters += counters_end - counters_start;
+    }
+
     // Schedule each of the resulting blocks
     for (auto& result: chunks) {
         step_ptr& other_step = m_steps.at(result.first);
@@ -388,8 +751,9 @@ void scheduler::execute_analytical_step(const step_ptr& step)
             next_chunk.chunk_id = other_step->last_chunk++;
         }
 
-        other_step->queue.push(std::move(next_chunk));
-        queue_analytical_step(other_step, next_chunk.chunk_id);
+        const size_t next_chunk_id = next_chunk.chunk_id;
+        other_step->push(std::move(next_chunk), m_profile);
+        queue_analytical_step(other_step, next_chunk_id);
     }
 
     // Unlock use of IO steps after finishing processing
@@ -415,7 +779,7 @@ void scheduler::execute_analytical_step(const step_ptr& step)
         step_ptr other_step = m_steps.front();
 
         std::lock_guard<std::mutex> step_lock(other_step->lock);
-        other_step->queue.push(data_chunk(m_chunk_counter));
+        other_step->push(data_chunk(m_chunk_counter), m_profile);
 
         queue_analytical_step(other_step, m_chunk_counter);
 
@@ -431,6 +795,10 @@ void scheduler::execute_analytical_step(const step_ptr& step)
 void scheduler::queue_analytical_step(const step_ptr& step, size_t current)
 {
     if (step->can_run(current)) {
+        if (m_profile && step->ptr->get_ordering() == analytical_step::ordering::ordered) {
+            step->profile.runnable_ns = get_wall_time_ns();
+        }
+
         if (step->ptr->file_io()) {
             m_queue_io.push(step);
         } else {
@@ -442,4 +810,343 @@ void scheduler::queue_analytical_step(const step_ptr& step, size_t current)
     }
 }
 
+
+void scheduler::write_profile(std::ostream& output) const
+{
+    const double ns_per_s = 1e9;
+
+    output << std::fixed << std::setprecision(6)
+           << "{\n"
+           << "  \"profiling\": " << (m_profile ? "true" : "false") << ",\n"
+           << "  \"threads\": " << m_threads << ",\n"
+           << "  \"wall_time\": " << m_runtime_ns / ns_per_s << ",\n"
+           << "  \"steps\": [";
+
+    bool is_first = true;
+    for (const auto& step: m_steps) {
+        if (!step) {
+            continue;
+        }
+
+        const step_profile& profile = step->profile;
+        const bool ordered = step->ptr->get_ordering() == analytical_step::ordering::ordered;
+
+        output << (is_first ? "\n" : ",\n")
+               << "    {\n"
+               << "      \"name\": " << json_encode(step->name) << ",\n"
+               << "      \"ordered\": " << (ordered ? "true" : "false") << ",\n"
+               << "      \"file_io\": " << (step->ptr->file_io() ? "true" : "false") << ",\n"
+               << "      \"chunks\": " << profile.chunks << ",\n"
+               << "      \"reads\": " << profile.reads << ",\n"
+               << "      \"wall_time\": " << profile.wall_ns / ns_per_s << ",\n"
+               << "      \"cpu_time\": " << profile.cpu_ns / ns_per_s << ",\n"
+               << "      \"queued_time\": " << profile.queued_ns / ns_per_s << ",\n"
+               << "      \"stalled_time\": " << profile.stalled_ns / ns_per_s << ",\n"
+               << "      \"max_queue_depth\": " << profile.max_queue_depth;
+
+        if (m_perf) {
+            const char* names[] = { "cycles", "instructions", "cache_misses", "branch_misses" };
+            for (size_t i = 0; i < static_cast<size_t>(perf_event::max); ++i) {
+                output << ",\n      \"" << names[i] << "\": ";
+                if (m_perf_events & (1u << i)) {
+                    output << profile.counters.counts[i];
+                } else {
+                    output << "null";
+                }
+            }
+        }
+
+        if (ALLOC_STATS_ENABLED) {
+            const alloc_values allocs = alloc_stats_get(step->id + 1);
+            output << ",\n      \"allocations\": " << allocs.allocations
+                   << ",\n      \"allocated_bytes\": " << allocs.bytes
+                   << ",\n      \"peak_live_bytes\": " << allocs.peak_live_bytes;
+        }
+
+        output << "\n    }";
+
+        is_first = false;
+    }
+
+    output << "\n  ]\n}\n";
+}
+
+
+void scheduler::update_status_rate()
+{
+    const double ns_per_s = 1e9;
+    const uint64_t now_ns = get_wall_time_ns();
+
+    size_t reads = 0;
+    {
+        std::lock_guard<std::mutex> lock(m_queue_lock);
+        reads = m_steps.front()->profile.reads;
+    }
+
+    const double interval = (now_ns - m_status_ns) / ns_per_s;
+    if (interval > 0) {
+        m_status_rate = (reads - m_status_reads) / interval;
+    }
+
+    m_status_ns = now_ns;
+    m_status_reads = reads;
+}
+
+
+void scheduler::write_status(std::ostream& output, bool finished)
+{
+    const double ns_per_s = 1e9;
+    const uint64_t now_ns = get_wall_time_ns();
+    const uint64_t bytes_read = line_reader::bytes_read();
+
+    size_t reads = 0;
+    {
+        std::lock_guard<std::mutex> lock(m_queue_lock);
+        reads = m_steps.front()->profile.reads;
+    }
+
+    const double elapsed = (now_ns - m_start_ns) / ns_per_s;
+
+    output << std::fixed << std::setprecision(3)
+           << "{\n"
+           << "  \"state\": \"" << (finished ? (errors_occured() ? "failed" : "finished") : "running") << "\",\n"
+           << "  \"elapsed\": " << elapsed << ",\n"
+           << "  \"reads\": " << reads << ",\n"
+           << "  \"reads_per_second\": " << m_status_rate << ",\n"
+           << "  \"average_reads_per_second\": " << (elapsed > 0 ? reads / elapsed : 0.0) << ",\n"
+           << "  \"bytes_read\": " << bytes_read << ",\n"
+           << "  \"bytes_written\": " << managed_writer::bytes_written() << ",\n"
+           << "  \"input_bytes\": " << m_input_bytes << ",\n"
+           << "  \"eta\": ";
+
+    if (finished) {
+        output << 0.0;
+    } else if (bytes_read && m_input_bytes >= bytes_read) {
+        output << elapsed * (m_input_bytes - bytes_read) / bytes_read;
+    } else {
+        output << "null";
+    }
+
+    std::ostringstream steps;
+    size_t total_memory = 0;
+    bool is_first = true;
+    for (const auto& step: m_steps) {
+        if (!step) {
+            continue;
+        }
+
+        size_t queued = 0;
+        size_t memory = 0;
+        {
+            std::lock_guard<std::mutex> lock(step->lock);
+            queued = step->queue.size();
+            memory = step->queue.memory_usage();
+        }
+
+        steps << (is_first ? "\n" : ",\n")
+              << "    {\n"
+              << "      \"name\": " << json_encode(step->name) << ",\n"
+              << "      \"queued_chunks\": " << queued << ",\n"
+              << "      \"queued_bytes\": " << memory << "\n"
+              << "    }";
+
+        total_memory += memory;
+        is_first = false;
+    }
+
+    output << ",\n"
+           << "  \"queued_bytes\": " << total_memory << ",\n"
+           << "  \"steps\": [" << steps.str() << "\n  ]\n}\n";
+}
+
+
+void scheduler::write_perf_table(std::ostream& output) const
+{
+    const std::ios_base::fmtflags flags = output.flags();
+    const std::streamsize precision = output.precision();
+
+    output << "Hardware performance counters per step:\n"
+           << std::left << std::setw(32) << "Step" << std::right
+           << std::setw(12) << "Reads"
+           << std::setw(16) << "Cycles/read"
+           << std::setw(8) << "IPC"
+           << std::setw(16) << "CacheMiss/read"
+           << std::setw(16) << "BranchMiss/read" << "\n";
+
+    for (const auto& step: m_steps) {
+        if (!step) {
+            continue;
+        }
+
+        const perf_values& counters = step->profile.counters;
+        const size_t reads = step->profile.reads;
+        auto has_event = [&](perf_event event) {
+            return (m_perf_events & (1u << static_cast<size_t>(event))) != 0;
+        };
+
+        output << std::left << std::setw(32) << step->name << std::right
+               << std::setw(12) << reads << std::fixed << std::setprecision(2);
+
+        output << std::setw(16);
+        if (reads) {
+            output << static_cast<double>(counters.at(perf_event::cycles)) / reads;
+        } else {
+            output << "NA";
+        }
+
+        output << std::setw(8);
+        if (has_event(perf_event::instructions) && counters.at(perf_event::cycles)) {
+            output << static_cast<double>(counters.at(perf_event::instructions))
+                      / counters.at(perf_event::cycles);
+        } else {
+            output << "NA";
+        }
+
+        for (const auto event : { perf_event::cache_misses, perf_event::branch_misses }) {
+            output << std::setw(16);
+            if (has_event(event) && reads) {
+                output << static_cast<double>(counters.at(event)) / reads;
+            } else {
+                output << "NA";
+            }
+        }
+
+        output << "\n";
+    }
+
+    output.flags(flags);
+    output.precision(precision);
+    output << std::flush;
+}
+
+
+void scheduler::write_alloc_table(std::ostream& output) const
+{
+    const std::ios_base::fmtflags flags = output.flags();
+    const std::streamsize precision = output.precision();
+
+    output << "Allocations per step:\n"
+           << std::left << std::setw(32) << "Step" << std::right
+           << std::setw(12) << "Reads"
+           << std::setw(16) << "Allocs/read"
+           << std::setw(16) << "Bytes/read"
+           << std::setw(16) << "PeakLiveBytes" << "\n";
+
+    for (const auto& step: m_steps) {
+        if (!step) {
+            continue;
+        }
+
+        const alloc_values allocs = alloc_stats_get(step->id + 1);
+        const size_t reads = step->profile.reads;
+
+        output << std::left << std::setw(32) << step->name << std::right
+               << std::setw(12) << reads << std::fixed << std::setprecision(2);
+
+        if (reads) {
+            output << std::setw(16) << static_cast<double>(allocs.allocations) / reads
+                   << std::setw(16) << static_cast<double>(allocs.bytes) / reads;
+        } else {
+            output << std::setw(16) << "NA" << std::setw(16) << "NA";
+        }
+
+        output << std::setw(16) << allocs.peak_live_bytes << "\n";
+    }
+
+    const alloc_values other = alloc_stats_get(0);
+    output << std::left << std::setw(32) << "(outside steps)" << std::right
+           << std::setw(12) << "NA" << std::setw(16) << "NA" << std::setw(16) << "NA"
+           << std::setw(16) << other.peak_live_bytes << "\n";
+
+    output.flags(flags);
+    output.precision(precision);
+    output << std::flush;
+}
+
+
+/**
+ * Opens 'filename' and passes the stream to 'writer'; IO errors are printed
+ * to STDERR, referring to the output as 'what', in which case false is
+ * returned.
+ */
+bool write_to_file(const std::string& filename,
+                   const std::string& what,
+                   const std::function<void(std::ostream&)>& writer)
+{
+    try {
+        std::ofstream output(filename.c_str(), std::ofstream::out);
+
+        if (!output.is_open()) {
+            std::string message = std::string("Failed to open file '") + filename + "': ";
+            throw std::ofstream::failure(message + std::strerror(errno));
+        }
+
+        output.exceptions(std::ofstream::failbit | std::ofstream::badbit);
+        writer(output);
+    } catch (const std::ios_base::failure& error) {
+        std::cerr << "IO error writing " << what << "; aborting:\n"
+                  << cli_formatter::fmt(error.what()) << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+
+bool scheduler::write_profile(const std::string& filename) const
+{
+    return write_to_file(filename, "profile", [this](std::ostream& output) {
+        write_profile(output);
+    });
+}
+
+
+void scheduler::write_trace(std::ostream& output) const
+{
+    output << std::fixed << std::setprecision(3)
+           << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+
+    bool is_first = true;
+    for (size_t thread_id = 0; thread_id < m_traces.size(); ++thread_id) {
+        output << (is_first ? "\n" : ",\n")
+               << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":"
+               << thread_id << ",\"args\":{\"name\":\"worker " << thread_id << "\"}}";
+        is_first = false;
+
+        const trace_buffer& events = *m_traces.at(thread_id);
+        for (size_t nth = 0; nth < events.size(); ++nth) {
+            const trace_event& event = events.at(nth);
+
+            output << ",\n{\"name\":";
+            if (event.step_id == TRACE_IDLE) {
+                output << "\"idle\",\"cat\":\"idle\"";
+            } else {
+                output << json_encode(m_steps.at(event.step_id)->name)
+                       << ",\"cat\":\"step\"";
+            }
+
+            output << ",\"ph\":\"X\",\"pid\":1,\"tid\":" << thread_id
+                   << ",\"ts\":" << (event.start_ns - m_start_ns) / 1000.0
+                   << ",\"dur\":" << (event.end_ns - event.start_ns) / 1000.0;
+
+            if (event.step_id != TRACE_IDLE) {
+                output << ",\"args\":{\"chunk\":" << event.chunk_id
+                       << ",\"reads\":" << event.reads << "}";
+            }
+
+            output << "}";
+        }
+    }
+
+    output << "\n]}\n";
+}
+
+
+bool scheduler::write_trace(const std::string& filename) const
+{
+    return write_to_file(filename, "trace", [this](std::ostream& output) {
+        write_trace(output);
+    });
+}
+
 } // namespace ar
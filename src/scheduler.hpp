@@ -26,6 +26,8 @@
 
 #include <atomic>
 #include <condition_variable>
+#include <cstdint>
+#include <iostream>
 #include <memory>
 #include <mutex>
 #include <queue>
@@ -39,6 +41,8 @@ namespace ar
 
 struct data_chunk;
 struct scheduler_step;
+class trace_buffer;
+struct thread_state;
 
 
 /**
@@ -52,6 +56,12 @@ public:
 
     /** Destructor; does nothing. */
     virtual ~analytical_chunk();
+
+    /** Returns the number of reads in the chunk, if any; used for tracing. */
+    virtual size_t read_count() const;
+
+    /** Returns the approximate size of data held by the chunk in bytes. */
+    virtual size_t memory_usage() const;
 };
 
 
@@ -197,8 +207,15 @@ private:
 class scheduler
 {
 public:
-    /** Constructor. */
-    scheduler();
+    /**
+     * Constructor.
+     *
+     * @param profile If true, per-step timings are collected during runs.
+     * @param trace If true, per-thread timelines are recorded during runs.
+     * @param perf If true, hardware performance counters are collected for
+     *             each step, if available, and summarized following runs.
+     */
+    explicit scheduler(bool profile = false, bool trace = false, bool perf = false);
 
     /** Frees any object passed via 'add_step'. **/
     ~scheduler();
@@ -217,9 +234,81 @@ public:
                   const std::string& name,
                   analytical_step* step);
 
+    /**
+     * Enables a live status feed during runs; see 'write_status'.
+     *
+     * @param filename The status is periodically written to this file (via
+     *                 a temporary file and rename), if not empty.
+     * @param socket The status is sent to clients connecting to a Unix domain
+     *               socket created at this path, if not empty.
+     * @param interval Number of seconds between writes to 'filename'.
+     * @param input_bytes Combined size of input files; used to estimate the
+     *                    remaining run-time. Zero if unknown.
+     */
+    void enable_status(const std::string& filename, const std::string& socket,
+                       unsigned interval, uint64_t input_bytes);
+
     /** Runs the pipeline with n threads; return false on error. */
     bool run(int nthreads);
 
+    /**
+     * Writes a JSON object describing the last run, including the number of
+     * chunks processed by each step, the wall and CPU time spent processing
+     * these, the time chunks spent queued and (for ordered steps) waiting
+     * for preceding chunks, and the maximum number of chunks queued. Timings
+     * are only collected if profiling was enabled in the constructor.
+     */
+    void write_profile(std::ostream& output) const;
+
+    /**
+     * Writes a table of hardware performance counters per step, including
+     * instructions per cycle (IPC) and cache / branch misses per read. This
+     * table is written to STDERR following runs with perf counters enabled.
+     */
+    void write_perf_table(std::ostream& output) const;
+
+    /**
+     * Writes a table of the number of allocations and bytes allocated per
+     * read, and of the peak number of bytes live, for each step. This table
+     * is written to STDERR following runs in builds with ALLOC_STATS=yes.
+     */
+    void write_alloc_table(std::ostream& output) const;
+
+    /** Writes profile to a file (see above); returns false on error. */
+    bool write_profile(const std::string& filename) const;
+
+    /**
+     * Writes a JSON object describing the progress of the current run,
+     * including the number of reads read, the current and average number of
+     * reads processed per second, the number of bytes read and written, the
+     * estimated time remaining, and the number and size of chunks queued for
+     * each step. Used by the status feed (see 'enable_status'), which must
+     * be the only caller while the pipeline is running. The current rate is
+     * that computed by the last call to 'update_status_rate'.
+     */
+    void write_status(std::ostream& output, bool finished);
+
+    /**
+     * Updates the current number of reads processed per second, based on the
+     * reads processed since the previous call. Called by the status feed once
+     * per interval, so that the rate does not depend on how often the status
+     * is requested.
+     */
+    void update_status_rate();
+
+    /**
+     * Writes the events recorded for each thread during the last run in the
+     * Chrome trace-event JSON format, which may be viewed using Perfetto or
+     * chrome://tracing. Each call to 'analytical_step::process' is recorded
+     * with the step name, chunk ID, and read count, as is time spent idle
+     * waiting for work. Only the most recent TRACE_BUFFER_SIZE events are
+     * kept per thread. Events are only recorded if enabled in constructor.
+     */
+    void write_trace(std::ostream& output) const;
+
+    /** Writes trace to a file (see above); returns false on error. */
+    bool write_trace(const std::string& filename) const;
+
     //! Copy construction not supported
     scheduler(const scheduler&) = delete;
     //! Assignment not supported
@@ -229,14 +318,15 @@ private:
     typedef std::shared_ptr<scheduler_step> step_ptr;
     typedef std::queue<step_ptr> runables;
     typedef std::vector<step_ptr> pipeline;
+    typedef std::vector<std::unique_ptr<trace_buffer>> trace_buffers;
 
     /** Wrapper function which calls do_run on the provided thread. */
-    static void run_wrapper(scheduler*);
+    static void run_wrapper(scheduler*, size_t thread_id);
     /** Work function; invoked by each thread. */
-    void do_run();
+    void do_run(thread_state& state);
 
-    /** Executes an analytical step. */
-    void execute_analytical_step(const step_ptr& step);
+    /** Executes an analytical step, recording events / counters if enabled. */
+    void execute_analytical_step(const step_ptr& step, thread_state& state);
     /** Attempts to queue an analytical step given a current chunk. */
     void queue_analytical_step(const step_ptr& step, size_t current);
 
@@ -267,6 +357,39 @@ private:
     bool m_io_active;
     //! Set to indicate if errors have occurred
     std::atomic_bool m_errors;
+
+    //! Indicates if per-step timings are collected
+    const bool m_profile;
+    //! Number of threads used during the last run
+    int m_threads;
+    //! Wall time of the last run in nanoseconds
+    uint64_t m_runtime_ns;
+
+    //! Per-thread trace events; empty unless tracing is enabled
+    trace_buffers m_traces;
+    //! Indicates if per-thread trace events are recorded
+    const bool m_trace;
+    //! Start of the last run in nanoseconds; used to offset trace events
+    uint64_t m_start_ns;
+
+    //! Indicates if hardware performance counters are collected
+    const bool m_perf;
+    //! Bit-mask of perf_events counted by one or more threads
+    std::atomic<unsigned> m_perf_events;
+
+    //! File to which the status is written during runs; disabled if empty
+    std::string m_status_file;
+    //! Unix domain socket on which the status is served; disabled if empty
+    std::string m_status_socket;
+    //! Number of seconds between writes of the status file
+    unsigned m_status_interval;
+    //! Combined size of input files; used to estimate time remaining
+    uint64_t m_input_bytes;
+    //! Time (ns) and number of reads at the last call to 'update_status_rate'
+    uint64_t m_status_ns;
+    size_t m_status_reads;
+    //! Reads processed per second, as of the last call to 'update_status_rate'
+    double m_status_rate;
 };
 
 
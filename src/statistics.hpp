@@ -28,6 +28,7 @@
 #include <cstdlib>
 #include <vector>
 
+#include "alignment.hpp"
 #include "commontypes.hpp"
 #include "vecutils.hpp"
 
@@ -52,7 +53,12 @@ struct statistics
       , keep2(0)
       , discard2(0)
       , records(0)
+      , alignment_cache_hits(0)
+      , alignment_cache_misses(0)
+      , alignments()
       , read_lengths()
+      , insert_sizes()
+      , insert_size_samples(0)
     {
     }
 
@@ -85,6 +91,13 @@ struct statistics
     //! Total number of reads / pairs processed
     size_t records;
 
+    //! Number of alignments retrieved from the alignment cache
+    size_t alignment_cache_hits;
+    //! Number of alignments not found in the alignment cache
+    size_t alignment_cache_misses;
+    //! Counts of work done when aligning reads
+    alignment_counters alignments;
+
     /** Increment the number of reads with of a given type / length. */
     void inc_length_count(read_type type, size_t length) {
         if (length >= read_lengths.size()) {
@@ -97,6 +110,35 @@ struct statistics
     //! Per read-type length distributions of reads
     std::vector<std::vector<size_t> > read_lengths;
 
+    /** Increment the number of well aligned pairs with a given insert size. */
+    void inc_insert_size_count(size_t length) {
+        if (length >= insert_sizes.size()) {
+            insert_sizes.resize(length + 1);
+        }
+
+        ++insert_sizes.at(length);
+        ++insert_size_samples;
+    }
+
+    /** Returns the most common insert size, or -1 if no pairs were sampled. */
+    int insert_size_mode() const {
+        int mode = -1;
+        size_t mode_count = 0;
+        for (size_t length = 0; length < insert_sizes.size(); ++length) {
+            if (insert_sizes.at(length) > mode_count) {
+                mode = static_cast<int>(length);
+                mode_count = insert_sizes.at(length);
+            }
+        }
+
+        return mode;
+    }
+
+    //! Distribution of insert sizes for a sample of well aligned PE reads
+    std::vector<size_t> insert_sizes;
+    //! Number of pairs included in the insert size distribution
+    size_t insert_size_samples;
+
     /** Combine statistics objects, e.g. those used by different threads. */
     statistics& operator+=(const statistics& other) {
         number_of_full_length_collapsed += other.number_of_full_length_collapsed;
@@ -114,8 +156,14 @@ struct statistics
 
         records += other.records;
 
+        alignment_cache_hits += other.alignment_cache_hits;
+        alignment_cache_misses += other.alignment_cache_misses;
+        alignments += other.alignments;
+
         merge_vectors(number_of_reads_with_adapter, other.number_of_reads_with_adapter);
         merge_sub_vectors(read_lengths, other.read_lengths);
+        merge_vectors(insert_sizes, other.insert_sizes);
+        insert_size_samples += other.insert_size_samples;
 
         return *this;
     }
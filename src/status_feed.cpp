@@ -0,0 +1,227 @@
+/*************************************************************************\
+ * AdapterRemoval - cleaning next-generation sequencing reads            *
+ *                                                                       *
+ * Copyright (C) 2015 by Mikkel Schubert - mikkelsch@gmail.com           *
+ *                                                                       *
+ * If you use the program, please cite the paper:                        *
+ * S. Lindgreen (2012): AdapterRemoval: Easy Cleaning of Next Generation *
+ * Sequencing Reads, BMC Research Notes, 5:337                           *
+ * http://www.biomedcentral.com/1756-0500/5/337/                         *
+ *                                                                       *
+ * This program is free software: you can redistribute it and/or modify  *
+ * it under the terms of the GNU General Public License as published by  *
+ * the Free Software Foundation, either version 3 of the License, or     *
+ * (at your option) any later version.                                   *
+ *                                                                       *
+ * This program is distributed in the hope that it will be useful,       *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ * GNU General Public License for more details.                          *
+ *                                                                       *
+ * You should have received a copy of the GNU General Public License     *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+\*************************************************************************/
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <poll.h>
+#include <sstream>
+#include <system_error>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "status_feed.hpp"
+#include "strutils.hpp"
+#include "threads.hpp"
+
+namespace ar
+{
+
+//! Maximum time in milliseconds between checks for clients / termination
+const int STATUS_POLL_MS = 100;
+
+
+status_feed::status_feed(const std::string& filename, const std::string& socket,
+                         unsigned interval, tick_func tick, status_func func)
+  : m_filename(filename)
+  , m_socket_path(socket)
+  , m_interval(interval)
+  , m_tick(tick)
+  , m_func(func)
+  , m_socket(-1)
+  , m_thread()
+  , m_lock()
+  , m_condition()
+  , m_stopped(false)
+  , m_warning_printed(false)
+{
+}
+
+
+status_feed::~status_feed()
+{
+    if (m_thread.joinable() || m_socket != -1) {
+        stop();
+    }
+}
+
+
+bool status_feed::start()
+{
+    if (!m_socket_path.empty()) {
+        sockaddr_un address;
+        std::memset(&address, 0, sizeof(address));
+        address.sun_family = AF_UNIX;
+
+        if (m_socket_path.size() >= sizeof(address.sun_path)) {
+            std::cerr << "ERROR: Path for --status-socket is too long: '"
+                      << m_socket_path << "'" << std::endl;
+            return false;
+        }
+
+        std::strncpy(address.sun_path, m_socket_path.c_str(), sizeof(address.sun_path) - 1);
+
+        // Stale sockets left by previous runs are replaced, but not other files
+        struct stat info;
+        if (!lstat(m_socket_path.c_str(), &info) && S_ISSOCK(info.st_mode)) {
+            unlink(m_socket_path.c_str());
+        }
+
+        m_socket = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (m_socket == -1
+            || bind(m_socket, reinterpret_cast<sockaddr*>(&address), sizeof(address))
+            || listen(m_socket, 16)) {
+            std::cerr << "ERROR: Could not create status socket '" << m_socket_path
+                      << "': " << std::strerror(errno) << std::endl;
+
+            if (m_socket != -1) {
+                close(m_socket);
+                m_socket = -1;
+            }
+
+            return false;
+        }
+    }
+
+    try {
+        m_thread = std::thread(&status_feed::run, this);
+    } catch (const std::system_error& error) {
+        std::cerr << "ERROR: Failed to create status thread:\n"
+                  << cli_formatter::fmt(error.what()) << std::endl;
+
+        return false;
+    }
+
+    return true;
+}
+
+
+void status_feed::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_stopped = true;
+    }
+
+    m_condition.notify_all();
+    if (m_thread.joinable()) {
+        m_thread.join();
+    }
+
+    if (m_socket != -1) {
+        close(m_socket);
+        unlink(m_socket_path.c_str());
+        m_socket = -1;
+    }
+
+    m_tick();
+    write_file(true);
+}
+
+
+void status_feed::run()
+{
+    typedef std::chrono::steady_clock clock;
+
+    clock::time_point next_write = clock::now();
+    while (true) {
+        if (clock::now() >= next_write) {
+            m_tick();
+            write_file(false);
+            next_write = clock::now() + std::chrono::seconds(m_interval);
+        }
+
+        std::unique_lock<std::mutex> lock(m_lock);
+        if (m_socket == -1) {
+            m_condition.wait_until(lock, next_write, [this]() { return m_stopped; });
+        }
+
+        if (m_stopped) {
+            break;
+        }
+
+        lock.unlock();
+        if (m_socket != -1) {
+            serve_clients();
+        }
+    }
+}
+
+
+void status_feed::write_file(bool finished)
+{
+    if (m_filename.empty()) {
+        return;
+    }
+
+    const std::string tmp_filename = m_filename + ".tmp";
+    std::ofstream output(tmp_filename);
+    m_func(output, finished);
+    output.close();
+
+    if (!output || std::rename(tmp_filename.c_str(), m_filename.c_str())) {
+        if (!m_warning_printed) {
+            print_locker lock;
+            std::cerr << "WARNING: Could not write status to '" << m_filename
+                      << "': " << std::strerror(errno) << std::endl;
+            m_warning_printed = true;
+        }
+    }
+}
+
+
+void status_feed::serve_clients()
+{
+    pollfd event = { m_socket, POLLIN, 0 };
+    if (poll(&event, 1, STATUS_POLL_MS) <= 0 || !(event.revents & POLLIN)) {
+        return;
+    }
+
+    const int client = accept(m_socket, nullptr, nullptr);
+    if (client == -1) {
+        return;
+    }
+
+    std::ostringstream stream;
+    m_func(stream, false);
+
+    // Clients that disconnect early are ignored; MSG_NOSIGNAL prevents SIGPIPE
+    const std::string status = stream.str();
+    for (size_t offset = 0; offset < status.size(); ) {
+        const ssize_t nsent = send(client, status.data() + offset,
+                                   status.size() - offset, MSG_NOSIGNAL);
+        if (nsent <= 0) {
+            break;
+        }
+
+        offset += nsent;
+    }
+
+    close(client);
+}
+
+} // namespace ar
@@ -0,0 +1,122 @@
+/*************************************************************************\
+ * AdapterRemoval - cleaning next-generation sequencing reads            *
+ *                                                                       *
+ * Copyright (C) 2015 by Mikkel Schubert - mikkelsch@gmail.com           *
+ *                                                                       *
+ * If you use the program, please cite the paper:                        *
+ * S. Lindgreen (2012): AdapterRemoval: Easy Cleaning of Next Generation *
+ * Sequencing Reads, BMC Research Notes, 5:337                           *
+ * http://www.biomedcentral.com/1756-0500/5/337/                         *
+ *                                                                       *
+ * This program is free software: you can redistribute it and/or modify  *
+ * it under the terms of the GNU General Public License as published by  *
+ * the Free Software Foundation, either version 3 of the License, or     *
+ * (at your option) any later version.                                   *
+ *                                                                       *
+ * This program is distributed in the hope that it will be useful,       *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ * GNU General Public License for more details.                          *
+ *                                                                       *
+ * You should have received a copy of the GNU General Public License     *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+\*************************************************************************/
+#ifndef STATUS_FEED_H
+#define STATUS_FEED_H
+
+#include <condition_variable>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace ar
+{
+
+/**
+ * Periodically publishes a (JSON) status document describing a running
+ * pipeline; see --status and --status-socket.
+ *
+ * The document is generated by a user supplied function on a dedicated
+ * thread, and is written to a file every 'interval' seconds and / or sent to
+ * each client connecting to a Unix domain socket. Files are written to a
+ * temporary file which is then renamed, so that readers never observe a
+ * partially written document. A second user supplied function is called once
+ * per interval (and once when the feed is stopped), before the status file is
+ * written, allowing values such as rates to be updated at a fixed cadence
+ * regardless of how many clients connect to the socket.
+ */
+class status_feed
+{
+public:
+    /** Function writing a status document; 'finished' is set for the last. */
+    typedef std::function<void(std::ostream&, bool finished)> status_func;
+    /** Function called once per interval, before the status file is written. */
+    typedef std::function<void()> tick_func;
+
+    /**
+     * Constructor.
+     *
+     * @param filename File to which the status is written; not set if empty.
+     * @param socket Path of Unix domain socket; not created if empty.
+     * @param interval Minimum number of seconds between writes to 'filename'.
+     * @param tick Function called once per interval and when stopping.
+     * @param func Function used to generate status documents.
+     */
+    status_feed(const std::string& filename, const std::string& socket,
+                unsigned interval, tick_func tick, status_func func);
+
+    /** Stops the feed if still running. */
+    ~status_feed();
+
+    /** Creates socket and starts the feed; returns false on error. */
+    bool start();
+
+    /**
+     * Stops the feed and writes the final status to 'filename'; the socket
+     * is closed and removed.
+     */
+    void stop();
+
+    //! Copy construction not supported
+    status_feed(const status_feed&) = delete;
+    //! Assignment not supported
+    status_feed& operator=(const status_feed&) = delete;
+
+private:
+    /** Work function for the feed thread. */
+    void run();
+    /** Generates and writes the status to 'filename' via a temporary file. */
+    void write_file(bool finished);
+    /** Sends the current status to each client waiting to connect. */
+    void serve_clients();
+
+    //! Destination of status documents; not written if empty
+    const std::string m_filename;
+    //! Path to Unix domain socket; not created if empty
+    const std::string m_socket_path;
+    //! Minimum number of seconds between writes to 'm_filename'
+    const unsigned m_interval;
+    //! Function called once per interval
+    const tick_func m_tick;
+    //! Function used to generate status documents
+    const status_func m_func;
+
+    //! Listening socket; -1 if not open
+    int m_socket;
+    //! Thread generating status documents
+    std::thread m_thread;
+    //! Lock used with 'm_condition' to signal termination
+    std::mutex m_lock;
+    //! Condition used to signal termination of the feed
+    std::condition_variable m_condition;
+    //! Set once the feed should terminate
+    bool m_stopped;
+    //! Indicates if a warning has been printed for failed writes
+    bool m_warning_printed;
+};
+
+} // namespace ar
+
+#endif
@@ -0,0 +1,552 @@
+/*************************************************************************\
+ * AdapterRemoval - cleaning next-generation sequencing reads            *
+ *                                                                       *
+ * Copyright (C) 2015 by Mikkel Schubert - mikkelsch@gmail.com           *
+ *                                                                       *
+ * If you use the program, please cite the paper:                        *
+ * S. Lindgreen (2012): AdapterRemoval: Easy Cleaning of Next Generation *
+ * Sequencing Reads, BMC Research Notes, 5:337                           *
+ * http://www.biomedcentral.com/1756-0500/5/337/                         *
+ *                                                                       *
+ * This program is free software: you can redistribute it and/or modify  *
+ * it under the terms of the GNU General Public License as published by  *
+ * the Free Software Foundation, either version 3 of the License, or     *
+ * (at your option) any later version.                                   *
+ *                                                                       *
+ * This program is distributed in the hope that it will be useful,       *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ * GNU General Public License for more details.                          *
+ *                                                                       *
+ * You should have received a copy of the GNU General Public License     *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+\*************************************************************************/
+#include <condition_variable>
+#include <deque>
+#include <iomanip>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+
+#include "debug.hpp"
+#include "fastq_io.hpp"
+#include "linereader.hpp"
+#include "main.hpp"
+#include "reads_processor.hpp"
+#include "scheduler.hpp"
+#include "streaming_trimmer.hpp"
+#include "threads.hpp"
+#include "userconfig.hpp"
+
+namespace ar
+{
+
+//! Placeholder for input files; userconfig requires input files to be set
+const std::string STREAMING_INPUT = "<streaming input>";
+//! Step receiving trimmed batches; analogous to writing mate 1 reads
+const size_t ai_collect_batches = ai_write_mate_1;
+
+
+/** State shared between a 'streaming_trimmer' and its pipeline. */
+struct streaming_state
+{
+    streaming_state(size_t max_input_)
+      : lock()
+      , input_changed()
+      , output_changed()
+      , input()
+      , output()
+      , max_input(max_input_)
+      , batches_pushed(0)
+      , reads_pushed(0)
+      , batches_trimmed(0)
+      , finished(false)
+      , terminated(false)
+      , failed(false)
+    {
+    }
+
+    //! Lock protecting all members of the state
+    std::mutex lock;
+    //! Signaled when batches are pushed / taken, or on termination
+    std::condition_variable input_changed;
+    //! Signaled when batches have been trimmed, or on termination
+    std::condition_variable output_changed;
+    //! Batches waiting to be trimmed
+    std::deque<read_chunk_ptr> input;
+    //! Trimmed batches, in the order in which they were pushed
+    std::deque<trimmed_batch> output;
+    //! Maximum number of batches in 'input' before 'push' blocks
+    const size_t max_input;
+    //! Number of batches / reads pushed so far
+    size_t batches_pushed;
+    size_t reads_pushed;
+    //! Number of batches trimmed so far
+    size_t batches_trimmed;
+    //! Set once 'finish' has been called
+    bool finished;
+    //! Set once the pipeline has terminated
+    bool terminated;
+    //! Set if an error occurred while trimming reads
+    bool failed;
+};
+
+
+/** Chunk containing the reads trimmed from a single batch. */
+class trimmed_batch_chunk : public analytical_chunk
+{
+public:
+    trimmed_batch_chunk()
+      : batch()
+    {
+    }
+
+    //! Reads trimmed from a single batch
+    trimmed_batch batch;
+};
+
+
+/** Line reader returning lines from a FASTQ text buffer. */
+class buffer_line_reader : public line_reader_base
+{
+public:
+    buffer_line_reader(const std::string& buffer)
+      : m_buffer(buffer)
+      , m_offset(0)
+    {
+    }
+
+    bool getline(std::string& dst)
+    {
+        if (m_offset >= m_buffer.size()) {
+            return false;
+        }
+
+        size_t end = m_buffer.find('\n', m_offset);
+        if (end == std::string::npos) {
+            end = m_buffer.size();
+        }
+
+        dst.assign(m_buffer, m_offset, end - m_offset);
+        if (!dst.empty() && dst.back() == '\r') {
+            dst.pop_back();
+        }
+
+        m_offset = end + 1;
+        return true;
+    }
+
+private:
+    //! Buffer containing FASTQ text
+    const std::string& m_buffer;
+    //! Offset of the next line in the buffer
+    size_t m_offset;
+};
+
+
+/** Parses all FASTQ records in a text buffer. */
+fastq_vec parse_fastq_buffer(const std::string& buffer, const fastq_encoding& encoding)
+{
+    buffer_line_reader reader(buffer);
+
+    fastq_vec reads;
+    fastq record;
+    while (record.read(reader, encoding)) {
+        reads.push_back(std::move(record));
+    }
+
+    return reads;
+}
+
+
+/**
+ * First step of the streaming pipeline; returns batches pushed by the user,
+ * waiting for batches to be pushed if none are available. The pipeline is
+ * terminated once 'finish' has been called and all batches have been taken.
+ */
+class streaming_source : public analytical_step
+{
+public:
+    streaming_source(streaming_state& state, size_t next_step)
+      : analytical_step(analytical_step::ordering::ordered)
+      , m_state(state)
+      , m_next_step(next_step)
+    {
+    }
+
+    chunk_vec process(analytical_chunk* chunk)
+    {
+        AR_DEBUG_ASSERT(chunk == nullptr);
+
+        std::unique_lock<std::mutex> lock(m_state.lock);
+        m_state.input_changed.wait(lock, [this]() {
+            return !m_state.input.empty() || m_state.finished || m_state.failed;
+        });
+
+        chunk_vec chunks;
+        if (!m_state.input.empty() && !m_state.failed) {
+            chunks.push_back(chunk_pair(m_next_step, std::move(m_state.input.front())));
+            m_state.input.pop_front();
+            m_state.input_changed.notify_all();
+        }
+
+        return chunks;
+    }
+
+private:
+    streaming_state& m_state;
+    const size_t m_next_step;
+};
+
+
+/**
+ * Trims a batch using a 'reads_processor', and collects the resulting
+ * records in a single trimmed_batch_chunk.
+ */
+class streaming_processor : public analytical_step
+{
+public:
+    streaming_processor(streaming_state& state, reads_processor* processor)
+      : analytical_step(analytical_step::ordering::unordered)
+      , m_state(state)
+      , m_processor(processor)
+    {
+    }
+
+    chunk_vec process(analytical_chunk* chunk)
+    {
+        std::unique_ptr<trimmed_batch_chunk> output(new trimmed_batch_chunk());
+        trimmed_batch& batch = output->batch;
+
+        try {
+            for (auto& result : m_processor->process(chunk)) {
+                fastq_output_chunk* reads = dynamic_cast<fastq_output_chunk*>(result.second.get());
+                AR_DEBUG_ASSERT(reads);
+
+                switch (result.first) {
+                    case ai_write_mate_1: batch.mate_1.swap(reads->records); break;
+                    case ai_write_mate_2: batch.mate_2.swap(reads->records); break;
+                    case ai_write_singleton: batch.singleton.swap(reads->records); break;
+                    case ai_write_collapsed: batch.collapsed.swap(reads->records); break;
+                    case ai_write_collapsed_truncated: batch.collapsed_truncated.swap(reads->records); break;
+                    case ai_write_discarded: batch.discarded.swap(reads->records); break;
+                    default:
+                        throw thread_error("streaming_processor: unexpected output step");
+                }
+            }
+        } catch (...) {
+            // The source may be waiting for input, and must be woken up
+            std::lock_guard<std::mutex> lock(m_state.lock);
+            m_state.failed = true;
+            m_state.input_changed.notify_all();
+
+            throw;
+        }
+
+        chunk_vec chunks;
+        chunks.push_back(chunk_pair(ai_collect_batches, std::move(output)));
+
+        return chunks;
+    }
+
+    void finalize()
+    {
+        m_processor->finalize();
+    }
+
+private:
+    streaming_state& m_state;
+    std::unique_ptr<reads_processor> m_processor;
+};
+
+
+/** Final step of the streaming pipeline; queues batches for 'pop'. */
+class streaming_sink : public analytical_step
+{
+public:
+    streaming_sink(streaming_state& state)
+      : analytical_step(analytical_step::ordering::ordered)
+      , m_state(state)
+    {
+    }
+
+    chunk_vec process(analytical_chunk* chunk)
+    {
+        std::unique_ptr<trimmed_batch_chunk> output(dynamic_cast<trimmed_batch_chunk*>(chunk));
+
+        std::lock_guard<std::mutex> lock(m_state.lock);
+        output->batch.id = m_state.batches_trimmed++;
+        m_state.output.push_back(std::move(output->batch));
+        m_state.output_changed.notify_all();
+
+        return chunk_vec();
+    }
+
+private:
+    streaming_state& m_state;
+};
+
+
+/** Converts the options to command-line arguments and parses these. */
+bool parse_trimmer_options(const trimmer_options& options, userconfig& config)
+{
+    auto to_str = [](double value) {
+        std::ostringstream stream;
+        stream << std::setprecision(17) << value;
+        return stream.str();
+    };
+
+    string_vec args = { NAME,
+                        "--file1", STREAMING_INPUT,
+                        "--minalignmentlength", std::to_string(options.min_alignment_length),
+                        "--minquality", std::to_string(options.min_quality),
+                        "--minlength", std::to_string(options.min_length),
+                        "--maxns", std::to_string(options.max_ns),
+                        "--threads", std::to_string(options.threads) };
+
+    if (options.paired) {
+        args.insert(args.end(), { "--file2", STREAMING_INPUT });
+    }
+
+    if (!options.adapter1.empty()) {
+        args.insert(args.end(), { "--adapter1", options.adapter1 });
+    }
+
+    if (!options.adapter2.empty()) {
+        args.insert(args.end(), { "--adapter2", options.adapter2 });
+    }
+
+    if (options.mismatch_rate >= 0) {
+        args.insert(args.end(), { "--mm", to_str(options.mismatch_rate) });
+    }
+
+    if (options.collapse) {
+        args.push_back("--collapse");
+    }
+
+    if (options.trim_ns) {
+        args.push_back("--trimns");
+    }
+
+    if (options.trim_qualities) {
+        args.push_back("--trimqualities");
+    }
+
+    args.insert(args.end(), options.extra_args.begin(), options.extra_args.end());
+
+    std::vector<char*> argv;
+    for (const auto& arg : args) {
+        argv.push_back(const_cast<char*>(arg.c_str()));
+    }
+    argv.push_back(nullptr);
+
+    if (config.parse_args(argv.size() - 1, argv.data()) != argparse::parse_result::ok) {
+        return false;
+    } else if (config.run_type != ar_command::trim_adapters || config.detect_adapters) {
+        std::cerr << "Error: Only adapter trimming is supported when streaming reads."
+                  << std::endl;
+        return false;
+    } else if (config.adapters.barcode_count()) {
+        std::cerr << "Error: Demultiplexing is not supported when streaming reads."
+                  << std::endl;
+        return false;
+    } else if (config.paired_ended_mode != options.paired
+               || config.input_files_1.size() != 1
+               || config.input_files_2.size() != (options.paired ? 1 : 0)) {
+        std::cerr << "Error: Input files cannot be specified when streaming reads."
+                  << std::endl;
+        return false;
+    }
+
+    config.input_files_1.clear();
+    config.input_files_2.clear();
+
+    return true;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Implementations for 'trimmer_options'
+
+trimmer_options::trimmer_options()
+  : paired(false)
+  , adapter1()
+  , adapter2()
+  , mismatch_rate(-1.0)
+  , collapse(false)
+  , min_alignment_length(11)
+  , trim_ns(false)
+  , trim_qualities(false)
+  , min_quality(2)
+  , min_length(15)
+  , max_ns(1000)
+  , threads(1)
+  , extra_args()
+{
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Implementations for 'trimmed_batch'
+
+trimmed_batch::trimmed_batch()
+  : id(0)
+  , mate_1()
+  , mate_2()
+  , singleton()
+  , collapsed()
+  , collapsed_truncated()
+  , discarded()
+{
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Implementations for 'streaming_trimmer'
+
+streaming_trimmer::streaming_trimmer(const trimmer_options& options)
+  : m_config(new userconfig(NAME, VERSION, HELPTEXT))
+  , m_state()
+  , m_scheduler(new scheduler())
+  , m_processor(nullptr)
+  , m_thread()
+{
+    if (!parse_trimmer_options(options, *m_config)) {
+        throw std::invalid_argument("invalid options for streaming_trimmer");
+    }
+
+    const unsigned nthreads = m_config->max_threads;
+    m_state.reset(new streaming_state(2 * nthreads));
+
+    const size_t trim_step = m_config->paired_ended_mode ? ai_trim_pe : ai_trim_se;
+    m_processor = create_reads_processor(*m_config, 0, true);
+
+    m_scheduler->add_step(ai_read_fastq, "read_stream",
+                          new streaming_source(*m_state, trim_step));
+    m_scheduler->add_step(trim_step, "trim_stream",
+                          new streaming_processor(*m_state, m_processor));
+    m_scheduler->add_step(ai_collect_batches, "collect_stream",
+                          new streaming_sink(*m_state));
+
+    // One thread may be blocked waiting for input, and an extra thread is
+    // therefore used, to allow trimming to proceed while waiting for input
+    m_thread = std::thread([this, nthreads]() {
+        bool success = false;
+        try {
+            success = m_scheduler->run(nthreads + 1);
+        } catch (const std::exception& error) {
+            print_locker lock;
+            std::cerr << "ERROR: Unhandled exception in streaming_trimmer:\n"
+                      << cli_formatter::fmt(error.what()) << std::endl;
+        }
+
+        std::lock_guard<std::mutex> lock(m_state->lock);
+        m_state->terminated = true;
+        m_state->failed = m_state->failed || !success;
+        m_state->input_changed.notify_all();
+        m_state->output_changed.notify_all();
+    });
+}
+
+
+streaming_trimmer::~streaming_trimmer()
+{
+    if (m_thread.joinable()) {
+        finish();
+        m_thread.join();
+    }
+}
+
+
+size_t streaming_trimmer::push(fastq_vec reads_1, fastq_vec reads_2)
+{
+    if (m_config->paired_ended_mode ? (reads_1.size() != reads_2.size()) : !reads_2.empty()) {
+        throw std::invalid_argument("streaming_trimmer::push: mate 2 reads must "
+                                    "match mate 1 reads for PE reads, and be "
+                                    "empty for SE reads");
+    }
+
+    std::unique_lock<std::mutex> lock(m_state->lock);
+    m_state->input_changed.wait(lock, [this]() {
+        return m_state->input.size() < m_state->max_input || m_state->failed;
+    });
+
+    if (m_state->failed) {
+        throw thread_error("streaming_trimmer::push: error while trimming reads");
+    } else if (m_state->finished) {
+        throw thread_error("streaming_trimmer::push: called after finish");
+    }
+
+    read_chunk_ptr chunk(new fastq_read_chunk(false, m_state->reads_pushed));
+    chunk->reads_1 = std::move(reads_1);
+    chunk->reads_2 = std::move(reads_2);
+
+    m_state->reads_pushed += chunk->reads_1.size();
+    m_state->input.push_back(std::move(chunk));
+    m_state->input_changed.notify_all();
+
+    return m_state->batches_pushed++;
+}
+
+
+size_t streaming_trimmer::push_fastq(const std::string& fastq_1,
+                                     const std::string& fastq_2)
+{
+    const fastq_encoding& encoding = *m_config->quality_input_fmt;
+
+    return push(parse_fastq_buffer(fastq_1, encoding),
+                parse_fastq_buffer(fastq_2, encoding));
+}
+
+
+bool streaming_trimmer::pop(trimmed_batch& batch)
+{
+    std::unique_lock<std::mutex> lock(m_state->lock);
+    m_state->output_changed.wait(lock, [this]() {
+        return !m_state->output.empty() || m_state->terminated;
+    });
+
+    if (!m_state->output.empty()) {
+        batch = std::move(m_state->output.front());
+        m_state->output.pop_front();
+
+        return true;
+    } else if (m_state->failed) {
+        throw thread_error("streaming_trimmer::pop: error while trimming reads");
+    }
+
+    return false;
+}
+
+
+void streaming_trimmer::finish()
+{
+    std::lock_guard<std::mutex> lock(m_state->lock);
+    m_state->finished = true;
+    m_state->input_changed.notify_all();
+}
+
+
+statistics_ptr streaming_trimmer::get_statistics()
+{
+    join();
+
+    return m_processor->get_final_statistics();
+}
+
+
+void streaming_trimmer::join()
+{
+    if (m_thread.joinable()) {
+        finish();
+        m_thread.join();
+    }
+
+    std::lock_guard<std::mutex> lock(m_state->lock);
+    if (m_state->failed) {
+        throw thread_error("streaming_trimmer: error while trimming reads");
+    }
+}
+
+} // namespace ar
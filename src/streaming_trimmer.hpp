@@ -0,0 +1,194 @@
+/*************************************************************************\
+ * AdapterRemoval - cleaning next-generation sequencing reads            *
+ *                                                                       *
+ * Copyright (C) 2015 by Mikkel Schubert - mikkelsch@gmail.com           *
+ *                                                                       *
+ * If you use the program, please cite the paper:                        *
+ * S. Lindgreen (2012): AdapterRemoval: Easy Cleaning of Next Generation *
+ * Sequencing Reads, BMC Research Notes, 5:337                           *
+ * http://www.biomedcentral.com/1756-0500/5/337/                         *
+ *                                                                       *
+ * This program is free software: you can redistribute it and/or modify  *
+ * it under the terms of the GNU General Public License as published by  *
+ * the Free Software Foundation, either version 3 of the License, or     *
+ * (at your option) any later version.                                   *
+ *                                                                       *
+ * This program is distributed in the hope that it will be useful,       *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ * GNU General Public License for more details.                          *
+ *                                                                       *
+ * You should have received a copy of the GNU General Public License     *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+\*************************************************************************/
+#ifndef STREAMING_TRIMMER_H
+#define STREAMING_TRIMMER_H
+
+#include <memory>
+#include <string>
+#include <thread>
+
+#include "commontypes.hpp"
+#include "fastq.hpp"
+#include "statistics.hpp"
+
+namespace ar
+{
+
+class reads_processor;
+class scheduler;
+class userconfig;
+struct streaming_state;
+
+typedef std::unique_ptr<statistics> statistics_ptr;
+
+
+/**
+ * Options for 'streaming_trimmer'; each field corresponds to the command-line
+ * option of the same name, and defaults to the same value.
+ */
+struct trimmer_options
+{
+    /** Constructor; sets default values. */
+    trimmer_options();
+
+    //! If true, pairs of reads are trimmed; corresponds to --file2
+    bool paired;
+    //! Adapter sequences (--adapter1 / --adapter2); defaults used if empty
+    std::string adapter1;
+    std::string adapter2;
+    //! Maximum mismatch rate (--mm); the default rate is used if negative
+    double mismatch_rate;
+    //! Overlapping pairs of reads are merged into one read (--collapse)
+    bool collapse;
+    //! Minimum overlap required to collapse reads (--minalignmentlength)
+    unsigned min_alignment_length;
+    //! Trim ambiguous bases at termini (--trimns)
+    bool trim_ns;
+    //! Trim low quality bases at termini (--trimqualities)
+    bool trim_qualities;
+    //! Highest quality score considered low quality (--minquality)
+    unsigned min_quality;
+    //! Minimum length of reads after trimming (--minlength)
+    unsigned min_length;
+    //! Maximum number of ambiguous bases after trimming (--maxns)
+    unsigned max_ns;
+    //! Number of threads used to trim reads (--threads)
+    unsigned threads;
+    //! Any other command-line options, e.g. { "--trimwindows", "10" }; options
+    //! selecting input files or other commands than trimming are not allowed.
+    string_vec extra_args;
+};
+
+
+/** Reads (pairs) trimmed from a single batch; see 'streaming_trimmer'. */
+struct trimmed_batch
+{
+    /** Constructor; creates empty batch. */
+    trimmed_batch();
+
+    //! ID of the batch, as returned by 'streaming_trimmer::push'
+    size_t id;
+    //! Trimmed mate 1 reads, or SE reads; for interleaved output (see
+    //! --interleaved-output) this also contains the mate 2 reads.
+    fastq_vec mate_1;
+    //! Trimmed mate 2 reads
+    fastq_vec mate_2;
+    //! Reads for which the mate was discarded (PE only)
+    fastq_vec singleton;
+    //! Collapsed reads, and collapsed reads that were subsequently trimmed
+    fastq_vec collapsed;
+    fastq_vec collapsed_truncated;
+    //! Reads that did not pass the filtering criteria
+    fastq_vec discarded;
+};
+
+
+/**
+ * Adapter trimmer for reads held in memory, for use by programs linking
+ * against libadapterremoval. Reads are trimmed using the same pipeline as
+ * used by AdapterRemoval, running on background threads.
+ *
+ * Batches of reads (or of raw FASTQ text) are queued using 'push', which may
+ * be called from any thread, and the trimmed reads are retrieved using 'pop'
+ * in the order in which batches were pushed. Once all reads have been pushed,
+ * 'finish' must be called, after which 'pop' returns false once all batches
+ * have been retrieved. Statistics are available via 'get_statistics'.
+ *
+ * 'push' blocks while too many batches are waiting to be trimmed, while
+ * trimmed batches are kept until retrieved; it is therefore safe to push all
+ * reads before calling 'pop', but memory use is reduced by retrieving trimmed
+ * reads while pushing. Each batch is processed as a unit, and batches should
+ * therefore contain a few thousand reads (see FASTQ_CHUNK_SIZE) to allow
+ * batches to be trimmed in parallel.
+ *
+ * Errors while trimming (e.g. mismatched read names for pairs of reads) are
+ * printed to STDERR, after which 'push', 'pop' and 'get_statistics' throw
+ * 'thread_error'.
+ */
+class streaming_trimmer
+{
+public:
+    /**
+     * Starts the trimming pipeline; throws std::invalid_argument if the
+     * options are invalid, in which case errors are printed to STDERR.
+     */
+    explicit streaming_trimmer(const trimmer_options& options);
+
+    /** Calls 'finish' and waits for remaining reads to be trimmed. */
+    ~streaming_trimmer();
+
+    /**
+     * Queues a batch of reads for trimming and returns the ID of the batch;
+     * 'reads_2' must be empty for SE reads and of the same size as 'reads_1'
+     * for PE reads. Records are expected to use Phred+33 qualities.
+     */
+    size_t push(fastq_vec reads_1, fastq_vec reads_2 = fastq_vec());
+
+    /**
+     * Parses FASTQ records from the text buffer(s) and queues these as a
+     * single batch; qualities are decoded as specified using --qualitybase.
+     * Throws fastq_error if the records are malformed.
+     */
+    size_t push_fastq(const std::string& fastq_1,
+                      const std::string& fastq_2 = std::string());
+
+    /**
+     * Waits for the next batch of trimmed reads; returns false if 'finish'
+     * has been called and all batches have been retrieved.
+     */
+    bool pop(trimmed_batch& batch);
+
+    /** Signals that no further reads will be pushed. */
+    void finish();
+
+    /**
+     * Calls 'finish', waits for all batches to be trimmed, and returns the
+     * combined statistics for all reads; may only be called once.
+     */
+    statistics_ptr get_statistics();
+
+    //! Copy construction not supported
+    streaming_trimmer(const streaming_trimmer&) = delete;
+    //! Assignment not supported
+    streaming_trimmer& operator=(const streaming_trimmer&) = delete;
+
+private:
+    /** Waits for the pipeline to terminate; throws on errors. */
+    void join();
+
+    //! Settings derived from the 'trimmer_options'
+    std::unique_ptr<userconfig> m_config;
+    //! Queues of batches shared with the pipeline
+    std::unique_ptr<streaming_state> m_state;
+    //! Pipeline used to trim batches
+    std::unique_ptr<scheduler> m_scheduler;
+    //! Step trimming reads; owned by 'm_scheduler'
+    reads_processor* m_processor;
+    //! Thread running the pipeline
+    std::thread m_thread;
+};
+
+} // namespace ar
+
+#endif
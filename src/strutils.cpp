@@ -72,6 +72,44 @@ std::string toupper(const std::string& str)
 }
 
 
+std::string json_encode(const std::string& str)
+{
+    std::string encoded;
+    encoded.reserve(str.size() + 2);
+    encoded.push_back('"');
+
+    for (const auto current : str) {
+        switch (current) {
+            case '"':
+                encoded += "\\\"";
+                break;
+            case '\\':
+                encoded += "\\\\";
+                break;
+            case '\n':
+                encoded += "\\n";
+                break;
+            case '\t':
+                encoded += "\\t";
+                break;
+            default:
+                if (static_cast<unsigned char>(current) < 0x20) {
+                    const char* hex = "0123456789abcdef";
+                    encoded += "\\u00";
+                    encoded.push_back(hex[(current >> 4) & 0xf]);
+                    encoded.push_back(hex[current & 0xf]);
+                } else {
+                    encoded.push_back(current);
+                }
+        }
+    }
+
+    encoded.push_back('"');
+
+    return encoded;
+}
+
+
 std::string indent_lines(const std::string& lines, size_t n_indent)
 {
     std::string line;
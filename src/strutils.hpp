@@ -49,6 +49,13 @@ unsigned str_to_unsigned(const std::string& s);
 std::string toupper(const std::string& str);
 
 
+/**
+ * Returns the string as a quoted JSON string literal; quotes, backslashes,
+ * and control characters are escaped.
+ */
+std::string json_encode(const std::string& str);
+
+
 /** Split text by newlines and add fixed indentation following newlines. */
 std::string indent_lines(const std::string& lines, size_t identation = DEFAULT_INDENTATION);
 
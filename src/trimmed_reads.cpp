@@ -38,7 +38,8 @@ inline void add_chunk(chunk_vec& chunks, size_t target, output_chunk_ptr chunk)
 }
 
 
-trimmed_reads::trimmed_reads(const userconfig& config, size_t offset, bool eof)
+trimmed_reads::trimmed_reads(const userconfig& config, size_t offset, bool eof,
+                             bool keep_records)
     : m_config(config)
     , m_encoding(*config.quality_output_fmt)
     , m_offset(offset)
@@ -49,21 +50,21 @@ trimmed_reads::trimmed_reads(const userconfig& config, size_t offset, bool eof)
     , m_collapsed_truncated()
     , m_discarded()
 {
-    m_mate_1.reset(new fastq_output_chunk(eof));
+    m_mate_1.reset(new fastq_output_chunk(eof, keep_records));
     if (config.paired_ended_mode && !config.interleaved_output) {
-        m_mate_2.reset(new fastq_output_chunk(eof));
+        m_mate_2.reset(new fastq_output_chunk(eof, keep_records));
     }
 
     if (!config.combined_output) {
-        m_discarded.reset(new fastq_output_chunk(eof));
+        m_discarded.reset(new fastq_output_chunk(eof, keep_records));
 
         if (config.paired_ended_mode) {
-            m_singleton.reset(new fastq_output_chunk(eof));
+            m_singleton.reset(new fastq_output_chunk(eof, keep_records));
         }
 
         if (config.collapse) {
-            m_collapsed.reset(new fastq_output_chunk(eof));
-            m_collapsed_truncated.reset(new fastq_output_chunk(eof));
+            m_collapsed.reset(new fastq_output_chunk(eof, keep_records));
+            m_collapsed_truncated.reset(new fastq_output_chunk(eof, keep_records));
         }
     }
 }
@@ -63,8 +63,11 @@ public:
      * @param config Global User-config instance; must outlive instance.
      * @param config offset The file-offset for the reads being processed.
      * @param config eof If true, this chunk of reads are at the EOF.
+     * @param keep_records If true, reads are kept as 'fastq' records in the
+     *                     output chunks, instead of being encoded as text.
      */
-    trimmed_reads(const userconfig& config, size_t offset, bool eof);
+    trimmed_reads(const userconfig& config, size_t offset, bool eof,
+                  bool keep_records = false);
 
     /**
      * Encodes and caches the specified mate 1 read.
@@ -40,6 +40,10 @@
 namespace ar
 {
 
+//! Default number of pairs buffered and examined by --detect-adapters
+const unsigned DETECT_ADAPTERS_MAX_READS = 500000;
+
+
 size_t get_seed()
 {
     struct timeval timestamp;
@@ -125,8 +129,19 @@ userconfig::userconfig(const std::string& name,
     , collapse(false)
     , deterministic(false)
     , shift(2)
+    , alignment_cache_size(0)
+    , report_alignment_stats(false)
+    , profile(false)
+    , trace_file()
+    , perf_counters(false)
+    , status_file()
+    , status_socket()
+    , status_interval(5)
     , seed(get_seed())
     , max_threads(1)
+    , max_reads(0)
+    , converge(false)
+    , detect_adapters(false)
     , gzip(false)
     , gzip_level(6)
     , bzip2(false)
@@ -135,6 +150,13 @@ userconfig::userconfig(const std::string& name,
     , barcode_mm_r1(0)
     , barcode_mm_r2(0)
     , adapters()
+    , sim_reads(0)
+    , sim_read_length(100)
+    , sim_insert_mean(150)
+    , sim_insert_sd(50)
+    , sim_duplication_rate(0)
+    , sim_error_rate(0.001)
+    , sim_n_rate(0.0001)
     , argparser(name, version, help)
     , adapter_1("AGATCGGAAGAGCACACGTCTGAACTCCAGTCACNNNNNNATCTCGTATGCCGTCTTCTGCTTG")
     , adapter_2("AGATCGGAAGAGCGTCGTGTAGGGAAAGAGTGTAGATCTCGGTGGTCGCCGTATCATT")
@@ -147,6 +169,7 @@ userconfig::userconfig(const std::string& name,
     , interleaved(false)
     , identify_adapters(false)
     , demultiplex_sequences(false)
+    , sim_paired(false)
     , trim5p()
     , trim3p()
 {
@@ -164,6 +187,23 @@ userconfig::userconfig(const std::string& name,
         new argparse::flag(&identify_adapters,
             "Attempt to identify the adapter pair of PE reads, by searching "
             "for overlapping mate reads [default: %default].");
+    argparser["--detect-adapters"] =
+        new argparse::flag(&detect_adapters,
+            "Infer the adapter pair from the first --max-reads pairs of "
+            "PE reads, as with --identify-adapters, and trim all reads "
+            "using the inferred adapters in the same pass; the buffered "
+            "pairs are kept in memory [default: %default].");
+    argparser["--max-reads"] =
+        new argparse::knob(&max_reads, "N",
+            "When identifying or detecting adapters, stop after examining "
+            "N pairs of reads; if 0, all pairs are examined [default: 0 "
+            "for --identify-adapters, 500000 for --detect-adapters].");
+    argparser["--converge"] =
+        new argparse::flag(&converge,
+            "When identifying or detecting adapters, stop once the "
+            "consensus adapter sequences and qualities are unchanged for 3 "
+            "consecutive checks, performed every 100,000 pairs "
+            "[default: %default].");
     argparser["--threads"] =
         new argparse::knob(&max_threads, "THREADS",
             "Maximum number of threads [default: %default]");
@@ -223,6 +263,41 @@ userconfig::userconfig(const std::string& name,
             "Output file containing information on the parameters used in the "
             "run as well as overall statistics on the reads after trimming "
             "[default: BASENAME.settings]");
+    argparser["--profile"] =
+        new argparse::flag(&profile,
+            "If set, the number of chunks processed by each step of the "
+            "pipeline, the time spent processing and waiting for these, and "
+            "the maximum queue depths are written to BASENAME.profile.json "
+            "[default: %default].");
+    argparser["--trace"] =
+        new argparse::any(&trace_file, "FILE",
+            "If set, the start and end of each step of the pipeline is "
+            "recorded for every thread, as is time spent waiting for work, "
+            "and written to FILE in the Chrome trace-event JSON format, which "
+            "may be viewed using Perfetto [default: not set].");
+    argparser["--perf-counters"] =
+        new argparse::flag(&perf_counters,
+            "If set, hardware performance counters (cycles, instructions, "
+            "cache misses, and branch misses) are collected for each step of "
+            "the pipeline using perf_event_open, and a table of IPC and of "
+            "misses per read is printed for each step; counters are also "
+            "written to the --profile file [default: %default].");
+    argparser["--status"] =
+        new argparse::any(&status_file, "FILE",
+            "If set, a JSON object describing the progress of the run, "
+            "including the number of reads processed, reads processed per "
+            "second, bytes read and written, per-step queue depths, and the "
+            "estimated time remaining, is periodically written to FILE "
+            "[default: not set].");
+    argparser["--status-socket"] =
+        new argparse::any(&status_socket, "PATH",
+            "If set, a Unix domain socket is created at PATH, and the status "
+            "described for --status is sent to each client connecting to "
+            "this socket [default: not set].");
+    argparser["--status-interval"] =
+        new argparse::knob(&status_interval, "SECONDS",
+            "Number of seconds between updates of the --status file "
+            "[default: %default].");
     argparser["--output1"] =
         new argparse::any(nullptr, "FILE",
             "Output file containing trimmed mate1 reads [default: "
@@ -313,6 +388,17 @@ userconfig::userconfig(const std::string& name,
         new argparse::knob(&shift, "N",
             "Consider alignments where up to N nucleotides are missing from "
             "the 5' termini [default: %default].");
+    argparser["--alignment-cache"] =
+        new argparse::knob(&alignment_cache_size, "MB",
+            "Cache alignments of reads / read pairs, using at most this many "
+            "megabytes of memory, so that exact duplicates need only be "
+            "aligned once; this is mainly useful for libraries with high "
+            "levels of duplication. Disabled if set to 0 [default: %default].");
+    argparser["--alignment-stats"] =
+        new argparse::flag(&report_alignment_stats,
+            "If set, the number of alignments evaluated and the number of "
+            "bases compared while aligning reads are written to the "
+            "settings file [default: %default].");
 
     argparser.add_seperator();
     argparser["--trim5p"] =
@@ -389,9 +475,10 @@ userconfig::userconfig(const std::string& name,
     argparser["--seed"] =
         new argparse::knob(&seed, "SEED",
             "Sets the RNG seed used when choosing between bases with equal "
-            "Phred scores when --collapse is enabled. This option is not "
-            "available if more than one thread is used. If not specified, a"
-            "seed is generated using the current time.");
+            "Phred scores when --collapse is enabled. Results are "
+            "reproducible for a given seed, regardless of the number of "
+            "threads used. If not specified, a seed is generated using the "
+            "current time.");
 
     argparser.add_header("DEMULTIPLEXING:");
     argparser["--barcode-list"] =
@@ -419,6 +506,25 @@ userconfig::userconfig(const std::string& name,
         new argparse::flag(&demultiplex_sequences,
             "Only carry out demultiplexing using the list of barcodes "
             "supplied with --barcode-list. No other processing is done.");
+
+    // Simulation of SE / PE reads for benchmarking; reads are written to
+    // --output1 / --output2, using --adapter1 / --adapter2 / --adapter-list,
+    // --barcode-list, --seed, --threads, and --gzip / --bzip2.
+    argparser["--simulate-reads"] =
+        new argparse::knob(&sim_reads, "N", "HIDDEN");
+    argparser["--sim-paired"] = new argparse::flag(&sim_paired, "HIDDEN");
+    argparser["--sim-read-length"] =
+        new argparse::knob(&sim_read_length, "LENGTH", "HIDDEN");
+    argparser["--sim-insert-mean"] =
+        new argparse::floaty_knob(&sim_insert_mean, "LENGTH", "HIDDEN");
+    argparser["--sim-insert-sd"] =
+        new argparse::floaty_knob(&sim_insert_sd, "LENGTH", "HIDDEN");
+    argparser["--sim-duplication-rate"] =
+        new argparse::floaty_knob(&sim_duplication_rate, "RATE", "HIDDEN");
+    argparser["--sim-error-rate"] =
+        new argparse::floaty_knob(&sim_error_rate, "RATE", "HIDDEN");
+    argparser["--sim-n-rate"] =
+        new argparse::floaty_knob(&sim_n_rate, "RATE", "HIDDEN");
 }
 
 
@@ -489,6 +595,19 @@ argparse::parse_result userconfig::parse_args(int argc, char *argv[])
             return argparse::parse_result::error;
         }
 
+        // Reads are not modified beyond the removal of barcodes, so Phred+33
+        // quality scores (the internal encoding) can be written as is, if the
+        // output is also Phred+33. Other encodings are still converted.
+        const std::string input_base = toupper(quality_input_base);
+        const std::string output_base = argparser.is_set("--qualitybase-output")
+                                            ? toupper(quality_output_base)
+                                            : input_base;
+
+        if (input_base == "33" && output_base == "33") {
+            quality_input_fmt.reset(new fastq_encoding_passthrough(quality_max));
+            quality_output_fmt.reset(new fastq_encoding_passthrough(quality_max));
+        }
+
         run_type = ar_command::demultiplex_sequences;
     }
 
@@ -508,7 +627,38 @@ argparse::parse_result userconfig::parse_args(int argc, char *argv[])
     }
 
     // Check for invalid combinations of settings
-    if (input_files_1.empty() && input_files_2.empty()) {
+    if (argparser.is_set("--simulate-reads")) {
+        if (identify_adapters || demultiplex_sequences || detect_adapters) {
+            std::cerr << "Error: --simulate-reads cannot be used together "
+                      << "with --identify-adapters, --detect-adapters, or "
+                      << "--demultiplex-only!" << std::endl;
+
+            return argparse::parse_result::error;
+        } else if (!input_files_1.empty() || !input_files_2.empty()) {
+            std::cerr << "Error: Input files (--file1 / --file2) cannot be "
+                      << "specified when using --simulate-reads!" << std::endl;
+
+            return argparse::parse_result::error;
+        } else if (!sim_reads || !sim_read_length) {
+            std::cerr << "Error: --simulate-reads and --sim-read-length must "
+                      << "be at least 1!" << std::endl;
+
+            return argparse::parse_result::error;
+        } else if (sim_insert_sd < 0
+                   || sim_duplication_rate < 0 || sim_duplication_rate > 1
+                   || sim_error_rate < 0 || sim_error_rate > 1
+                   || sim_n_rate < 0 || sim_n_rate > 1) {
+            std::cerr << "Error: --sim-insert-sd must be >= 0, and the "
+                      << "--sim-duplication-rate, --sim-error-rate, and "
+                      << "--sim-n-rate must be in the range 0 to 1!"
+                      << std::endl;
+
+            return argparse::parse_result::error;
+        }
+
+        paired_ended_mode = sim_paired;
+        run_type = ar_command::simulate_reads;
+    } else if (input_files_1.empty() && input_files_2.empty()) {
         std::cerr << "Error: No input files (--file1 / --file2) specified.\n"
                   << "Please specify at least one input file using --file1 FILENAME."
                   << std::endl;
@@ -541,6 +691,45 @@ argparse::parse_result userconfig::parse_args(int argc, char *argv[])
         paired_ended_mode = true;
     }
 
+    if (!identify_adapters && !detect_adapters
+        && (argparser.is_set("--max-reads") || converge)) {
+        std::cerr << "Error: --max-reads and --converge may only be used "
+                  << "together with --identify-adapters or --detect-adapters!"
+                  << std::endl;
+
+        return argparse::parse_result::error;
+    }
+
+    if (detect_adapters) {
+        if (identify_adapters || demultiplex_sequences) {
+            std::cerr << "Error: --detect-adapters cannot be used together "
+                      << "with --identify-adapters or --demultiplex-only!"
+                      << std::endl;
+
+            return argparse::parse_result::error;
+        } else if (!paired_ended_mode) {
+            std::cerr << "Error: --detect-adapters requires paired-end reads "
+                      << "(--file1 and --file2, or --interleaved)!"
+                      << std::endl;
+
+            return argparse::parse_result::error;
+        } else if (argparser.is_set("--adapter-list")
+                   || argparser.is_set("--barcode-list")) {
+            std::cerr << "Error: --detect-adapters cannot be used together "
+                      << "with --adapter-list or --barcode-list!"
+                      << std::endl;
+
+            return argparse::parse_result::error;
+        } else if (!argparser.is_set("--max-reads")) {
+            max_reads = DETECT_ADAPTERS_MAX_READS;
+        } else if (!max_reads) {
+            std::cerr << "Error: --max-reads must be at least 1 when using "
+                      << "--detect-adapters!" << std::endl;
+
+            return argparse::parse_result::error;
+        }
+    }
+
     if (identify_adapters && !paired_ended_mode) {
         std::cerr << "Error: Both input files (--file1 / --file2) must be "
                   << "specified when using --identify-adapters, or input must "
@@ -587,11 +776,9 @@ argparse::parse_result userconfig::parse_args(int argc, char *argv[])
     if (!max_threads) {
         std::cerr << "Error: --threads must be at least 1!" << std::endl;
         return argparse::parse_result::error;
-    } else if (max_threads > 1 && argparser.is_set("--seed")) {
-        std::cerr << "Warning: The option --seed should not be used when "
-                  << "using multiple threads; multi-threaded behavior is not "
-                  << "deterministic even with a fixed seed!"
-                  << std::endl;
+    } else if (!status_interval) {
+        std::cerr << "Error: --status-interval must be at least 1!" << std::endl;
+        return argparse::parse_result::error;
     }
 
     try {
@@ -631,6 +818,13 @@ statistics_ptr userconfig::create_stats() const
 
 
 bool userconfig::is_good_alignment(const alignment_info& alignment) const
+{
+    return is_good_alignment(alignment, mismatch_threshold);
+}
+
+
+bool userconfig::is_good_alignment(const alignment_info& alignment,
+                                   double max_mismatch_rate) const
 {
     if (!alignment.length || alignment.score <= 0) {
         return false;
@@ -638,20 +832,11 @@ bool userconfig::is_good_alignment(const alignment_info& alignment) const
 
     // Only pairs of called bases are considered part of the alignment
     const size_t n_aligned = static_cast<size_t>(alignment.length - alignment.n_ambiguous);
-    size_t mm_threshold = static_cast<size_t>(mismatch_threshold * n_aligned);
-
     if (n_aligned < min_adapter_overlap) {
         return false;
     }
 
-    if (n_aligned < 6) {
-        mm_threshold = 0;
-    } else if (n_aligned < 10) {
-        // --mm may imply fewer allowed mismatches than 1, so always compare
-        mm_threshold = std::min<size_t>(1, mm_threshold);
-    }
-
-    if (alignment.n_mismatches > mm_threshold) {
+    if (alignment.n_mismatches > max_alignment_mismatches(n_aligned, max_mismatch_rate)) {
         return false;
     }
 
@@ -695,6 +880,30 @@ std::string userconfig::get_output_filename(const std::string& key,
 
     if (key == "demux_stats") {
         return filename += "settings";
+    } else if (key == "--profile") {
+        return filename += "profile.json";
+    } else if (run_type == ar_command::simulate_reads) {
+        if (argparser.is_set(key)) {
+            return argparser.at(key)->to_str();
+        } else if (!paired_ended_mode) {
+            filename += "simulated.fastq";
+        } else if (interleaved_output) {
+            filename += "simulated.paired.fastq";
+        } else if (key == "--output1") {
+            filename += "simulated.pair1.fastq";
+        } else if (key == "--output2") {
+            filename += "simulated.pair2.fastq";
+        } else {
+            throw std::invalid_argument("invalid read-type in userconfig::get_output_filename constructor: " + key);
+        }
+
+        if (gzip) {
+            filename += ".gz";
+        } else if (bzip2) {
+            filename += ".bz2";
+        }
+
+        return filename;
     } else if (key == "demux_unknown") {
         filename += "unidentified";
 
@@ -50,6 +50,7 @@ enum class ar_command
     trim_adapters,
     identify_adapters,
     demultiplex_sequences,
+    simulate_reads,
 };
 
 
@@ -81,6 +82,9 @@ public:
 
     /** Characterize an alignment based on user settings. */
     bool is_good_alignment(const alignment_info& alignment) const;
+    /** Characterize an alignment using a specific mismatch threshold. */
+    bool is_good_alignment(const alignment_info& alignment,
+                           double max_mismatch_rate) const;
 
     /** Returns true if the alignment is sufficient for collapsing. */
     bool is_alignment_collapsible(const alignment_info& alignment) const;
@@ -155,6 +159,22 @@ public:
     bool deterministic;
     // Allow for slipping basepairs by allowing missing bases in adapter
     unsigned shift;
+    //! Size of the alignment cache in megabytes; caching is disabled if 0.
+    unsigned alignment_cache_size;
+    //! If true, counts of work done during alignment are reported.
+    bool report_alignment_stats;
+    //! If true, per-step timings are written to BASENAME.profile.json
+    bool profile;
+    //! If set, a per-thread timeline is written to this file (--trace)
+    std::string trace_file;
+    //! If true, hardware performance counters are collected per step
+    bool perf_counters;
+    //! If set, the progress of the run is periodically written to this file
+    std::string status_file;
+    //! If set, the progress of the run is served on this Unix domain socket
+    std::string status_socket;
+    //! Number of seconds between writes of the status file
+    unsigned status_interval;
 
     //! RNG seed for randomly selecting between to bases with the same quality
     //! when collapsing overllapping PE reads.
@@ -163,6 +183,14 @@ public:
     //! The maximum number of threads used by the program
     unsigned max_threads;
 
+    //! Maximum number of pairs examined when identifying adapters; 0 if all
+    unsigned max_reads;
+    //! If true, stop identifying adapters once the consensus has converged
+    bool converge;
+    //! If true, adapters are inferred from the first --max-reads pairs of
+    //! reads, which are then trimmed using the inferred adapters.
+    bool detect_adapters;
+
     //! GZip compression enabled / disabled
     bool gzip;
     //! GZip compression level used for output reads
@@ -182,6 +210,20 @@ public:
 
     adapter_set adapters;
 
+    //! Number of reads (pairs) to simulate; see --simulate-reads
+    unsigned sim_reads;
+    //! Length of simulated reads
+    unsigned sim_read_length;
+    //! Mean and standard deviation of simulated insert sizes
+    double sim_insert_mean;
+    double sim_insert_sd;
+    //! Fraction of simulated reads (pairs) that duplicate an earlier read
+    double sim_duplication_rate;
+    //! Per-base rate of substitutions in simulated reads
+    double sim_error_rate;
+    //! Per-base rate of ambiguous bases (N) in simulated reads
+    double sim_n_rate;
+
     //! Copy construction not supported
     userconfig(const userconfig&) = delete;
     //! Assignment not supported
@@ -222,6 +264,8 @@ private:
     bool identify_adapters;
     //! Sink for --demultiplex-sequences
     bool demultiplex_sequences;
+    //! Sink for --sim-paired
+    bool sim_paired;
 
     //! Sink for --trim5p
     string_vec trim5p;
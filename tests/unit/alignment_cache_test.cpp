@@ -0,0 +1,118 @@
+/*************************************************************************\
+ * AdapterRemoval - cleaning next-generation sequencing reads            *
+ *                                                                       *
+ * Copyright (C) 2011 by Stinus Lindgreen - stinus@binf.ku.dk            *
+ * Copyright (C) 2014 by Mikkel Schubert - mikkelsch@gmail.com           *
+ *                                                                       *
+ * If you use the program, please cite the paper:                        *
+ * S. Lindgreen (2012): AdapterRemoval: Easy Cleaning of Next Generation *
+ * Sequencing Reads, BMC Research Notes, 5:337                           *
+ * http://www.biomedcentral.com/1756-0500/5/337/                         *
+ *                                                                       *
+ * This program is free software: you can redistribute it and/or modify  *
+ * it under the terms of the GNU General Public License as published by  *
+ * the Free Software Foundation, either version 3 of the License, or     *
+ * (at your option) any later version.                                   *
+ *                                                                       *
+ * This program is distributed in the hope that it will be useful,       *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ * GNU General Public License for more details.                          *
+ *                                                                       *
+ * You should have received a copy of the GNU General Public License     *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+\*************************************************************************/
+#include <string>
+
+#include "testing.hpp"
+#include "alignment.hpp"
+#include "alignment_cache.hpp"
+
+
+namespace ar
+{
+
+alignment_info new_alignment(int offset, int score)
+{
+    alignment_info alignment;
+    alignment.offset = offset;
+    alignment.score = score;
+    alignment.length = score;
+    alignment.adapter_id = 0;
+
+    return alignment;
+}
+
+
+TEST_CASE("Empty cache contains no alignments", "[alignment_cache]")
+{
+    alignment_cache cache(1024 * 1024);
+    alignment_info result;
+
+    REQUIRE(!cache.lookup("ACGTACGT", "", result));
+    REQUIRE(!cache.lookup("", "", result));
+}
+
+
+TEST_CASE("Cached SE alignment is returned", "[alignment_cache]")
+{
+    alignment_cache cache(1024 * 1024);
+    cache.insert("ACGTACGT", "", new_alignment(3, 5));
+
+    alignment_info result;
+    REQUIRE(cache.lookup("ACGTACGT", "", result));
+    REQUIRE(result.offset == 3);
+    REQUIRE(result.score == 5);
+    REQUIRE(result.adapter_id == 0);
+}
+
+
+TEST_CASE("Cached PE alignment requires both sequences", "[alignment_cache]")
+{
+    alignment_cache cache(1024 * 1024);
+    cache.insert("ACGTACGT", "TTTTGGGG", new_alignment(-2, 6));
+
+    alignment_info result;
+    REQUIRE(!cache.lookup("ACGTACGT", "", result));
+    REQUIRE(!cache.lookup("ACGTACGT", "TTTTGGGC", result));
+    REQUIRE(!cache.lookup("TTTTGGGG", "ACGTACGT", result));
+    REQUIRE(cache.lookup("ACGTACGT", "TTTTGGGG", result));
+    REQUIRE(result.offset == -2);
+    REQUIRE(result.score == 6);
+}
+
+
+TEST_CASE("Sequences are not split across keys", "[alignment_cache]")
+{
+    alignment_cache cache(1024 * 1024);
+    cache.insert("ACGT", "ACGT", new_alignment(1, 2));
+
+    alignment_info result;
+    REQUIRE(!cache.lookup("ACGTA", "CGT", result));
+    REQUIRE(!cache.lookup("ACG", "TACGT", result));
+}
+
+
+TEST_CASE("Newer alignments replace older alignments", "[alignment_cache]")
+{
+    alignment_cache cache(1024 * 1024);
+    cache.insert("ACGTACGT", "", new_alignment(3, 5));
+    cache.insert("ACGTACGT", "", new_alignment(4, 4));
+
+    alignment_info result;
+    REQUIRE(cache.lookup("ACGTACGT", "", result));
+    REQUIRE(result.offset == 4);
+    REQUIRE(result.score == 4);
+}
+
+
+TEST_CASE("Alignments exceeding memory limit are not cached", "[alignment_cache]")
+{
+    alignment_cache cache(0);
+    cache.insert("ACGTACGT", "", new_alignment(3, 5));
+
+    alignment_info result;
+    REQUIRE(!cache.lookup("ACGTACGT", "", result));
+}
+
+} // namespace ar
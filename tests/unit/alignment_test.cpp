@@ -23,6 +23,7 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>. *
 \*************************************************************************/
 #include <limits>
+#include <random>
 #include <sstream>
 #include <vector>
 
@@ -136,8 +137,8 @@ fastq_pair_vec create_adapter_vec(const fastq& pcr1, const fastq& pcr2 = fastq()
 
 
 std::random_device g_seed;
-std::mt19937 g_rng_instance(g_seed());
-std::mt19937* g_rng(&g_rng_instance);
+counter_rng g_rng_instance(g_seed(), 0, 0);
+counter_rng* g_rng(&g_rng_instance);
 
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -718,6 +719,117 @@ TEST_CASE("Adapter only sequences, with missing base", "[alignment::paired_end]"
 }
 
 
+std::string random_sequence(std::mt19937& rng, const std::string& alphabet, size_t length)
+{
+    std::string sequence;
+    for (size_t i = 0; i < length; ++i) {
+        sequence.push_back(alphabet.at(rng() % alphabet.size()));
+    }
+
+    return sequence;
+}
+
+
+TEST_CASE("Insert size does not affect alignments", "[alignment::paired_end]")
+{
+    // Low complexity sequences result in many alignments with identical scores
+    const std::string alphabet = "AACCN";
+    std::mt19937 rng(1234);
+
+    for (size_t i = 0; i < 1000; ++i) {
+        fastq_pair_vec adapters;
+        for (size_t j = 1 + rng() % 3; j; --j) {
+            const std::string adapter1 = random_sequence(rng, alphabet, 1 + rng() % 12);
+            const std::string adapter2 = random_sequence(rng, alphabet, 1 + rng() % 12);
+
+            adapters.push_back(fastq_pair(fastq("PCR1", adapter1, std::string(adapter1.length(), '!')),
+                                          fastq("PCR2", adapter2, std::string(adapter2.length(), '!'))));
+        }
+
+        const std::string sequence1 = random_sequence(rng, alphabet, rng() % 30);
+        const std::string sequence2 = random_sequence(rng, alphabet, rng() % 30);
+        const fastq record1("Rec1", sequence1, std::string(sequence1.length(), '!'));
+        const fastq record2("Rec2", sequence2, std::string(sequence2.length(), '!'));
+        const int shift = rng() % 3;
+
+        const alignment_info expected = align_paired_ended_sequences(record1, record2, adapters, shift);
+        for (int insert_size = 0; insert_size < 60; insert_size += 7) {
+            const alignment_info result = align_paired_ended_sequences(record1, record2, adapters, shift, insert_size);
+
+            REQUIRE(result == expected);
+        }
+    }
+}
+
+
+bool is_acceptable_alignment(const alignment_info& alignment, double mismatch_threshold)
+{
+    return alignment.length
+        && alignment.score > 0
+        && alignment.n_mismatches <= max_alignment_mismatches(alignment.length - alignment.n_ambiguous,
+                                                              mismatch_threshold);
+}
+
+
+TEST_CASE("Mismatch threshold does not affect acceptable alignments", "[alignment::paired_end]")
+{
+    const std::string alphabet = "AACGTN";
+    std::mt19937 rng(5678);
+
+    for (size_t i = 0; i < 2000; ++i) {
+        fastq_pair_vec adapters;
+        for (size_t j = 1 + rng() % 3; j; --j) {
+            const std::string adapter1 = random_sequence(rng, alphabet, 1 + rng() % 20);
+            const std::string adapter2 = random_sequence(rng, alphabet, 1 + rng() % 20);
+
+            adapters.push_back(fastq_pair(fastq("PCR1", adapter1, std::string(adapter1.length(), '!')),
+                                          fastq("PCR2", adapter2, std::string(adapter2.length(), '!'))));
+        }
+
+        const std::string sequence1 = random_sequence(rng, alphabet, rng() % 40);
+        const std::string sequence2 = random_sequence(rng, alphabet, rng() % 40);
+        const fastq record1("Rec1", sequence1, std::string(sequence1.length(), '!'));
+        const fastq record2("Rec2", sequence2, std::string(sequence2.length(), '!'));
+        const double mismatch_threshold = (rng() % 5) / 10.0;
+
+        alignment_counters counters;
+        const alignment_info expected_se = align_single_ended_sequence(record1, adapters, 2);
+        const alignment_info result_se = align_single_ended_sequence(record1, adapters, 2, mismatch_threshold, &counters);
+        const alignment_info expected_pe = align_paired_ended_sequences(record1, record2, adapters, 2);
+        const alignment_info result_pe = align_paired_ended_sequences(record1, record2, adapters, 2, -1, mismatch_threshold, &counters);
+
+        if (is_acceptable_alignment(expected_se, mismatch_threshold)) {
+            REQUIRE(result_se == expected_se);
+        } else {
+            REQUIRE(!is_acceptable_alignment(result_se, mismatch_threshold));
+        }
+
+        if (is_acceptable_alignment(expected_pe, mismatch_threshold)) {
+            REQUIRE(result_pe == expected_pe);
+        } else {
+            REQUIRE(!is_acceptable_alignment(result_pe, mismatch_threshold));
+        }
+    }
+}
+
+
+TEST_CASE("Alignment counters", "[alignment::single_end]")
+{
+    // Every offset is abandoned at the first (mismatching) base
+    const fastq record("Rec", "ACGAGCACGACA", "!!!!!!!!!!!!");
+    const fastq_pair_vec adapters = create_adapter_vec(fastq("Rec", "TTTTTTTT", "!!!!!!!!"));
+
+    alignment_counters counters;
+    const alignment_info result = align_single_ended_sequence(record, adapters, 0, 0.0, &counters);
+
+    REQUIRE(result == ALN().adapter_id(-1));
+    REQUIRE(counters.offsets_evaluated == 12);
+    REQUIRE(counters.offsets_abandoned == 12);
+    REQUIRE(counters.offsets_resumed == 0);
+    REQUIRE(counters.bases_compared == 12);
+}
+
+
 ///////////////////////////////////////////////////////////////////////////////
 // 
 
@@ -871,8 +983,7 @@ TEST_CASE("Randomly select between different nucleotides with same quality #1",
     const fastq record1("Rec1", "G", "1");
     const fastq record2("Rec2", "T", "1");
     const alignment_info alignment;
-    std::seed_seq seed{1};
-    std::mt19937 rng(seed);
+    counter_rng rng(2, 0, 0);
 
     const fastq collapsed_expected = fastq("Rec1", "G", "#");
     const fastq collapsed_result = collapse_paired_ended_sequences(alignment, record1, record2, &rng);
@@ -885,8 +996,7 @@ TEST_CASE("Randomly select between different nucleotides with same quality #2",
     const fastq record1("Rec1", "G", "1");
     const fastq record2("Rec2", "T", "1");
     const alignment_info alignment;
-    std::seed_seq seed{2};
-    std::mt19937 rng(seed);
+    counter_rng rng(1, 0, 0);
 
     const fastq collapsed_expected = fastq("Rec1", "T", "#");
     const fastq collapsed_result = collapse_paired_ended_sequences(alignment, record1, record2, &rng);
@@ -899,9 +1009,6 @@ TEST_CASE("Set conflicts to N/! if no RNG is provided", "[alignment::collapse]")
     const fastq record1("Rec1", "G", "1");
     const fastq record2("Rec2", "T", "1");
     const alignment_info alignment;
-    std::seed_seq seed{2};
-    std::mt19937 rng(seed);
-
     const fastq collapsed_expected = fastq("Rec1", "N", "!");
     const fastq collapsed_result = collapse_paired_ended_sequences(alignment, record1, record2, nullptr);
     REQUIRE(collapsed_result == collapsed_expected);
@@ -22,10 +22,14 @@
  * You should have received a copy of the GNU General Public License     *
  * along with this program.  If not, see <http://www.gnu.org/licenses/>. *
 \*************************************************************************/
+#include <algorithm>
 #include <limits>
+#include <random>
+#include <set>
 #include <sstream>
 #include <vector>
 
+#include "barcode_hamming.hpp"
 #include "barcode_table.hpp"
 #include "debug.hpp"
 #include "fastq.hpp"
@@ -652,4 +656,233 @@ TEST_CASE("Mismatch resulting in apparent match", "[barcodes::inexact::se]")
     REQUIRE(table.identify(fastq("A", "ACCTT")) == 1);
 }
 
-} // namespace ar
\ No newline at end of file
+
+///////////////////////////////////////////////////////////////////////////////
+// Equivalence of identification strategies
+
+std::string random_barcode(std::mt19937& rng, size_t length, const std::string& alphabet = "ACGT")
+{
+    std::uniform_int_distribution<size_t> dist(0, alphabet.size() - 1);
+
+    std::string sequence;
+    for (size_t i = 0; i < length; ++i) {
+        sequence.push_back(alphabet.at(dist(rng)));
+    }
+
+    return sequence;
+}
+
+
+/** Introduces up to 'max_mm' random substitutions, including Ns. */
+std::string mutate_barcode(std::mt19937& rng, std::string sequence, size_t max_mm)
+{
+    std::uniform_int_distribution<size_t> n_mm_dist(0, max_mm);
+    std::uniform_int_distribution<size_t> pos_dist(0, sequence.size() - 1);
+
+    for (size_t n_mm = n_mm_dist(rng); n_mm; --n_mm) {
+        sequence.at(pos_dist(rng)) = random_barcode(rng, 1, "ACGTN").front();
+    }
+
+    return sequence;
+}
+
+
+fastq_pair_vec random_barcodes(std::mt19937& rng, size_t count, size_t len_1, size_t len_2)
+{
+    std::set<std::string> observed;
+    fastq_pair_vec barcodes;
+    while (barcodes.size() < count) {
+        const std::string barcode_1 = random_barcode(rng, len_1);
+        const std::string barcode_2 = random_barcode(rng, len_2);
+
+        if (observed.insert(barcode_1 + barcode_2).second) {
+            barcodes.push_back(fastq_pair(fastq("1", barcode_1), fastq("2", barcode_2)));
+        }
+    }
+
+    return barcodes;
+}
+
+
+TEST_CASE("Neighbourhood table matches quad-tree for SE barcodes", "[barcodes::strategies]")
+{
+    std::mt19937 rng(4321);
+
+    for (size_t max_mm = 0; max_mm <= 3; ++max_mm) {
+        const fastq_pair_vec barcodes = random_barcodes(rng, 20, 5, 0);
+
+        const barcode_table trie(barcodes, max_mm, max_mm, 0, barcode_strategy::trie);
+        const barcode_table neighbourhood(barcodes, max_mm, max_mm, 0, barcode_strategy::neighbourhood);
+
+        for (size_t i = 0; i < 2000; ++i) {
+            const auto& barcode = barcodes.at(i % barcodes.size());
+            const fastq read("read", mutate_barcode(rng, barcode.first.sequence(), max_mm + 1) + "ACGT");
+
+            REQUIRE(neighbourhood.identify(read) == trie.identify(read));
+            REQUIRE(neighbourhood.identify(read, fastq()) == trie.identify(read, fastq()));
+        }
+    }
+}
+
+
+TEST_CASE("Neighbourhood table matches quad-tree for PE barcodes", "[barcodes::strategies]")
+{
+    std::mt19937 rng(1234);
+
+    for (size_t max_mm = 0; max_mm <= 3; ++max_mm) {
+        for (size_t max_mm_r1 = 0; max_mm_r1 <= max_mm; ++max_mm_r1) {
+            for (size_t max_mm_r2 = 0; max_mm_r2 <= max_mm; ++max_mm_r2) {
+                const fastq_pair_vec barcodes = random_barcodes(rng, 20, 4, 3);
+
+                const barcode_table trie(barcodes, max_mm, max_mm_r1, max_mm_r2, barcode_strategy::trie);
+                const barcode_table neighbourhood(barcodes, max_mm, max_mm_r1, max_mm_r2, barcode_strategy::neighbourhood);
+
+                for (size_t i = 0; i < 500; ++i) {
+                    const auto& barcode = barcodes.at(i % barcodes.size());
+                    const fastq read_1("read", mutate_barcode(rng, barcode.first.sequence(), max_mm_r1 + 1) + "AC");
+                    const fastq read_2("read", mutate_barcode(rng, barcode.second.sequence(), max_mm_r2 + 1) + "GT");
+
+                    REQUIRE(neighbourhood.identify(read_1, read_2) == trie.identify(read_1, read_2));
+                    REQUIRE(neighbourhood.identify(read_1) == trie.identify(read_1));
+                }
+            }
+        }
+    }
+}
+
+
+/** Identifies barcodes using the engine directly; mate 2 is skipped if empty. */
+int hamming_identify(const barcode_hamming& engine, const fastq& read_1, const fastq& read_2 = fastq())
+{
+    int barcode = barcode_table::no_match;
+    const char* seq_2 = read_2.length() ? read_2.sequence().c_str() : nullptr;
+    REQUIRE(engine.lookup(read_1.sequence().c_str(), seq_2, barcode));
+
+    return barcode;
+}
+
+
+TEST_CASE("Hamming engine matches quad-tree for SE barcodes", "[barcodes::strategies]")
+{
+    std::mt19937 rng(8765);
+
+    for (size_t length : {5, 37}) {
+        for (size_t max_mm = 0; max_mm <= 3; ++max_mm) {
+            const fastq_pair_vec barcodes = random_barcodes(rng, 23, length, 0);
+
+            const barcode_table trie(barcodes, max_mm, max_mm, 0, barcode_strategy::trie);
+            const barcode_table hamming(barcodes, max_mm, max_mm, 0, barcode_strategy::hamming);
+            // Engines with and without AVX2 (if supported by the CPU)
+            const barcode_hamming scalar(barcodes, max_mm, max_mm, 0, false);
+            const barcode_hamming simd(barcodes, max_mm, max_mm, 0, true);
+
+            for (size_t i = 0; i < 2000; ++i) {
+                const auto& barcode = barcodes.at(i % barcodes.size());
+                const fastq read("read", mutate_barcode(rng, barcode.first.sequence(), max_mm + 1) + "ACGT");
+                const int expected = trie.identify(read);
+
+                REQUIRE(hamming.identify(read) == expected);
+                REQUIRE(hamming.identify(read, fastq()) == trie.identify(read, fastq()));
+                REQUIRE(hamming_identify(scalar, read) == expected);
+                REQUIRE(hamming_identify(simd, read) == expected);
+            }
+        }
+    }
+}
+
+
+TEST_CASE("Hamming engine matches quad-tree for PE barcodes", "[barcodes::strategies]")
+{
+    std::mt19937 rng(5678);
+
+    for (size_t length : {4, 33}) {
+        for (size_t max_mm = 0; max_mm <= 3; ++max_mm) {
+            for (size_t max_mm_r1 = 0; max_mm_r1 <= max_mm; ++max_mm_r1) {
+                for (size_t max_mm_r2 = 0; max_mm_r2 <= max_mm; ++max_mm_r2) {
+                    const fastq_pair_vec barcodes = random_barcodes(rng, 21, length, length - 1);
+
+                    const barcode_table trie(barcodes, max_mm, max_mm_r1, max_mm_r2, barcode_strategy::trie);
+                    const barcode_table hamming(barcodes, max_mm, max_mm_r1, max_mm_r2, barcode_strategy::hamming);
+
+                    // Limits as normalized by barcode_table
+                    const size_t mm = std::min(max_mm, max_mm_r1 + max_mm_r2);
+                    const size_t mm_r1 = std::min(mm, max_mm_r1);
+                    const size_t mm_r2 = std::min(mm, max_mm_r2);
+                    const barcode_hamming scalar(barcodes, mm, mm_r1, mm_r2, false);
+                    const barcode_hamming simd(barcodes, mm, mm_r1, mm_r2, true);
+
+                    for (size_t i = 0; i < 200; ++i) {
+                        const auto& barcode = barcodes.at(i % barcodes.size());
+                        const fastq read_1("read", mutate_barcode(rng, barcode.first.sequence(), max_mm_r1 + 1) + "AC");
+                        const fastq read_2("read", mutate_barcode(rng, barcode.second.sequence(), max_mm_r2 + 1) + "GT");
+                        const int expected_pe = trie.identify(read_1, read_2);
+                        const int expected_se = trie.identify(read_1);
+
+                        REQUIRE(hamming.identify(read_1, read_2) == expected_pe);
+                        REQUIRE(hamming.identify(read_1) == expected_se);
+                        REQUIRE(hamming_identify(scalar, read_1, read_2) == expected_pe);
+                        REQUIRE(hamming_identify(simd, read_1, read_2) == expected_pe);
+                        REQUIRE(hamming_identify(scalar, read_1) == expected_se);
+                        REQUIRE(hamming_identify(simd, read_1) == expected_se);
+                    }
+                }
+            }
+        }
+    }
+}
+
+
+
+TEST_CASE("Automatic strategy uses small neighbourhood tables", "[barcodes::strategies]")
+{
+    std::mt19937 rng(1357);
+    const fastq_pair_vec barcodes = random_barcodes(rng, 96, 8, 8);
+
+    REQUIRE(barcode_table(barcodes, 1, 1, 1).strategy() == barcode_strategy::neighbourhood);
+}
+
+
+TEST_CASE("Automatic strategy uses quad-tree for large panels and few mismatches", "[barcodes::strategies]")
+{
+    std::mt19937 rng(1358);
+    // Too long for a neighbourhood table
+    const fastq_pair_vec barcodes = random_barcodes(rng, 1536, 17, 17);
+
+    REQUIRE(barcode_table(barcodes, 0, 0, 0).strategy() == barcode_strategy::trie);
+    REQUIRE(barcode_table(barcodes, 1, 1, 1).strategy() == barcode_strategy::trie);
+    REQUIRE(barcode_table(barcodes, 0, 0, 0, barcode_strategy::hamming).strategy() == barcode_strategy::hamming);
+}
+
+
+TEST_CASE("Automatic strategy uses Hamming engine for small panels and many mismatches", "[barcodes::strategies]")
+{
+    std::mt19937 rng(1359);
+    const fastq_pair_vec barcodes = random_barcodes(rng, 24, 17, 17);
+
+    REQUIRE(barcode_table(barcodes, 3, 3, 3).strategy() == barcode_strategy::hamming);
+    REQUIRE(barcode_table(barcodes, 0, 0, 0).strategy() == barcode_strategy::trie);
+    REQUIRE(barcode_table(barcodes, 3, 3, 3, barcode_strategy::trie).strategy() == barcode_strategy::trie);
+}
+
+
+TEST_CASE("Quad-tree with more than 2^16 nodes", "[barcodes::strategies]")
+{
+    std::mt19937 rng(2468);
+
+    // Large enough that 32-bit child indices are required
+    const fastq_pair_vec barcodes = random_barcodes(rng, 4000, 24, 0);
+
+    const barcode_table trie(barcodes, 1, 1, 0, barcode_strategy::trie);
+    const barcode_table hamming(barcodes, 1, 1, 0, barcode_strategy::hamming);
+
+    for (size_t i = 0; i < barcodes.size(); ++i) {
+        const auto& barcode = barcodes.at(i);
+        const fastq exact("read", barcode.first.sequence() + "ACGT");
+        const fastq read("read", mutate_barcode(rng, barcode.first.sequence(), 2) + "ACGT");
+
+        REQUIRE(trie.identify(exact) == static_cast<int>(i));
+        REQUIRE(hamming.identify(read) == trie.identify(read));
+    }
+}
+
+} // namespace ar
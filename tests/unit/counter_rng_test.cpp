@@ -0,0 +1,106 @@
+/*************************************************************************\
+ * AdapterRemoval - cleaning next-generation sequencing reads            *
+ *                                                                       *
+ * Copyright (C) 2011 by Stinus Lindgreen - stinus@binf.ku.dk            *
+ * Copyright (C) 2014 by Mikkel Schubert - mikkelsch@gmail.com           *
+ *                                                                       *
+ * If you use the program, please cite the paper:                        *
+ * S. Lindgreen (2012): AdapterRemoval: Easy Cleaning of Next Generation *
+ * Sequencing Reads, BMC Research Notes, 5:337                           *
+ * http://www.biomedcentral.com/1756-0500/5/337/                         *
+ *                                                                       *
+ * This program is free software: you can redistribute it and/or modify  *
+ * it under the terms of the GNU General Public License as published by  *
+ * the Free Software Foundation, either version 3 of the License, or     *
+ * (at your option) any later version.                                   *
+ *                                                                       *
+ * This program is distributed in the hope that it will be useful,       *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ * GNU General Public License for more details.                          *
+ *                                                                       *
+ * You should have received a copy of the GNU General Public License     *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+\*************************************************************************/
+#include <set>
+#include <vector>
+
+#include "testing.hpp"
+#include "counter_rng.hpp"
+
+
+namespace ar
+{
+
+///////////////////////////////////////////////////////////////////////////////
+// Known answers
+
+TEST_CASE("Philox4x32-10 known answer for zero key and counter", "[counter_rng]")
+{
+    counter_rng rng(0, 0, 0);
+
+    REQUIRE(rng() == 0x6627e8d5);
+    REQUIRE(rng() == 0xe169c58d);
+    REQUIRE(rng() == 0xbc57ac4c);
+    REQUIRE(rng() == 0x9b00dbd8);
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Reproducibility
+
+TEST_CASE("Values depend only on seed, stream, and index", "[counter_rng]")
+{
+    std::vector<counter_rng::result_type> expected;
+    counter_rng rng_1(1234, 3, 1000000);
+    for (size_t i = 0; i < 10; ++i) {
+        expected.push_back(rng_1());
+    }
+
+    // Unrelated generators do not affect the values returned
+    counter_rng other(1234, 3, 999999);
+    other();
+
+    counter_rng rng_2(1234, 3, 1000000);
+    for (size_t i = 0; i < 10; ++i) {
+        REQUIRE(rng_2() == expected.at(i));
+    }
+}
+
+
+TEST_CASE("Different seeds, streams, and indices give different values", "[counter_rng]")
+{
+    std::set<counter_rng::result_type> values;
+    for (uint32_t seed = 0; seed < 4; ++seed) {
+        for (uint32_t stream = 0; stream < 4; ++stream) {
+            for (uint64_t index = 0; index < 4; ++index) {
+                values.insert(counter_rng(seed, stream, index)());
+            }
+        }
+    }
+
+    REQUIRE(values.size() == 4 * 4 * 4);
+}
+
+
+TEST_CASE("Indices beyond 32 bits are supported", "[counter_rng]")
+{
+    counter_rng rng_1(1, 0, 1);
+    counter_rng rng_2(1, 0, (uint64_t(1) << 32) + 1);
+
+    REQUIRE(rng_1() != rng_2());
+}
+
+
+TEST_CASE("Values are not repeated across blocks", "[counter_rng]")
+{
+    std::set<counter_rng::result_type> values;
+    counter_rng rng(42, 0, 0);
+    for (size_t i = 0; i < 64; ++i) {
+        values.insert(rng());
+    }
+
+    REQUIRE(values.size() == 64);
+}
+
+} // namespace ar
@@ -0,0 +1,242 @@
+/*************************************************************************\
+ * AdapterRemoval - cleaning next-generation sequencing reads            *
+ *                                                                       *
+ * Copyright (C) 2015 by Mikkel Schubert - mikkelsch@gmail.com           *
+ *                                                                       *
+ * If you use the program, please cite the paper:                        *
+ * S. Lindgreen (2012): AdapterRemoval: Easy Cleaning of Next Generation *
+ * Sequencing Reads, BMC Research Notes, 5:337                           *
+ * http://www.biomedcentral.com/1756-0500/5/337/                         *
+ *                                                                       *
+ * This program is free software: you can redistribute it and/or modify  *
+ * it under the terms of the GNU General Public License as published by  *
+ * the Free Software Foundation, either version 3 of the License, or     *
+ * (at your option) any later version.                                   *
+ *                                                                       *
+ * This program is distributed in the hope that it will be useful,       *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ * GNU General Public License for more details.                          *
+ *                                                                       *
+ * You should have received a copy of the GNU General Public License     *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+\*************************************************************************/
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include "testing.hpp"
+#include "demultiplex.hpp"
+#include "main.hpp"
+#include "userconfig.hpp"
+
+
+namespace ar
+{
+
+//! Number of samples used in the tests below
+const size_t N_SAMPLES = 3;
+//! Approximate size of each read, as counted by demultiplex_reads
+const size_t READ_SIZE = 100;
+
+
+/** User settings for SE demultiplexing with N_SAMPLES barcodes. */
+class demux_config
+{
+public:
+    demux_config()
+      : m_filename("/tmp/ar_barcodes_XXXXXX")
+      , m_config(NAME, VERSION, HELPTEXT)
+    {
+        const int handle = mkstemp(&m_filename[0]);
+        REQUIRE(handle != -1);
+        close(handle);
+
+        std::ofstream output(m_filename.c_str());
+        output << "sample_1\tACGTACGT\n"
+               << "sample_2\tCCGGTTAA\n"
+               << "sample_3\tGGAATTCC\n";
+        output.close();
+
+        const std::vector<const char*> args = { "AdapterRemoval",
+                                                "--file1", "input_1.fastq",
+                                                "--barcode-list", m_filename.c_str(),
+                                                "--demultiplex-only" };
+
+        REQUIRE(m_config.parse_args(args.size(), const_cast<char**>(args.data()))
+                == argparse::parse_result::ok);
+    }
+
+    ~demux_config()
+    {
+        std::remove(m_filename.c_str());
+    }
+
+    const userconfig* get() const
+    {
+        return &m_config;
+    }
+
+    demux_config(const demux_config&) = delete;
+    demux_config& operator=(const demux_config&) = delete;
+
+private:
+    std::string m_filename;
+    userconfig m_config;
+};
+
+
+/** Returns a read whose size (as counted by demultiplex_reads) is READ_SIZE. */
+fastq make_read(size_t nth)
+{
+    const std::string header = "read_" + std::to_string(100000 + nth);
+    const size_t length = (READ_SIZE - header.size()) / 2;
+
+    return fastq(header, std::string(length, 'A'), std::string(length, 'I'));
+}
+
+
+/** Input chunk containing reads identified as coming from the given samples. */
+read_chunk_ptr make_chunk(const std::vector<int>& barcodes, size_t& nth_read,
+                          bool eof = false)
+{
+    read_chunk_ptr chunk(new fastq_read_chunk(eof, nth_read));
+    for (const auto barcode : barcodes) {
+        chunk->reads_1.push_back(make_read(nth_read++));
+        chunk->barcodes.push_back(barcode);
+    }
+
+    return chunk;
+}
+
+
+/** Returns the sample (0-based) to which the output chunk is forwarded. */
+size_t get_sample(const chunk_pair& pair)
+{
+    REQUIRE(pair.first % ai_analyses_offset == 0);
+    REQUIRE(pair.first >= ai_analyses_offset);
+
+    return pair.first / ai_analyses_offset - 1;
+}
+
+
+/** Returns the samples of flushed caches, in the order they were flushed. */
+std::vector<size_t> get_flushed_samples(const chunk_vec& chunks)
+{
+    std::vector<size_t> samples;
+    for (const auto& pair : chunks) {
+        if (pair.first != ai_write_unidentified_1) {
+            samples.push_back(get_sample(pair));
+        }
+    }
+
+    return samples;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Flushing of caches
+
+TEST_CASE("Sparse samples are flushed after DEMUX_CACHE_MAX_AGE chunks", "[demultiplex]")
+{
+    const demux_config config;
+    demultiplex_se_reads demultiplexer(config.get());
+
+    size_t nth_read = 0;
+    // Sample 1 is seen in the first chunk only; sample 2 in every chunk
+    chunk_vec chunks = demultiplexer.process(make_chunk({ 0, 1 }, nth_read).release());
+    REQUIRE(get_flushed_samples(chunks).empty());
+
+    for (size_t i = 1; i < DEMUX_CACHE_MAX_AGE; ++i) {
+        chunks = demultiplexer.process(make_chunk({ 1 }, nth_read).release());
+        REQUIRE(get_flushed_samples(chunks).empty());
+    }
+
+    // Both caches were created in the first chunk, and are therefore flushed
+    chunks = demultiplexer.process(make_chunk({ 1 }, nth_read).release());
+    REQUIRE(get_flushed_samples(chunks) == std::vector<size_t>({ 0, 1 }));
+
+    const fastq_read_chunk& sample_1 = dynamic_cast<const fastq_read_chunk&>(*chunks.at(0).second);
+    REQUIRE(sample_1.reads_1.size() == 1);
+    REQUIRE(sample_1.reads_1.front() == make_read(0));
+    REQUIRE(!sample_1.eof);
+
+    // The age of a cache counts from the first read added to it
+    chunks = demultiplexer.process(make_chunk({ 0 }, nth_read).release());
+    REQUIRE(get_flushed_samples(chunks).empty());
+}
+
+
+TEST_CASE("Largest caches are flushed first when over max size", "[demultiplex]")
+{
+    const demux_config config;
+    demultiplex_se_reads demultiplexer(config.get(), DEMUX_CACHE_MAX_AGE, 4 * READ_SIZE);
+
+    size_t nth_read = 0;
+    chunk_vec chunks = demultiplexer.process(make_chunk({ 0, 2, 2, 1 }, nth_read).release());
+    REQUIRE(get_flushed_samples(chunks).empty());
+
+    // 9 reads in total; sample 3 (4 reads) is flushed first, then sample 2 (3
+    // reads), at which point 2 reads (sample 1) remain in the cache
+    chunks = demultiplexer.process(make_chunk({ 0, 1, 1, 2, 2 }, nth_read).release());
+    REQUIRE(get_flushed_samples(chunks) == std::vector<size_t>({ 2, 1 }));
+    REQUIRE(chunks.at(0).second->read_count() == 4);
+    REQUIRE(chunks.at(1).second->read_count() == 3);
+
+    // Remaining reads are flushed at EOF
+    chunks = demultiplexer.process(make_chunk({}, nth_read, true).release());
+    REQUIRE(get_flushed_samples(chunks) == std::vector<size_t>({ 0, 1, 2 }));
+    REQUIRE(chunks.at(1).second->read_count() == 2);
+    REQUIRE(chunks.at(2).second->read_count() == 0);
+    REQUIRE(chunks.at(3).second->read_count() == 0);
+}
+
+
+TEST_CASE("Flushing caches does not change the order of reads", "[demultiplex]")
+{
+    const demux_config config;
+    demultiplex_se_reads demultiplexer(config.get(), 4, 20 * READ_SIZE);
+
+    std::mt19937 rng(1234);
+    std::uniform_int_distribution<int> barcode_dist(-1, N_SAMPLES - 1);
+    std::uniform_int_distribution<size_t> size_dist(0, 16);
+
+    size_t nth_read = 0;
+    std::vector<fastq_vec> expected(N_SAMPLES);
+    std::vector<fastq_vec> observed(N_SAMPLES);
+    for (size_t i = 0; i <= 200; ++i) {
+        std::vector<int> barcodes;
+        for (size_t j = size_dist(rng); j; --j) {
+            barcodes.push_back(barcode_dist(rng));
+            if (barcodes.back() >= 0) {
+                expected.at(barcodes.back()).push_back(make_read(nth_read + barcodes.size() - 1));
+            }
+        }
+
+        const chunk_vec chunks = demultiplexer.process(make_chunk(barcodes, nth_read, i == 200).release());
+        for (const auto& pair : chunks) {
+            if (pair.first == ai_write_unidentified_1) {
+                const fastq_output_chunk& chunk = dynamic_cast<const fastq_output_chunk&>(*pair.second);
+                REQUIRE(chunk.eof == (i == 200));
+            } else {
+                const fastq_read_chunk& chunk = dynamic_cast<const fastq_read_chunk&>(*pair.second);
+                fastq_vec& dst = observed.at(get_sample(pair));
+                REQUIRE(chunk.eof == (i == 200));
+                // Read indices count from the start of each sample
+                REQUIRE(chunk.first_read == dst.size());
+
+                dst.insert(dst.end(), chunk.reads_1.begin(), chunk.reads_1.end());
+            }
+        }
+    }
+
+    REQUIRE(observed == expected);
+}
+
+} // namespace ar
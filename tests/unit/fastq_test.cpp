@@ -190,6 +190,16 @@ TEST_CASE("constructor_score_boundries_ignored", "[fastq::fastq]")
 }
 
 
+TEST_CASE("constructor_score_boundries_passthrough", "[fastq::fastq]")
+{
+    const fastq_encoding_passthrough encoding;
+    REQUIRE_NOTHROW(fastq("Rec", "CAT", "!!\"", encoding));
+    REQUIRE_THROWS_AS(fastq("Rec", "CAT", " !\"", encoding), fastq_error);
+    REQUIRE_NOTHROW(fastq("Rec", "CAT", "IJJ", encoding));
+    REQUIRE_THROWS_AS(fastq("Rec", "CAT", "IJK", encoding), fastq_error);
+}
+
+
 TEST_CASE("constructor_field_lengths", "[fastq::fastq]")
 {
     REQUIRE_NOTHROW(fastq("Name", "CAT", "IJJ"));
@@ -998,6 +1008,15 @@ TEST_CASE("Writing_to_stream_phred_64_explicit", "[fastq::fastq]")
     REQUIRE(record.to_str(FASTQ_ENCODING_64) == "@record_1\nACGTACGATA\n+\n@CBCIUWbfi\n");
 }
 
+TEST_CASE("Writing_to_stream_passthrough", "[fastq::fastq]")
+{
+    const fastq_encoding_passthrough encoding;
+    const fastq record = fastq("record_1", "ACGTACGATA", "!$#$*68CGJ", encoding);
+    REQUIRE(record.qualities() == "!$#$*68CGJ");
+    REQUIRE(record.to_str(encoding) == "@record_1\nACGTACGATA\n+\n!$#$*68CGJ\n");
+    REQUIRE(record.to_str(FASTQ_ENCODING_64) == "@record_1\nACGTACGATA\n+\n@CBCIUWbfi\n");
+}
+
 
 ///////////////////////////////////////////////////////////////////////////////
 // Validating pairs
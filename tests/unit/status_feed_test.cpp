@@ -0,0 +1,225 @@
+/*************************************************************************\
+ * AdapterRemoval - cleaning next-generation sequencing reads            *
+ *                                                                       *
+ * Copyright (C) 2015 by Mikkel Schubert - mikkelsch@gmail.com           *
+ *                                                                       *
+ * If you use the program, please cite the paper:                        *
+ * S. Lindgreen (2012): AdapterRemoval: Easy Cleaning of Next Generation *
+ * Sequencing Reads, BMC Research Notes, 5:337                           *
+ * http://www.biomedcentral.com/1756-0500/5/337/                         *
+ *                                                                       *
+ * This program is free software: you can redistribute it and/or modify  *
+ * it under the terms of the GNU General Public License as published by  *
+ * the Free Software Foundation, either version 3 of the License, or     *
+ * (at your option) any later version.                                   *
+ *                                                                       *
+ * This program is distributed in the hope that it will be useful,       *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ * GNU General Public License for more details.                          *
+ *                                                                       *
+ * You should have received a copy of the GNU General Public License     *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+\*************************************************************************/
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "testing.hpp"
+#include "status_feed.hpp"
+
+
+namespace ar
+{
+
+/** Temporary directory for status files / sockets; removed on exit. */
+class status_dir
+{
+public:
+    status_dir()
+      : m_path("/tmp/ar_status_XXXXXX")
+    {
+        REQUIRE(mkdtemp(&m_path[0]));
+    }
+
+    ~status_dir()
+    {
+        std::remove(path("status.json").c_str());
+        std::remove(path("status.json.tmp").c_str());
+        std::remove(path("status.sock").c_str());
+        rmdir(m_path.c_str());
+    }
+
+    std::string path(const std::string& filename) const
+    {
+        return m_path + "/" + filename;
+    }
+
+    status_dir(const status_dir&) = delete;
+    status_dir& operator=(const status_dir&) = delete;
+
+private:
+    std::string m_path;
+};
+
+
+std::string read_status_file(const std::string& filename)
+{
+    std::ifstream input(filename.c_str());
+    std::ostringstream stream;
+    stream << input.rdbuf();
+
+    return stream.str();
+}
+
+
+/** Connects to a status socket and returns the document sent. */
+std::string read_status_socket(const std::string& filename)
+{
+    sockaddr_un address;
+    std::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    std::strncpy(address.sun_path, filename.c_str(), sizeof(address.sun_path) - 1);
+
+    const int client = socket(AF_UNIX, SOCK_STREAM, 0);
+    REQUIRE(client != -1);
+    REQUIRE(!connect(client, reinterpret_cast<sockaddr*>(&address), sizeof(address)));
+
+    std::string result;
+    char buffer[256];
+    ssize_t nread = 0;
+    while ((nread = read(client, buffer, sizeof(buffer))) > 0) {
+        result.append(buffer, nread);
+    }
+
+    close(client);
+
+    return result;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Status file
+
+TEST_CASE("Final status is written to file", "[status_feed]")
+{
+    status_dir dir;
+    const std::string filename = dir.path("status.json");
+
+    status_feed feed(filename, "", 60, []() {},
+                     [](std::ostream& output, bool finished) {
+                         output << (finished ? "finished" : "running") << "\n";
+                     });
+
+    REQUIRE(feed.start());
+    feed.stop();
+
+    REQUIRE(read_status_file(filename) == "finished\n");
+}
+
+
+TEST_CASE("Status file is written via renamed temporary file", "[status_feed]")
+{
+    status_dir dir;
+    const std::string filename = dir.path("status.json");
+    const std::string tmp_filename = filename + ".tmp";
+
+    // Records the state of files while a document is being written; checked
+    // on this thread, since REQUIRE may not be used on the feed thread
+    std::vector<bool> tmp_exists;
+    std::vector<std::string> contents;
+
+    status_feed feed(filename, "", 60, []() {},
+                     [&](std::ostream& output, bool finished) {
+                         tmp_exists.push_back(!access(tmp_filename.c_str(), F_OK));
+                         contents.push_back(read_status_file(filename));
+
+                         output << (finished ? "finished" : "running") << "\n";
+                     });
+
+    REQUIRE(feed.start());
+    feed.stop();
+
+    // The first document is written as soon as the feed starts
+    REQUIRE(tmp_exists == std::vector<bool>({ true, true }));
+    REQUIRE(contents == std::vector<std::string>({ "", "running\n" }));
+    REQUIRE(read_status_file(filename) == "finished\n");
+    REQUIRE(access(tmp_filename.c_str(), F_OK));
+}
+
+
+TEST_CASE("Status file is written once per interval", "[status_feed]")
+{
+    status_dir dir;
+    const std::string filename = dir.path("status.json");
+
+    std::atomic<size_t> writes(0);
+    status_feed feed(filename, "", 1, []() {},
+                     [&](std::ostream& output, bool) { output << ++writes; });
+
+    REQUIRE(feed.start());
+    while (writes < 2) {
+        usleep(10000);
+    }
+    feed.stop();
+
+    REQUIRE(read_status_file(filename) == std::to_string(writes.load()));
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Periodic tick
+
+TEST_CASE("Tick precedes each status file write", "[status_feed]")
+{
+    status_dir dir;
+
+    std::atomic<size_t> ticks(0);
+    std::vector<size_t> ticks_per_write;
+    status_feed feed(dir.path("status.json"), "", 1, [&]() { ++ticks; },
+                     [&](std::ostream&, bool) { ticks_per_write.push_back(ticks); });
+
+    REQUIRE(feed.start());
+    while (ticks < 2) {
+        usleep(10000);
+    }
+    feed.stop();
+
+    REQUIRE(ticks_per_write.size() == ticks);
+    for (size_t i = 0; i < ticks_per_write.size(); ++i) {
+        REQUIRE(ticks_per_write.at(i) == i + 1);
+    }
+}
+
+
+TEST_CASE("Socket clients do not trigger ticks", "[status_feed]")
+{
+    status_dir dir;
+    const std::string socket = dir.path("status.sock");
+
+    std::atomic<size_t> ticks(0);
+    std::atomic<size_t> writes(0);
+    status_feed feed("", socket, 60, [&]() { ++ticks; },
+                     [&](std::ostream& output, bool) { output << "status " << ++writes; });
+
+    REQUIRE(feed.start());
+    REQUIRE(read_status_socket(socket) == "status 1");
+    REQUIRE(read_status_socket(socket) == "status 2");
+    REQUIRE(read_status_socket(socket) == "status 3");
+    feed.stop();
+
+    // One tick when the feed starts and one when it is stopped
+    REQUIRE(ticks == 2);
+    REQUIRE(access(socket.c_str(), F_OK));
+}
+
+} // namespace ar
@@ -0,0 +1,462 @@
+/*************************************************************************\
+ * AdapterRemoval - cleaning next-generation sequencing reads            *
+ *                                                                       *
+ * Copyright (C) 2015 by Mikkel Schubert - mikkelsch@gmail.com           *
+ *                                                                       *
+ * If you use the program, please cite the paper:                        *
+ * S. Lindgreen (2012): AdapterRemoval: Easy Cleaning of Next Generation *
+ * Sequencing Reads, BMC Research Notes, 5:337                           *
+ * http://www.biomedcentral.com/1756-0500/5/337/                         *
+ *                                                                       *
+ * This program is free software: you can redistribute it and/or modify  *
+ * it under the terms of the GNU General Public License as published by  *
+ * the Free Software Foundation, either version 3 of the License, or     *
+ * (at your option) any later version.                                   *
+ *                                                                       *
+ * This program is distributed in the hope that it will be useful,       *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ * GNU General Public License for more details.                          *
+ *                                                                       *
+ * You should have received a copy of the GNU General Public License     *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+\*************************************************************************/
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <dirent.h>
+#include <unistd.h>
+
+#include "testing.hpp"
+#include "fastq_io.hpp"
+#include "main.hpp"
+#include "streaming_trimmer.hpp"
+#include "threads.hpp"
+#include "userconfig.hpp"
+
+
+namespace ar
+{
+
+// See main_adapter_rm.cpp
+int remove_adapter_sequences(userconfig& config);
+
+
+//! Default adapter sequences, with the barcode (NNNNNN) filled in
+const std::string ADAPTER_1 = "AGATCGGAAGAGCACACGTCTGAACTCCAGTCACCGATGTATCTCGTATGCCGTCTTCTGCTTG";
+const std::string ADAPTER_2 = "AGATCGGAAGAGCGTCGTGTAGGGAAAGAGTGTAGATCTCGGTGGTCGCCGTATCATT";
+
+
+/** Temporary directory; the directory and its contents are removed on exit. */
+class temp_dir
+{
+public:
+    temp_dir()
+      : m_path("/tmp/ar_streaming_XXXXXX")
+    {
+        REQUIRE(mkdtemp(&m_path[0]));
+    }
+
+    ~temp_dir()
+    {
+        if (DIR* dir = opendir(m_path.c_str())) {
+            while (struct dirent* entry = readdir(dir)) {
+                const std::string name = entry->d_name;
+                if (name != "." && name != "..") {
+                    std::remove(path(name).c_str());
+                }
+            }
+
+            closedir(dir);
+        }
+
+        rmdir(m_path.c_str());
+    }
+
+    std::string path(const std::string& name) const
+    {
+        return m_path + "/" + name;
+    }
+
+    temp_dir(const temp_dir&) = delete;
+    temp_dir& operator=(const temp_dir&) = delete;
+
+private:
+    std::string m_path;
+};
+
+
+/** Returns the contents of a file, or an empty string if it does not exist. */
+std::string read_file(const std::string& filename)
+{
+    std::ifstream stream(filename.c_str());
+    std::ostringstream contents;
+    contents << stream.rdbuf();
+
+    return contents.str();
+}
+
+
+/** Returns the records formatted as Phred+33 encoded FASTQ text. */
+std::string to_fastq(const fastq_vec& reads)
+{
+    std::string result;
+    for (const auto& read : reads) {
+        result += read.to_str();
+    }
+
+    return result;
+}
+
+
+std::vector<std::string> get_headers(const fastq_vec& reads)
+{
+    std::vector<std::string> headers;
+    for (const auto& read : reads) {
+        headers.push_back(read.header());
+    }
+
+    return headers;
+}
+
+
+/**
+ * Simulates read pairs for inserts of 30 to 150 bp, with adapters and
+ * errors in mate 2 reads; qualities are drawn from a small set of values, to
+ * produce ties between mismatching bases when collapsing.
+ */
+void simulate_pairs(size_t count, fastq_vec& reads_1, fastq_vec& reads_2)
+{
+    const size_t read_length = 100;
+    const std::string nucleotides = "ACGT";
+    const std::string qualities = "#+5?I";
+
+    std::mt19937 rng(1234);
+    auto random_string = [&rng](const std::string& chars, size_t length) {
+        std::string result;
+        for (size_t i = 0; i < length; ++i) {
+            result.push_back(chars.at(rng() % chars.size()));
+        }
+
+        return result;
+    };
+
+    for (size_t i = 0; i < count; ++i) {
+        const std::string name = "read_" + std::to_string(i);
+        const std::string insert = random_string(nucleotides, 30 + rng() % 121);
+
+        fastq insert_rc("insert", insert);
+        insert_rc.reverse_complement();
+
+        std::string sequence_1 = (insert + ADAPTER_1 + random_string(nucleotides, read_length));
+        std::string sequence_2 = (insert_rc.sequence() + ADAPTER_2 + random_string(nucleotides, read_length));
+        sequence_1.resize(read_length);
+        sequence_2.resize(read_length);
+
+        for (auto& nt : sequence_2) {
+            if (rng() % 20 == 0) {
+                nt = nucleotides.at(rng() % nucleotides.size());
+            }
+        }
+
+        reads_1.push_back(fastq(name + "/1", sequence_1, random_string(qualities, read_length)));
+        reads_2.push_back(fastq(name + "/2", sequence_2, random_string(qualities, read_length)));
+    }
+}
+
+
+/** Simulates SE reads without adapters, named after the batch they belong to. */
+fastq_vec simulate_batch(size_t batch, size_t count, const std::string& suffix = "")
+{
+    fastq_vec reads;
+    for (size_t i = 0; i < count; ++i) {
+        const std::string name = "batch_" + std::to_string(batch) + "_read_" + std::to_string(i);
+
+        reads.push_back(fastq(name + suffix, std::string(50, 'T')));
+    }
+
+    return reads;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Ordering of batches
+
+TEST_CASE("SE batches are popped in push order", "[streaming_trimmer]")
+{
+    trimmer_options options;
+    options.threads = 4;
+
+    streaming_trimmer trimmer(options);
+
+    std::vector<std::string> expected;
+    for (size_t batch = 0; batch < 20; ++batch) {
+        const fastq_vec reads = simulate_batch(batch, 1 + batch * 10);
+        for (const auto& header : get_headers(reads)) {
+            expected.push_back(header);
+        }
+
+        REQUIRE(trimmer.push(reads) == batch);
+    }
+
+    trimmer.finish();
+
+    size_t next_id = 0;
+    std::vector<std::string> observed;
+    trimmed_batch batch;
+    while (trimmer.pop(batch)) {
+        REQUIRE(batch.id == next_id++);
+        REQUIRE(batch.mate_2.empty());
+        for (const auto& header : get_headers(batch.mate_1)) {
+            observed.push_back(header);
+        }
+    }
+
+    REQUIRE(next_id == 20);
+    REQUIRE(observed == expected);
+    REQUIRE(trimmer.get_statistics()->records == expected.size());
+}
+
+
+TEST_CASE("PE batches are popped in push order", "[streaming_trimmer]")
+{
+    trimmer_options options;
+    options.paired = true;
+    options.threads = 4;
+
+    streaming_trimmer trimmer(options);
+
+    std::vector<std::string> expected_1;
+    std::vector<std::string> expected_2;
+    size_t next_id = 0;
+    trimmed_batch batch;
+    std::vector<std::string> observed_1;
+    std::vector<std::string> observed_2;
+
+    for (size_t batch_id = 0; batch_id < 20; ++batch_id) {
+        const fastq_vec reads_1 = simulate_batch(batch_id, 50, "/1");
+        const fastq_vec reads_2 = simulate_batch(batch_id, 50, "/2");
+        for (const auto& header : get_headers(reads_1)) {
+            expected_1.push_back(header);
+        }
+        for (const auto& header : get_headers(reads_2)) {
+            expected_2.push_back(header);
+        }
+
+        REQUIRE(trimmer.push(reads_1, reads_2) == batch_id);
+
+        // Interleave pushing and popping
+        if (batch_id % 5 == 4) {
+            REQUIRE(trimmer.pop(batch));
+            REQUIRE(batch.id == next_id++);
+            for (const auto& header : get_headers(batch.mate_1)) {
+                observed_1.push_back(header);
+            }
+            for (const auto& header : get_headers(batch.mate_2)) {
+                observed_2.push_back(header);
+            }
+        }
+    }
+
+    trimmer.finish();
+    while (trimmer.pop(batch)) {
+        REQUIRE(batch.id == next_id++);
+        for (const auto& header : get_headers(batch.mate_1)) {
+            observed_1.push_back(header);
+        }
+        for (const auto& header : get_headers(batch.mate_2)) {
+            observed_2.push_back(header);
+        }
+    }
+
+    REQUIRE(next_id == 20);
+    REQUIRE(observed_1 == expected_1);
+    REQUIRE(observed_2 == expected_2);
+}
+
+
+TEST_CASE("PE batches must contain the same number of reads", "[streaming_trimmer]")
+{
+    trimmer_options options;
+    options.paired = true;
+
+    streaming_trimmer trimmer(options);
+    REQUIRE_THROWS_AS(trimmer.push(simulate_batch(0, 2), simulate_batch(0, 1)), std::invalid_argument);
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Parsing of FASTQ text
+
+TEST_CASE("push_fastq parses FASTQ records", "[streaming_trimmer]")
+{
+    trimmer_options options;
+    options.min_length = 1;
+    options.extra_args = { "--qualitybase", "64" };
+
+    streaming_trimmer trimmer(options);
+    REQUIRE(trimmer.push_fastq("@read_1 meta\nTTTTT\n+\nhhhhh\n"
+                               "@read_2\nTTTT\n+read_2\n@@ZZ\n") == 0);
+    trimmer.finish();
+
+    trimmed_batch batch;
+    REQUIRE(trimmer.pop(batch));
+    REQUIRE(batch.mate_1 == fastq_vec({ fastq("read_1 meta", "TTTTT", "IIIII"),
+                                        fastq("read_2", "TTTT", "!!;;") }));
+    REQUIRE(!trimmer.pop(batch));
+}
+
+
+TEST_CASE("push_fastq parses PE FASTQ records", "[streaming_trimmer]")
+{
+    trimmer_options options;
+    options.paired = true;
+    options.min_length = 1;
+
+    streaming_trimmer trimmer(options);
+    REQUIRE(trimmer.push_fastq("@read/1\nTTTTT\n+\nIIIII\n",
+                               "@read/2\nTTTT\n+\n5555\n") == 0);
+    trimmer.finish();
+
+    trimmed_batch batch;
+    REQUIRE(trimmer.pop(batch));
+    REQUIRE(batch.mate_1 == fastq_vec({ fastq("read/1", "TTTTT", "IIIII") }));
+    REQUIRE(batch.mate_2 == fastq_vec({ fastq("read/2", "TTTT", "5555") }));
+    REQUIRE(!trimmer.pop(batch));
+}
+
+
+TEST_CASE("push_fastq throws on malformed records", "[streaming_trimmer]")
+{
+    trimmer_options options;
+
+    streaming_trimmer trimmer(options);
+    REQUIRE_THROWS_AS(trimmer.push_fastq("@read_1\nTTTTT\n+\nIII\n"), fastq_error);
+    REQUIRE_THROWS_AS(trimmer.push_fastq("read_1\nTTTTT\n+\nIIIII\n"), fastq_error);
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Error handling
+
+TEST_CASE("Errors while trimming are raised by pop and push", "[streaming_trimmer]")
+{
+    trimmer_options options;
+    options.paired = true;
+
+    streaming_trimmer trimmer(options);
+    REQUIRE(trimmer.push({ fastq("read_1/1", "TTTTTTTTTTTTTTTTTTTT") },
+                         { fastq("read_2/2", "TTTTTTTTTTTTTTTTTTTT") }) == 0);
+
+    trimmed_batch batch;
+    REQUIRE_THROWS_AS(trimmer.pop(batch), thread_error);
+    REQUIRE_THROWS_AS(trimmer.push(simulate_batch(1, 1, "/1"), simulate_batch(1, 1, "/2")), thread_error);
+    REQUIRE_THROWS_AS(trimmer.get_statistics(), thread_error);
+}
+
+
+TEST_CASE("Errors while trimming are raised without finish", "[streaming_trimmer]")
+{
+    trimmer_options options;
+    options.paired = true;
+    options.threads = 2;
+
+    streaming_trimmer trimmer(options);
+    trimmer.push(simulate_batch(0, 10, "/1"), simulate_batch(0, 10, "/2"));
+    trimmer.push(simulate_batch(1, 10, "/1"), simulate_batch(2, 10, "/2"));
+
+    // Batches trimmed before the error may or may not be returned
+    auto pop_all = [&trimmer]() {
+        trimmed_batch batch;
+        while (trimmer.pop(batch)) {
+        }
+    };
+
+    REQUIRE_THROWS_AS(pop_all(), thread_error);
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Consistency with the command-line interface
+
+TEST_CASE("Output matches AdapterRemoval for a fixed seed", "[streaming_trimmer]")
+{
+    fastq_vec reads_1;
+    fastq_vec reads_2;
+    // Several input chunks, to check that read indices match for --collapse
+    simulate_pairs(3 * FASTQ_CHUNK_SIZE + 100, reads_1, reads_2);
+
+    temp_dir dir;
+    {
+        std::ofstream file_1(dir.path("input_1.fastq").c_str());
+        std::ofstream file_2(dir.path("input_2.fastq").c_str());
+        file_1 << to_fastq(reads_1);
+        file_2 << to_fastq(reads_2);
+    }
+
+    const std::string input_1 = dir.path("input_1.fastq");
+    const std::string input_2 = dir.path("input_2.fastq");
+    const std::string basename = dir.path("cli");
+    const std::vector<const char*> args = { "AdapterRemoval",
+                                            "--file1", input_1.c_str(),
+                                            "--file2", input_2.c_str(),
+                                            "--basename", basename.c_str(),
+                                            "--collapse", "--trimns",
+                                            "--trimqualities", "--seed", "1",
+                                            "--threads", "2" };
+
+    userconfig config(NAME, VERSION, HELPTEXT);
+    REQUIRE(config.parse_args(args.size(), const_cast<char**>(args.data())) == argparse::parse_result::ok);
+    REQUIRE(remove_adapter_sequences(config) == 0);
+
+    trimmer_options options;
+    options.paired = true;
+    options.collapse = true;
+    options.trim_ns = true;
+    options.trim_qualities = true;
+    options.threads = 3;
+    options.extra_args = { "--seed", "1" };
+
+    // Batches deliberately do not match the chunks read by AdapterRemoval
+    streaming_trimmer trimmer(options);
+    const size_t batch_size = 1000;
+    for (size_t offset = 0; offset < reads_1.size(); offset += batch_size) {
+        const size_t end = std::min(offset + batch_size, reads_1.size());
+
+        trimmer.push(fastq_vec(reads_1.begin() + offset, reads_1.begin() + end),
+                     fastq_vec(reads_2.begin() + offset, reads_2.begin() + end));
+    }
+    trimmer.finish();
+
+    trimmed_batch merged;
+    trimmed_batch batch;
+    while (trimmer.pop(batch)) {
+        for (auto& reads : { std::make_pair(&merged.mate_1, &batch.mate_1),
+                             std::make_pair(&merged.mate_2, &batch.mate_2),
+                             std::make_pair(&merged.singleton, &batch.singleton),
+                             std::make_pair(&merged.collapsed, &batch.collapsed),
+                             std::make_pair(&merged.collapsed_truncated, &batch.collapsed_truncated),
+                             std::make_pair(&merged.discarded, &batch.discarded) }) {
+            reads.first->insert(reads.first->end(), reads.second->begin(), reads.second->end());
+        }
+    }
+
+    // Sanity check that the relevant code-paths were exercised
+    REQUIRE(!merged.collapsed.empty());
+    REQUIRE(!merged.collapsed_truncated.empty());
+
+    REQUIRE(to_fastq(merged.mate_1) == read_file(basename + ".pair1.truncated"));
+    REQUIRE(to_fastq(merged.mate_2) == read_file(basename + ".pair2.truncated"));
+    REQUIRE(to_fastq(merged.singleton) == read_file(basename + ".singleton.truncated"));
+    REQUIRE(to_fastq(merged.collapsed) == read_file(basename + ".collapsed"));
+    REQUIRE(to_fastq(merged.collapsed_truncated) == read_file(basename + ".collapsed.truncated"));
+    REQUIRE(to_fastq(merged.discarded) == read_file(basename + ".discarded"));
+}
+
+} // namespace ar
@@ -41,6 +41,19 @@ TEST_CASE("ASCII letters are uppercased", "[strutils::toupper]")
 }
 
 
+///////////////////////////////////////////////////////////////////////////////
+// Tests for 'json_encode'
+
+TEST_CASE("Strings are quoted and escaped for JSON", "[strutils::json_encode]")
+{
+    REQUIRE(json_encode("") == "\"\"");
+    REQUIRE(json_encode("trim_pe_sample") == "\"trim_pe_sample\"");
+    REQUIRE(json_encode("a\"b\\c") == "\"a\\\"b\\\\c\"");
+    REQUIRE(json_encode("a\nb\tc") == "\"a\\nb\\tc\"");
+    REQUIRE(json_encode(std::string("\x01\x1f", 2)) == "\"\\u0001\\u001f\"");
+}
+
+
 ///////////////////////////////////////////////////////////////////////////////
 // Tests for 'indent_lines'
 